@@ -0,0 +1,208 @@
+/**
+ * (C) roentgen 
+ * this code is licensed under the MIT License.
+ */
+#include "archive.hpp"
+#include "footprint.hpp"
+#include "mipgen.hpp"
+#include <stdio.h>
+#include <string.h>
+#include <algorithm>
+#include <memory>
+
+uint64_t rawa_name_hash(const char* name)
+{
+    uint64_t h = 0xcbf29ce484222325ULL;
+    for (const uint8_t* p = reinterpret_cast< const uint8_t* >(name); *p; p ++) {
+        h ^= *p;
+        h *= 0x100000001b3ULL;
+    }
+    return h;
+}
+
+uint64_t rawa_name_hash(const std::wstring& name)
+{
+    return rawa_name_hash(narrow_path(name).c_str());
+}
+
+std::wstring rawa_key_from_path(const std::wstring& path)
+{
+    size_t b = path.find_last_of(L"\\/");
+    b = (b == std::wstring::npos) ? 0 : b + 1;
+    size_t e = path.rfind(L'.');
+    if (e == std::wstring::npos || e < b)
+        e = path.size();
+    return path.substr(b, e - b);
+}
+
+/* 並びは footprint_layout() そのもの. bpp は header の値 (RGBA8 は format からは分からない) */
+static footprint_desc_t level_desc(uint32_t width, uint32_t height, uint32_t format, uint32_t bpp, uint32_t mips)
+{
+    footprint_desc_t d = footprint_tex2d(format, width, height, mips);
+    d.block_bytes = bpp;
+    return d;
+}
+
+rawa_level_t rawa_level(uint32_t width, uint32_t height, uint32_t format, uint32_t bpp, uint32_t level)
+{
+    const footprint_desc_t d = level_desc(width, height, format, bpp, level + 1);
+    rawa_level_t l = {};
+    /* level の先頭は手前の level の終わりの次の 512 byte 境界 */
+    if (level)
+        l.offset = align_up(footprint_layout(d, 0, level, 0, nullptr), RAWA_PAYLOAD_ALIGNMENT);
+    l.width = std::max< uint32_t >(width >> level, 1);
+    l.height = std::max< uint32_t >(height >> level, 1);
+    const pixel_view_t v = {nullptr, l.width, l.height, format, bpp, 0};
+    l.pitch = footprint_row_pitch(rawd_row_bytes(v));
+    return l;
+}
+
+uint64_t rawa_payload_size(uint32_t width, uint32_t height, uint32_t format, uint32_t bpp, uint32_t mips)
+{
+    return footprint_layout(level_desc(width, height, format, bpp, mips), 0, mips, 0, nullptr);
+}
+
+/* view() と loader はこの値で map の中を読むので、 file に収まらないものや形式と合わないものは弾く */
+static bool valid_entry(const rawa_entry_t& e, uint64_t size)
+{
+    if (e.offset > size || e.size > size - e.offset)
+        return false;
+    if (!e.width || !e.height || !e.mips || e.mips > mip_levels(e.width, e.height))
+        return false;
+    /* RGBA8 は rawd_format_bytes() が 0 を返すが、 archive には 4 byte/texel でしか書かない */
+    const uint32_t bytes = e.format == RAWD_FORMAT_RGBA8 ? 4 : rawd_format_bytes(e.format);
+    if (!bytes || e.bpp != bytes)
+        return false;
+    return e.size >= rawa_payload_size(e.width, e.height, e.format, e.bpp, e.mips);
+}
+
+int rawd_archive_t::open(const std::wstring& fname)
+{
+    toc_ = nullptr;
+    count_ = 0;
+    checksums_ = false;
+    int err = file_.open(fname);
+    if (err < 0)
+        return err;
+
+    const uint8_t* p = file_.data();
+    const size_t size = file_.size();
+    rawa_header_t head;
+    if (size < sizeof(head)) {
+        file_.close();
+        return RAWD_ERR_TRUNCATED;
+    }
+    memcpy(&head, p, sizeof(head));
+    if (memcmp(head.fourcc, "RAWA", 4) != 0 || head.ver_hi != 1) {
+        file_.close();
+        return RAWD_ERR_HEADER;
+    }
+    if (sizeof(head) + static_cast< uint64_t >(head.count) * sizeof(rawa_entry_t) > size) {
+        file_.close();
+        return RAWD_ERR_TRUNCATED;
+    }
+    const rawa_entry_t* toc = reinterpret_cast< const rawa_entry_t* >(p + sizeof(head));
+    for (uint32_t i = 0; i < head.count; i ++) {
+        /* find() は二分探索なので hash の昇順 (重複なし) でなければ引けないものが出る */
+        if (!valid_entry(toc[i], size) || (i && toc[i].hash <= toc[i - 1].hash)) {
+            file_.close();
+            return RAWD_ERR_CORRUPT;
+        }
+    }
+    path_ = fname;
+    toc_ = toc;
+    count_ = head.count;
+    checksums_ = head.ver_lo >= 1;
+    return 0;
+}
+
+const rawa_entry_t* rawd_archive_t::find(uint64_t hash) const
+{
+    const rawa_entry_t* e = std::lower_bound(begin(), end(), hash, [](const rawa_entry_t& a, uint64_t h) { return a.hash < h; });
+    if (e == end() || e->hash != hash)
+        return nullptr;
+    return e;
+}
+
+int rawd_archive_t::view(const rawa_entry_t* e, uint32_t level, pixel_view_t& v) const
+{
+    if (!e || level >= e->mips)
+        return -1;
+    rawa_level_t l = rawa_level(e->width, e->height, e->format, e->bpp, level);
+    v.data = file_.data() + e->offset + l.offset;
+    v.width = l.width;
+    v.height = l.height;
+    v.format = e->format;
+    v.bpp = e->bpp;
+    v.pitch = l.pitch;
+    return 0;
+}
+
+int rawd_archive_writer_t::add(const std::string& name, const pixel_view_t* levels, uint32_t mips)
+{
+    if (!mips || !levels[0].data)
+        return -1;
+    const pixel_view_t& base = levels[0];
+    item_t item = {};
+    item.entry.hash = rawa_name_hash(name.c_str());
+    for (auto& i : items_) {
+        if (i.entry.hash == item.entry.hash)
+            return -1; /* 名前の衝突 (または二重登録) */
+    }
+    item.entry.width = base.width;
+    item.entry.height = base.height;
+    item.entry.format = base.format;
+    item.entry.bpp = static_cast< uint16_t >(base.bpp);
+    item.entry.mips = static_cast< uint16_t >(mips);
+    item.entry.pitch = rawa_level(base.width, base.height, base.format, base.bpp, 0).pitch;
+    item.entry.size = rawa_payload_size(base.width, base.height, base.format, base.bpp, mips);
+    item.payload.resize(static_cast< size_t >(item.entry.size));
+    for (uint32_t i = 0; i < mips; i ++) {
+        rawa_level_t l = rawa_level(base.width, base.height, base.format, base.bpp, i);
+        const pixel_view_t& src = levels[i];
+        if (src.width != l.width || src.height != l.height || src.bpp != base.bpp || src.format != base.format)
+            return -1;
+        const uint32_t rows = rawd_rows(src);
+        for (uint32_t y = 0; y < rows; y ++)
+            memcpy(&item.payload[static_cast< size_t >(l.offset + static_cast< uint64_t >(l.pitch) * y)], src.data + src.pitch * y, rawd_row_bytes(src));
+    }
+    item.entry.checksum = rawd_checksum(item.payload.data(), item.payload.size());
+    items_.push_back(std::move(item));
+    return 0;
+}
+
+int rawd_archive_writer_t::write(const std::wstring& fname)
+{
+    std::sort(items_.begin(), items_.end(), [](const item_t& a, const item_t& b) { return a.entry.hash < b.entry.hash; });
+
+    uint64_t offset = align_up(sizeof(rawa_header_t) + sizeof(rawa_entry_t) * items_.size(), RAWA_PAYLOAD_ALIGNMENT);
+    for (auto& i : items_) {
+        i.entry.offset = offset;
+        offset = align_up(offset + i.entry.size, RAWA_PAYLOAD_ALIGNMENT);
+    }
+
+#if defined(_WIN32)
+    FILE* rawfp = nullptr;
+    _wfopen_s(&rawfp, fname.c_str(), L"wb");
+#else
+    FILE* rawfp = fopen(narrow_path(fname).c_str(), "wb");
+#endif
+    std::unique_ptr< FILE, decltype(&fclose) > fp(rawfp, fclose);
+    if (!fp)
+        return RAWD_ERR_OPEN;
+
+    rawa_header_t head = {{'R', 'A', 'W', 'A'}, 1, 1, static_cast< uint32_t >(items_.size()), 0};
+    fwrite(&head, 1, sizeof(head), fp.get());
+    for (auto& i : items_)
+        fwrite(&i.entry, 1, sizeof(rawa_entry_t), fp.get());
+
+    static const uint8_t zero[RAWA_PAYLOAD_ALIGNMENT] = {};
+    uint64_t pos = sizeof(rawa_header_t) + sizeof(rawa_entry_t) * items_.size();
+    for (auto& i : items_) {
+        fwrite(zero, 1, static_cast< size_t >(i.entry.offset - pos), fp.get());
+        if (fwrite(i.payload.data(), 1, i.payload.size(), fp.get()) != i.payload.size())
+            return RAWD_ERR_OPEN;
+        pos = i.entry.offset + i.entry.size;
+    }
+    return 0;
+}
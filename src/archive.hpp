@@ -0,0 +1,122 @@
+/**
+ * (C) roentgen 
+ * this code is licensed under the MIT License.
+ */
+#if !defined(ARCHIVE_HPP__)
+#define ARCHIVE_HPP__
+
+#include "rawd.hpp"
+#include <stdint.h>
+#include <string>
+#include <vector>
+
+/* RAWA: 複数の RAWD をひとつにまとめたアーカイブ.
+
+   +-------------------+ 0
+   | rawa_header_t     |
+   | rawa_entry_t[n]   | hash 昇順
+   +-------------------+ RAWA_PAYLOAD_ALIGNMENT
+   | payload[0]        |
+   +-------------------+ RAWA_PAYLOAD_ALIGNMENT
+   | payload[1] ...    |
+
+   payload 内の各 mip level は GetCopyableFootprints() と同じ並び
+   (先頭 512 byte 境界, 行は 256 byte 境界) にしてあるので、行を詰め直さずに
+   そのまま upload heap へコピーできる.
+   v1.1 (ver_lo >= 1) では entry の checksum に payload (size byte) の rawd_checksum() が入る */
+
+#define RAWA_PAYLOAD_ALIGNMENT (512) /* D3D12_TEXTURE_DATA_PLACEMENT_ALIGNMENT */
+#define RAWA_PITCH_ALIGNMENT   (256) /* D3D12_TEXTURE_DATA_PITCH_ALIGNMENT */
+
+#pragma pack(push, 1)
+struct rawa_header_t {
+    uint8_t fourcc[4];
+    uint16_t ver_hi;
+    uint16_t ver_lo;
+    uint32_t count;     /* toc の要素数 */
+    uint32_t reserve;
+};
+
+struct rawa_entry_t {
+    uint64_t hash;      /* rawa_name_hash() */
+    uint64_t offset;    /* ファイル先頭からの payload 位置 (RAWA_PAYLOAD_ALIGNMENT 境界) */
+    uint64_t size;      /* payload の byte 数 (行・level のパディング込み) */
+    uint32_t width;
+    uint32_t height;
+    uint32_t format;
+    uint16_t bpp;
+    uint16_t mips;
+    uint32_t pitch;     /* level 0 の行の byte 数 (RAWA_PITCH_ALIGNMENT 境界) */
+    uint32_t checksum;  /* v1.1 から */
+};
+#pragma pack(pop)
+
+static_assert(sizeof(rawa_header_t) == 16, "RAWA header must be 16 bytes");
+static_assert(sizeof(rawa_entry_t) == 48, "RAWA toc entry must be 48 bytes");
+
+template < typename T >
+inline T align_up(T t, uint64_t a)
+{
+    return static_cast< T >((static_cast< uint64_t >(t) + a - 1) & ~(a - 1));
+}
+
+/* FNV-1a (64bit). 名前は拡張子もディレクトリも含まない stem (e.g. "mc256x256_0") */
+uint64_t rawa_name_hash(const char* name);
+uint64_t rawa_name_hash(const std::wstring& name);
+
+/* "C:\\foo\\mc256x256_0.rawdata" -> "mc256x256_0" */
+std::wstring rawa_key_from_path(const std::wstring& path);
+
+/* payload 内の level のレイアウト. offset は payload 先頭から */
+struct rawa_level_t {
+    uint64_t offset;
+    uint32_t width;
+    uint32_t height;
+    uint32_t pitch;
+};
+
+/* width/height は texel 数. BCn では 4x4 block の行/列で並べる (pitch は block 1 行分) */
+rawa_level_t rawa_level(uint32_t width, uint32_t height, uint32_t format, uint32_t bpp, uint32_t level);
+uint64_t rawa_payload_size(uint32_t width, uint32_t height, uint32_t format, uint32_t bpp, uint32_t mips);
+
+/* アーカイブを一度だけ map し、以後は toc を二分探索して payload への view を返す */
+class rawd_archive_t {
+    mapped_file_t file_;
+    std::wstring path_;
+    const rawa_entry_t* toc_;
+    uint32_t count_;
+    bool checksums_;
+public:
+    rawd_archive_t() : toc_(nullptr), count_(0), checksums_(false) {}
+
+    int open(const std::wstring& fname);
+
+    const rawa_entry_t* find(uint64_t hash) const;
+    const rawa_entry_t* find(const std::wstring& name) const { return find(rawa_name_hash(name)); }
+    int view(const rawa_entry_t* e, uint32_t level, pixel_view_t& v) const;
+    /* 全 level を含む payload の先頭 (size byte) */
+    inline const uint8_t* payload(const rawa_entry_t* e) const { return file_.data() + e->offset; }
+    /* 古い archive なら 0 */
+    inline uint32_t checksum(const rawa_entry_t* e) const { return checksums_ ? e->checksum : 0; }
+
+    inline uint32_t count() const { return count_; }
+    inline const std::wstring& path() const { return path_; }
+    inline const rawa_entry_t* begin() const { return toc_; }
+    inline const rawa_entry_t* end() const { return toc_ + count_; }
+};
+
+/* cooker 用. add() した順序によらず toc は hash でソートして書き出す */
+class rawd_archive_writer_t {
+    struct item_t {
+        rawa_entry_t entry;
+        std::vector< uint8_t > payload;
+    };
+    std::vector< item_t > items_;
+public:
+    /* levels[0] が level 0. 各 level は dense でも padding 付きでもよい */
+    int add(const std::string& name, const pixel_view_t* levels, uint32_t mips);
+    int write(const std::wstring& fname);
+    inline size_t size() const { return items_.size(); }
+};
+
+#endif
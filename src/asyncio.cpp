@@ -0,0 +1,481 @@
+/**
+ * (C) roentgen 
+ * this code is licensed under the MIT License.
+ */
+#include "asyncio.hpp"
+#include "rawd.hpp"
+#include <string.h>
+#include <algorithm>
+
+#if defined(_WIN32)
+#ifndef WIN32_LEAN_AND_MEAN
+#define WIN32_LEAN_AND_MEAN
+#endif
+#include <windows.h>
+#else
+#include <sys/types.h>
+#include <sys/stat.h>
+#include <sys/uio.h>
+#include <fcntl.h>
+#include <unistd.h>
+#include <errno.h>
+#endif
+
+#if defined(__linux__) && defined(__has_include)
+#if __has_include(<linux/io_uring.h>)
+#define ASYNCIO_URING
+#include <linux/io_uring.h>
+#include <sys/mman.h>
+#include <sys/syscall.h>
+#endif
+#endif
+
+/* 1 回の read の上限. Win32 の ReadFile は DWORD, Linux の read は 2GB 弱までしか読まない */
+static const size_t IO_CHUNK = size_t(1) << 30;
+
+struct async_io_t::op_t {
+    io_request_t req;
+    uint64_t token;
+    size_t done; /* 読み済みの byte 数. 短い read の続きはここから */
+#if defined(ASYNCIO_URING)
+    struct iovec iov;
+#endif
+};
+
+io_file_t io_open(const std::wstring& fname, uint64_t* size)
+{
+#if defined(_WIN32)
+    HANDLE file = CreateFileW(fname.c_str(), GENERIC_READ, FILE_SHARE_READ, nullptr, OPEN_EXISTING, FILE_ATTRIBUTE_NORMAL, nullptr);
+    if (file == INVALID_HANDLE_VALUE)
+        return IO_INVALID_FILE;
+    if (size) {
+        LARGE_INTEGER sz = {};
+        if (!GetFileSizeEx(file, &sz)) {
+            CloseHandle(file);
+            return IO_INVALID_FILE;
+        }
+        *size = static_cast< uint64_t >(sz.QuadPart);
+    }
+    return reinterpret_cast< io_file_t >(file);
+#else
+    int fd = ::open(narrow_path(fname).c_str(), O_RDONLY | O_CLOEXEC);
+    if (fd < 0)
+        return IO_INVALID_FILE;
+    if (size) {
+        struct stat st;
+        if (fstat(fd, &st) < 0) {
+            ::close(fd);
+            return IO_INVALID_FILE;
+        }
+        *size = static_cast< uint64_t >(st.st_size);
+    }
+    return static_cast< io_file_t >(fd);
+#endif
+}
+
+void io_close(io_file_t f)
+{
+    if (f == IO_INVALID_FILE)
+        return;
+#if defined(_WIN32)
+    CloseHandle(reinterpret_cast< HANDLE >(f));
+#else
+    ::close(static_cast< int >(f));
+#endif
+}
+
+/* EOF まで読んだら短くても成功 */
+static int64_t read_at(io_file_t f, uint64_t offset, uint8_t* dst, size_t size)
+{
+    size_t done = 0;
+    while (done < size) {
+        const size_t chunk = std::min< size_t >(size - done, IO_CHUNK);
+#if defined(_WIN32)
+        OVERLAPPED ov = {};
+        ov.Offset = static_cast< DWORD >(offset + done);
+        ov.OffsetHigh = static_cast< DWORD >((offset + done) >> 32);
+        DWORD got = 0;
+        if (!ReadFile(reinterpret_cast< HANDLE >(f), dst + done, static_cast< DWORD >(chunk), &got, &ov)) {
+            if (GetLastError() == ERROR_HANDLE_EOF)
+                break;
+            return IO_ERR_READ;
+        }
+#else
+        const ssize_t got = pread(static_cast< int >(f), dst + done, chunk, static_cast< off_t >(offset + done));
+        if (got < 0) {
+            if (errno == EINTR)
+                continue;
+            return IO_ERR_READ;
+        }
+#endif
+        if (got == 0)
+            break;
+        done += static_cast< size_t >(got);
+    }
+    return static_cast< int64_t >(done);
+}
+
+int io_prefetch(const std::wstring& fname, uint64_t offset, uint64_t size)
+{
+    uint64_t filesize = 0;
+    io_file_t f = io_open(fname, &filesize);
+    if (f == IO_INVALID_FILE)
+        return IO_ERR_OPEN;
+    if (offset >= filesize) {
+        io_close(f);
+        return 0;
+    }
+    if (!size || size > filesize - offset)
+        size = filesize - offset;
+#if defined(_WIN32)
+    /* Win32 には WILLNEED に当たるものが無いので、 cache を通して読み捨てる */
+    static const size_t PREFETCH_CHUNK = 1 << 20;
+    thread_local std::vector< uint8_t > buf;
+    buf.resize(PREFETCH_CHUNK);
+    int64_t err = 0;
+    for (uint64_t done = 0; done < size && err >= 0; done += PREFETCH_CHUNK)
+        err = read_at(f, offset + done, buf.data(), static_cast< size_t >(std::min< uint64_t >(size - done, PREFETCH_CHUNK)));
+#else
+    /* readahead を発行するだけで完了は待たない */
+    int64_t err = posix_fadvise(static_cast< int >(f), static_cast< off_t >(offset), static_cast< off_t >(size), POSIX_FADV_WILLNEED) ? IO_ERR_READ : 0;
+#endif
+    io_close(f);
+    return err < 0 ? IO_ERR_READ : 0;
+}
+
+#if defined(ASYNCIO_URING)
+struct async_io_t::uring_t {
+    int fd;
+    uint8_t* sq_ring;
+    size_t sq_ring_size;
+    uint8_t* cq_ring;
+    size_t cq_ring_size;
+    io_uring_sqe* sqes;
+    size_t sqes_size;
+    unsigned* sq_head;
+    unsigned* sq_tail;
+    unsigned* sq_array;
+    unsigned sq_mask;
+    unsigned sq_entries;
+    unsigned* cq_head;
+    unsigned* cq_tail;
+    unsigned cq_mask;
+    io_uring_cqe* cqes;
+    unsigned inflight; /* 投げて cqe がまだ返ってきていない要求. sq_entries を超えない (cq は 2 倍ある) */
+};
+
+static int uring_setup(unsigned entries, io_uring_params* p)
+{
+    return static_cast< int >(syscall(__NR_io_uring_setup, entries, p));
+}
+
+static int uring_enter(int fd, unsigned submit, unsigned wait, unsigned flags)
+{
+    return static_cast< int >(syscall(__NR_io_uring_enter, fd, submit, wait, flags, nullptr, 0));
+}
+
+/* sq に積んだまま kernel がまだ取っていない sqe を全部渡す. sq_mtx_ を持って呼ぶ */
+void async_io_t::flush_sqes()
+{
+    uring_t* r = uring_;
+    for (;;) {
+        const unsigned pending = *r->sq_tail - __atomic_load_n(r->sq_head, __ATOMIC_ACQUIRE);
+        if (!pending)
+            return;
+        if (uring_enter(r->fd, pending, 0, 0) < 0) {
+            if (errno == EINTR || errno == EAGAIN || errno == EBUSY) {
+                std::this_thread::yield();
+                continue;
+            }
+            return;
+        }
+    }
+}
+
+bool async_io_t::start_uring(uint32_t depth)
+{
+    io_uring_params p;
+    memset(&p, 0, sizeof(p));
+    const int fd = uring_setup(std::max< uint32_t >(depth, 1), &p);
+    if (fd < 0)
+        return false; /* 古い kernel や seccomp で禁止されている */
+
+    uring_t* r = new uring_t();
+    r->fd = fd;
+    r->sq_ring_size = p.sq_off.array + p.sq_entries * sizeof(unsigned);
+    r->cq_ring_size = p.cq_off.cqes + p.cq_entries * sizeof(io_uring_cqe);
+    const bool single = (p.features & IORING_FEAT_SINGLE_MMAP) != 0;
+    if (single)
+        r->sq_ring_size = r->cq_ring_size = std::max(r->sq_ring_size, r->cq_ring_size);
+    void* sq = mmap(nullptr, r->sq_ring_size, PROT_READ | PROT_WRITE, MAP_SHARED | MAP_POPULATE, fd, IORING_OFF_SQ_RING);
+    void* cq = single ? sq : mmap(nullptr, r->cq_ring_size, PROT_READ | PROT_WRITE, MAP_SHARED | MAP_POPULATE, fd, IORING_OFF_CQ_RING);
+    r->sqes_size = p.sq_entries * sizeof(io_uring_sqe);
+    void* sqes = mmap(nullptr, r->sqes_size, PROT_READ | PROT_WRITE, MAP_SHARED | MAP_POPULATE, fd, IORING_OFF_SQES);
+    if (sq == MAP_FAILED || cq == MAP_FAILED || sqes == MAP_FAILED) {
+        if (sqes != MAP_FAILED)
+            munmap(sqes, r->sqes_size);
+        if (cq != MAP_FAILED && !single)
+            munmap(cq, r->cq_ring_size);
+        if (sq != MAP_FAILED)
+            munmap(sq, r->sq_ring_size);
+        ::close(fd);
+        delete r;
+        return false;
+    }
+    r->sq_ring = static_cast< uint8_t* >(sq);
+    r->cq_ring = static_cast< uint8_t* >(cq);
+    r->sqes = static_cast< io_uring_sqe* >(sqes);
+    r->sq_head = reinterpret_cast< unsigned* >(r->sq_ring + p.sq_off.head);
+    r->sq_tail = reinterpret_cast< unsigned* >(r->sq_ring + p.sq_off.tail);
+    r->sq_array = reinterpret_cast< unsigned* >(r->sq_ring + p.sq_off.array);
+    r->sq_mask = *reinterpret_cast< unsigned* >(r->sq_ring + p.sq_off.ring_mask);
+    r->sq_entries = p.sq_entries;
+    r->cq_head = reinterpret_cast< unsigned* >(r->cq_ring + p.cq_off.head);
+    r->cq_tail = reinterpret_cast< unsigned* >(r->cq_ring + p.cq_off.tail);
+    r->cq_mask = *reinterpret_cast< unsigned* >(r->cq_ring + p.cq_off.ring_mask);
+    r->cqes = reinterpret_cast< io_uring_cqe* >(r->cq_ring + p.cq_off.cqes);
+    r->inflight = 0;
+    uring_ = r;
+    reaper_ = std::thread([this]{ run_reaper(); });
+    return true;
+}
+
+void async_io_t::stop_uring()
+{
+    if (!uring_)
+        return;
+    {
+        /* NOP (user_data 0) を reaper への終了の合図にする */
+        std::lock_guard< std::mutex > lock(sq_mtx_);
+        push_sqe(nullptr);
+        flush_sqes();
+    }
+    reaper_.join();
+    munmap(uring_->sqes, uring_->sqes_size);
+    if (uring_->cq_ring != uring_->sq_ring)
+        munmap(uring_->cq_ring, uring_->cq_ring_size);
+    munmap(uring_->sq_ring, uring_->sq_ring_size);
+    ::close(uring_->fd);
+    delete uring_;
+    uring_ = nullptr;
+}
+
+/* sq_mtx_ を持って呼ぶ. sq に空きがあることは呼び出し側が保証する */
+void async_io_t::push_sqe(op_t* op)
+{
+    uring_t* r = uring_;
+    const unsigned tail = *r->sq_tail;
+    const unsigned idx = tail & r->sq_mask;
+    io_uring_sqe* sqe = &r->sqes[idx];
+    memset(sqe, 0, sizeof(*sqe));
+    if (op) {
+        op->iov.iov_base = op->req.dst + op->done;
+        op->iov.iov_len = std::min< size_t >(op->req.size - op->done, IO_CHUNK);
+        sqe->opcode = IORING_OP_READV;
+        sqe->fd = static_cast< int >(op->req.file);
+        sqe->off = op->req.offset + op->done;
+        sqe->addr = reinterpret_cast< uint64_t >(&op->iov);
+        sqe->len = 1;
+        sqe->user_data = reinterpret_cast< uint64_t >(op);
+    }
+    else {
+        sqe->opcode = IORING_OP_NOP;
+    }
+    r->sq_array[idx] = idx;
+    __atomic_store_n(r->sq_tail, tail + 1, __ATOMIC_RELEASE);
+}
+
+void async_io_t::run_reaper()
+{
+    uring_t* r = uring_;
+    std::vector< std::pair< op_t*, int > > cqes;
+    for (bool quit = false; !quit; ) {
+        if (uring_enter(r->fd, 0, 1, IORING_ENTER_GETEVENTS) < 0 && errno != EINTR && errno != EAGAIN)
+            break;
+        unsigned head = *r->cq_head;
+        const unsigned tail = __atomic_load_n(r->cq_tail, __ATOMIC_ACQUIRE);
+        cqes.clear();
+        for (; head != tail; head ++) {
+            const io_uring_cqe* cqe = &r->cqes[head & r->cq_mask];
+            if (!cqe->user_data)
+                quit = true;
+            else
+                cqes.push_back(std::make_pair(reinterpret_cast< op_t* >(cqe->user_data), cqe->res));
+        }
+        __atomic_store_n(r->cq_head, head, __ATOMIC_RELEASE);
+
+        unsigned finished = 0;
+        for (auto& c : cqes) {
+            op_t* op = c.first;
+            const int res = c.second;
+            if (res == -EINTR || res == -EAGAIN || (res > 0 && op->done + res < op->req.size)) {
+                /* 短い read は続きを投げ直す. 同じ op なので inflight は増えない */
+                if (res > 0)
+                    op->done += static_cast< size_t >(res);
+                std::lock_guard< std::mutex > lock(sq_mtx_);
+                push_sqe(op);
+                flush_sqes();
+                continue;
+            }
+            if (res < 0)
+                finish(op, IO_ERR_READ);
+            else
+                finish(op, static_cast< int64_t >(op->done + res));
+            finished ++;
+        }
+        if (finished) {
+            std::lock_guard< std::mutex > lock(sq_mtx_);
+            r->inflight -= finished;
+            sq_space_.notify_all();
+        }
+    }
+}
+#else
+struct async_io_t::uring_t {};
+
+bool async_io_t::start_uring(uint32_t) { return false; }
+void async_io_t::stop_uring() {}
+void async_io_t::push_sqe(op_t*) {}
+void async_io_t::flush_sqes() {}
+void async_io_t::run_reaper() {}
+#endif
+
+void async_io_t::finish(op_t* op, int64_t result)
+{
+    if (op->req.result)
+        *op->req.result = result;
+    const uint64_t token = op->token;
+    delete op;
+    std::lock_guard< std::mutex > lock(mtx_);
+    batches_[static_cast< size_t >(token - batches_.front().token)].pending --;
+    /* 前の batch が終わるまでは completed_ を進めない (fence と同じく単調に増える) */
+    bool advanced = false;
+    while (!batches_.empty() && batches_.front().pending == 0) {
+        completed_.store(batches_.front().token, std::memory_order_release);
+        batches_.pop_front();
+        advanced = true;
+    }
+    if (advanced)
+        done_.notify_all();
+}
+
+void async_io_t::run_thread()
+{
+    for (;;) {
+        op_t* op;
+        {
+            std::unique_lock< std::mutex > lock(work_mtx_);
+            work_.wait(lock, [this]{ return quit_ || !ops_.empty(); });
+            if (ops_.empty())
+                return;
+            op = ops_.front();
+            ops_.pop_front();
+        }
+        finish(op, read_at(op->req.file, op->req.offset, op->req.dst, op->req.size));
+    }
+}
+
+void async_io_t::dispatch(op_t** ops, size_t n)
+{
+    if (backend_ == IO_BACKEND_THREADS) {
+        {
+            std::lock_guard< std::mutex > lock(work_mtx_);
+            ops_.insert(ops_.end(), ops, ops + n);
+        }
+        work_.notify_all();
+        return;
+    }
+#if defined(ASYNCIO_URING)
+    /* 全部積んでから 1 回の io_uring_enter で渡す. 深さが足りなければ途中で渡して空くのを待つ */
+    uring_t* r = uring_;
+    std::unique_lock< std::mutex > lock(sq_mtx_);
+    for (size_t i = 0; i < n; i ++) {
+        if (r->inflight >= r->sq_entries) {
+            flush_sqes();
+            sq_space_.wait(lock, [r]{ return r->inflight < r->sq_entries; });
+        }
+        r->inflight ++;
+        push_sqe(ops[i]);
+    }
+    flush_sqes();
+#endif
+}
+
+int async_io_t::start(io_backend_t backend, uint32_t depth, int threads)
+{
+    stop();
+    next_token_ = 0;
+    completed_ = 0;
+    quit_ = false;
+    backend_ = IO_BACKEND_THREADS;
+    if (backend != IO_BACKEND_THREADS && start_uring(depth))
+        backend_ = IO_BACKEND_URING;
+    else if (backend == IO_BACKEND_URING)
+        return -1;
+    else
+        for (int i = 0; i < std::max(threads, 1); i ++)
+            threads_.emplace_back([this]{ run_thread(); });
+    std::lock_guard< std::mutex > lock(mtx_);
+    running_ = true;
+    return 0;
+}
+
+void async_io_t::stop()
+{
+    uint64_t last;
+    {
+        std::lock_guard< std::mutex > lock(mtx_);
+        if (!running_)
+            return;
+        running_ = false;
+        last = next_token_;
+    }
+    wait(last);
+    stop_uring();
+    {
+        std::lock_guard< std::mutex > lock(work_mtx_);
+        quit_ = true;
+    }
+    work_.notify_all();
+    for (auto& t : threads_)
+        t.join();
+    threads_.clear();
+}
+
+uint64_t async_io_t::submit(const io_request_t* reqs, size_t n)
+{
+    uint64_t token;
+    {
+        std::lock_guard< std::mutex > lock(mtx_);
+        if (!running_) {
+            for (size_t i = 0; i < n; i ++)
+                if (reqs[i].result)
+                    *reqs[i].result = IO_ERR_CLOSED;
+            return 0;
+        }
+        token = ++ next_token_;
+        batch_t b = {token, n};
+        batches_.push_back(b);
+        if (n == 0 && batches_.size() == 1) {
+            /* 空の batch は前が全部終わっていればその場で完了 */
+            completed_.store(token, std::memory_order_release);
+            batches_.pop_front();
+            done_.notify_all();
+        }
+    }
+    std::vector< op_t* > ops(n);
+    for (size_t i = 0; i < n; i ++) {
+        ops[i] = new op_t();
+        ops[i]->req = reqs[i];
+        ops[i]->token = token;
+        ops[i]->done = 0;
+    }
+    dispatch(ops.data(), n);
+    return token;
+}
+
+void async_io_t::wait(uint64_t token)
+{
+    std::unique_lock< std::mutex > lock(mtx_);
+    done_.wait(lock, [this, token]{ return completed_.load(std::memory_order_acquire) >= token; });
+}
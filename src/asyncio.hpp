@@ -0,0 +1,115 @@
+/**
+ * (C) roentgen 
+ * this code is licensed under the MIT License.
+ */
+#if !defined(ASYNCIO_HPP__)
+#define ASYNCIO_HPP__
+
+#include <stdint.h>
+#include <stddef.h>
+#include <string>
+#include <vector>
+#include <deque>
+#include <thread>
+#include <mutex>
+#include <condition_variable>
+#include <atomic>
+
+/* まとめて投げる非同期 read. D3D12 には依存しない.
+   file/offset/size/dst の要求を何個か並べて submit() すると token が返り、 fence と同じように
+   completed() がその値に達したら batch の中の要求は全部終わっている (batch は投げた順に完了する).
+   Linux では io_uring (liburing は使わず syscall を直接呼ぶ)、 それ以外や io_uring が使えない時は
+   スレッドで pread/ReadFile する */
+
+#define IO_ERR_OPEN   (-1) /* ファイルが開けない */
+#define IO_ERR_READ   (-2) /* read が失敗した */
+#define IO_ERR_CLOSED (-3) /* stop() 済み */
+
+/* POSIX では fd, Win32 では HANDLE */
+typedef intptr_t io_file_t;
+#define IO_INVALID_FILE (static_cast< io_file_t >(-1))
+
+/* 読み込み専用で開く. size があればファイルの大きさを返す */
+io_file_t io_open(const std::wstring& fname, uint64_t* size = nullptr);
+void io_close(io_file_t f);
+
+/* [offset, offset + size) をページキャッシュに載せるよう OS に頼む (size 0 ならファイルの終わりまで).
+   POSIX では posix_fadvise(WILLNEED) で、 Win32 では読み捨てる. 失敗しても読み込みには影響しない */
+int io_prefetch(const std::wstring& fname, uint64_t offset = 0, uint64_t size = 0);
+
+/* dst は CPU のメモリでも map した upload heap でもよい. 完了するまで触らないこと */
+struct io_request_t {
+    io_file_t file;
+    uint64_t offset;
+    size_t size;
+    uint8_t* dst;
+    int64_t* result; /* 完了時に読めた byte 数 (EOF なら size より短い) か IO_ERR_*. nullptr なら捨てる */
+};
+
+enum io_backend_t {
+    IO_BACKEND_AUTO,    /* io_uring が使えればそれ、 駄目ならスレッド */
+    IO_BACKEND_URING,
+    IO_BACKEND_THREADS,
+};
+
+class async_io_t {
+    struct op_t;
+    struct batch_t {
+        uint64_t token;
+        size_t pending;
+    };
+
+    io_backend_t backend_;
+
+    /* batch の完了 */
+    std::mutex mtx_;
+    std::condition_variable done_;
+    std::deque< batch_t > batches_; /* 未完了の batch. token の順 */
+    uint64_t next_token_;
+    std::atomic< uint64_t > completed_;
+    bool running_;
+
+    /* スレッドの backend */
+    std::mutex work_mtx_;
+    std::condition_variable work_;
+    std::deque< op_t* > ops_;
+    bool quit_;
+    std::vector< std::thread > threads_;
+
+    /* io_uring の backend */
+    struct uring_t;
+    uring_t* uring_;
+    std::mutex sq_mtx_;
+    std::condition_variable sq_space_;
+    std::thread reaper_;
+
+    void finish(op_t* op, int64_t result);
+    void dispatch(op_t** ops, size_t n);
+    void run_thread();
+    bool start_uring(uint32_t depth);
+    void stop_uring();
+    void push_sqe(op_t* op);
+    void flush_sqes();
+    void run_reaper();
+
+public:
+    async_io_t() : backend_(IO_BACKEND_THREADS), next_token_(0), completed_(0), running_(false), quit_(false), uring_(nullptr) {}
+    ~async_io_t() { stop(); }
+    async_io_t(const async_io_t&) = delete;
+    async_io_t& operator=(const async_io_t&) = delete;
+
+    /* depth は io_uring の queue の深さ (同時に投げておく要求の数), threads はスレッドの backend の worker 数 */
+    int start(io_backend_t backend = IO_BACKEND_AUTO, uint32_t depth = 64, int threads = 2);
+    /* 投げてあるものが全部終わるのを待ってから止める */
+    void stop();
+    io_backend_t backend() const { return backend_; }
+
+    /* n 個の要求をひとつの batch として投げ、 batch の token を返す. stop() 済みなら 0.
+       各要求の result は batch が完了した時点で書かれている */
+    uint64_t submit(const io_request_t* reqs, size_t n);
+    /* この値以下の token の batch は全部終わっている (ID3D12Fence::GetCompletedValue と同じ) */
+    uint64_t completed() const { return completed_.load(std::memory_order_acquire); }
+    void wait(uint64_t token);
+};
+
+#endif
@@ -0,0 +1,535 @@
+/**
+ * (C) roentgen 
+ * this code is licensed under the MIT License.
+ */
+#include "bcenc.hpp"
+#include "simd.hpp"
+#include <math.h>
+#include <string.h>
+#include <algorithm>
+
+/* 4x4 texel を channel ごとに並べたもの. 値は 0..255 */
+struct bc_block_t {
+    float c[4][16];
+};
+
+static void load_block(const pixel_view_t& src, uint32_t bx, uint32_t by, bc_block_t& b)
+{
+    for (uint32_t y = 0; y < 4; y ++) {
+        const uint8_t* row = src.data + src.pitch * std::min< uint32_t >(by * 4 + y, src.height - 1);
+        for (uint32_t x = 0; x < 4; x ++) {
+            const uint8_t* p = row + std::min< uint32_t >(bx * 4 + x, src.width - 1) * 4;
+            for (int c = 0; c < 4; c ++)
+                b.c[c][y * 4 + x] = p[c];
+        }
+    }
+}
+
+/* 各 texel に一番近い palette の番号を idx に入れ, 二乗誤差の合計を返す.
+   palette は n 色 (最大 16), 比較するのは先頭の channels 個の channel */
+static float fit_indices(const bc_block_t& b, int first, int channels, const float (*pal)[4], int n, uint8_t idx[16])
+{
+#if defined(SIMD_X86)
+    float total = 0.0f;
+    for (int g = 0; g < 16; g += 4) {
+        __m128 px[4];
+        for (int c = 0; c < channels; c ++)
+            px[c] = _mm_loadu_ps(&b.c[first + c][g]);
+        __m128 best = _mm_set1_ps(1e30f);
+        __m128 bi = _mm_setzero_ps();
+        for (int k = 0; k < n; k ++) {
+            __m128 d = _mm_setzero_ps();
+            for (int c = 0; c < channels; c ++) {
+                const __m128 t = _mm_sub_ps(px[c], _mm_set1_ps(pal[k][c]));
+                d = _mm_add_ps(d, _mm_mul_ps(t, t));
+            }
+            const __m128 less = _mm_cmplt_ps(d, best);
+            best = _mm_min_ps(d, best);
+            bi = _mm_or_ps(_mm_and_ps(less, _mm_set1_ps(static_cast< float >(k))), _mm_andnot_ps(less, bi));
+        }
+        float e[4];
+        float i[4];
+        _mm_storeu_ps(e, best);
+        _mm_storeu_ps(i, bi);
+        for (int t = 0; t < 4; t ++) {
+            idx[g + t] = static_cast< uint8_t >(i[t]);
+            total += e[t];
+        }
+    }
+    return total;
+#else
+    float total = 0.0f;
+    for (int t = 0; t < 16; t ++) {
+        float best = 1e30f;
+        for (int k = 0; k < n; k ++) {
+            float d = 0.0f;
+            for (int c = 0; c < channels; c ++) {
+                const float v = b.c[first + c][t] - pal[k][c];
+                d += v * v;
+            }
+            if (d < best) {
+                best = d;
+                idx[t] = static_cast< uint8_t >(k);
+            }
+        }
+        total += best;
+    }
+    return total;
+#endif
+}
+
+/* 主成分の軸に射影した両端を端点にする */
+static void principal_endpoints(const bc_block_t& b, int channels, float e0[4], float e1[4])
+{
+    float mean[4] = {};
+    for (int c = 0; c < channels; c ++) {
+        for (int t = 0; t < 16; t ++)
+            mean[c] += b.c[c][t];
+        mean[c] /= 16.0f;
+    }
+    float cov[4][4] = {};
+    for (int t = 0; t < 16; t ++) {
+        for (int i = 0; i < channels; i ++)
+            for (int j = 0; j < channels; j ++)
+                cov[i][j] += (b.c[i][t] - mean[i]) * (b.c[j][t] - mean[j]);
+    }
+    /* べき乗法. 初期値は対角 (各 channel の分散) */
+    float axis[4] = {};
+    for (int c = 0; c < channels; c ++)
+        axis[c] = cov[c][c] + 1e-3f;
+    for (int it = 0; it < 8; it ++) {
+        float next[4] = {};
+        float len = 0.0f;
+        for (int i = 0; i < channels; i ++) {
+            for (int j = 0; j < channels; j ++)
+                next[i] += cov[i][j] * axis[j];
+            len += next[i] * next[i];
+        }
+        if (len < 1e-12f)
+            break;
+        len = 1.0f / sqrtf(len);
+        for (int c = 0; c < channels; c ++)
+            axis[c] = next[c] * len;
+    }
+    float tmin = 0.0f;
+    float tmax = 0.0f;
+    for (int t = 0; t < 16; t ++) {
+        float d = 0.0f;
+        for (int c = 0; c < channels; c ++)
+            d += (b.c[c][t] - mean[c]) * axis[c];
+        tmin = std::min(tmin, d);
+        tmax = std::max(tmax, d);
+    }
+    for (int c = 0; c < channels; c ++) {
+        e0[c] = std::min(std::max(mean[c] + axis[c] * tmin, 0.0f), 255.0f);
+        e1[c] = std::min(std::max(mean[c] + axis[c] * tmax, 0.0f), 255.0f);
+    }
+}
+
+/* index を固定して (1 - w) * e0 + w * e1 の二乗誤差が最小になる端点を解く. 退化していたら false */
+static bool refine_endpoints(const bc_block_t& b, int first, int channels, const uint8_t idx[16], const float* weight, float e0[4], float e1[4])
+{
+    float aa = 0.0f, bb = 0.0f, ab = 0.0f;
+    float x[4] = {}, y[4] = {};
+    for (int t = 0; t < 16; t ++) {
+        const float w = weight[idx[t]];
+        const float v = 1.0f - w;
+        aa += v * v;
+        bb += w * w;
+        ab += v * w;
+        for (int c = 0; c < channels; c ++) {
+            x[c] += v * b.c[first + c][t];
+            y[c] += w * b.c[first + c][t];
+        }
+    }
+    const float det = aa * bb - ab * ab;
+    if (fabsf(det) < 1e-6f)
+        return false;
+    for (int c = 0; c < channels; c ++) {
+        e0[c] = std::min(std::max((bb * x[c] - ab * y[c]) / det, 0.0f), 255.0f);
+        e1[c] = std::min(std::max((aa * y[c] - ab * x[c]) / det, 0.0f), 255.0f);
+    }
+    return true;
+}
+
+static inline int quantize(float v, int bits)
+{
+    const int m = (1 << bits) - 1;
+    return std::min(std::max(static_cast< int >(v * m / 255.0f + 0.5f), 0), m);
+}
+
+/*
+ * BC1 の color block
+ */
+
+static uint16_t pack565(const float e[4])
+{
+    return static_cast< uint16_t >((quantize(e[0], 5) << 11) | (quantize(e[1], 6) << 5) | quantize(e[2], 5));
+}
+
+static void unpack565(uint16_t c, float e[4])
+{
+    const int r = (c >> 11) & 31, g = (c >> 5) & 63, b = c & 31;
+    e[0] = static_cast< float >((r << 3) | (r >> 2));
+    e[1] = static_cast< float >((g << 2) | (g >> 4));
+    e[2] = static_cast< float >((b << 3) | (b >> 2));
+    e[3] = 255.0f;
+}
+
+/* 4 色 mode. c0 > c1 でないと 3 色 + 透明の mode になってしまうので呼び出し側で並べる */
+static float bc1_try(const bc_block_t& b, uint16_t c0, uint16_t c1, uint8_t idx[16])
+{
+    float pal[4][4];
+    unpack565(c0, pal[0]);
+    unpack565(c1, pal[1]);
+    for (int c = 0; c < 3; c ++) {
+        pal[2][c] = (2.0f * pal[0][c] + pal[1][c]) / 3.0f;
+        pal[3][c] = (pal[0][c] + 2.0f * pal[1][c]) / 3.0f;
+    }
+    return fit_indices(b, 0, 3, pal, 4, idx);
+}
+
+static float bc1_order(const bc_block_t& b, const float e0[4], const float e1[4], uint16_t& c0, uint16_t& c1, uint8_t idx[16])
+{
+    c0 = pack565(e0);
+    c1 = pack565(e1);
+    if (c0 < c1)
+        std::swap(c0, c1);
+    if (c0 == c1) {
+        /* 3 色 mode になるが index 0 (= c0) しか使わなければ同じ */
+        memset(idx, 0, 16);
+        float pal[1][4];
+        unpack565(c0, pal[0]);
+        return fit_indices(b, 0, 3, pal, 1, idx);
+    }
+    return bc1_try(b, c0, c1, idx);
+}
+
+static void encode_bc1_color(const bc_block_t& b, int quality, uint8_t* out)
+{
+    static const float weight[4] = {0.0f, 1.0f, 1.0f / 3.0f, 2.0f / 3.0f};
+    float e0[4], e1[4];
+    principal_endpoints(b, 3, e0, e1);
+    uint16_t c0, c1;
+    uint8_t idx[16];
+    float err = bc1_order(b, e0, e1, c0, c1, idx);
+    const int iterations = quality <= BC_QUALITY_FAST ? 0 : quality == BC_QUALITY_NORMAL ? 2 : 8;
+    for (int it = 0; it < iterations && err > 0.0f; it ++) {
+        if (c0 == c1 || !refine_endpoints(b, 0, 3, idx, weight, e0, e1))
+            break;
+        uint16_t n0, n1;
+        uint8_t nidx[16];
+        const float e = bc1_order(b, e0, e1, n0, n1, nidx);
+        if (e >= err)
+            break;
+        err = e;
+        c0 = n0;
+        c1 = n1;
+        memcpy(idx, nidx, 16);
+    }
+    uint32_t bits = 0;
+    for (int t = 0; t < 16; t ++)
+        bits |= static_cast< uint32_t >(idx[t]) << (t * 2);
+    out[0] = static_cast< uint8_t >(c0);
+    out[1] = static_cast< uint8_t >(c0 >> 8);
+    out[2] = static_cast< uint8_t >(c1);
+    out[3] = static_cast< uint8_t >(c1 >> 8);
+    for (int i = 0; i < 4; i ++)
+        out[4 + i] = static_cast< uint8_t >(bits >> (i * 8));
+}
+
+/*
+ * BC3 の alpha block (BC4 と同じ形式)
+ */
+
+static float alpha_try(const bc_block_t& b, int a0, int a1, uint8_t idx[16])
+{
+    float pal[8][4] = {};
+    pal[0][0] = static_cast< float >(a0);
+    pal[1][0] = static_cast< float >(a1);
+    if (a0 > a1) {
+        for (int i = 1; i < 7; i ++)
+            pal[i + 1][0] = static_cast< float >(((7 - i) * a0 + i * a1) / 7);
+    }
+    else {
+        for (int i = 1; i < 5; i ++)
+            pal[i + 1][0] = static_cast< float >(((5 - i) * a0 + i * a1) / 5);
+        pal[6][0] = 0.0f;
+        pal[7][0] = 255.0f;
+    }
+    return fit_indices(b, 3, 1, pal, 8, idx);
+}
+
+static void encode_alpha(const bc_block_t& b, int quality, uint8_t* out)
+{
+    int amin = 255, amax = 0;
+    int imin = 255, imax = 0; /* 0 と 255 を除いた範囲 (6 値 mode 用) */
+    for (int t = 0; t < 16; t ++) {
+        const int a = static_cast< int >(b.c[3][t]);
+        amin = std::min(amin, a);
+        amax = std::max(amax, a);
+        if (a != 0 && a != 255) {
+            imin = std::min(imin, a);
+            imax = std::max(imax, a);
+        }
+    }
+    int a0 = amax, a1 = amin;
+    uint8_t idx[16];
+    float err;
+    if (a0 == a1) {
+        memset(idx, 0, 16);
+        err = 0.0f;
+    }
+    else {
+        err = alpha_try(b, a0, a1, idx);
+    }
+    if (err > 0.0f && quality >= BC_QUALITY_SLOW && imin <= imax) {
+        /* 0/255 と中間の値が混ざっている block は 6 値 mode の方が良いことがある */
+        uint8_t nidx[16];
+        const float e = alpha_try(b, imin, imax, nidx);
+        if (e < err) {
+            a0 = imin;
+            a1 = imax;
+            memcpy(idx, nidx, 16);
+        }
+    }
+    out[0] = static_cast< uint8_t >(a0);
+    out[1] = static_cast< uint8_t >(a1);
+    uint64_t bits = 0;
+    for (int t = 0; t < 16; t ++)
+        bits |= static_cast< uint64_t >(idx[t]) << (t * 3);
+    for (int i = 0; i < 6; i ++)
+        out[2 + i] = static_cast< uint8_t >(bits >> (i * 8));
+}
+
+/*
+ * BC7 mode 6
+ */
+
+static const int BC7_WEIGHT4[16] = {0, 4, 9, 13, 17, 21, 26, 30, 34, 38, 43, 47, 51, 55, 60, 64};
+
+struct bc7_endpoints_t {
+    int q[2][4];   /* 7bit */
+    int p[2];      /* p-bit */
+};
+
+/* 7bit + p-bit. p を固定して e に一番近い値にする */
+static int bc7_quantize(float e, int p)
+{
+    return std::min(std::max(static_cast< int >((e - p) / 2.0f + 0.5f), 0), 127);
+}
+
+static float bc7_try(const bc_block_t& b, const bc7_endpoints_t& ep, uint8_t idx[16])
+{
+    float pal[16][4];
+    for (int c = 0; c < 4; c ++) {
+        const int v0 = (ep.q[0][c] << 1) | ep.p[0];
+        const int v1 = (ep.q[1][c] << 1) | ep.p[1];
+        for (int k = 0; k < 16; k ++)
+            pal[k][c] = static_cast< float >(((64 - BC7_WEIGHT4[k]) * v0 + BC7_WEIGHT4[k] * v1 + 32) >> 6);
+    }
+    return fit_indices(b, 0, 4, pal, 16, idx);
+}
+
+/* p-bit ごとに量子化して一番良いものを選ぶ. slow なら 4 通りを index まで含めて比べる */
+static float bc7_quantize_endpoints(const bc_block_t& b, const float e0[4], const float e1[4], bool exhaustive, bc7_endpoints_t& ep, uint8_t idx[16])
+{
+    const float* e[2] = {e0, e1};
+    if (!exhaustive) {
+        for (int i = 0; i < 2; i ++) {
+            float best = 1e30f;
+            for (int p = 0; p < 2; p ++) {
+                float d = 0.0f;
+                int q[4];
+                for (int c = 0; c < 4; c ++) {
+                    q[c] = bc7_quantize(e[i][c], p);
+                    const float v = static_cast< float >((q[c] << 1) | p) - e[i][c];
+                    d += v * v;
+                }
+                if (d < best) {
+                    best = d;
+                    ep.p[i] = p;
+                    memcpy(ep.q[i], q, sizeof(q));
+                }
+            }
+        }
+        return bc7_try(b, ep, idx);
+    }
+    float best = 1e30f;
+    for (int pp = 0; pp < 4; pp ++) {
+        bc7_endpoints_t t;
+        t.p[0] = pp & 1;
+        t.p[1] = pp >> 1;
+        for (int i = 0; i < 2; i ++)
+            for (int c = 0; c < 4; c ++)
+                t.q[i][c] = bc7_quantize(e[i][c], t.p[i]);
+        uint8_t tidx[16];
+        const float err = bc7_try(b, t, tidx);
+        if (err < best) {
+            best = err;
+            ep = t;
+            memcpy(idx, tidx, 16);
+        }
+    }
+    return best;
+}
+
+/* LSB から順に詰める */
+struct bitwriter_t {
+    uint8_t* out;
+    int pos;
+    void put(uint32_t v, int bits)
+    {
+        for (int i = 0; i < bits; i ++, pos ++) {
+            if ((v >> i) & 1)
+                out[pos >> 3] |= static_cast< uint8_t >(1 << (pos & 7));
+        }
+    }
+};
+
+static void encode_bc7(const bc_block_t& b, int quality, uint8_t* out)
+{
+    float weight[16];
+    for (int k = 0; k < 16; k ++)
+        weight[k] = BC7_WEIGHT4[k] / 64.0f;
+
+    const bool exhaustive = quality >= BC_QUALITY_SLOW;
+    float e0[4], e1[4];
+    principal_endpoints(b, 4, e0, e1);
+    bc7_endpoints_t ep;
+    uint8_t idx[16];
+    float err = bc7_quantize_endpoints(b, e0, e1, exhaustive, ep, idx);
+    const int iterations = quality <= BC_QUALITY_FAST ? 0 : quality == BC_QUALITY_NORMAL ? 2 : 6;
+    for (int it = 0; it < iterations && err > 0.0f; it ++) {
+        if (!refine_endpoints(b, 0, 4, idx, weight, e0, e1))
+            break;
+        bc7_endpoints_t nep;
+        uint8_t nidx[16];
+        const float e = bc7_quantize_endpoints(b, e0, e1, exhaustive, nep, nidx);
+        if (e >= err)
+            break;
+        err = e;
+        ep = nep;
+        memcpy(idx, nidx, 16);
+    }
+    /* texel 0 の index は最上位 bit を省略するので 8 未満にする (端点を入れ替えて index を反転) */
+    if (idx[0] & 8) {
+        std::swap(ep.p[0], ep.p[1]);
+        for (int c = 0; c < 4; c ++)
+            std::swap(ep.q[0][c], ep.q[1][c]);
+        for (int t = 0; t < 16; t ++)
+            idx[t] = static_cast< uint8_t >(15 - idx[t]);
+    }
+    memset(out, 0, 16);
+    bitwriter_t w = {out, 0};
+    w.put(1 << 6, 7); /* mode 6 */
+    for (int c = 0; c < 4; c ++) {
+        w.put(ep.q[0][c], 7);
+        w.put(ep.q[1][c], 7);
+    }
+    w.put(ep.p[0], 1);
+    w.put(ep.p[1], 1);
+    w.put(idx[0], 3);
+    for (int t = 1; t < 16; t ++)
+        w.put(idx[t], 4);
+}
+
+/*
+ * 中間形式 (transcode.hpp). RGBA8 の端点 2 つ + 2bit index
+ */
+
+static float universal_try(const bc_block_t& b, const int q[2][4], uint8_t idx[16])
+{
+    float pal[4][4];
+    for (int k = 0; k < 4; k ++)
+        for (int c = 0; c < 4; c ++)
+            pal[k][c] = static_cast< float >(((3 - k) * q[0][c] + k * q[1][c] + 1) / 3);
+    return fit_indices(b, 0, 4, pal, 4, idx);
+}
+
+static void universal_quantize(const float e0[4], const float e1[4], int q[2][4])
+{
+    for (int c = 0; c < 4; c ++) {
+        q[0][c] = quantize(e0[c], 8);
+        q[1][c] = quantize(e1[c], 8);
+    }
+}
+
+static void encode_universal(const bc_block_t& b, int quality, uint8_t* out)
+{
+    static const float weight[4] = {0.0f, 1.0f / 3.0f, 2.0f / 3.0f, 1.0f};
+    float e0[4], e1[4];
+    principal_endpoints(b, 4, e0, e1);
+    int q[2][4];
+    uint8_t idx[16];
+    universal_quantize(e0, e1, q);
+    float err = universal_try(b, q, idx);
+    const int iterations = quality <= BC_QUALITY_FAST ? 0 : quality == BC_QUALITY_NORMAL ? 2 : 8;
+    for (int it = 0; it < iterations && err > 0.0f; it ++) {
+        if (!refine_endpoints(b, 0, 4, idx, weight, e0, e1))
+            break;
+        int nq[2][4];
+        uint8_t nidx[16];
+        universal_quantize(e0, e1, nq);
+        const float e = universal_try(b, nq, nidx);
+        if (e >= err)
+            break;
+        err = e;
+        memcpy(q, nq, sizeof(q));
+        memcpy(idx, nidx, 16);
+    }
+    uint32_t bits = 0;
+    for (int t = 0; t < 16; t ++)
+        bits |= static_cast< uint32_t >(idx[t]) << (t * 2);
+    for (int c = 0; c < 4; c ++) {
+        out[c] = static_cast< uint8_t >(q[0][c]);
+        out[4 + c] = static_cast< uint8_t >(q[1][c]);
+    }
+    for (int i = 0; i < 4; i ++)
+        out[8 + i] = static_cast< uint8_t >(bits >> (i * 8));
+}
+
+int bc_encode(const pixel_view_t& src, uint32_t format, int quality, std::vector< uint8_t >& buf, pixel_view_t& dst, worker_pool_t* pool)
+{
+    if (src.bpp != 4 || !src.data || !rawd_is_block(format))
+        return -1;
+    dst.width = src.width;
+    dst.height = src.height;
+    dst.format = format;
+    dst.bpp = rawd_format_bytes(format);
+    dst.pitch = rawd_row_bytes(dst);
+    const uint32_t bw = (src.width + 3) / 4;
+    const uint32_t bh = rawd_rows(dst);
+    buf.assign(dst.pitch * bh, 0);
+
+    uint8_t* base = buf.data();
+    auto row = [&](size_t by) {
+        uint8_t* out = base + dst.pitch * by;
+        bc_block_t b;
+        for (uint32_t bx = 0; bx < bw; bx ++, out += dst.bpp) {
+            load_block(src, bx, static_cast< uint32_t >(by), b);
+            switch (format) {
+            case RAWD_FORMAT_BC1:
+                encode_bc1_color(b, quality, out);
+                break;
+            case RAWD_FORMAT_BC3:
+                encode_alpha(b, quality, out);
+                encode_bc1_color(b, quality, out + 8);
+                break;
+            case RAWD_FORMAT_UNIVERSAL:
+                encode_universal(b, quality, out);
+                break;
+            default:
+                encode_bc7(b, quality, out);
+                break;
+            }
+        }
+    };
+    if (pool)
+        pool->parallel_for(bh, row);
+    else
+        for (uint32_t by = 0; by < bh; by ++)
+            row(by);
+    dst.data = buf.data();
+    return 0;
+}
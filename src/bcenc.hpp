@@ -0,0 +1,31 @@
+/**
+ * (C) roentgen 
+ * this code is licensed under the MIT License.
+ */
+#if !defined(BCENC_HPP__)
+#define BCENC_HPP__
+
+#include "rawd.hpp"
+#include "pipeline.hpp"
+#include <stdint.h>
+#include <vector>
+
+/* RGBA8 を BC1/BC3/BC7 (と load 時に変換する中間形式) に圧縮する (cooker 用). D3D12 には依存しない.
+
+   BC1: RGB 565 の端点 2 つ + 2bit index (常に 4 色 mode, alpha は捨てる)
+   BC3: BC4 形式の alpha block + BC1 の color block
+   BC7: mode 6 (1 subset, RGBA 7bit + p-bit の端点, 4bit index) だけを使う
+   中間形式: RGBA8 の端点 2 つ + 2bit index (transcode.hpp)
+
+   端点は主成分の軸の両端から始めて、 quality に応じて最小二乗で詰め直す.
+   texel と palette の距離計算は 4 texel ずつ SSE で行い、 block 行は pool に配って並列に処理する */
+
+#define BC_QUALITY_FAST    (0) /* 主成分の両端だけ */
+#define BC_QUALITY_NORMAL  (1) /* 最小二乗で 2 回詰め直す */
+#define BC_QUALITY_SLOW    (2) /* 詰め直しを増やし, p-bit や alpha の 6 値 mode も総当たりする */
+
+/* src (RGBA8) を format (RAWD_FORMAT_BC* か RAWD_FORMAT_UNIVERSAL) で圧縮し, buf に block を詰めて dst にその view を返す.
+   端の 4x4 に満たない block は端の texel を繰り返して埋める */
+int bc_encode(const pixel_view_t& src, uint32_t format, int quality, std::vector< uint8_t >& buf, pixel_view_t& dst, worker_pool_t* pool = nullptr);
+
+#endif
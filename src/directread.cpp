@@ -0,0 +1,53 @@
+/**
+ * (C) roentgen 
+ * this code is licensed under the MIT License.
+ */
+#include "directread.hpp"
+
+int direct_probe(const uint8_t* head, size_t headsize, uint64_t filesize, direct_source_t& src)
+{
+    rawd_header_t h;
+    src.offset = 0;
+    src.checksum = 0;
+    int err = rawd_pixel_offset(head, headsize, filesize, h, src.view, src.offset);
+    if (err < 0)
+        return err;
+    /* RGBA8 は rawd_format_bytes() が 0 を返すので別に見る */
+    const uint32_t bytes = src.view.format == RAWD_FORMAT_RGBA8 ? 4 : rawd_format_bytes(src.view.format);
+    if (!bytes || src.view.bpp != bytes)
+        return RAWD_ERR_HEADER;
+    if (h.ver_lo >= 2)
+        src.checksum = h.checksum;
+    return 0;
+}
+
+size_t direct_requests(const direct_source_t& src, io_file_t f, uint8_t* dst, size_t row_pitch, std::vector< io_request_t >& reads)
+{
+    const pixel_view_t& v = src.view;
+    if (v.pitch == row_pitch) {
+        io_request_t r = {f, src.offset, rawd_payload_bytes(v), dst, nullptr};
+        reads.push_back(r);
+        return 1;
+    }
+    const uint32_t rows = rawd_rows(v);
+    const size_t row = rawd_row_bytes(v);
+    for (uint32_t y = 0; y < rows; y ++) {
+        io_request_t r = {f, src.offset + static_cast< uint64_t >(v.pitch) * y, row, dst + row_pitch * y, nullptr};
+        reads.push_back(r);
+    }
+    return rows;
+}
+
+int direct_verify(const direct_source_t& src, const std::wstring& fname)
+{
+    if (!src.checksum)
+        return 0;
+    mapped_file_t file;
+    int err = file.open(fname);
+    if (err < 0)
+        return err;
+    const size_t bytes = rawd_payload_bytes(src.view);
+    if (src.offset > file.size() || bytes > file.size() - src.offset)
+        return RAWD_ERR_TRUNCATED;
+    return rawd_checksum(file.data() + src.offset, bytes) == src.checksum ? 0 : RAWD_ERR_CHECKSUM;
+}
@@ -0,0 +1,38 @@
+/**
+ * (C) roentgen 
+ * this code is licensed under the MIT License.
+ */
+#if !defined(DIRECTREAD_HPP__)
+#define DIRECTREAD_HPP__
+
+#include "rawd.hpp"
+#include "asyncio.hpp"
+#include <stdint.h>
+#include <stddef.h>
+#include <string>
+#include <vector>
+
+/* 非圧縮の RAWD の pixel 列を、 中間バッファを通さずに書き込み先 (upload ring の footprint) へ直接読む.
+   D3D12 には依存しない. texture_loader_t の direct で使う.
+   書き込み先は write-combined で読み直すと遅いので、 checksum を持つもの (v1.2 以降) は読み終わった後に
+   ファイルを map して page cache の方で照合する (direct_verify). cache と相乗りは使わない */
+
+struct direct_source_t {
+    pixel_view_t view; /* data は nullptr */
+    uint64_t offset;   /* ファイルの中の pixel 列の位置 */
+    uint32_t checksum; /* header の checksum. 0 なら無い */
+};
+
+/* head はファイルの先頭 headsize byte. 直接読めるなら 0.
+   圧縮されたものや PNG, pixperbyte が形式と合わないものは RAWD_ERR_HEADER */
+int direct_probe(const uint8_t* head, size_t headsize, uint64_t filesize, direct_source_t& src);
+
+/* src の pixel 列を dst (1 行 row_pitch byte) へ読む要求を reads の後ろに足し、 足した数を返す.
+   ファイルの pitch が row_pitch と同じなら 1 個、 違えば行ごと. reads の capacity が足りていれば allocation はしない */
+size_t direct_requests(const direct_source_t& src, io_file_t f, uint8_t* dst, size_t row_pitch, std::vector< io_request_t >& reads);
+
+/* fname を map して src の pixel 列を checksum と照合する. 直前に読んだばかりなら page cache から読むだけで済む.
+   checksum が無ければ何もしない. 合わなければ RAWD_ERR_CHECKSUM, 開けないか短ければ RAWD_ERR_OPEN / RAWD_ERR_TRUNCATED */
+int direct_verify(const direct_source_t& src, const std::wstring& fname);
+
+#endif
@@ -0,0 +1,105 @@
+/**
+ * (C) roentgen 
+ * this code is licensed under the MIT License.
+ */
+#include "footprint.hpp"
+#include "rawd.hpp"
+#include <algorithm>
+
+static const uint64_t INVALID = ~0ULL;
+
+static inline uint64_t align_up64(uint64_t v, uint64_t align)
+{
+    return (v + align - 1) & ~(align - 1);
+}
+
+footprint_desc_t footprint_tex2d(uint32_t format, uint64_t width, uint32_t height, uint32_t mips, uint32_t array)
+{
+    /* RGBA8 は rawd_format_bytes() では 0 (header を信じる) */
+    const uint32_t bytes = format == RAWD_FORMAT_RGBA8 ? 4 : rawd_format_bytes(format);
+    footprint_desc_t d = {FOOTPRINT_TEXTURE2D, width, height, array, mips, rawd_block_dim(format), bytes};
+    return d;
+}
+
+footprint_desc_t footprint_buffer(uint64_t bytes)
+{
+    footprint_desc_t d = {FOOTPRINT_BUFFER, bytes, 1, 1, 1, 1, 1};
+    return d;
+}
+
+uint32_t footprint_mips(const footprint_desc_t& desc)
+{
+    if (desc.dimension == FOOTPRINT_BUFFER)
+        return 1;
+    uint64_t size = std::max< uint64_t >(desc.width, desc.height);
+    if (desc.dimension == FOOTPRINT_TEXTURE3D)
+        size = std::max< uint64_t >(size, desc.depth_or_array);
+    uint32_t full = 1;
+    while (size > 1) {
+        size >>= 1;
+        full ++;
+    }
+    return desc.mips ? desc.mips : full;
+}
+
+uint32_t footprint_subresources(const footprint_desc_t& desc)
+{
+    if (desc.dimension == FOOTPRINT_BUFFER)
+        return 1;
+    const uint32_t slices = desc.dimension == FOOTPRINT_TEXTURE3D ? 1 : desc.depth_or_array;
+    return footprint_mips(desc) * slices;
+}
+
+uint64_t footprint_layout(const footprint_desc_t& desc, uint32_t first, uint32_t n, uint64_t base, subresource_footprint_t* out)
+{
+    if (desc.dimension > FOOTPRINT_TEXTURE3D || !desc.width || !desc.block_dim || !desc.block_bytes)
+        return INVALID;
+    if (desc.dimension != FOOTPRINT_BUFFER && (!desc.height || !desc.depth_or_array))
+        return INVALID;
+    const uint32_t count = footprint_subresources(desc);
+    if (first >= count || n > count - first)
+        return INVALID;
+
+    if (desc.dimension == FOOTPRINT_BUFFER) {
+        if (out) {
+            subresource_footprint_t& f = out[0];
+            f.offset = base;
+            f.width = static_cast< uint32_t >(desc.width);
+            f.height = 1;
+            f.depth = 1;
+            f.row_pitch = footprint_row_pitch(desc.width);
+            f.rows = 1;
+            f.row_bytes = desc.width;
+        }
+        return desc.width;
+    }
+
+    const uint32_t mips = footprint_mips(desc);
+    const uint32_t dim = desc.block_dim;
+    uint64_t offset = 0;
+    uint64_t total = 0;
+    for (uint32_t i = 0; i < n; i ++) {
+        const uint32_t mip = (first + i) % mips;
+        const uint64_t w = std::max< uint64_t >(desc.width >> mip, 1);
+        const uint32_t h = desc.dimension == FOOTPRINT_TEXTURE1D ? 1 : std::max< uint32_t >(desc.height >> mip, 1);
+        const uint32_t d = desc.dimension == FOOTPRINT_TEXTURE3D ? std::max< uint32_t >(desc.depth_or_array >> mip, 1) : 1;
+        const uint64_t blocks = (w + dim - 1) / dim;
+        const uint32_t rows = (h + dim - 1) / dim;
+        const uint64_t row_bytes = blocks * desc.block_bytes;
+        const uint32_t pitch = footprint_row_pitch(row_bytes);
+        if (i)
+            offset = align_up64(total, FOOTPRINT_PLACEMENT_ALIGNMENT);
+        total = offset + static_cast< uint64_t >(pitch) * (static_cast< uint64_t >(rows) * d - 1) + row_bytes;
+        if (out) {
+            subresource_footprint_t& f = out[i];
+            f.offset = base + offset;
+            f.width = static_cast< uint32_t >(blocks * dim);
+            f.height = rows * dim;
+            f.depth = d;
+            f.row_pitch = pitch;
+            f.rows = rows;
+            f.row_bytes = row_bytes;
+        }
+    }
+    return total;
+}
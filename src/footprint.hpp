@@ -0,0 +1,70 @@
+/**
+ * (C) roentgen 
+ * this code is licensed under the MIT License.
+ */
+#if !defined(FOOTPRINT_HPP__)
+#define FOOTPRINT_HPP__
+
+#include <stdint.h>
+#include <stddef.h>
+
+/* ID3D12Device::GetCopyableFootprints() と同じ配置を device 無しで計算する. D3D12 には依存しない.
+   cooker が payload を upload heap と同じ並びで書いておけば、 runtime はそれをまとめて 1 回コピーするだけでよい.
+
+   - 行は FOOTPRINT_PITCH_ALIGNMENT (256) byte 境界, 各 subresource の先頭は FOOTPRINT_PLACEMENT_ALIGNMENT (512) byte 境界
+   - block 圧縮の形式は幅と高さを block に揃え、 行は block の行で数える
+   - subresource の番号は D3D12 と同じく mip + array * mips (3D は depth ごとに分けず、 slice を行の塊として並べる)
+   - total は最後の subresource の最後の行の終わりまで (パディングを含まない) で、 base は含まない
+   plane が複数ある形式 (NV12 など) は扱わない */
+
+#define FOOTPRINT_PITCH_ALIGNMENT     (256) /* D3D12_TEXTURE_DATA_PITCH_ALIGNMENT */
+#define FOOTPRINT_PLACEMENT_ALIGNMENT (512) /* D3D12_TEXTURE_DATA_PLACEMENT_ALIGNMENT */
+
+enum footprint_dimension_t {
+    FOOTPRINT_BUFFER = 0,
+    FOOTPRINT_TEXTURE1D = 1,
+    FOOTPRINT_TEXTURE2D = 2,
+    FOOTPRINT_TEXTURE3D = 3,
+};
+
+/* D3D12_RESOURCE_DESC のうち配置に効くところ */
+struct footprint_desc_t {
+    uint32_t dimension;      /* FOOTPRINT_* */
+    uint64_t width;          /* buffer なら byte 数 */
+    uint32_t height;
+    uint32_t depth_or_array; /* 3D なら depth, それ以外は array の数 */
+    uint32_t mips;           /* 0 なら 1x1 までの全部 */
+    uint32_t block_dim;      /* 圧縮の block の幅と高さ (非圧縮は 1) */
+    uint32_t block_bytes;    /* block (非圧縮なら texel) あたりの byte 数 */
+};
+
+/* D3D12_PLACED_SUBRESOURCE_FOOTPRINT と NumRows, RowSizeInBytes をまとめたもの */
+struct subresource_footprint_t {
+    uint64_t offset;
+    uint32_t width;     /* block に揃えた texel 数 */
+    uint32_t height;
+    uint32_t depth;
+    uint32_t row_pitch;
+    uint32_t rows;      /* 1 slice の行の数 (block の行) */
+    uint64_t row_bytes; /* 1 行の意味のある byte 数 */
+};
+
+/* format (RAWD_FORMAT_*) の 2D texture */
+footprint_desc_t footprint_tex2d(uint32_t format, uint64_t width, uint32_t height, uint32_t mips = 1, uint32_t array = 1);
+footprint_desc_t footprint_buffer(uint64_t bytes);
+
+/* 0 なら 1x1 までの数に直した mips */
+uint32_t footprint_mips(const footprint_desc_t& desc);
+/* subresource の総数 */
+uint32_t footprint_subresources(const footprint_desc_t& desc);
+
+inline uint32_t footprint_row_pitch(uint64_t row_bytes)
+{
+    return static_cast< uint32_t >((row_bytes + FOOTPRINT_PITCH_ALIGNMENT - 1) & ~static_cast< uint64_t >(FOOTPRINT_PITCH_ALIGNMENT - 1));
+}
+
+/* first から n 個の subresource の配置を out に書いて total を返す. out は nullptr でもよい.
+   範囲が subresource の数を超えるか desc がおかしければ、 D3D12 と同じく UINT64_MAX (~0) を返す */
+uint64_t footprint_layout(const footprint_desc_t& desc, uint32_t first, uint32_t n, uint64_t base, subresource_footprint_t* out);
+
+#endif
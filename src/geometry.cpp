@@ -0,0 +1,208 @@
+/**
+ * (C) roentgen 
+ * this code is licensed under the MIT License.
+ */
+#include "stdafx.h"
+#include "geometry.hpp"
+#include "wccopy.hpp"
+#include "dbgutils.hpp"
+#include <algorithm>
+
+using namespace Microsoft::WRL;
+
+static inline uint64_t align_up(uint64_t v, uint64_t align)
+{
+    return (v + align - 1) & ~(align - 1);
+}
+
+geometry_pool_t::~geometry_pool_t()
+{
+    timeline_.stop();
+}
+
+int geometry_pool_t::init(uniq_device_t& u, uint64_t block_size, uint64_t staging_size, placed_heap_t* heap)
+{
+    u_ = &u;
+    heap_ = heap;
+    block_size_ = align_up(std::max< uint64_t >(block_size, 1), D3D12_DEFAULT_RESOURCE_PLACEMENT_ALIGNMENT);
+    staging_size_ = align_up(std::max< uint64_t >(staging_size, 1), D3D12_DEFAULT_RESOURCE_PLACEMENT_ALIGNMENT);
+    auto hr = u.dev()->CreateFence(0, D3D12_FENCE_FLAG_NONE, IID_PPV_ARGS(&fence_));
+    if (FAILED(hr)) {
+        ABT("failed to create fence for geometry: err:0x%x\n", hr);
+        return -1;
+    }
+    fence_value_ = 0;
+    return timeline_.start(fence_);
+}
+
+HRESULT geometry_pool_t::create_buffer(uint64_t size, D3D12_HEAP_TYPE type, D3D12_RESOURCE_STATES state, ComPtr< ID3D12Resource >& out)
+{
+    auto desc = setup_buffer(size);
+    if (heap_)
+        return heap_->create(desc, type, state, nullptr, out);
+    auto prop = setup_heapprop(type);
+    return u_->dev()->CreateCommittedResource(&prop, D3D12_HEAP_FLAG_NONE, &desc, state, nullptr, IID_PPV_ARGS(&out));
+}
+
+/* 先頭の block から順に、末尾の空きに入るところ. どこにも入らなければ block を足す */
+bool geometry_pool_t::place(uint64_t size, uint64_t align, block_t*& block, uint64_t& offset)
+{
+    for (auto& b : blocks_) {
+        const uint64_t off = align_up(b.used, align);
+        if (off + size <= b.size) {
+            b.used = off + size;
+            block = &b;
+            offset = off;
+            return true;
+        }
+    }
+    block_t b;
+    b.size = std::max(block_size_, align_up(size, D3D12_DEFAULT_RESOURCE_PLACEMENT_ALIGNMENT));
+    b.used = size;
+    auto hr = create_buffer(b.size, D3D12_HEAP_TYPE_DEFAULT, D3D12_RESOURCE_STATE_COMMON, b.buf);
+    if (FAILED(hr)) {
+        ABT("failed to create geometry block: err:0x%x\n", hr);
+        return false;
+    }
+    NAME_OBJ(b.buf);
+    blocks_.push_back(b);
+    block = &blocks_.back();
+    offset = 0;
+    return true;
+}
+
+/* mtx_ を持って呼ぶ. ring から size byte を取り、書き込み先を返す.
+   埋まっていれば submit 済みの一番古い区間の fence を待つ. submit されていない区間で埋まっているか
+   ring より大きければ、その mesh だけの UPLOAD buffer を作って次の fence まで持つ */
+uint8_t* geometry_pool_t::stage(uint64_t size, ID3D12Resource*& src, uint64_t& srcoffset)
+{
+    if (!staging_) {
+        auto hr = create_buffer(staging_size_, D3D12_HEAP_TYPE_UPLOAD, D3D12_RESOURCE_STATE_GENERIC_READ, staging_);
+        if (FAILED(hr)) {
+            ABT("failed to create geometry staging: err:0x%x\n", hr);
+            return nullptr;
+        }
+        NAME_OBJ(staging_);
+        D3D12_RANGE readrange = {0, 0};
+        staging_->Map(0, &readrange, reinterpret_cast< void** >(&staging_ptr_));
+        ring_.reset(staging_size_);
+    }
+    ring_.retire(fence_->GetCompletedValue());
+    uint64_t offset = 0;
+    uint64_t ticket = 0;
+    bool ok = ring_.alloc(size, 16, offset, ticket);
+    uint64_t oldest = 0;
+    while (!ok && ring_.oldest(oldest) && oldest) {
+        fence_->SetEventOnCompletion(oldest, nullptr);
+        ring_.retire(oldest);
+        ok = ring_.alloc(size, 16, offset, ticket);
+    }
+    if (ok) {
+        tickets_.push_back(ticket);
+        staging_peak_ = std::max(staging_peak_, ring_.used());
+        src = staging_.Get();
+        srcoffset = offset;
+        return staging_ptr_ + offset;
+    }
+    ComPtr< ID3D12Resource > buf;
+    auto hr = create_buffer(size, D3D12_HEAP_TYPE_UPLOAD, D3D12_RESOURCE_STATE_GENERIC_READ, buf);
+    if (FAILED(hr)) {
+        ABT("failed to create geometry staging: err:0x%x\n", hr);
+        return nullptr;
+    }
+    uint8_t* ptr = nullptr;
+    D3D12_RANGE readrange = {0, 0};
+    buf->Map(0, &readrange, reinterpret_cast< void** >(&ptr));
+    overflow_.push_back(buf);
+    src = buf.Get();
+    srcoffset = 0;
+    return ptr;
+}
+
+D3D12_GPU_VIRTUAL_ADDRESS geometry_pool_t::upload(ID3D12GraphicsCommandList* cmdlist, const void* data, uint64_t size, uint64_t align)
+{
+    if (!data || !size)
+        return 0;
+    std::lock_guard< std::mutex > lock(mtx_);
+    block_t* block = nullptr;
+    uint64_t offset = 0;
+    if (!place(size, align, block, offset))
+        return 0;
+    ID3D12Resource* src = nullptr;
+    uint64_t srcoffset = 0;
+    uint8_t* ptr = stage(size, src, srcoffset);
+    if (!ptr)
+        return 0;
+    wc_copy(ptr, data, static_cast< size_t >(size));
+    cmdlist->CopyBufferRegion(block->buf.Get(), offset, src, srcoffset, size);
+    meshes_ ++;
+    bytes_ += size;
+    committed_ += 2 * align_up(size, D3D12_DEFAULT_RESOURCE_PLACEMENT_ALIGNMENT);
+    return block->buf->GetGPUVirtualAddress() + offset;
+}
+
+D3D12_VERTEX_BUFFER_VIEW geometry_pool_t::upload_vertices(ID3D12GraphicsCommandList* cmdlist, const void* v, uint32_t stride, uint32_t count)
+{
+    const uint64_t size = static_cast< uint64_t >(stride) * count;
+    D3D12_VERTEX_BUFFER_VIEW vbv = {};
+    vbv.BufferLocation = upload(cmdlist, v, size);
+    vbv.StrideInBytes = stride;
+    vbv.SizeInBytes = vbv.BufferLocation ? static_cast< UINT >(size) : 0;
+    return vbv;
+}
+
+D3D12_INDEX_BUFFER_VIEW geometry_pool_t::upload_indices(ID3D12GraphicsCommandList* cmdlist, const void* idx, DXGI_FORMAT format, uint32_t count)
+{
+    const uint64_t size = static_cast< uint64_t >(format == DXGI_FORMAT_R32_UINT ? 4 : 2) * count;
+    D3D12_INDEX_BUFFER_VIEW ibv = {};
+    ibv.BufferLocation = upload(cmdlist, idx, size);
+    ibv.Format = format;
+    ibv.SizeInBytes = ibv.BufferLocation ? static_cast< UINT >(size) : 0;
+    return ibv;
+}
+
+/* ring の区間に fence を付け、 達したら返す. ring が空になれば staging を捨てて、その時点の結果を出す */
+uint64_t geometry_pool_t::submitted(ID3D12CommandQueue* queue)
+{
+    std::lock_guard< std::mutex > lock(mtx_);
+    const uint64_t value = ++ fence_value_;
+    queue->Signal(fence_.Get(), value);
+    for (auto t : tickets_)
+        ring_.set_fence(t, value);
+    tickets_.clear();
+    /* std::function は copy できるものしか持てないので shared_ptr に包む */
+    auto overflow = std::make_shared< std::vector< ComPtr< ID3D12Resource > > >(std::move(overflow_));
+    overflow_.clear();
+    timeline_.when(value, [this, value, overflow] {
+            overflow->clear();
+            bool released = false;
+            {
+                std::lock_guard< std::mutex > lock(mtx_);
+                ring_.retire(value);
+                if (staging_ && ring_.used() == 0 && tickets_.empty()) {
+                    staging_->Unmap(0, nullptr);
+                    staging_.Reset();
+                    staging_ptr_ = nullptr;
+                    released = true;
+                }
+            }
+            if (released) {
+                releases_ ++;
+                report();
+            }
+        });
+    return value;
+}
+
+void geometry_pool_t::report()
+{
+    std::lock_guard< std::mutex > lock(mtx_);
+    uint64_t blocks = 0;
+    for (auto& b : blocks_)
+        blocks += b.size;
+    const uint64_t held = blocks + (staging_ ? staging_size_ : 0);
+    INF("geometry: %lld meshes %lld bytes in %lld blocks (%lld bytes), staging peak %lld bytes (released %lld times)\n",
+        meshes_, bytes_, static_cast< uint64_t >(blocks_.size()), blocks, staging_peak_, releases_.load());
+    INF("geometry: %lld bytes held vs %lld bytes as committed buffers per mesh, saved %lld bytes\n",
+        held, committed_, static_cast< int64_t >(committed_) - static_cast< int64_t >(held));
+}
@@ -0,0 +1,77 @@
+/**
+ * (C) roentgen 
+ * this code is licensed under the MIT License.
+ */
+#if !defined(GEOMETRY_HPP__)
+#define GEOMETRY_HPP__
+
+#include "uniq_device.hpp"
+#include "ringalloc.hpp"
+#include "timeline.hpp"
+#include "placedheap.hpp"
+#include <stdint.h>
+#include <vector>
+#include <mutex>
+#include <memory>
+#include <atomic>
+
+/* 頂点と index を少数の大きな DEFAULT buffer (block) から切り出して置く.
+   中身は共有の staging (UPLOAD の ring) に書いて、呼び出し元の cmdlist に CopyBufferRegion() を記録する.
+   cmdlist を Execute したら submitted() を呼ぶ. fence に達した区間は ring に返り、 ring が空になれば staging ごと捨てる.
+   block は COMMON で作るので、 copy で COPY_DEST に昇格し、 Execute が終われば COMMON に戻ってから
+   頂点/index として読まれる (barrier は要らないが、 copy と同じ cmdlist では描かないこと).
+   mesh ごとに解放はしない. block は pool と一緒に捨てる */
+class geometry_pool_t {
+    struct block_t {
+        Microsoft::WRL::ComPtr< ID3D12Resource > buf;
+        uint64_t size;
+        uint64_t used;
+    };
+    uniq_device_t* u_;
+    placed_heap_t* heap_; /* nullptr なら buffer は committed */
+    uint64_t block_size_;
+    uint64_t staging_size_;
+    std::vector< block_t > blocks_;
+    std::mutex mtx_; /* staging_ は timeline の継続からも捨てる */
+    Microsoft::WRL::ComPtr< ID3D12Resource > staging_; /* map したままの UPLOAD buffer. 使っていなければ空 */
+    uint8_t* staging_ptr_;
+    ring_allocator_t ring_;
+    std::vector< uint64_t > tickets_; /* 記録したがまだ submitted() されていない ring の区間 */
+    std::vector< Microsoft::WRL::ComPtr< ID3D12Resource > > overflow_; /* ring に入らなかった分の UPLOAD buffer */
+    Microsoft::WRL::ComPtr< ID3D12Fence > fence_;
+    uint64_t fence_value_;
+    uint64_t meshes_;
+    uint64_t bytes_;
+    uint64_t committed_; /* mesh ごとに DEFAULT と UPLOAD を committed で作っていた時の大きさ */
+    uint64_t staging_peak_;
+    std::atomic< uint64_t > releases_;
+    fence_timeline_t timeline_;
+
+    bool place(uint64_t size, uint64_t align, block_t*& block, uint64_t& offset);
+    uint8_t* stage(uint64_t size, ID3D12Resource*& src, uint64_t& srcoffset);
+    HRESULT create_buffer(uint64_t size, D3D12_HEAP_TYPE type, D3D12_RESOURCE_STATES state, Microsoft::WRL::ComPtr< ID3D12Resource >& out);
+
+public:
+    geometry_pool_t() : u_(nullptr), heap_(nullptr), block_size_(0), staging_size_(0), staging_ptr_(nullptr), fence_value_(0), meshes_(0), bytes_(0), committed_(0), staging_peak_(0), releases_(0) {}
+    ~geometry_pool_t();
+    geometry_pool_t(const geometry_pool_t&) = delete;
+    geometry_pool_t& operator=(const geometry_pool_t&) = delete;
+
+    /* block_size より大きい mesh はそれだけの block を作る. staging_size は ring の大きさ.
+       heap があれば block と staging はそこから切り出す (pool より長生きさせること) */
+    int init(uniq_device_t& u, uint64_t block_size = uint64_t(4) << 20, uint64_t staging_size = uint64_t(1) << 20, placed_heap_t* heap = nullptr);
+
+    /* size byte を align に揃えて置き、 copy を cmdlist に記録する. 置いた場所の GPU VA (失敗すれば 0) */
+    D3D12_GPU_VIRTUAL_ADDRESS upload(ID3D12GraphicsCommandList* cmdlist, const void* data, uint64_t size, uint64_t align = 16);
+    D3D12_VERTEX_BUFFER_VIEW upload_vertices(ID3D12GraphicsCommandList* cmdlist, const void* v, uint32_t stride, uint32_t count);
+    /* format は DXGI_FORMAT_R16_UINT か DXGI_FORMAT_R32_UINT */
+    D3D12_INDEX_BUFFER_VIEW upload_indices(ID3D12GraphicsCommandList* cmdlist, const void* idx, DXGI_FORMAT format, uint32_t count);
+
+    /* upload() を記録した cmdlist を queue に Execute した後に呼ぶ. fence を打ち、達したら staging を返す */
+    uint64_t submitted(ID3D12CommandQueue* queue);
+
+    /* mesh ごとに committed buffer を作った場合と比べてどれだけ減ったか */
+    void report();
+};
+
+#endif
@@ -0,0 +1,17 @@
+/**
+ * (C) roentgen 
+ * this code is licensed under the MIT License.
+ */
+#if !defined(HASH_HPP__)
+#define HASH_HPP__
+
+#include <stdint.h>
+#include <stddef.h>
+
+/* 内容の同一性と破損を見るための hash. D3D12 には依存しない.
+   名前の hash (rawa_name_hash) と違って MB 単位の payload を流すので 32 byte ずつ 4 lane で回す */
+
+/* XXH64. 出力は本家の xxHash と同じ */
+uint64_t xxh64(const void* data, size_t size, uint64_t seed = 0);
+
+#endif
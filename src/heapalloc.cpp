@@ -0,0 +1,283 @@
+/**
+ * (C) roentgen 
+ * this code is licensed under the MIT License.
+ */
+#include "heapalloc.hpp"
+#include <algorithm>
+
+#if defined(_MSC_VER)
+#include <intrin.h>
+#endif
+
+static inline uint64_t align_up(uint64_t v, uint64_t align)
+{
+    return (v + align - 1) & ~(align - 1);
+}
+
+/* 立っている一番上/下の bit の位置. v は 0 でないこと */
+static inline uint32_t msb64(uint64_t v)
+{
+#if defined(_MSC_VER)
+    unsigned long i;
+    _BitScanReverse64(&i, v);
+    return i;
+#else
+    return 63 - __builtin_clzll(v);
+#endif
+}
+
+static inline uint32_t lsb64(uint64_t v)
+{
+#if defined(_MSC_VER)
+    unsigned long i;
+    _BitScanForward64(&i, v);
+    return i;
+#else
+    return __builtin_ctzll(v);
+#endif
+}
+
+/* size が入る list. 第 2 段は最上位 bit の下の SL_BITS bit */
+static inline void mapping(uint64_t size, uint32_t sl_bits, uint32_t& fl, uint32_t& sl)
+{
+    fl = msb64(size);
+    sl = static_cast< uint32_t >(size >> (fl - sl_bits)) & ((1u << sl_bits) - 1);
+}
+
+const uint32_t tlsf_allocator_t::NONE;
+const uint64_t tlsf_allocator_t::GRANULE;
+
+void tlsf_allocator_t::reset(uint64_t capacity)
+{
+    nodes_.clear();
+    spare_.clear();
+    for (uint32_t i = 0; i < FL_COUNT; i ++) {
+        sl_bitmap_[i] = 0;
+        for (uint32_t j = 0; j < SL_COUNT; j ++)
+            heads_[i][j] = NONE;
+    }
+    fl_bitmap_ = 0;
+    capacity_ = capacity & ~(GRANULE - 1);
+    used_ = 0;
+    count_ = 0;
+    if (!capacity_)
+        return;
+    const uint32_t n = new_node();
+    node_t& node = nodes_[n];
+    node.offset = 0;
+    node.size = capacity_;
+    node.prev_phys = NONE;
+    node.next_phys = NONE;
+    insert_free(n);
+}
+
+uint32_t tlsf_allocator_t::new_node()
+{
+    if (!spare_.empty()) {
+        const uint32_t n = spare_.back();
+        spare_.pop_back();
+        return n;
+    }
+    nodes_.push_back(node_t());
+    return static_cast< uint32_t >(nodes_.size() - 1);
+}
+
+void tlsf_allocator_t::insert_free(uint32_t n)
+{
+    node_t& node = nodes_[n];
+    uint32_t fl, sl;
+    mapping(node.size, SL_BITS, fl, sl);
+    node.free = true;
+    node.prev_free = NONE;
+    node.next_free = heads_[fl][sl];
+    if (node.next_free != NONE)
+        nodes_[node.next_free].prev_free = n;
+    heads_[fl][sl] = n;
+    fl_bitmap_ |= uint64_t(1) << fl;
+    sl_bitmap_[fl] |= 1u << sl;
+}
+
+void tlsf_allocator_t::remove_free(uint32_t n)
+{
+    node_t& node = nodes_[n];
+    uint32_t fl, sl;
+    mapping(node.size, SL_BITS, fl, sl);
+    if (node.prev_free != NONE)
+        nodes_[node.prev_free].next_free = node.next_free;
+    else
+        heads_[fl][sl] = node.next_free;
+    if (node.next_free != NONE)
+        nodes_[node.next_free].prev_free = node.prev_free;
+    if (heads_[fl][sl] == NONE) {
+        sl_bitmap_[fl] &= ~(1u << sl);
+        if (!sl_bitmap_[fl])
+            fl_bitmap_ &= ~(uint64_t(1) << fl);
+    }
+    node.free = false;
+}
+
+/* align を含めて size 以上が必ず入っている一番小さい list の先頭.
+   無ければ (満杯に近い時) size の入る list から上を順に見て、 揃えても収まる区間を探す */
+uint32_t tlsf_allocator_t::find_free(uint64_t size, uint64_t align) const
+{
+    uint32_t fl, sl;
+    const uint64_t need = size + align - GRANULE; /* 区間の先頭は GRANULE に揃っているので、前を削るのは多くてもこれだけ */
+    const uint64_t round = need + (uint64_t(1) << (msb64(need) - SL_BITS)) - 1;
+    if (round >= need) {
+        mapping(round, SL_BITS, fl, sl);
+        uint32_t slmap = sl_bitmap_[fl] & (~0u << sl);
+        if (!slmap) {
+            const uint64_t flmap = fl + 1 < FL_COUNT ? fl_bitmap_ & (~uint64_t(0) << (fl + 1)) : 0;
+            if (flmap) {
+                fl = lsb64(flmap);
+                slmap = sl_bitmap_[fl];
+            }
+        }
+        if (slmap)
+            return heads_[fl][lsb64(slmap)];
+    }
+    mapping(size, SL_BITS, fl, sl);
+    for (; fl < FL_COUNT; fl ++, sl = 0) {
+        for (uint32_t slmap = sl_bitmap_[fl] & (~0u << sl); slmap; slmap &= slmap - 1) {
+            for (uint32_t n = heads_[fl][lsb64(slmap)]; n != NONE; n = nodes_[n].next_free) {
+                const node_t& node = nodes_[n];
+                if (align_up(node.offset, align) + size <= node.offset + node.size)
+                    return n;
+            }
+        }
+    }
+    return NONE;
+}
+
+/* 使用中の n を size byte にして、前 (front) か後ろの余りを空き区間として切り出す */
+void tlsf_allocator_t::split(uint32_t n, uint64_t size, bool front)
+{
+    const uint32_t r = new_node(); /* nodes_ が伸びるので参照はこの後で取る */
+    node_t& node = nodes_[n];
+    node_t& rest = nodes_[r];
+    rest.size = node.size - size;
+    node.size = size;
+    if (front) {
+        rest.offset = node.offset;
+        node.offset += rest.size;
+        rest.prev_phys = node.prev_phys;
+        rest.next_phys = n;
+        if (node.prev_phys != NONE)
+            nodes_[node.prev_phys].next_phys = r;
+        node.prev_phys = r;
+    }
+    else {
+        rest.offset = node.offset + size;
+        rest.prev_phys = n;
+        rest.next_phys = node.next_phys;
+        if (node.next_phys != NONE)
+            nodes_[node.next_phys].prev_phys = r;
+        node.next_phys = r;
+    }
+    insert_free(r);
+}
+
+bool tlsf_allocator_t::alloc(uint64_t size, uint64_t align, uint64_t& offset, uint32_t& handle)
+{
+    if (!size || size > capacity_)
+        return false;
+    size = align_up(size, GRANULE);
+    align = std::max(align, GRANULE);
+    const uint32_t n = find_free(size, align);
+    if (n == NONE)
+        return false;
+    remove_free(n);
+    const uint64_t gap = align_up(nodes_[n].offset, align) - nodes_[n].offset;
+    if (gap)
+        split(n, nodes_[n].size - gap, true);
+    if (nodes_[n].size > size)
+        split(n, size, false);
+    used_ += size;
+    count_ ++;
+    offset = nodes_[n].offset;
+    handle = n;
+    return true;
+}
+
+void tlsf_allocator_t::free(uint32_t handle)
+{
+    if (handle >= nodes_.size() || nodes_[handle].free)
+        return;
+    uint32_t n = handle;
+    used_ -= nodes_[n].size;
+    count_ --;
+    /* 前の空き区間に自分をつなぐ */
+    const uint32_t prev = nodes_[n].prev_phys;
+    if (prev != NONE && nodes_[prev].free) {
+        remove_free(prev);
+        nodes_[prev].size += nodes_[n].size;
+        nodes_[prev].next_phys = nodes_[n].next_phys;
+        if (nodes_[n].next_phys != NONE)
+            nodes_[nodes_[n].next_phys].prev_phys = prev;
+        nodes_[n].free = true; /* spare も二重 free しないように free 扱い */
+        spare_.push_back(n);
+        n = prev;
+    }
+    /* 後ろの空き区間を自分につなぐ */
+    const uint32_t next = nodes_[n].next_phys;
+    if (next != NONE && nodes_[next].free) {
+        remove_free(next);
+        nodes_[n].size += nodes_[next].size;
+        nodes_[n].next_phys = nodes_[next].next_phys;
+        if (nodes_[next].next_phys != NONE)
+            nodes_[nodes_[next].next_phys].prev_phys = n;
+        nodes_[next].free = true;
+        spare_.push_back(next);
+    }
+    insert_free(n);
+}
+
+uint64_t tlsf_allocator_t::largest_free() const
+{
+    if (!fl_bitmap_)
+        return 0;
+    const uint32_t fl = msb64(fl_bitmap_);
+    const uint32_t sl = msb64(sl_bitmap_[fl]);
+    uint64_t largest = 0;
+    for (uint32_t n = heads_[fl][sl]; n != NONE; n = nodes_[n].next_free)
+        largest = std::max(largest, nodes_[n].size);
+    return largest;
+}
+
+void heap_suballocator_t::reset(uint32_t categories)
+{
+    blocks_.clear();
+    blocks_.resize(categories);
+}
+
+bool heap_suballocator_t::alloc(uint32_t category, uint64_t size, uint64_t align, heap_allocation_t& a)
+{
+    if (category >= blocks_.size())
+        return false;
+    auto& list = blocks_[category];
+    for (uint32_t b = 0; b < list.size(); b ++) {
+        if (list[b]->capacity() - list[b]->used() < size)
+            continue;
+        if (list[b]->alloc(size, align, a.offset, a.handle)) {
+            a.category = category;
+            a.block = b;
+            a.size = size;
+            return true;
+        }
+    }
+    return false;
+}
+
+uint32_t heap_suballocator_t::add_block(uint32_t category, uint64_t capacity)
+{
+    std::unique_ptr< tlsf_allocator_t > b(new tlsf_allocator_t());
+    b->reset(capacity);
+    blocks_[category].push_back(std::move(b));
+    return static_cast< uint32_t >(blocks_[category].size() - 1);
+}
+
+void heap_suballocator_t::free(const heap_allocation_t& a)
+{
+    if (a.category < blocks_.size() && a.block < blocks_[a.category].size())
+        blocks_[a.category][a.block]->free(a.handle);
+}
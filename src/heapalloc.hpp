@@ -0,0 +1,97 @@
+/**
+ * (C) roentgen 
+ * this code is licensed under the MIT License.
+ */
+#if !defined(HEAPALLOC_HPP__)
+#define HEAPALLOC_HPP__
+
+#include <stdint.h>
+#include <stddef.h>
+#include <vector>
+#include <memory>
+
+/* heap の中の offset を配る TLSF (two-level segregated fit). D3D12 には依存しない (どの heap かは知らない).
+   空き区間を大きさの 2 のべき (第 1 段) とそれを 16 等分したもの (第 2 段) の list に分けて持ち、
+   bitmap で空いている list を探すので、 alloc も free も区間の数によらずほぼ一定の時間で済む.
+   隣り合う空き区間は free で必ずつなぐ. 大きさと offset は GRANULE (256 byte) 単位に揃える */
+class tlsf_allocator_t {
+public:
+    static const uint32_t NONE = ~0u;
+    static const uint64_t GRANULE = 256;
+
+private:
+    enum { SL_BITS = 4, SL_COUNT = 1 << SL_BITS, FL_COUNT = 64 };
+    struct node_t {
+        uint64_t offset;
+        uint64_t size;
+        uint32_t prev_phys; /* offset の並びで隣の区間 */
+        uint32_t next_phys;
+        uint32_t prev_free; /* 同じ list の空き区間 */
+        uint32_t next_free;
+        bool free;
+    };
+    std::vector< node_t > nodes_;
+    std::vector< uint32_t > spare_; /* つないで要らなくなった node */
+    uint32_t heads_[FL_COUNT][SL_COUNT];
+    uint64_t fl_bitmap_;
+    uint32_t sl_bitmap_[FL_COUNT];
+    uint64_t capacity_;
+    uint64_t used_;
+    uint32_t count_;
+
+    uint32_t new_node();
+    void insert_free(uint32_t n);
+    void remove_free(uint32_t n);
+    uint32_t find_free(uint64_t size, uint64_t align) const;
+    void split(uint32_t n, uint64_t size, bool front);
+
+public:
+    tlsf_allocator_t() : fl_bitmap_(0), capacity_(0), used_(0), count_(0) { reset(0); }
+
+    /* 全部を空けて capacity byte (GRANULE 単位に切り捨て) の区間ひとつにする */
+    void reset(uint64_t capacity);
+
+    /* size byte を align (2 のべき) に揃えて取る. handle は free() に渡す. 入らなければ false */
+    bool alloc(uint64_t size, uint64_t align, uint64_t& offset, uint32_t& handle);
+    void free(uint32_t handle);
+
+    uint64_t capacity() const { return capacity_; }
+    uint64_t used() const { return used_; }
+    uint32_t allocations() const { return count_; }
+    /* 一番大きい空き区間. free 全体との比が断片化の目安 */
+    uint64_t largest_free() const;
+};
+
+/* heap_suballocator_t::alloc() の結果. free() にそのまま渡す */
+struct heap_allocation_t {
+    uint32_t category;
+    uint32_t block;
+    uint32_t handle;
+    uint64_t offset;
+    uint64_t size;
+};
+
+/* category (resource の種類と heap の型の組) ごとに block (heap ひとつ) を並べ、 それぞれを TLSF で切り分ける.
+   block を作るのは呼び出し元で、 alloc() が false なら heap を作って add_block() してからもう一度 alloc() する.
+   block は空になっても残して次に使う. lock はしないので呼び出し元が守ること */
+class heap_suballocator_t {
+    std::vector< std::vector< std::unique_ptr< tlsf_allocator_t > > > blocks_;
+
+public:
+    explicit heap_suballocator_t(uint32_t categories = 0) : blocks_(categories) {}
+
+    /* block を全部捨てて category の数を決め直す */
+    void reset(uint32_t categories);
+
+    /* category の block を先頭から見て、入るところに置く */
+    bool alloc(uint32_t category, uint64_t size, uint64_t align, heap_allocation_t& a);
+    /* 新しい block の番号 */
+    uint32_t add_block(uint32_t category, uint64_t capacity);
+    void free(const heap_allocation_t& a);
+
+    uint32_t categories() const { return static_cast< uint32_t >(blocks_.size()); }
+    uint32_t blocks(uint32_t category) const { return static_cast< uint32_t >(blocks_[category].size()); }
+    const tlsf_allocator_t& block(uint32_t category, uint32_t b) const { return *blocks_[category][b]; }
+};
+
+#endif
@@ -0,0 +1,371 @@
+/**
+ * (C) roentgen 
+ * this code is licensed under the MIT License.
+ */
+#include "inflate.hpp"
+#include "simd.hpp"
+#include <string.h>
+#include <algorithm>
+
+#define HUFF_FAST_BITS (10)
+#define HUFF_MAX_BITS  (15)
+#define ADLER_MOD      (65521)
+#define ADLER_NMAX     (5552)    /* 32bit で溢れない最大の byte 数 (16 の倍数) */
+
+static const uint16_t len_base[29] = {3, 4, 5, 6, 7, 8, 9, 10, 11, 13, 15, 17, 19, 23, 27, 31, 35, 43, 51, 59, 67, 83, 99, 115, 131, 163, 195, 227, 258};
+static const uint8_t len_extra[29] = {0, 0, 0, 0, 0, 0, 0, 0, 1, 1, 1, 1, 2, 2, 2, 2, 3, 3, 3, 3, 4, 4, 4, 4, 5, 5, 5, 5, 0};
+static const uint16_t dist_base[30] = {1, 2, 3, 4, 5, 7, 9, 13, 17, 25, 33, 49, 65, 97, 129, 193, 257, 385, 513, 769, 1025, 1537, 2049, 3073, 4097, 6145, 8193, 12289, 16385, 24577};
+static const uint8_t dist_extra[30] = {0, 0, 0, 0, 1, 1, 2, 2, 3, 3, 4, 4, 5, 5, 6, 6, 7, 7, 8, 8, 9, 9, 10, 10, 11, 11, 12, 12, 13, 13};
+
+/* canonical Huffman. 短い符号は fast を 1 回引くだけ、 長い符号は count から 1bit ずつ辿る */
+struct huff_t {
+    uint16_t fast[1 << HUFF_FAST_BITS]; /* (symbol << 4) | 長さ. 0 なら HUFF_FAST_BITS より長い */
+    uint16_t count[HUFF_MAX_BITS + 1];
+    uint16_t symbols[288];
+};
+
+static bool huff_build(huff_t& h, const uint8_t* lengths, int n)
+{
+    memset(h.count, 0, sizeof(h.count));
+    for (int i = 0; i < n; i ++)
+        h.count[lengths[i]] ++;
+    h.count[0] = 0;
+    int left = 1;
+    for (int l = 1; l <= HUFF_MAX_BITS; l ++) {
+        left = (left << 1) - h.count[l];
+        if (left < 0)
+            return false; /* 符号が多すぎる. 足りないのは距離符号 1 個の時などにあるので許す */
+    }
+    uint16_t offset[HUFF_MAX_BITS + 2];
+    uint16_t code[HUFF_MAX_BITS + 1];
+    offset[1] = 0;
+    code[1] = 0;
+    for (int l = 1; l <= HUFF_MAX_BITS; l ++) {
+        offset[l + 1] = static_cast< uint16_t >(offset[l] + h.count[l]);
+        if (l > 1)
+            code[l] = static_cast< uint16_t >((code[l - 1] + h.count[l - 1]) << 1);
+    }
+    memset(h.fast, 0, sizeof(h.fast));
+    for (int s = 0; s < n; s ++) {
+        const int l = lengths[s];
+        if (!l)
+            continue;
+        h.symbols[offset[l] ++] = static_cast< uint16_t >(s);
+        const uint32_t c = code[l] ++;
+        if (l > HUFF_FAST_BITS)
+            continue;
+        /* stream は LSB から読むので符号を反転して引けるようにする */
+        uint32_t r = 0;
+        for (int i = 0; i < l; i ++)
+            r |= ((c >> i) & 1) << (l - 1 - i);
+        for (; r < (1u << HUFF_FAST_BITS); r += 1u << l)
+            h.fast[r] = static_cast< uint16_t >((s << 4) | l);
+    }
+    return true;
+}
+
+/* bits の下位から符号を読み、 symbol を返して len に長さを入れる. 該当しなければ -1 */
+static inline int huff_decode(const huff_t& h, uint64_t bits, int& len)
+{
+    const uint16_t e = h.fast[bits & ((1u << HUFF_FAST_BITS) - 1)];
+    if (e) {
+        len = e & 15;
+        return e >> 4;
+    }
+    int code = 0, first = 0, index = 0;
+    for (int l = 1; l <= HUFF_MAX_BITS; l ++) {
+        code |= static_cast< int >((bits >> (l - 1)) & 1);
+        const int count = h.count[l];
+        if (code - first < count) {
+            len = l;
+            return h.symbols[index + code - first];
+        }
+        index += count;
+        first = (first + count) << 1;
+        code <<= 1;
+    }
+    return -1;
+}
+
+struct fixed_tables_t {
+    huff_t lit;
+    huff_t dist;
+    fixed_tables_t()
+    {
+        uint8_t l[288];
+        memset(l, 8, 144);
+        memset(l + 144, 9, 112);
+        memset(l + 256, 7, 24);
+        memset(l + 280, 8, 8);
+        huff_build(lit, l, 288);
+        memset(l, 5, 30);
+        huff_build(dist, l, 30);
+    }
+};
+
+static const fixed_tables_t& fixed_tables()
+{
+    static const fixed_tables_t t;
+    return t;
+}
+
+/* LSB から読む bit 列. 末尾を越えた分は 0 を読ませておき、 最後に越えていないか確かめる */
+struct bitreader_t {
+    const uint8_t* src;
+    size_t len;
+    size_t pos;     /* 次に bits に入れる byte. len を越えることがある */
+    uint64_t bits;
+    int count;
+
+    inline void refill()
+    {
+        if (pos + 8 <= len) {
+            uint64_t v;
+            memcpy(&v, src + pos, 8);
+            bits |= v << count;
+            pos += (63 - count) >> 3;
+            count |= 56;
+            return;
+        }
+        while (count <= 56) {
+            bits |= static_cast< uint64_t >(pos < len ? src[pos] : 0) << count;
+            pos ++;
+            count += 8;
+        }
+    }
+    inline uint32_t peek(int n) const { return static_cast< uint32_t >(bits & ((uint64_t(1) << n) - 1)); }
+    inline void consume(int n) { bits >>= n; count -= n; }
+    inline uint32_t take(int n) { const uint32_t v = peek(n); consume(n); return v; }
+    /* まだ使っていない byte の位置 */
+    inline size_t tell() const { return pos - static_cast< size_t >(count >> 3); }
+    inline bool overrun() const { return tell() > len; }
+};
+
+static int read_dynamic(bitreader_t& br, huff_t& lit, huff_t& dist)
+{
+    static const uint8_t order[19] = {16, 17, 18, 0, 8, 7, 9, 6, 10, 5, 11, 4, 12, 3, 13, 2, 14, 1, 15};
+    br.refill();
+    const int hlit = static_cast< int >(br.take(5)) + 257;
+    const int hdist = static_cast< int >(br.take(5)) + 1;
+    const int hclen = static_cast< int >(br.take(4)) + 4;
+    if (hlit > 286 || hdist > 30)
+        return INFLATE_ERR_DATA;
+    uint8_t cl[19] = {};
+    for (int i = 0; i < hclen; i ++) {
+        br.refill();
+        cl[order[i]] = static_cast< uint8_t >(br.take(3));
+    }
+    huff_t clh;
+    if (!huff_build(clh, cl, 19))
+        return INFLATE_ERR_DATA;
+    uint8_t lengths[286 + 30];
+    for (int n = 0; n < hlit + hdist; ) {
+        br.refill();
+        int l;
+        const int s = huff_decode(clh, br.bits, l);
+        if (s < 0)
+            return INFLATE_ERR_DATA;
+        br.consume(l);
+        if (s < 16) {
+            lengths[n ++] = static_cast< uint8_t >(s);
+            continue;
+        }
+        int rep;
+        uint8_t v = 0;
+        if (s == 16) {
+            if (n == 0)
+                return INFLATE_ERR_DATA;
+            v = lengths[n - 1];
+            rep = 3 + static_cast< int >(br.take(2));
+        }
+        else if (s == 17) {
+            rep = 3 + static_cast< int >(br.take(3));
+        }
+        else {
+            rep = 11 + static_cast< int >(br.take(7));
+        }
+        if (n + rep > hlit + hdist)
+            return INFLATE_ERR_DATA;
+        memset(lengths + n, v, rep);
+        n += rep;
+    }
+    if (!lengths[256])
+        return INFLATE_ERR_DATA; /* 終端の符号が無い */
+    if (!huff_build(lit, lengths, hlit) || !huff_build(dist, lengths + hlit, hdist))
+        return INFLATE_ERR_DATA;
+    return 0;
+}
+
+static inline void copy16(uint8_t* d, const uint8_t* s)
+{
+#if defined(SIMD_X86)
+    _mm_storeu_si128(reinterpret_cast< __m128i* >(d), _mm_loadu_si128(reinterpret_cast< const __m128i* >(s)));
+#else
+    memcpy(d, s, 16);
+#endif
+}
+
+/* 一致を op に len byte 書く. 余裕があれば (wide) 16 byte 単位で末尾をはみ出して書く */
+static inline void copy_match(uint8_t* op, size_t dist, size_t len, bool wide)
+{
+    const uint8_t* from = op - dist;
+    if (wide && dist >= 16) {
+        for (size_t i = 0; i < len; i += 16)
+            copy16(op + i, from + i);
+    }
+    else if (dist == 1) {
+        memset(op, from[0], len);
+    }
+    else if (wide && dist >= 8) {
+        for (size_t i = 0; i < len; i += 8)
+            memcpy(op + i, from + i, 8);
+    }
+    else {
+        for (size_t i = 0; i < len; i ++)
+            op[i] = from[i];
+    }
+}
+
+static int inflate_block(bitreader_t& br, const huff_t& lit, const huff_t& dist, uint8_t* dst, size_t dstlen, size_t& out)
+{
+    for (;;) {
+        br.refill();
+        int l;
+        int s = huff_decode(lit, br.bits, l);
+        if (s < 0)
+            return INFLATE_ERR_DATA;
+        br.consume(l);
+        if (s < 256) {
+            if (out >= dstlen)
+                return INFLATE_ERR_SPACE;
+            dst[out ++] = static_cast< uint8_t >(s);
+            continue;
+        }
+        if (s == 256)
+            return 0;
+        s -= 257;
+        if (s >= 29)
+            return INFLATE_ERR_DATA;
+        /* 長さ + extra + 距離 + extra で 48bit. refill 1 回で足りる */
+        const size_t len = len_base[s] + br.take(len_extra[s]);
+        const int d = huff_decode(dist, br.bits, l);
+        if (d < 0 || d >= 30)
+            return INFLATE_ERR_DATA;
+        br.consume(l);
+        const size_t dd = dist_base[d] + br.take(dist_extra[d]);
+        if (dd > out)
+            return INFLATE_ERR_DATA;
+        if (len > dstlen - out)
+            return INFLATE_ERR_SPACE;
+        copy_match(dst + out, dd, len, dstlen - out >= len + 16);
+        out += len;
+    }
+}
+
+int64_t zlib_inflate(const uint8_t* src, size_t srclen, uint8_t* dst, size_t dstlen)
+{
+    if (srclen < 6)
+        return INFLATE_ERR_HEADER;
+    const uint32_t cmf = src[0], flg = src[1];
+    if ((cmf & 15) != 8 || (cmf >> 4) > 7 || ((cmf << 8) | flg) % 31 || (flg & 0x20))
+        return INFLATE_ERR_HEADER;
+
+    bitreader_t br = {src, srclen - 4, 2, 0, 0};
+    huff_t lit, dist;
+    size_t out = 0;
+    for (bool last = false; !last; ) {
+        br.refill();
+        last = br.take(1) != 0;
+        const uint32_t type = br.take(2);
+        int err = 0;
+        if (type == 0) {
+            /* 格納: byte 境界に揃えて LEN/NLEN を読む */
+            br.consume(br.count & 7);
+            size_t p = br.tell();
+            br.bits = 0;
+            br.count = 0;
+            if (p + 4 > br.len)
+                return INFLATE_ERR_DATA;
+            const uint32_t len = src[p] | (src[p + 1] << 8);
+            const uint32_t nlen = src[p + 2] | (src[p + 3] << 8);
+            p += 4;
+            if ((len ^ 0xffff) != nlen || p + len > br.len)
+                return INFLATE_ERR_DATA;
+            if (len > dstlen - out)
+                return INFLATE_ERR_SPACE;
+            memcpy(dst + out, src + p, len);
+            out += len;
+            br.pos = p + len;
+        }
+        else if (type == 1) {
+            err = inflate_block(br, fixed_tables().lit, fixed_tables().dist, dst, dstlen, out);
+        }
+        else if (type == 2) {
+            err = read_dynamic(br, lit, dist);
+            if (err == 0)
+                err = inflate_block(br, lit, dist, dst, dstlen, out);
+        }
+        else {
+            err = INFLATE_ERR_DATA;
+        }
+        if (err == 0 && br.overrun())
+            err = INFLATE_ERR_DATA;
+        if (err < 0)
+            return err;
+    }
+    /* 最後の byte の残りは捨てて big endian の adler32 */
+    const size_t p = br.tell();
+    const uint8_t* a = src + p;
+    const uint32_t check = (static_cast< uint32_t >(a[0]) << 24) | (a[1] << 16) | (a[2] << 8) | a[3];
+    if (adler32(1, dst, out) != check)
+        return INFLATE_ERR_CHECKSUM;
+    return static_cast< int64_t >(out);
+}
+
+uint32_t adler32(uint32_t adler, const uint8_t* p, size_t n)
+{
+    uint64_t a = adler & 0xffff;
+    uint64_t b = adler >> 16;
+#if defined(SIMD_X86)
+    /* 16 byte ごとに b += 16 * a + sum((16 - i) * p[i]), a += sum(p[i]).
+       a の途中経過は ps に溜めておき、 NMAX ごとにまとめて足して剰余を取る */
+    const __m128i zero = _mm_setzero_si128();
+    const __m128i wlo = _mm_setr_epi16(16, 15, 14, 13, 12, 11, 10, 9);
+    const __m128i whi = _mm_setr_epi16(8, 7, 6, 5, 4, 3, 2, 1);
+    while (n >= 16) {
+        size_t blocks = std::min< size_t >(n, ADLER_NMAX) / 16;
+        n -= blocks * 16;
+        b += a * 16 * blocks;
+        __m128i va = zero, vps = zero, vb = zero;
+        do {
+            const __m128i v = _mm_loadu_si128(reinterpret_cast< const __m128i* >(p));
+            p += 16;
+            vps = _mm_add_epi32(vps, va);
+            va = _mm_add_epi32(va, _mm_sad_epu8(v, zero));
+            vb = _mm_add_epi32(vb, _mm_madd_epi16(_mm_unpacklo_epi8(v, zero), wlo));
+            vb = _mm_add_epi32(vb, _mm_madd_epi16(_mm_unpackhi_epi8(v, zero), whi));
+        } while (-- blocks);
+        uint32_t t[4];
+        _mm_storeu_si128(reinterpret_cast< __m128i* >(t), va);
+        a += t[0] + t[2];
+        _mm_storeu_si128(reinterpret_cast< __m128i* >(t), vps);
+        b += (static_cast< uint64_t >(t[0]) + t[2]) * 16;
+        _mm_storeu_si128(reinterpret_cast< __m128i* >(t), vb);
+        b += static_cast< uint64_t >(t[0]) + t[1] + t[2] + t[3];
+        a %= ADLER_MOD;
+        b %= ADLER_MOD;
+    }
+#endif
+    while (n) {
+        const size_t m = std::min< size_t >(n, ADLER_NMAX);
+        n -= m;
+        for (size_t i = 0; i < m; i ++) {
+            a += p[i];
+            b += a;
+        }
+        p += m;
+        a %= ADLER_MOD;
+        b %= ADLER_MOD;
+    }
+    return static_cast< uint32_t >((b << 16) | a);
+}
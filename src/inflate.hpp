@@ -0,0 +1,24 @@
+/**
+ * (C) roentgen 
+ * this code is licensed under the MIT License.
+ */
+#if !defined(INFLATE_HPP__)
+#define INFLATE_HPP__
+
+#include <stdint.h>
+#include <stddef.h>
+
+/* zlib (RFC 1950) / deflate (RFC 1951) の展開. PNG の IDAT 用で、 D3D12 には依存しない.
+   一致の copy は 16 byte ずつ、 adler32 は SSE2 でまとめて数える */
+
+#define INFLATE_ERR_HEADER  (-1) /* zlib の header がおかしい / preset dictionary */
+#define INFLATE_ERR_DATA    (-2) /* 符号や距離が壊れている */
+#define INFLATE_ERR_SPACE   (-3) /* dst に入りきらない */
+#define INFLATE_ERR_CHECKSUM (-4)
+
+/* src の zlib stream を dst に展開して書いた byte 数を返す */
+int64_t zlib_inflate(const uint8_t* src, size_t srclen, uint8_t* dst, size_t dstlen);
+
+uint32_t adler32(uint32_t adler, const uint8_t* p, size_t n);
+
+#endif
@@ -112,7 +112,7 @@ void graphics_impl_t::init(uniq_device_t& u,  ID3D12GraphicsCommandList* cmdlist
         uint8_t* va = nullptr;
         D3D12_RANGE readrange = {0, 0};
         vertbuf_->Map(0, &readrange, reinterpret_cast< void** >(&va));
-        memcpy(va, v, size);
+        wc_copy(va, v, size);
         vertbuf_->Unmap(0, nullptr);
 
         vbv_.BufferLocation = vertbuf_->GetGPUVirtualAddress(); // GPU
@@ -154,8 +154,8 @@ void graphics_impl_t::init(uniq_device_t& u,  ID3D12GraphicsCommandList* cmdlist
         float* ptr = nullptr;
         D3D12_RANGE readrange = {0, 0};
         cbv_->Map(0, &readrange, reinterpret_cast< void** >(&ptr));
-        memcpy(ptr, matrix, sizeof(float) * 16);
-        memcpy(reinterpret_cast< uint8_t* >(ptr) + ((sizeof(float)*16+255) & ~255), &matrix[1], sizeof(float) * 16);
+        wc_copy(ptr, matrix, sizeof(float) * 16);
+        wc_copy(reinterpret_cast< uint8_t* >(ptr) + ((sizeof(float)*16+255) & ~255), &matrix[1], sizeof(float) * 16);
         cbv_->Unmap(0, nullptr);
     }
 
@@ -163,23 +163,27 @@ void graphics_impl_t::init(uniq_device_t& u,  ID3D12GraphicsCommandList* cmdlist
     {
         int width = 64;
         int height = 64;
-        std::vector< uint32_t > data = load_graphics_asset(dir +L"loading.rawdata", width, height);
+        rawd_image_t img;
+        if (load_graphics_asset(dir +L"loading.png", img) == 0) {
+            width = img.view().width;
+            height = img.view().height;
+        }
         INF("loading: first texture: width%d height:%d\n", width, height);
-        D3D12_RESOURCE_DESC desc = setup_tex2d(width, height);
+        D3D12_RESOURCE_DESC desc = setup_tex2d(width, height, texture_format(upload_format(img.view(), supported_formats(u))));
         D3D12_HEAP_PROPERTIES resident = setup_heapprop(D3D12_HEAP_TYPE_DEFAULT);
 
         auto hr = u.dev()->CreateCommittedResource(&resident, D3D12_HEAP_FLAG_NONE, &desc, D3D12_RESOURCE_STATE_COPY_DEST, nullptr, IID_PPV_ARGS(&tex_));
         if (FAILED(hr)) {
             ABT("failed to create resident texture: err:0x%x\n", hr);
         }
-        D3D12_PLACED_SUBRESOURCE_FOOTPRINT copied = write_to_trampoline(u, std::move(data), desc, trampoline); /* copy to trampoline */
+        D3D12_PLACED_SUBRESOURCE_FOOTPRINT copied = write_to_trampoline(u, img, desc, trampoline); /* copy to trampoline */
         
         //issue_texture_upload(copycmdlist.Get(), copied, tex_.Get(), trampoline);
         issue_texture_upload(cmdlist, copied, tex_.Get(), trampoline);
         
         D3D12_SHADER_RESOURCE_VIEW_DESC srv = {};
         srv.Shader4ComponentMapping = D3D12_DEFAULT_SHADER_4_COMPONENT_MAPPING;
-        srv.Format = DXGI_FORMAT_R8G8B8A8_UNORM;
+        srv.Format = desc.Format;
         srv.ViewDimension = D3D12_SRV_DIMENSION_TEXTURE2D;
         srv.Texture2D.MipLevels = 1;
         /* 指定した SRV Heap に ID3D12Resource/D3D12_SHADER_RESOURCE_VIEW_DESC で指定した SRV を生成する */
@@ -254,49 +258,6 @@ void graphics_impl_t::init(uniq_device_t& u,  ID3D12GraphicsCommandList* cmdlist
     }
 }
 
-std::vector< uint32_t > load_graphics_asset(const std::wstring& fname, int& width, int& height)
-{
-    std::vector< uint32_t > data;
-    FILE* rawfp = nullptr;
-    _wfopen_s(&rawfp, fname.c_str(), L"rb");
-    std::unique_ptr< FILE, decltype(&fclose) > fp(rawfp, fclose);
-    if (!fp) {
-        WRN("could not locate file:%s\n", fname.c_str());
-        return data;
-    }
-    __pragma(pack(push, 1)) struct header_t {
-        uint8_t fourcc[4];
-        uint16_t ver_hi;
-        uint16_t ver_lo;
-        uint32_t reserve;
-        uint32_t width;
-        uint32_t height;
-        uint32_t format;
-        uint32_t pixperbyte;
-        uint32_t notelen;
-    };// __attribute__((__packed__));
-    __pragma(pack(pop));
-    header_t head;
-    if (fread(&head, 1, sizeof(header_t), fp.get()) < sizeof(header_t)) {
-        WRN("file maybe broken:%s\n", fname.c_str());
-        return data;
-    }
-    fseek(fp.get(), head.notelen, SEEK_CUR);
-    
-    width = head.width;
-    height = head.height;
-    
-    if (head.width > TRAMPOLINE_MAX_WIDTH || head.height > TRAMPOLINE_MAX_HEIGHT) {
-        WRN("file must small than trampoline buffer:%s (%d, %d) \n ", fname.c_str(), head.width, head.height);
-        return data;
-    }
-    size_t len = head.width * head.height; /* たぶん dense */
-    data.reserve(len);
-    data.resize(len);
-    fread(&data[0], 1, len * head.pixperbyte, fp.get());
-    return data;
-}
-
 ComPtr< ID3D12Resource > graphics_impl_t::create_texture(uniq_device_t& u, int width, int height)
 {
     D3D12_RESOURCE_DESC desc = setup_tex2d(width, height);
@@ -340,58 +301,3 @@ void graphics_impl_t::draw(uniq_device_t& u, ID3D12GraphicsCommandList* cmdlist)
     cmdlist->IASetVertexBuffers(0, 1, &vbv_);
     cmdlist->DrawInstanced(4, 1, 0, 0);
 }
-
-
-D3D12_PLACED_SUBRESOURCE_FOOTPRINT write_to_trampoline(uniq_device_t& u, std::vector< uint32_t > data, const D3D12_RESOURCE_DESC& texdesc, ID3D12Resource* trampoline)
-{
-    D3D12_PLACED_SUBRESOURCE_FOOTPRINT footprint = {};
-    size_t rowpitch;
-    size_t totalbytes;
-    uint32_t rows;
-    u.dev()->GetCopyableFootprints(&texdesc,
-                                   0 /* first idx of the resource */,
-                                   1 /* num of subresorces */,
-                                   0 /* base offset to the resource in bytes */,
-                                       &footprint, &rows, &rowpitch, &totalbytes);
-    INF("texture footprint: rows:%d rowpitch:%lld totalbyte:%lld\n", rows, rowpitch, totalbytes);
-    uint8_t* ptr = nullptr;
-    trampoline->Map(0, nullptr, reinterpret_cast< void** >(&ptr));
-    for (int y = 0; y < texdesc.Height; ++ y) {
-        memcpy(ptr + footprint.Offset + footprint.Footprint.RowPitch * y, data.data() + texdesc.Width * y, rowpitch);
-    }
-    trampoline->Unmap(0, nullptr);
-    return footprint;
-}
-
-int issue_texture_upload(ID3D12GraphicsCommandList* cmdlist, const D3D12_PLACED_SUBRESOURCE_FOOTPRINT& footprint, ID3D12Resource* tex, ID3D12Resource* trampoline, D3D12_RESOURCE_STATES after)
-{
-    /* COPY コマンドを設定: trampoline(UPLOAD) -> tex(RESIDENT VRAM) */
-    D3D12_TEXTURE_COPY_LOCATION dst = {tex, D3D12_TEXTURE_COPY_TYPE_SUBRESOURCE_INDEX, {0}};
-    D3D12_TEXTURE_COPY_LOCATION src = {trampoline, D3D12_TEXTURE_COPY_TYPE_PLACED_FOOTPRINT, {footprint}};
-    /* dst の Dimension が Buffer なら CopyBufferRegion() を使う */
-    cmdlist->CopyTextureRegion(&dst, 0 /* dst-x */, 0 /* dst-y */, 0/* dst-z */, &src, nullptr);
-
-    /* Barrier(GPU 同期): 
-       D3D12_RESOURCE_TRANSITION_BARRIER でリソースの状態を明示する.
-       COPY 前に参照していない場合は D3D12_RESOURCE_STATE_COPY_DEST.
-    */
-    D3D12_RESOURCE_BARRIER barrier = {
-        D3D12_RESOURCE_BARRIER_TYPE_TRANSITION,
-        D3D12_RESOURCE_BARRIER_FLAG_NONE,
-        /* D3D12_RESOURCE_TRANSITION_BARRIER */
-        { 
-            tex,
-            D3D12_RESOURCE_BARRIER_ALL_SUBRESOURCES,
-            D3D12_RESOURCE_STATE_COPY_DEST,/* before state */
-            D3D12_RESOURCE_STATE_PIXEL_SHADER_RESOURCE /* after state */
-        }
-    };
-    /* COPY cmdlist の場合は CommandQueue の非同期実行完了時に暗黙の状態遷移(COMMON への降格(decay))が起きる */
-    if (cmdlist->GetType() == D3D12_COMMAND_LIST_TYPE_COPY) {
-        barrier.Transition.StateAfter = D3D12_RESOURCE_STATE_COMMON;
-    }
-    cmdlist->ResourceBarrier(1, &barrier);
-    
-    return 0;
-}
-
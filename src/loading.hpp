@@ -8,6 +8,7 @@
 #include "scene.hpp"
 #include "dbgutils.hpp"
 #include "uniq_device.hpp"
+#include "texloader.hpp"
 #include <comdef.h>
 #include <vector>
 #include <thread>
@@ -38,15 +39,6 @@ public:
     Microsoft::WRL::ComPtr< ID3D12PipelineState > get_pso() { return pso_;};
 };
 
-static const int TRAMPOLINE_MAX_WIDTH = 512;
-static const int TRAMPOLINE_MAX_HEIGHT = 512;
-
-std::vector< uint32_t > load_graphics_asset(const std::wstring& fname, int& width, int& height);
-
-D3D12_PLACED_SUBRESOURCE_FOOTPRINT write_to_trampoline(uniq_device_t& u, std::vector< uint32_t > data, const D3D12_RESOURCE_DESC& texdesc, ID3D12Resource* trampoline);
-
-int issue_texture_upload(ID3D12GraphicsCommandList* cmdlist, const D3D12_PLACED_SUBRESOURCE_FOOTPRINT& foorprint, ID3D12Resource* tex, ID3D12Resource* trampoline, D3D12_RESOURCE_STATES after=D3D12_RESOURCE_STATE_PIXEL_SHADER_RESOURCE);
-
 template < typename Next >
 class loading_t : public scene_t {
     typedef Next next_scene_t;
@@ -59,10 +51,14 @@ class loading_t : public scene_t {
     std::thread loadthr_;
     std::future< std::weak_ptr< Next > > consumer_;
     std::atomic< bool > finished_;
-    std::atomic< bool > shutdown_;
-    std::shared_ptr< std::deque< std::wstring > > workq_;
+    std::shared_ptr< texture_request_queue_t > requests_;
+    std::vector< texture_handle_t > batch_; /* ロード画面の間に読むもの. payload はこの順に並ぶ */
+    rawd_archive_t archive_;
+    texture_loader_config_t loadercfg_;
+    texture_loader_t loader_;
 public:
-    loading_t(std::shared_ptr< std::deque< std::wstring > > workq) : finished_(false), shutdown_(false), workq_(std::move(workq)) {}
+    loading_t(std::shared_ptr< texture_request_queue_t > requests, std::vector< texture_handle_t > batch, const texture_loader_config_t& cfg = texture_loader_config_t())
+        : finished_(false), requests_(std::move(requests)), batch_(std::move(batch)), loadercfg_(cfg) {}
     void set_consumer(std::future< std::weak_ptr< Next > > weakref) { consumer_ = std::move(weakref); }
     
     void init(uniq_device_t& u, ID3D12GraphicsCommandList* cmdlist, const std::wstring& basepath)
@@ -70,6 +66,16 @@ public:
         /* Load Loading Screen */
 
         uploader_.create_uploader(u);
+
+        /* 前回の起動で読んだ順に先読みを始めておく (ロード画面の準備と並ぶ) */
+        if (loadercfg_.manifest.empty())
+            loadercfg_.manifest = basepath + L"textures.manifest";
+        loader_.init(u, uploader_.queue(), loadercfg_);
+
+        /* cook 済みのアーカイブがあればそちらを優先する. 無ければ個別の .rawdata を読む */
+        if (archive_.open(basepath + L"textures.rawa") == 0) {
+            INF("texture archive: %d entries\n", archive_.count());
+        }
         
         ComPtr< ID3D12GraphicsCommandList > copycmdlist;
         /* upload のための cmdlist には PSO は必要ではない */
@@ -118,35 +124,16 @@ public:
         
         finished_ = true;
         
-        loadthr_ = std::thread([&, payload, copycmdlist]{
-                while (!shutdown_ && !workq_->empty()) {
-                    auto wi = workq_->front();
-                    workq_->pop_front();
-                    int w, h;
-                    auto data = load_graphics_asset(wi, w, h);
-                    if (!data.size())
-                        continue;
-                    INF("Load texture: %s w:%d h:%d\n", wi.c_str(), w, h);
-                    
-                    Sleep(1000); /* Loading Screen っぽくもったいつける */
-                    uploader_.allocator()->Reset();
-                    auto hr = copycmdlist->Reset(uploader_.allocator().Get(), nullptr);
-                    if (FAILED(hr)) {
-                        ABT("failed to reset copycmdlist:0x%x\n", hr);
-                    }
-                    
-                    auto tex = impl_.create_texture(u, w, h);
-                    auto copied = write_to_trampoline(u, std::move(data), tex->GetDesc(), trampoline_.Get()); /* copy to trampoline */
-                    issue_texture_upload(copycmdlist.Get(), copied, tex.Get(), trampoline_.Get());
-                    copycmdlist->Close();
-                    
-                    ID3D12CommandList* l[] = {copycmdlist.Get()};
-                    uploader_.queue()->ExecuteCommandLists(std::extent< decltype(l) >::value, l);
-                    qsync_.wait(uploader_.queue().Get());
-                    
-                    payload->push_back(std::move(tex));
-                }
-                
+        loader_.set_archive(&archive_);
+
+        /* ロード画面の後も requests_ に submit() すれば読み込める */
+        loader_.start(requests_);
+
+        loadthr_ = std::thread([&, payload]{
+                INF("Load textures: %lld requests\n", static_cast< uint64_t >(batch_.size()));
+                texture_loader_t::collect(batch_, *payload);
+                loader_.report();
+
                 auto p = consumer_.get().lock();
                 if (p) {
                     p->set_payload(u, std::move(payload));
@@ -169,11 +156,14 @@ public:
     }
 
     Microsoft::WRL::ComPtr< ID3D12PipelineState > get_pso() { return impl_.pso_;};
+    std::vector< stage_report_t > loader_stats() const { return loader_.stats(); }
+    std::shared_ptr< texture_request_queue_t > requests() { return requests_; }
 
     void shutdown()
     {
+        /* 待っている要求は cancel されるので batch_ の待ちも抜ける */
+        loader_.stop();
         if (loadthr_.joinable()) {
-            shutdown_ = true;
             loadthr_.join();
         }
     }
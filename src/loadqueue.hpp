@@ -0,0 +1,217 @@
+/**
+ * (C) roentgen 
+ * this code is licensed under the MIT License.
+ */
+#if !defined(LOADQUEUE_HPP__)
+#define LOADQUEUE_HPP__
+
+#include <stdint.h>
+#include <stddef.h>
+#include <atomic>
+#include <chrono>
+#include <condition_variable>
+#include <deque>
+#include <future>
+#include <memory>
+#include <mutex>
+#include <string>
+#include <vector>
+
+/* 数字が小さいほど先に取り出される. 同じ優先度の中では投入順 */
+enum load_priority_t {
+    LOAD_PRIORITY_URGENT,   /* 画面に見えているもの */
+    LOAD_PRIORITY_HIGH,
+    LOAD_PRIORITY_NORMAL,
+    LOAD_PRIORITY_PREFETCH, /* 先読み. 他に何も無い時だけ */
+    LOAD_PRIORITY_NUM
+};
+
+#define LOAD_ERR_CANCELLED (-16) /* 取り出される前/処理中に cancel された */
+#define LOAD_ERR_CLOSED    (-17) /* close() 済みのキューに投げた */
+
+/* 複数の request や handle で共有できる取り消しフラグ */
+class cancel_token_t {
+    std::shared_ptr< std::atomic< bool > > flag_;
+public:
+    cancel_token_t() : flag_(std::make_shared< std::atomic< bool > >(false)) {}
+    void cancel() { *flag_ = true; }
+    bool cancelled() const { return *flag_; }
+};
+
+/* submit() の戻り値. 完了を待つか、 ready() でポーリングする.
+   Result は int (status) から構築できること */
+template < typename Result >
+class load_handle_t {
+    uint64_t id_;
+    cancel_token_t token_;
+    std::shared_future< Result > future_;
+public:
+    load_handle_t() : id_(0) {}
+    load_handle_t(uint64_t id, cancel_token_t token, std::shared_future< Result > f) : id_(id), token_(std::move(token)), future_(std::move(f)) {}
+
+    uint64_t id() const { return id_; }
+    bool valid() const { return future_.valid(); }
+    bool ready() const { return valid() && future_.wait_for(std::chrono::seconds(0)) == std::future_status::ready; }
+    const Result& get() const { return future_.get(); }
+    void cancel() { token_.cancel(); }
+};
+
+/* どのスレッドからでも submit() できる優先度付きの読み込み要求キュー.
+   優先度ごとに FIFO を持ち、 pop() は一番優先度の高い FIFO の先頭を返す.
+   cancel 済みの要求は pop() の時点で LOAD_ERR_CANCELLED で完了させて捨てる */
+template < typename Result >
+class load_request_queue_t {
+public:
+    typedef load_handle_t< Result > handle_t;
+
+    struct request_t {
+        uint64_t id;
+        std::wstring path;
+        load_priority_t priority;
+        cancel_token_t token;
+        std::shared_ptr< std::promise< Result > > done;
+
+        bool cancelled() const { return token.cancelled(); }
+        void complete(Result r) { done->set_value(std::move(r)); done.reset(); }
+    };
+
+private:
+    mutable std::mutex mtx_;
+    std::condition_variable cv_;
+    std::deque< request_t > q_[LOAD_PRIORITY_NUM];
+    uint64_t next_id_;
+    bool closed_;
+
+    /* lock を持ったまま呼ぶ. cancel 済みのものは drop に移す */
+    bool take_locked(request_t& r, std::vector< request_t >& drop)
+    {
+        for (auto& q : q_) {
+            while (!q.empty()) {
+                request_t front = std::move(q.front());
+                q.pop_front();
+                if (front.cancelled()) {
+                    drop.push_back(std::move(front));
+                    continue;
+                }
+                r = std::move(front);
+                return true;
+            }
+        }
+        return false;
+    }
+
+    static void complete_all(std::vector< request_t >& v, int status)
+    {
+        for (auto& r : v)
+            r.complete(Result(status));
+    }
+
+public:
+    load_request_queue_t() : next_id_(1), closed_(false) {}
+
+    handle_t submit(const std::wstring& path, load_priority_t priority = LOAD_PRIORITY_NORMAL, cancel_token_t token = cancel_token_t())
+    {
+        request_t r;
+        r.path = path;
+        r.priority = (priority < LOAD_PRIORITY_NUM) ? priority : LOAD_PRIORITY_PREFETCH;
+        r.token = token;
+        r.done = std::make_shared< std::promise< Result > >();
+        std::shared_future< Result > f = r.done->get_future().share();
+        {
+            std::lock_guard< std::mutex > lock(mtx_);
+            r.id = next_id_ ++;
+            if (!closed_) {
+                const uint64_t id = r.id;
+                q_[r.priority].push_back(std::move(r));
+                cv_.notify_one();
+                return handle_t(id, std::move(token), std::move(f));
+            }
+        }
+        r.complete(Result(LOAD_ERR_CLOSED));
+        return handle_t(r.id, std::move(token), std::move(f));
+    }
+
+    /* 次の要求が来るまで待つ. close() されて空になったら false */
+    bool pop(request_t& r)
+    {
+        std::vector< request_t > drop;
+        bool ok;
+        {
+            std::unique_lock< std::mutex > lock(mtx_);
+            while (!(ok = take_locked(r, drop)) && !closed_)
+                cv_.wait(lock);
+        }
+        complete_all(drop, LOAD_ERR_CANCELLED);
+        return ok;
+    }
+
+    bool try_pop(request_t& r)
+    {
+        std::vector< request_t > drop;
+        bool ok;
+        {
+            std::lock_guard< std::mutex > lock(mtx_);
+            ok = take_locked(r, drop);
+        }
+        complete_all(drop, LOAD_ERR_CANCELLED);
+        return ok;
+    }
+
+    /* まだ取り出されていない要求の優先度を上げる (先読みしていたものが急に見えた時など) */
+    bool promote(uint64_t id, load_priority_t priority)
+    {
+        std::lock_guard< std::mutex > lock(mtx_);
+        for (int p = priority + 1; p < LOAD_PRIORITY_NUM; p ++) {
+            for (auto it = q_[p].begin(); it != q_[p].end(); ++ it) {
+                if (it->id != id)
+                    continue;
+                it->priority = priority;
+                /* 同じ優先度の中では投入順を守る */
+                auto& dst = q_[priority];
+                auto pos = dst.begin();
+                while (pos != dst.end() && pos->id < id)
+                    ++ pos;
+                dst.insert(pos, std::move(*it));
+                q_[p].erase(it);
+                return true;
+            }
+        }
+        return false;
+    }
+
+    /* 待っている要求を全部 LOAD_ERR_CANCELLED で完了させる. 取り出し済みのものには影響しない */
+    void cancel_pending()
+    {
+        std::vector< request_t > drop;
+        {
+            std::lock_guard< std::mutex > lock(mtx_);
+            for (auto& q : q_) {
+                for (auto& r : q)
+                    drop.push_back(std::move(r));
+                q.clear();
+            }
+        }
+        complete_all(drop, LOAD_ERR_CANCELLED);
+    }
+
+    /* 以後の submit() は LOAD_ERR_CLOSED で即完了する. 残っている要求は pop() で取り出せる */
+    void close()
+    {
+        std::lock_guard< std::mutex > lock(mtx_);
+        closed_ = true;
+        cv_.notify_all();
+    }
+
+    bool closed() const { std::lock_guard< std::mutex > lock(mtx_); return closed_; }
+
+    size_t size() const
+    {
+        std::lock_guard< std::mutex > lock(mtx_);
+        size_t n = 0;
+        for (auto& q : q_)
+            n += q.size();
+        return n;
+    }
+};
+
+#endif
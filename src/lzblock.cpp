@@ -0,0 +1,188 @@
+/**
+ * (C) roentgen 
+ * this code is licensed under the MIT License.
+ */
+#include "lzblock.hpp"
+#include "simd.hpp"
+#include <string.h>
+
+#define LZ_HASH_BITS (13)
+
+static inline uint32_t read32(const uint8_t* p)
+{
+    uint32_t v;
+    memcpy(&v, p, 4);
+    return v;
+}
+
+static inline uint32_t hash4(uint32_t v)
+{
+    return (v * 2654435761U) >> (32 - LZ_HASH_BITS);
+}
+
+/* 16 byte を一度に. 範囲外への書き込みは呼び出し側が margin を確認してから使う */
+static inline void copy16(uint8_t* d, const uint8_t* s)
+{
+#if defined(SIMD_X86)
+    _mm_storeu_si128(reinterpret_cast< __m128i* >(d), _mm_loadu_si128(reinterpret_cast< const __m128i* >(s)));
+#else
+    memcpy(d, s, 16);
+#endif
+}
+
+/* d から e まで 16 byte 単位でコピーする. 最大 15 byte はみ出して書く */
+static inline void wildcopy16(uint8_t* d, const uint8_t* s, uint8_t* e)
+{
+    do {
+        copy16(d, s);
+        d += 16;
+        s += 16;
+    } while (d < e);
+}
+
+static uint8_t* put_length(uint8_t* op, uint8_t* oend, size_t len)
+{
+    while (len >= 255) {
+        if (op >= oend)
+            return nullptr;
+        *op ++ = 255;
+        len -= 255;
+    }
+    if (op >= oend)
+        return nullptr;
+    *op ++ = static_cast< uint8_t >(len);
+    return op;
+}
+
+/* literal (anchor..lit_end) と match をひとつの sequence として書き出す. 最後の sequence は mlen = 0 */
+static uint8_t* put_sequence(uint8_t* op, uint8_t* oend, const uint8_t* anchor, size_t lit, size_t offset, size_t mlen)
+{
+    if (op >= oend)
+        return nullptr;
+    uint8_t* token = op ++;
+    const size_t ml = mlen ? mlen - LZ_MIN_MATCH : 0;
+    *token = static_cast< uint8_t >(((lit < 15 ? lit : 15) << 4) | (ml < 15 ? ml : 15));
+    if (lit >= 15 && !(op = put_length(op, oend, lit - 15)))
+        return nullptr;
+    if (static_cast< size_t >(oend - op) < lit)
+        return nullptr;
+    if (lit)
+        memcpy(op, anchor, lit);
+    op += lit;
+    if (!mlen)
+        return op;
+    if (oend - op < 2)
+        return nullptr;
+    *op ++ = static_cast< uint8_t >(offset);
+    *op ++ = static_cast< uint8_t >(offset >> 8);
+    if (ml >= 15 && !(op = put_length(op, oend, ml - 15)))
+        return nullptr;
+    return op;
+}
+
+size_t lz_compress(const uint8_t* src, size_t n, uint8_t* dst, size_t cap)
+{
+    int32_t table[1 << LZ_HASH_BITS];
+    for (auto& t : table)
+        t = -1;
+
+    uint8_t* op = dst;
+    uint8_t* const oend = dst + cap;
+    size_t anchor = 0;
+    size_t i = 0;
+    /* greedy: 4 byte のハッシュで直近の候補をひとつだけ見る */
+    while (n >= LZ_MIN_MATCH && i + LZ_MIN_MATCH <= n) {
+        const uint32_t v = read32(src + i);
+        const uint32_t h = hash4(v);
+        const int32_t cand = table[h];
+        table[h] = static_cast< int32_t >(i);
+        if (cand < 0 || i - cand > LZ_MAX_OFFSET || read32(src + cand) != v) {
+            i ++;
+            continue;
+        }
+        size_t len = LZ_MIN_MATCH;
+        while (i + len < n && src[cand + len] == src[i + len])
+            len ++;
+        op = put_sequence(op, oend, src + anchor, i - anchor, i - cand, len);
+        if (!op)
+            return 0;
+        /* match の途中の位置もいくつか登録しておくと次の match が見つかりやすい */
+        if (i + len + LZ_MIN_MATCH <= n && len > 2)
+            table[hash4(read32(src + i + len - 2))] = static_cast< int32_t >(i + len - 2);
+        i += len;
+        anchor = i;
+    }
+    op = put_sequence(op, oend, src + anchor, n - anchor, 0, 0);
+    return op ? static_cast< size_t >(op - dst) : 0;
+}
+
+static inline bool get_length(const uint8_t*& ip, const uint8_t* iend, size_t& len)
+{
+    uint8_t b;
+    do {
+        if (ip >= iend)
+            return false;
+        b = *ip ++;
+        len += b;
+    } while (b == 255);
+    return true;
+}
+
+int lz_decompress(const uint8_t* src, size_t n, uint8_t* dst, size_t dstlen)
+{
+    const uint8_t* ip = src;
+    const uint8_t* const iend = src + n;
+    uint8_t* op = dst;
+    uint8_t* const oend = dst + dstlen;
+
+    while (ip < iend) {
+        const uint8_t token = *ip ++;
+
+        /* literals */
+        size_t lit = token >> 4;
+        if (lit == 15 && !get_length(ip, iend, lit))
+            return LZ_ERR_CORRUPT;
+        if (static_cast< size_t >(iend - ip) < lit)
+            return LZ_ERR_CORRUPT;
+        if (static_cast< size_t >(oend - op) < lit)
+            return LZ_ERR_OVERFLOW;
+        if (lit && static_cast< size_t >(oend - op) >= lit + 16 && static_cast< size_t >(iend - ip) >= lit + 16)
+            wildcopy16(op, ip, op + lit);
+        else
+            memcpy(op, ip, lit);
+        op += lit;
+        ip += lit;
+        if (ip >= iend)
+            break; /* 最後の sequence は literal だけ */
+
+        /* match */
+        if (iend - ip < 2)
+            return LZ_ERR_CORRUPT;
+        const size_t offset = ip[0] | (static_cast< size_t >(ip[1]) << 8);
+        ip += 2;
+        if (!offset || offset > static_cast< size_t >(op - dst))
+            return LZ_ERR_CORRUPT;
+        size_t mlen = token & 15;
+        if (mlen == 15 && !get_length(ip, iend, mlen))
+            return LZ_ERR_CORRUPT;
+        mlen += LZ_MIN_MATCH;
+        if (static_cast< size_t >(oend - op) < mlen)
+            return LZ_ERR_OVERFLOW;
+
+        const uint8_t* match = op - offset;
+        if (offset >= 16 && static_cast< size_t >(oend - op) >= mlen + 16) {
+            /* 16 byte 読む範囲が常に書き込み済みの領域に収まるのでまとめてコピーできる */
+            wildcopy16(op, match, op + mlen);
+            op += mlen;
+        }
+        else {
+            /* 近い offset は繰り返しパターン (1 byte なら塗りつぶし). 重なるので 1 byte ずつ */
+            uint8_t* const e = op + mlen;
+            while (op < e)
+                *op ++ = *match ++;
+        }
+    }
+    if (op != oend)
+        return LZ_ERR_CORRUPT;
+    return static_cast< int >(op - dst);
+}
@@ -0,0 +1,36 @@
+/**
+ * (C) roentgen 
+ * this code is licensed under the MIT License.
+ */
+#if !defined(LZBLOCK_HPP__)
+#define LZBLOCK_HPP__
+
+#include <stdint.h>
+#include <stddef.h>
+
+/* LZ4 系のバイト指向の block codec. block は互いに独立しているので並列に展開できる.
+
+   sequence := token [literal 長の延長] literals [offset(LE16) [match 長の延長]]
+     token の上位 4bit が literal 長, 下位 4bit が match 長 - 4.
+     どちらも 15 なら 255 が続く間足し込み、 255 未満の byte で止める.
+   block の最後の sequence は literal だけで終わる (offset を持たない).
+
+   展開側は出力の残りに余裕がある間は 16 byte 単位 (SSE2) でまとめてコピーし、
+   末尾の数 byte だけ丁寧にコピーする */
+
+#define LZ_MIN_MATCH   (4)
+#define LZ_MAX_OFFSET  (65535)
+
+#define LZ_ERR_CORRUPT  (-1) /* token や offset が壊れている */
+#define LZ_ERR_OVERFLOW (-2) /* 出力先が足りない */
+
+/* 最悪 (全部 literal) の時の圧縮後の大きさ */
+inline size_t lz_compress_bound(size_t n) { return n + n / 255 + 16; }
+
+/* 圧縮後の byte 数を返す. cap に収まらなければ 0 */
+size_t lz_compress(const uint8_t* src, size_t n, uint8_t* dst, size_t cap);
+
+/* 展開した byte 数を返す. ちょうど dstlen にならなければエラー (負の値) */
+int lz_decompress(const uint8_t* src, size_t n, uint8_t* dst, size_t dstlen);
+
+#endif
@@ -0,0 +1,363 @@
+/**
+ * (C) roentgen 
+ * this code is licensed under the MIT License.
+ */
+#include "mipgen.hpp"
+#include "simd.hpp"
+#include <math.h>
+#include <string.h>
+#include <algorithm>
+
+#if defined(SIMD_X86)
+#include <immintrin.h>
+#endif
+
+#define KAISER_RADIUS (3)    /* 縮小後の texel 単位 */
+#define KAISER_ALPHA  (4.0)
+#define KAISER_TAPS   (KAISER_RADIUS * 4) /* 縮小前の texel 数 */
+
+static const double PI = 3.14159265358979323846;
+
+uint32_t mip_levels(uint32_t width, uint32_t height)
+{
+    uint32_t n = 1;
+    for (uint32_t m = std::max(width, height); m > 1; m >>= 1)
+        n ++;
+    return n;
+}
+
+/* sRGB <-> 線形の変換表. 線形 -> sRGB は 16bit に量子化して引く (暗部でも 1/255 以上ずれない) */
+struct srgb_table_t {
+    float to_linear[256];
+    uint8_t to_srgb[65536];
+
+    srgb_table_t()
+    {
+        for (int i = 0; i < 256; i ++) {
+            const double c = i / 255.0;
+            to_linear[i] = static_cast< float >(c <= 0.04045 ? c / 12.92 : pow((c + 0.055) / 1.055, 2.4));
+        }
+        for (int i = 0; i < 65536; i ++) {
+            const double l = i / 65535.0;
+            const double c = l <= 0.0031308 ? l * 12.92 : 1.055 * pow(l, 1.0 / 2.4) - 0.055;
+            to_srgb[i] = static_cast< uint8_t >(std::min(255.0, c * 255.0 + 0.5));
+        }
+    }
+};
+
+static const srgb_table_t& srgb_table()
+{
+    static const srgb_table_t t;
+    return t;
+}
+
+static inline size_t row_bytes(const pixel_view_t& v)
+{
+    return static_cast< size_t >(v.width) * 4;
+}
+
+/*
+ * box (整数). 2 行を縦に足してから隣り合う 2 texel を足し、 +2 して 4 で割る
+ */
+
+static void box_row_scalar(const uint8_t* r0, const uint8_t* r1, uint32_t srcw, uint8_t* d, uint32_t x, uint32_t dstw)
+{
+    for (; x < dstw; x ++) {
+        const uint32_t x0 = std::min< uint32_t >(x * 2, srcw - 1) * 4;
+        const uint32_t x1 = std::min< uint32_t >(x * 2 + 1, srcw - 1) * 4;
+        for (int c = 0; c < 4; c ++)
+            d[x * 4 + c] = static_cast< uint8_t >((r0[x0 + c] + r0[x1 + c] + r1[x0 + c] + r1[x1 + c] + 2) >> 2);
+    }
+}
+
+#if defined(SIMD_X86)
+/* 4 texel (16 byte) ずつ読んで 2 texel 分の和を 16bit で返す */
+static inline __m128i box_pair_sse2(const uint8_t* r0, const uint8_t* r1)
+{
+    const __m128i z = _mm_setzero_si128();
+    const __m128i a = _mm_loadu_si128(reinterpret_cast< const __m128i* >(r0));
+    const __m128i b = _mm_loadu_si128(reinterpret_cast< const __m128i* >(r1));
+    const __m128i lo = _mm_add_epi16(_mm_unpacklo_epi8(a, z), _mm_unpacklo_epi8(b, z)); /* texel 0, 1 */
+    const __m128i hi = _mm_add_epi16(_mm_unpackhi_epi8(a, z), _mm_unpackhi_epi8(b, z)); /* texel 2, 3 */
+    return _mm_add_epi16(_mm_unpacklo_epi64(lo, hi), _mm_unpackhi_epi64(lo, hi));
+}
+
+/* 縮小後の 4 texel ずつ */
+static uint32_t box_row_sse2(const uint8_t* r0, const uint8_t* r1, uint8_t* d, uint32_t n)
+{
+    const __m128i round = _mm_set1_epi16(2);
+    uint32_t x = 0;
+    for (; x + 4 <= n; x += 4) {
+        __m128i s0 = box_pair_sse2(r0 + x * 8, r1 + x * 8);
+        __m128i s1 = box_pair_sse2(r0 + x * 8 + 16, r1 + x * 8 + 16);
+        s0 = _mm_srli_epi16(_mm_add_epi16(s0, round), 2);
+        s1 = _mm_srli_epi16(_mm_add_epi16(s1, round), 2);
+        _mm_storeu_si128(reinterpret_cast< __m128i* >(d + x * 4), _mm_packus_epi16(s0, s1));
+    }
+    return x;
+}
+
+SIMD_TARGET("avx2")
+static inline __m256i box_pair_avx2(const uint8_t* r0, const uint8_t* r1)
+{
+    const __m256i z = _mm256_setzero_si256();
+    const __m256i a = _mm256_loadu_si256(reinterpret_cast< const __m256i* >(r0));
+    const __m256i b = _mm256_loadu_si256(reinterpret_cast< const __m256i* >(r1));
+    const __m256i lo = _mm256_add_epi16(_mm256_unpacklo_epi8(a, z), _mm256_unpacklo_epi8(b, z));
+    const __m256i hi = _mm256_add_epi16(_mm256_unpackhi_epi8(a, z), _mm256_unpackhi_epi8(b, z));
+    return _mm256_add_epi16(_mm256_unpacklo_epi64(lo, hi), _mm256_unpackhi_epi64(lo, hi));
+}
+
+/* 縮小後の 8 texel ずつ. unpack/pack は 128bit lane ごとなので最後に 64bit 単位で並べ直す */
+SIMD_TARGET("avx2")
+static uint32_t box_row_avx2(const uint8_t* r0, const uint8_t* r1, uint8_t* d, uint32_t n)
+{
+    const __m256i round = _mm256_set1_epi16(2);
+    uint32_t x = 0;
+    for (; x + 8 <= n; x += 8) {
+        __m256i s0 = box_pair_avx2(r0 + x * 8, r1 + x * 8);
+        __m256i s1 = box_pair_avx2(r0 + x * 8 + 32, r1 + x * 8 + 32);
+        s0 = _mm256_srli_epi16(_mm256_add_epi16(s0, round), 2);
+        s1 = _mm256_srli_epi16(_mm256_add_epi16(s1, round), 2);
+        const __m256i p = _mm256_permute4x64_epi64(_mm256_packus_epi16(s0, s1), _MM_SHUFFLE(3, 1, 2, 0));
+        _mm256_storeu_si256(reinterpret_cast< __m256i* >(d + x * 4), p);
+    }
+    return x;
+}
+#endif
+
+static void box_rgba8(const pixel_view_t& src, uint8_t* out, const pixel_view_t& dst)
+{
+#if defined(SIMD_X86)
+    const bool avx2 = cpu_features().avx2;
+#endif
+    /* 右端で 2 texel 目が src をはみ出さない範囲だけ SIMD で, 残りは端を繰り返す scalar */
+    const uint32_t inner = std::min< uint32_t >(dst.width, src.width / 2);
+    for (uint32_t y = 0; y < dst.height; y ++) {
+        const uint8_t* r0 = src.data + src.pitch * std::min< uint32_t >(y * 2, src.height - 1);
+        const uint8_t* r1 = src.data + src.pitch * std::min< uint32_t >(y * 2 + 1, src.height - 1);
+        uint8_t* d = out + dst.pitch * y;
+        uint32_t x = 0;
+#if defined(SIMD_X86)
+        if (avx2)
+            x = box_row_avx2(r0, r1, d, inner);
+        x += box_row_sse2(r0 + x * 8, r1 + x * 8, d + x * 4, inner - x);
+#endif
+        box_row_scalar(r0, r1, src.width, d, x, dst.width);
+    }
+}
+
+/*
+ * 浮動小数点の分離フィルタ (sRGB の box と kaiser). 1 texel = RGBA の 4 float を 1 本の __m128 で扱う
+ */
+
+#if defined(SIMD_X86)
+typedef __m128 f4_t;
+static inline f4_t f4_zero() { return _mm_setzero_ps(); }
+static inline f4_t f4_load(const float* p) { return _mm_loadu_ps(p); }
+static inline void f4_store(float* p, f4_t v) { _mm_storeu_ps(p, v); }
+static inline f4_t f4_madd(f4_t acc, f4_t v, float w) { return _mm_add_ps(acc, _mm_mul_ps(v, _mm_set1_ps(w))); }
+#else
+struct f4_t { float v[4]; };
+static inline f4_t f4_zero() { f4_t r = {{0, 0, 0, 0}}; return r; }
+static inline f4_t f4_load(const float* p) { f4_t r; memcpy(r.v, p, sizeof(r.v)); return r; }
+static inline void f4_store(float* p, f4_t v) { memcpy(p, v.v, sizeof(v.v)); }
+static inline f4_t f4_madd(f4_t acc, f4_t v, float w)
+{
+    for (int c = 0; c < 4; c ++)
+        acc.v[c] += v.v[c] * w;
+    return acc;
+}
+#endif
+
+/* 縮小後の x には縮小前の first + 2x + k (k = 0..taps-1) が weight[k] で効く */
+struct kernel_t {
+    int first;
+    int taps;
+    float weight[KAISER_TAPS];
+};
+
+static double bessel_i0(double x)
+{
+    double sum = 1.0;
+    double term = 1.0;
+    for (int k = 1; k < 32; k ++) {
+        term *= (x / (2.0 * k)) * (x / (2.0 * k));
+        sum += term;
+    }
+    return sum;
+}
+
+static kernel_t make_kernel(mip_filter_t filter)
+{
+    kernel_t k = {};
+    if (filter == MIP_FILTER_BOX) {
+        k.first = 0;
+        k.taps = 2;
+        k.weight[0] = k.weight[1] = 0.5f;
+        return k;
+    }
+    /* 縮小後の texel の中心 (縮小前の 2x + 1) から texel 中心までの距離 t (縮小後の単位) で
+       sinc(t) * kaiser(t / radius) を重みにする */
+    k.first = 1 - 2 * KAISER_RADIUS;
+    k.taps = KAISER_TAPS;
+    double sum = 0.0;
+    double w[KAISER_TAPS];
+    for (int i = 0; i < KAISER_TAPS; i ++) {
+        const double t = (k.first + i + 0.5 - 1.0) / 2.0;
+        const double s = t == 0.0 ? 1.0 : sin(PI * t) / (PI * t);
+        const double r = t / KAISER_RADIUS;
+        const double win = (r * r < 1.0) ? bessel_i0(KAISER_ALPHA * sqrt(1.0 - r * r)) / bessel_i0(KAISER_ALPHA) : 0.0;
+        w[i] = s * win;
+        sum += w[i];
+    }
+    for (int i = 0; i < KAISER_TAPS; i ++)
+        k.weight[i] = static_cast< float >(w[i] / sum);
+    return k;
+}
+
+static void decode_row(const uint8_t* s, uint32_t width, bool srgb, float* d)
+{
+    const srgb_table_t& t = srgb_table();
+    for (uint32_t x = 0; x < width; x ++, s += 4, d += 4) {
+        for (int c = 0; c < 3; c ++)
+            d[c] = srgb ? t.to_linear[s[c]] : s[c] * (1.0f / 255.0f);
+        d[3] = s[3] * (1.0f / 255.0f);
+    }
+}
+
+static void encode_row(const float* s, uint32_t width, bool srgb, uint8_t* d)
+{
+    const srgb_table_t& t = srgb_table();
+    for (uint32_t x = 0; x < width; x ++, s += 4, d += 4) {
+        for (int c = 0; c < 4; c ++) {
+            /* kaiser は負の lobe があるので範囲外になり得る */
+            const float v = std::min(std::max(s[c], 0.0f), 1.0f);
+            d[c] = (srgb && c < 3) ? t.to_srgb[static_cast< int >(v * 65535.0f + 0.5f)] : static_cast< uint8_t >(v * 255.0f + 0.5f);
+        }
+    }
+}
+
+static void filter_rgba8(const pixel_view_t& src, uint8_t* out, const pixel_view_t& dst, mip_filter_t filter, bool srgb)
+{
+    const kernel_t k = make_kernel(filter);
+    const int sw = static_cast< int >(src.width);
+    const int sh = static_cast< int >(src.height);
+    /* 横方向を先に: 縮小前の全行 x 縮小後の幅 */
+    std::vector< float > line(static_cast< size_t >(sw) * 4);
+    std::vector< float > horz(static_cast< size_t >(sh) * dst.width * 4);
+    for (int y = 0; y < sh; y ++) {
+        decode_row(src.data + src.pitch * y, src.width, srgb, line.data());
+        float* h = &horz[static_cast< size_t >(y) * dst.width * 4];
+        for (uint32_t x = 0; x < dst.width; x ++) {
+            f4_t acc = f4_zero();
+            const int x0 = k.first + static_cast< int >(x) * 2;
+            for (int i = 0; i < k.taps; i ++) {
+                const int sx = std::min(std::max(x0 + i, 0), sw - 1);
+                acc = f4_madd(acc, f4_load(&line[sx * 4]), k.weight[i]);
+            }
+            f4_store(h + x * 4, acc);
+        }
+    }
+    /* 縦方向 */
+    std::vector< float > row(static_cast< size_t >(dst.width) * 4);
+    const size_t hpitch = static_cast< size_t >(dst.width) * 4;
+    for (uint32_t y = 0; y < dst.height; y ++) {
+        const int y0 = k.first + static_cast< int >(y) * 2;
+        for (uint32_t x = 0; x < dst.width; x ++) {
+            f4_t acc = f4_zero();
+            for (int i = 0; i < k.taps; i ++) {
+                const int sy = std::min(std::max(y0 + i, 0), sh - 1);
+                acc = f4_madd(acc, f4_load(&horz[hpitch * sy + x * 4]), k.weight[i]);
+            }
+            f4_store(&row[x * 4], acc);
+        }
+        encode_row(row.data(), dst.width, srgb, out + dst.pitch * y);
+    }
+}
+
+/* dst の形を決める. 縮小後は dense */
+static void next_level(const pixel_view_t& src, pixel_view_t& dst)
+{
+    dst.width = std::max< uint32_t >(src.width >> 1, 1);
+    dst.height = std::max< uint32_t >(src.height >> 1, 1);
+    dst.format = src.format;
+    dst.bpp = src.bpp;
+    dst.pitch = row_bytes(dst);
+}
+
+static void downsample_to(const pixel_view_t& src, mip_filter_t filter, bool srgb, uint8_t* out, pixel_view_t& dst)
+{
+    if (filter == MIP_FILTER_BOX && !srgb)
+        box_rgba8(src, out, dst);
+    else
+        filter_rgba8(src, out, dst, filter, srgb);
+    dst.data = out;
+}
+
+int downsample_rgba8(const pixel_view_t& src, mip_filter_t filter, bool srgb, std::vector< uint8_t >& buf, pixel_view_t& dst)
+{
+    if (src.bpp != 4 || !src.data || !src.width || !src.height)
+        return -1;
+    next_level(src, dst);
+    buf.resize(dst.pitch * dst.height);
+    downsample_to(src, filter, srgb, buf.data(), dst);
+    return 0;
+}
+
+int generate_mips(const pixel_view_t& base, mip_filter_t filter, bool srgb, mip_chain_t& chain, uint32_t maxlevels)
+{
+    uint32_t n = mip_levels(base.width, base.height);
+    if (maxlevels)
+        n = std::min(n, maxlevels);
+    chain.levels.assign(1, base);
+    chain.bufs.resize(n);
+    for (uint32_t i = 1; i < n; i ++) {
+        pixel_view_t next;
+        if (downsample_rgba8(chain.levels.back(), filter, srgb, chain.bufs[i], next) < 0)
+            return -1;
+        chain.levels.push_back(next);
+    }
+    return 0;
+}
+
+/* level は 64 byte 境界から置く */
+static size_t level_offset(size_t bytes)
+{
+    return (bytes + 63) & ~size_t(63);
+}
+
+size_t mip_chain_bytes(const pixel_view_t& base, uint32_t maxlevels)
+{
+    uint32_t n = mip_levels(base.width, base.height);
+    if (maxlevels)
+        n = std::min(n, maxlevels);
+    size_t bytes = 0;
+    pixel_view_t v = base;
+    for (uint32_t i = 1; i < n; i ++) {
+        pixel_view_t next;
+        next_level(v, next);
+        bytes += level_offset(next.pitch * next.height);
+        v = next;
+    }
+    return bytes;
+}
+
+int generate_mips_to(const pixel_view_t& base, mip_filter_t filter, bool srgb, uint8_t* dst, size_t size, mip_chain_t& chain, uint32_t maxlevels)
+{
+    if (base.bpp != 4 || !base.data || !base.width || !base.height || size < mip_chain_bytes(base, maxlevels))
+        return -1;
+    uint32_t n = mip_levels(base.width, base.height);
+    if (maxlevels)
+        n = std::min(n, maxlevels);
+    chain.levels.assign(1, base);
+    chain.bufs.clear();
+    for (uint32_t i = 1; i < n; i ++) {
+        pixel_view_t next;
+        next_level(chain.levels.back(), next);
+        downsample_to(chain.levels.back(), filter, srgb, dst, next);
+        dst += level_offset(next.pitch * next.height);
+        chain.levels.push_back(next);
+    }
+    return 0;
+}
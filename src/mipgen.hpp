@@ -0,0 +1,43 @@
+/**
+ * (C) roentgen 
+ * this code is licensed under the MIT License.
+ */
+#if !defined(MIPGEN_HPP__)
+#define MIPGEN_HPP__
+
+#include "rawd.hpp"
+#include <stdint.h>
+#include <vector>
+
+/* RGBA8 の mip chain を CPU で作る. D3D12 には依存しないので cooker と loader の両方から使う.
+
+   box:    2x2 の平均. sRGB でなければ整数のまま SSE2/AVX2 で処理する
+   kaiser: Kaiser 窓付き sinc (半径 3 texel, alpha 4) の分離フィルタ. box より縮小時のモアレが少ない
+   srgb を指定すると RGB は線形空間に戻してから平均し、 sRGB に戻す (alpha は線形のまま).
+   奇数の幅/高さは端の texel を繰り返して扱う */
+
+enum mip_filter_t {
+    MIP_FILTER_BOX,
+    MIP_FILTER_KAISER,
+};
+
+/* 1x1 までの level 数 */
+uint32_t mip_levels(uint32_t width, uint32_t height);
+
+/* levels[0] は元画像をそのまま指す (コピーしない). levels[1..] は bufs の中 */
+struct mip_chain_t {
+    std::vector< pixel_view_t > levels;
+    std::vector< std::vector< uint8_t > > bufs;
+};
+
+/* src を 1 段縮小して buf に書き、 dst にその view (dense) を返す. RGBA8 以外は -1 */
+int downsample_rgba8(const pixel_view_t& src, mip_filter_t filter, bool srgb, std::vector< uint8_t >& buf, pixel_view_t& dst);
+
+/* base から maxlevels 段 (0 なら 1x1 まで) の chain を作る. 各 level は前の level から縮小する */
+int generate_mips(const pixel_view_t& base, mip_filter_t filter, bool srgb, mip_chain_t& chain, uint32_t maxlevels = 0);
+
+/* generate_mips() の levels[1..] を呼び出し側のバッファに置くもの (bufs は使わない). dst には mip_chain_bytes() 以上要る */
+size_t mip_chain_bytes(const pixel_view_t& base, uint32_t maxlevels = 0);
+int generate_mips_to(const pixel_view_t& base, mip_filter_t filter, bool srgb, uint8_t* dst, size_t size, mip_chain_t& chain, uint32_t maxlevels = 0);
+
+#endif
@@ -0,0 +1,221 @@
+/**
+ * (C) roentgen 
+ * this code is licensed under the MIT License.
+ */
+#if !defined(PIPELINE_HPP__)
+#define PIPELINE_HPP__
+
+#include <stdint.h>
+#include <stddef.h>
+#include <atomic>
+#include <chrono>
+#include <condition_variable>
+#include <deque>
+#include <functional>
+#include <mutex>
+#include <thread>
+#include <vector>
+
+/* stage 間をつなぐ容量制限付きの FIFO.
+   満杯なら push() が、空なら pop() が待つので、遅い stage に合わせて前段が自然に止まる.
+   close() 後は push() は失敗し、 pop() は残りを吐き出してから false を返す */
+template < typename T >
+class bounded_queue_t {
+    mutable std::mutex mtx_;
+    std::condition_variable notfull_;
+    std::condition_variable notempty_;
+    std::deque< T > q_;
+    size_t capacity_;
+    size_t maxdepth_;
+    bool closed_;
+public:
+    explicit bounded_queue_t(size_t capacity) : capacity_(capacity ? capacity : 1), maxdepth_(0), closed_(false) {}
+
+    bool push(T&& v)
+    {
+        std::unique_lock< std::mutex > lock(mtx_);
+        notfull_.wait(lock, [this]{ return closed_ || q_.size() < capacity_; });
+        if (closed_)
+            return false;
+        q_.push_back(std::move(v));
+        if (q_.size() > maxdepth_)
+            maxdepth_ = q_.size();
+        notempty_.notify_one();
+        return true;
+    }
+
+    bool push(const T& v)
+    {
+        T tmp(v);
+        return push(std::move(tmp));
+    }
+
+    bool pop(T& v)
+    {
+        std::unique_lock< std::mutex > lock(mtx_);
+        notempty_.wait(lock, [this]{ return closed_ || !q_.empty(); });
+        if (q_.empty())
+            return false;
+        v = std::move(q_.front());
+        q_.pop_front();
+        notfull_.notify_one();
+        return true;
+    }
+
+    /* 空なら待たずに false */
+    bool try_pop(T& v)
+    {
+        std::lock_guard< std::mutex > lock(mtx_);
+        if (q_.empty())
+            return false;
+        v = std::move(q_.front());
+        q_.pop_front();
+        notfull_.notify_one();
+        return true;
+    }
+
+    void close()
+    {
+        std::lock_guard< std::mutex > lock(mtx_);
+        closed_ = true;
+        notfull_.notify_all();
+        notempty_.notify_all();
+    }
+
+    /* close() したキューを再び使えるようにする. 中身は空になっているはず */
+    void reopen()
+    {
+        std::lock_guard< std::mutex > lock(mtx_);
+        closed_ = false;
+        maxdepth_ = q_.size();
+    }
+
+    size_t depth() const { std::lock_guard< std::mutex > lock(mtx_); return q_.size(); }
+    size_t max_depth() const { std::lock_guard< std::mutex > lock(mtx_); return maxdepth_; }
+    size_t capacity() const { return capacity_; }
+};
+
+/* 1 枚のテクスチャの中の独立した仕事 (block の展開など) を数個の worker に配る fork-join.
+   parallel_for() の呼び出し元も一緒に働く. 他のスレッドが parallel_for() 中なら待たずに呼び出し元だけで処理するので、
+   複数の stage worker から共有しても詰まらない */
+class worker_pool_t {
+    std::mutex call_;
+    std::mutex mtx_;
+    std::condition_variable start_;
+    std::condition_variable done_;
+    std::vector< std::thread > threads_;
+    const std::function< void(size_t) >* fn_;
+    size_t n_;
+    std::atomic< size_t > next_;
+    size_t busy_;  /* 今の世代をまだ処理している worker の数 */
+    uint64_t gen_;
+    bool quit_;
+
+    void work()
+    {
+        for (size_t i = next_ ++; i < n_; i = next_ ++)
+            (*fn_)(i);
+    }
+
+    void run()
+    {
+        uint64_t seen = 0;
+        std::unique_lock< std::mutex > lock(mtx_);
+        for (;;) {
+            start_.wait(lock, [&]{ return quit_ || gen_ != seen; });
+            if (quit_)
+                return;
+            seen = gen_;
+            lock.unlock();
+            work();
+            lock.lock();
+            if (-- busy_ == 0)
+                done_.notify_all();
+        }
+    }
+
+public:
+    worker_pool_t() : fn_(nullptr), n_(0), next_(0), busy_(0), gen_(0), quit_(false) {}
+    ~worker_pool_t() { stop(); }
+    worker_pool_t(const worker_pool_t&) = delete;
+    worker_pool_t& operator=(const worker_pool_t&) = delete;
+
+    /* 呼び出し元のほかに workers 本のスレッドを立てる. 0 なら parallel_for() はただのループになる */
+    void start(int workers)
+    {
+        stop();
+        quit_ = false;
+        for (int i = 0; i < workers; i ++)
+            threads_.emplace_back([this]{ run(); });
+    }
+
+    void stop()
+    {
+        {
+            std::lock_guard< std::mutex > lock(mtx_);
+            quit_ = true;
+        }
+        start_.notify_all();
+        for (auto& t : threads_)
+            t.join();
+        threads_.clear();
+    }
+
+    size_t size() const { return threads_.size(); }
+
+    /* fn(0) .. fn(n - 1) を全部終えてから戻る. 順序は不定 */
+    void parallel_for(size_t n, const std::function< void(size_t) >& fn)
+    {
+        std::unique_lock< std::mutex > call(call_, std::try_to_lock);
+        if (!call.owns_lock() || threads_.empty() || n < 2) {
+            for (size_t i = 0; i < n; i ++)
+                fn(i);
+            return;
+        }
+        {
+            std::lock_guard< std::mutex > lock(mtx_);
+            fn_ = &fn;
+            n_ = n;
+            next_ = 0;
+            busy_ = threads_.size();
+            gen_ ++;
+        }
+        start_.notify_all();
+        work();
+        std::unique_lock< std::mutex > lock(mtx_);
+        done_.wait(lock, [this]{ return busy_ == 0; });
+        fn_ = nullptr;
+    }
+};
+
+/* stage ごとの計測値. worker から lock なしで加算する */
+struct stage_counter_t {
+    std::atomic< uint64_t > items;
+    std::atomic< uint64_t > bytes;
+    std::atomic< uint64_t > busy_ns; /* worker が仕事をしていた時間の合計 (待ち時間は含まない) */
+    std::atomic< uint64_t > dropped;
+
+    stage_counter_t() : items(0), bytes(0), busy_ns(0), dropped(0) {}
+
+    void add(uint64_t nbytes, std::chrono::steady_clock::time_point begin)
+    {
+        items ++;
+        bytes += nbytes;
+        busy_ns += static_cast< uint64_t >(std::chrono::duration_cast< std::chrono::nanoseconds >(std::chrono::steady_clock::now() - begin).count());
+    }
+};
+
+/* stats() のスナップショット */
+struct stage_report_t {
+    const char* name;
+    int workers;
+    uint64_t items;
+    uint64_t bytes;
+    uint64_t dropped;
+    double busy_ms;
+    size_t depth;      /* 入力キューの現在の深さ */
+    size_t max_depth;  /* 入力キューの最大の深さ */
+    size_t capacity;
+};
+
+#endif
@@ -0,0 +1,317 @@
+/**
+ * (C) roentgen 
+ * this code is licensed under the MIT License.
+ */
+#include "pixconv.hpp"
+#include "simd.hpp"
+#include "wccopy.hpp"
+#include <math.h>
+#include <string.h>
+#include <algorithm>
+
+#if defined(SIMD_X86)
+#include <immintrin.h>
+#endif
+
+/* 1 度に pool に渡す行数 */
+#define PIXCONV_BAND_ROWS (16)
+
+/* width texel 分を変換する. 戻り値は処理した texel 数 (残りは呼び出し側が scalar で) */
+typedef uint32_t (*row_fn_t)(const uint8_t* src, uint8_t* dst, uint32_t width);
+
+/*
+ * RGB8 -> RGBA8
+ */
+
+static void rgb8_scalar(const uint8_t* src, uint8_t* dst, uint32_t x, uint32_t width)
+{
+    for (; x < width; x ++) {
+        dst[x * 4 + 0] = src[x * 3 + 0];
+        dst[x * 4 + 1] = src[x * 3 + 1];
+        dst[x * 4 + 2] = src[x * 3 + 2];
+        dst[x * 4 + 3] = 255;
+    }
+}
+
+#if defined(SIMD_X86)
+/* 12 byte (4 texel) を広げる. 16 byte 読むので最後の 2 texel 分は scalar に残す */
+SIMD_TARGET("ssse3")
+static uint32_t rgb8_ssse3(const uint8_t* src, uint8_t* dst, uint32_t width)
+{
+    const __m128i shuf = _mm_setr_epi8(0, 1, 2, -1, 3, 4, 5, -1, 6, 7, 8, -1, 9, 10, 11, -1);
+    const __m128i alpha = _mm_set1_epi32(static_cast< int >(0xff000000u));
+    uint32_t x = 0;
+    for (; x + 6 <= width; x += 4) {
+        const __m128i v = _mm_loadu_si128(reinterpret_cast< const __m128i* >(src + x * 3));
+        _mm_storeu_si128(reinterpret_cast< __m128i* >(dst + x * 4), _mm_or_si128(_mm_shuffle_epi8(v, shuf), alpha));
+    }
+    return x;
+}
+#endif
+
+/*
+ * BGRA8 -> RGBA8. 32bit で見ると A R G B -> A B G R なので R と B の 16bit 回転だけ
+ */
+
+static void bgra8_scalar(const uint8_t* src, uint8_t* dst, uint32_t x, uint32_t width)
+{
+    for (; x < width; x ++) {
+        dst[x * 4 + 0] = src[x * 4 + 2];
+        dst[x * 4 + 1] = src[x * 4 + 1];
+        dst[x * 4 + 2] = src[x * 4 + 0];
+        dst[x * 4 + 3] = src[x * 4 + 3];
+    }
+}
+
+#if defined(SIMD_X86)
+static uint32_t bgra8_sse2(const uint8_t* src, uint8_t* dst, uint32_t width)
+{
+    const __m128i ag = _mm_set1_epi32(static_cast< int >(0xff00ff00u));
+    const __m128i rb = _mm_set1_epi32(0x00ff00ff);
+    uint32_t x = 0;
+    for (; x + 4 <= width; x += 4) {
+        const __m128i v = _mm_loadu_si128(reinterpret_cast< const __m128i* >(src + x * 4));
+        const __m128i t = _mm_and_si128(v, rb);
+        const __m128i s = _mm_or_si128(_mm_slli_epi32(t, 16), _mm_srli_epi32(t, 16));
+        _mm_storeu_si128(reinterpret_cast< __m128i* >(dst + x * 4), _mm_or_si128(_mm_and_si128(v, ag), s));
+    }
+    return x;
+}
+
+SIMD_TARGET("avx2")
+static uint32_t bgra8_avx2(const uint8_t* src, uint8_t* dst, uint32_t width)
+{
+    const __m256i shuf = _mm256_setr_epi8(2, 1, 0, 3, 6, 5, 4, 7, 10, 9, 8, 11, 14, 13, 12, 15,
+                                          2, 1, 0, 3, 6, 5, 4, 7, 10, 9, 8, 11, 14, 13, 12, 15);
+    uint32_t x = 0;
+    for (; x + 8 <= width; x += 8) {
+        const __m256i v = _mm256_loadu_si256(reinterpret_cast< const __m256i* >(src + x * 4));
+        _mm256_storeu_si256(reinterpret_cast< __m256i* >(dst + x * 4), _mm256_shuffle_epi8(v, shuf));
+    }
+    return x + bgra8_sse2(src + x * 4, dst + x * 4, width - x);
+}
+#endif
+
+/*
+ * RGBA8 (線形) -> sRGB. 256 通りしかないので表を引く
+ */
+
+struct srgb_encode_table_t {
+    uint8_t v[256];
+    srgb_encode_table_t()
+    {
+        for (int i = 0; i < 256; i ++) {
+            const double l = i / 255.0;
+            const double c = l <= 0.0031308 ? l * 12.92 : 1.055 * pow(l, 1.0 / 2.4) - 0.055;
+            v[i] = static_cast< uint8_t >(std::min(255.0, c * 255.0 + 0.5));
+        }
+    }
+};
+
+static void srgb_scalar(const uint8_t* src, uint8_t* dst, uint32_t x, uint32_t width)
+{
+    static const srgb_encode_table_t t;
+    for (; x < width; x ++) {
+        dst[x * 4 + 0] = t.v[src[x * 4 + 0]];
+        dst[x * 4 + 1] = t.v[src[x * 4 + 1]];
+        dst[x * 4 + 2] = t.v[src[x * 4 + 2]];
+        dst[x * 4 + 3] = src[x * 4 + 3];
+    }
+}
+
+/*
+ * float -> half. scalar は最近接偶数丸めで F16C と同じ結果になる (NaN の payload は除く)
+ */
+
+static uint16_t float_to_half(float f)
+{
+    uint32_t u;
+    memcpy(&u, &f, 4);
+    const uint32_t sign = (u >> 16) & 0x8000;
+    u &= 0x7fffffff;
+    if (u >= (127 + 16) << 23) /* 65536 以上, inf, NaN */
+        return static_cast< uint16_t >(sign | (u > 0x7f800000 ? 0x7e00 : 0x7c00));
+    if (u < (127 - 14) << 23) {
+        /* half の非正規化数. 0.5 を足すと仮数部の下位に丸めた結果が残る */
+        float t;
+        memcpy(&t, &u, 4);
+        t += 0.5f;
+        memcpy(&u, &t, 4);
+        return static_cast< uint16_t >(sign | (u - 0x3f000000));
+    }
+    const uint32_t odd = (u >> 13) & 1;
+    u += (static_cast< uint32_t >(15 - 127) << 23) + 0xfff + odd;
+    return static_cast< uint16_t >(sign | (u >> 13));
+}
+
+static void f16_scalar(const uint8_t* src, uint8_t* dst, uint32_t x, uint32_t width)
+{
+    const float* s = reinterpret_cast< const float* >(src);
+    for (; x < width; x ++) {
+        for (int c = 0; c < 4; c ++) {
+            const uint16_t h = float_to_half(s[x * 4 + c]);
+            memcpy(dst + x * 8 + c * 2, &h, 2);
+        }
+    }
+}
+
+#if defined(SIMD_X86)
+/* 2 texel (8 float) ずつ */
+SIMD_TARGET("avx,f16c")
+static uint32_t f16_f16c(const uint8_t* src, uint8_t* dst, uint32_t width)
+{
+    uint32_t x = 0;
+    for (; x + 2 <= width; x += 2) {
+        const __m256 v = _mm256_loadu_ps(reinterpret_cast< const float* >(src + x * 16));
+        _mm_storeu_si128(reinterpret_cast< __m128i* >(dst + x * 8), _mm256_cvtps_ph(v, _MM_FROUND_TO_NEAREST_INT));
+    }
+    return x;
+}
+#endif
+
+/*
+ * float -> RGB10A2. NaN は 0 にする
+ */
+
+static inline uint32_t unorm(float v, float scale)
+{
+    v = v > 0.0f ? (v < 1.0f ? v : 1.0f) : 0.0f;
+    return static_cast< uint32_t >(v * scale + 0.5f);
+}
+
+static void rgb10a2_scalar(const uint8_t* src, uint8_t* dst, uint32_t x, uint32_t width)
+{
+    const float* s = reinterpret_cast< const float* >(src);
+    for (; x < width; x ++) {
+        const float* t = s + x * 4;
+        const uint32_t v = unorm(t[0], 1023.0f) | (unorm(t[1], 1023.0f) << 10) | (unorm(t[2], 1023.0f) << 20) | (unorm(t[3], 3.0f) << 30);
+        memcpy(dst + x * 4, &v, 4);
+    }
+}
+
+#if defined(SIMD_X86)
+/* 1 texel を 1 本の __m128 で量子化し、 channel ごとの shift を掛けてから hadd で 1 つにまとめる (bit が重ならないので和 = or) */
+SIMD_TARGET("sse4.1")
+static inline __m128i rgb10a2_texel(const float* t, __m128 scale, __m128i shift)
+{
+    __m128 v = _mm_min_ps(_mm_max_ps(_mm_loadu_ps(t), _mm_setzero_ps()), _mm_set1_ps(1.0f));
+    v = _mm_add_ps(_mm_mul_ps(v, scale), _mm_set1_ps(0.5f));
+    return _mm_mullo_epi32(_mm_cvttps_epi32(v), shift);
+}
+
+SIMD_TARGET("sse4.1")
+static uint32_t rgb10a2_sse41(const uint8_t* src, uint8_t* dst, uint32_t width)
+{
+    const __m128 scale = _mm_setr_ps(1023.0f, 1023.0f, 1023.0f, 3.0f);
+    const __m128i shift = _mm_setr_epi32(1, 1 << 10, 1 << 20, 1 << 30);
+    const float* s = reinterpret_cast< const float* >(src);
+    uint32_t x = 0;
+    for (; x + 4 <= width; x += 4) {
+        const __m128i t0 = rgb10a2_texel(s + x * 4, scale, shift);
+        const __m128i t1 = rgb10a2_texel(s + x * 4 + 4, scale, shift);
+        const __m128i t2 = rgb10a2_texel(s + x * 4 + 8, scale, shift);
+        const __m128i t3 = rgb10a2_texel(s + x * 4 + 12, scale, shift);
+        const __m128i v = _mm_hadd_epi32(_mm_hadd_epi32(t0, t1), _mm_hadd_epi32(t2, t3));
+        _mm_storeu_si128(reinterpret_cast< __m128i* >(dst + x * 4), v);
+    }
+    return x;
+}
+#endif
+
+uint32_t pixconv_target(uint32_t format, uint32_t flags)
+{
+    switch (format) {
+    case RAWD_FORMAT_RGB8:
+    case RAWD_FORMAT_BGRA8:
+        return RAWD_FORMAT_RGBA8;
+    case RAWD_FORMAT_RGBA8:
+        return (flags & PIXCONV_SRGB) ? RAWD_FORMAT_RGBA8_SRGB : RAWD_FORMAT_RGBA8;
+    case RAWD_FORMAT_RGBA32F:
+        return (flags & PIXCONV_PACK_FLOAT) ? RAWD_FORMAT_RGB10A2 : RAWD_FORMAT_RGBA16F;
+    default:
+        return format;
+    }
+}
+
+bool pixconv_supported(uint32_t src, uint32_t format)
+{
+    if (src == format)
+        return true;
+    switch (src) {
+    case RAWD_FORMAT_RGB8:
+    case RAWD_FORMAT_BGRA8:
+        return format == RAWD_FORMAT_RGBA8;
+    case RAWD_FORMAT_RGBA8:
+        return format == RAWD_FORMAT_RGBA8_SRGB;
+    case RAWD_FORMAT_RGBA32F:
+        return format == RAWD_FORMAT_RGBA16F || format == RAWD_FORMAT_RGB10A2;
+    default:
+        return false;
+    }
+}
+
+int pixconv(const pixel_view_t& src, uint32_t format, uint8_t* dst, size_t dstpitch, worker_pool_t* pool)
+{
+    if (!src.data || !pixconv_supported(src.format, format))
+        return -1;
+    if (src.format == format) {
+        copy_rows(dst, dstpitch, src.data, src.pitch, rawd_row_bytes(src), rawd_rows(src));
+        return 0;
+    }
+    if (rawd_format_bytes(src.format) != src.bpp && !(src.format == RAWD_FORMAT_RGBA8 && src.bpp == 4))
+        return -1;
+
+    /* SIMD で処理できるだけ処理し、 残りを scalar で */
+    row_fn_t simd = nullptr;
+    void (*scalar)(const uint8_t*, uint8_t*, uint32_t, uint32_t) = nullptr;
+#if defined(SIMD_X86)
+    const cpu_features_t& cpu = cpu_features();
+#endif
+    if (src.format == RAWD_FORMAT_RGB8) {
+        scalar = rgb8_scalar;
+#if defined(SIMD_X86)
+        if (cpu.ssse3)
+            simd = rgb8_ssse3;
+#endif
+    }
+    else if (src.format == RAWD_FORMAT_BGRA8) {
+        scalar = bgra8_scalar;
+#if defined(SIMD_X86)
+        simd = cpu.avx2 ? bgra8_avx2 : bgra8_sse2;
+#endif
+    }
+    else if (src.format == RAWD_FORMAT_RGBA8) {
+        scalar = srgb_scalar;
+    }
+    else if (format == RAWD_FORMAT_RGBA16F) {
+        scalar = f16_scalar;
+#if defined(SIMD_X86)
+        if (cpu.avx && cpu.f16c)
+            simd = f16_f16c;
+#endif
+    }
+    else {
+        scalar = rgb10a2_scalar;
+#if defined(SIMD_X86)
+        if (cpu.sse41)
+            simd = rgb10a2_sse41;
+#endif
+    }
+
+    auto band = [&](size_t b) {
+        const uint32_t y0 = static_cast< uint32_t >(b) * PIXCONV_BAND_ROWS;
+        const uint32_t y1 = std::min< uint32_t >(y0 + PIXCONV_BAND_ROWS, src.height);
+        for (uint32_t y = y0; y < y1; y ++) {
+            const uint8_t* s = src.data + src.pitch * y;
+            uint8_t* d = dst + dstpitch * y;
+            scalar(s, d, simd ? simd(s, d, src.width) : 0, src.width);
+        }
+    };
+    const uint32_t bands = (src.height + PIXCONV_BAND_ROWS - 1) / PIXCONV_BAND_ROWS;
+    if (pool)
+        pool->parallel_for(bands, band);
+    else
+        for (uint32_t b = 0; b < bands; b ++)
+            band(b);
+    return 0;
+}
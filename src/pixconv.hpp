@@ -0,0 +1,33 @@
+/**
+ * (C) roentgen 
+ * this code is licensed under the MIT License.
+ */
+#if !defined(PIXCONV_HPP__)
+#define PIXCONV_HPP__
+
+#include "rawd.hpp"
+#include "pipeline.hpp"
+#include <stdint.h>
+
+/* GPU がそのまま読めない texel 形式を upload 用の形式に変換する. D3D12 には依存しない.
+   変換は行単位で、 書き込み先は trampoline の footprint でよい (コピーと変換を一度に済ませる).
+
+   RGB8    -> RGBA8   : alpha を 255 で埋める (SSSE3)
+   BGRA8   -> RGBA8   : R と B を入れ替える (SSE2/AVX2)
+   RGBA8   -> sRGB    : 線形の RGB を sRGB に符号化する (表引き, alpha はそのまま)
+   RGBA32F -> RGBA16F : F16C. 無ければ scalar で最近接偶数丸め
+   RGBA32F -> RGB10A2 : 0..1 に clamp して詰める (SSE4.1) */
+
+#define PIXCONV_SRGB       (1u << 0) /* 線形の RGBA8 を sRGB の texture にする */
+#define PIXCONV_PACK_FLOAT (1u << 1) /* float を RGBA16F でなく RGB10A2 にする (HDR の範囲は捨てる) */
+
+/* format を flags (PIXCONV_*) に従って upload する時の形式. 変換しないものは format のまま */
+uint32_t pixconv_target(uint32_t format, uint32_t flags);
+
+/* src から format への変換 (かコピー) ができるか */
+bool pixconv_supported(uint32_t src, uint32_t format);
+
+/* src を format に変換して dst に dstpitch 間隔で書く. 行は pool に配って並列に処理する */
+int pixconv(const pixel_view_t& src, uint32_t format, uint8_t* dst, size_t dstpitch, worker_pool_t* pool = nullptr);
+
+#endif
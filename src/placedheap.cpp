@@ -0,0 +1,187 @@
+/**
+ * (C) roentgen 
+ * this code is licensed under the MIT License.
+ */
+#include "stdafx.h"
+#include "placedheap.hpp"
+#include "dbgutils.hpp"
+#include <vector>
+#include <mutex>
+#include <atomic>
+#include <algorithm>
+
+using namespace Microsoft::WRL;
+
+struct placed_heap_t::state_t {
+    std::mutex mtx;
+    ComPtr< ID3D12Device > dev;
+    uint64_t block_size;
+    heap_suballocator_t core;
+    std::vector< ComPtr< ID3D12Heap > > heaps[PLACED_CATEGORIES];
+    std::atomic< uint64_t > placed;
+    std::atomic< uint64_t > small;     /* 4KB に揃えて置けた texture */
+    std::atomic< uint64_t > committed; /* 条件に合わずに committed で作ったもの */
+
+    state_t() : block_size(0), core(PLACED_CATEGORIES), placed(0), small(0), committed(0) {}
+
+    void free(const heap_allocation_t& a)
+    {
+        std::lock_guard< std::mutex > lock(mtx);
+        core.free(a);
+    }
+};
+
+/* resource の private data に付けておく. resource が壊れると一緒に Release され、区間を返す.
+   state_t を持っているので block (heap) は最後の resource より先には壊れない */
+class placed_release_t : public IUnknown {
+    std::atomic< ULONG > ref_;
+    std::shared_ptr< placed_heap_t::state_t > state_;
+    heap_allocation_t a_;
+public:
+    placed_release_t(std::shared_ptr< placed_heap_t::state_t > state, const heap_allocation_t& a) : ref_(1), state_(std::move(state)), a_(a) {}
+
+    HRESULT STDMETHODCALLTYPE QueryInterface(REFIID riid, void** out) override
+    {
+        if (riid == __uuidof(IUnknown)) {
+            *out = static_cast< IUnknown* >(this);
+            AddRef();
+            return S_OK;
+        }
+        *out = nullptr;
+        return E_NOINTERFACE;
+    }
+    ULONG STDMETHODCALLTYPE AddRef() override { return ++ ref_; }
+    ULONG STDMETHODCALLTYPE Release() override
+    {
+        const ULONG r = -- ref_;
+        if (!r) {
+            state_->free(a_);
+            delete this;
+        }
+        return r;
+    }
+};
+
+/* {6B1F3A52-2C4D-4E8A-9D31-5A7C0E42B819} */
+static const GUID PLACED_RELEASE_GUID = {0x6b1f3a52, 0x2c4d, 0x4e8a, {0x9d, 0x31, 0x5a, 0x7c, 0x0e, 0x42, 0xb8, 0x19}};
+
+static HRESULT create_committed(ID3D12Device* dev, const D3D12_RESOURCE_DESC& desc, D3D12_HEAP_TYPE type, D3D12_RESOURCE_STATES state, const D3D12_CLEAR_VALUE* clear, ComPtr< ID3D12Resource >& out)
+{
+    auto prop = setup_heapprop(type);
+    return dev->CreateCommittedResource(&prop, D3D12_HEAP_FLAG_NONE, &desc, state, clear, IID_PPV_ARGS(&out));
+}
+
+/* placed にできなければ PLACED_CATEGORIES */
+static uint32_t category_of(const D3D12_RESOURCE_DESC& desc, D3D12_HEAP_TYPE type)
+{
+    if (desc.Dimension == D3D12_RESOURCE_DIMENSION_BUFFER) {
+        if (type == D3D12_HEAP_TYPE_DEFAULT)
+            return PLACED_BUFFER_DEFAULT;
+        if (type == D3D12_HEAP_TYPE_UPLOAD)
+            return PLACED_BUFFER_UPLOAD;
+        return PLACED_CATEGORIES;
+    }
+    /* RT/DS は置いた後に clear か discard が要るので committed のまま */
+    const D3D12_RESOURCE_FLAGS rtds = D3D12_RESOURCE_FLAG_ALLOW_RENDER_TARGET | D3D12_RESOURCE_FLAG_ALLOW_DEPTH_STENCIL;
+    if (type != D3D12_HEAP_TYPE_DEFAULT || (desc.Flags & rtds) || desc.SampleDesc.Count > 1 || desc.Layout != D3D12_TEXTURE_LAYOUT_UNKNOWN)
+        return PLACED_CATEGORIES;
+    return PLACED_TEXTURE;
+}
+
+int placed_heap_t::init(uniq_device_t& u, uint64_t block_size)
+{
+    state_ = std::make_shared< state_t >();
+    state_->dev = u.dev();
+    state_->block_size = (block_size + D3D12_DEFAULT_RESOURCE_PLACEMENT_ALIGNMENT - 1) & ~static_cast< uint64_t >(D3D12_DEFAULT_RESOURCE_PLACEMENT_ALIGNMENT - 1);
+    return 0;
+}
+
+HRESULT placed_heap_t::create(const D3D12_RESOURCE_DESC& desc, D3D12_HEAP_TYPE type, D3D12_RESOURCE_STATES state, const D3D12_CLEAR_VALUE* clear, ComPtr< ID3D12Resource >& out)
+{
+    if (!state_)
+        return E_FAIL; /* init() されていない */
+    ID3D12Device* dev = state_->dev.Get();
+    const uint32_t category = state_->block_size ? category_of(desc, type) : PLACED_CATEGORIES;
+    if (category == PLACED_CATEGORIES) {
+        state_->committed ++;
+        return create_committed(dev, desc, type, state, clear, out);
+    }
+    D3D12_RESOURCE_DESC d = desc;
+    D3D12_RESOURCE_ALLOCATION_INFO info = {UINT64_MAX, 0};
+    if (category == PLACED_TEXTURE) {
+        d.Alignment = D3D12_SMALL_RESOURCE_PLACEMENT_ALIGNMENT;
+        info = dev->GetResourceAllocationInfo(0, 1, &d);
+    }
+    if (info.SizeInBytes == UINT64_MAX || info.Alignment != D3D12_SMALL_RESOURCE_PLACEMENT_ALIGNMENT) {
+        d.Alignment = 0;
+        info = dev->GetResourceAllocationInfo(0, 1, &d);
+    }
+    if (info.SizeInBytes == UINT64_MAX || info.SizeInBytes > state_->block_size) {
+        state_->committed ++;
+        return create_committed(dev, desc, type, state, clear, out);
+    }
+
+    heap_allocation_t a;
+    ID3D12Heap* heap = nullptr;
+    {
+        std::lock_guard< std::mutex > lock(state_->mtx);
+        if (!state_->core.alloc(category, info.SizeInBytes, info.Alignment, a)) {
+            static const D3D12_HEAP_FLAGS flags[PLACED_CATEGORIES] = {
+                D3D12_HEAP_FLAG_ALLOW_ONLY_BUFFERS, D3D12_HEAP_FLAG_ALLOW_ONLY_BUFFERS, D3D12_HEAP_FLAG_ALLOW_ONLY_NON_RT_DS_TEXTURES
+            };
+            D3D12_HEAP_DESC hd = {};
+            hd.SizeInBytes = state_->block_size;
+            hd.Properties = setup_heapprop(category == PLACED_BUFFER_UPLOAD ? D3D12_HEAP_TYPE_UPLOAD : D3D12_HEAP_TYPE_DEFAULT);
+            hd.Alignment = D3D12_DEFAULT_RESOURCE_PLACEMENT_ALIGNMENT;
+            hd.Flags = flags[category];
+            ComPtr< ID3D12Heap > h;
+            auto hr = dev->CreateHeap(&hd, IID_PPV_ARGS(&h));
+            if (FAILED(hr)) {
+                WRN("failed to create placed heap: category:%d err:0x%x\n", category, hr);
+                state_->committed ++;
+                return create_committed(dev, desc, type, state, clear, out);
+            }
+            NAME_OBJ2(h, L"placed heap");
+            state_->heaps[category].push_back(h);
+            state_->core.add_block(category, state_->block_size);
+            state_->core.alloc(category, info.SizeInBytes, info.Alignment, a);
+        }
+        heap = state_->heaps[category][a.block].Get();
+    }
+    auto hr = dev->CreatePlacedResource(heap, a.offset, &d, state, clear, IID_PPV_ARGS(&out));
+    if (FAILED(hr)) {
+        WRN("failed to create placed resource: err:0x%x\n", hr);
+        state_->free(a);
+        state_->committed ++;
+        return create_committed(dev, desc, type, state, clear, out);
+    }
+    placed_release_t* release = new placed_release_t(state_, a);
+    out->SetPrivateDataInterface(PLACED_RELEASE_GUID, release);
+    release->Release(); /* ここからは resource が持つ */
+    state_->placed ++;
+    if (info.Alignment == D3D12_SMALL_RESOURCE_PLACEMENT_ALIGNMENT)
+        state_->small ++;
+    return S_OK;
+}
+
+void placed_heap_t::report() const
+{
+    if (!state_ || !state_->block_size)
+        return;
+    static const wchar_t* names[PLACED_CATEGORIES] = {L"buffer", L"upload", L"texture"};
+    std::lock_guard< std::mutex > lock(state_->mtx);
+    for (uint32_t c = 0; c < PLACED_CATEGORIES; c ++) {
+        uint64_t capacity = 0, used = 0, largest = 0, live = 0;
+        for (uint32_t b = 0; b < state_->core.blocks(c); b ++) {
+            const tlsf_allocator_t& t = state_->core.block(c, b);
+            capacity += t.capacity();
+            used += t.used();
+            live += t.allocations();
+            largest = std::max(largest, t.largest_free());
+        }
+        if (capacity)
+            INF("placed heap %s: %d blocks %.2f/%.2f MB, %lld resources, largest free %.2f MB\n", names[c], state_->core.blocks(c),
+                used / (1024.0 * 1024.0), capacity / (1024.0 * 1024.0), live, largest / (1024.0 * 1024.0));
+    }
+    INF("placed heap: %lld placed (%lld at 4KB), %lld committed\n", state_->placed.load(), state_->small.load(), state_->committed.load());
+}
@@ -0,0 +1,46 @@
+/**
+ * (C) roentgen 
+ * this code is licensed under the MIT License.
+ */
+#if !defined(PLACEDHEAP_HPP__)
+#define PLACEDHEAP_HPP__
+
+#include "uniq_device.hpp"
+#include "heapalloc.hpp"
+#include <stdint.h>
+#include <memory>
+
+/* heap の category. ResourceHeapTier 1 の device でも使えるように buffer と texture の heap は分ける */
+enum placed_category_t {
+    PLACED_BUFFER_DEFAULT = 0,
+    PLACED_BUFFER_UPLOAD = 1,
+    PLACED_TEXTURE = 2,        /* DEFAULT の RT/DS でない texture */
+    PLACED_CATEGORIES = 3,
+};
+
+/* 大きな ID3D12Heap (block) を heap_suballocator_t で切り分けて placed resource を作る.
+   resource ごとに heap を作る committed より作るのも捨てるのも軽く、 alignment の無駄も減る.
+   - 小さい texture は D3D12_SMALL_RESOURCE_PLACEMENT_ALIGNMENT (4KB) を試し、 駄目なら 64KB に揃える. buffer は 64KB
+   - 区間は resource の private data に付けた object が、 resource が壊れる時に返す.
+     なので resource は今まで通り ComPtr で持ち、 GPU が使い終わってから手放せばよい (committed と同じ決まり)
+   - block は resource が残っている間は生きている (placed_heap_t が先に壊れても)
+   RT/DS, MSAA, 既定以外の layout, CUSTOM heap, block より大きいものは committed で作る. thread safe */
+class placed_heap_t {
+public:
+    struct state_t;
+
+private:
+    std::shared_ptr< state_t > state_;
+
+public:
+    /* block_size が 0 なら全部 committed */
+    int init(uniq_device_t& u, uint64_t block_size = uint64_t(64) << 20);
+
+    HRESULT create(const D3D12_RESOURCE_DESC& desc, D3D12_HEAP_TYPE type, D3D12_RESOURCE_STATES state, const D3D12_CLEAR_VALUE* clear,
+                   Microsoft::WRL::ComPtr< ID3D12Resource >& out);
+
+    /* category ごとの block の数, 使用量, 一番大きい空き (断片化の目安) と、 placed/committed の数 */
+    void report() const;
+};
+
+#endif
@@ -0,0 +1,349 @@
+/**
+ * (C) roentgen 
+ * this code is licensed under the MIT License.
+ */
+#include "png.hpp"
+#include "inflate.hpp"
+#include "pixconv.hpp"
+#include "simd.hpp"
+#include <string.h>
+#include <stdlib.h>
+#include <algorithm>
+
+static const uint8_t png_magic[8] = {0x89, 'P', 'N', 'G', 0x0d, 0x0a, 0x1a, 0x0a};
+
+static inline uint32_t be32(const uint8_t* p)
+{
+    return (static_cast< uint32_t >(p[0]) << 24) | (p[1] << 16) | (p[2] << 8) | p[3];
+}
+
+static inline int png_channels(uint8_t color)
+{
+    static const int channels[7] = {1, 0, 3, 1, 2, 0, 4};
+    return color < 7 ? channels[color] : 0;
+}
+
+bool png_signature(const uint8_t* p, size_t size)
+{
+    return size >= sizeof(png_magic) && memcmp(p, png_magic, sizeof(png_magic)) == 0;
+}
+
+int png_info(const uint8_t* p, size_t size, png_info_t& info)
+{
+    if (!png_signature(p, size))
+        return RAWD_ERR_HEADER;
+    if (size < 8 + 8 + 13 + 4)
+        return RAWD_ERR_TRUNCATED;
+    const uint8_t* ihdr = p + 8;
+    if (be32(ihdr) != 13 || memcmp(ihdr + 4, "IHDR", 4) != 0)
+        return RAWD_ERR_HEADER;
+    info.width = be32(ihdr + 8);
+    info.height = be32(ihdr + 12);
+    info.depth = ihdr[16];
+    info.color = ihdr[17];
+    info.interlace = ihdr[20];
+    if (!info.width || !info.height || info.width > (1u << 24) || info.height > (1u << 24))
+        return RAWD_ERR_HEADER;
+    if (ihdr[18] != 0 || ihdr[19] != 0 || info.interlace != 0)
+        return RAWD_ERR_HEADER; /* Adam7 は読まない */
+    switch (info.color) {
+    case 0:
+        if (info.depth != 1 && info.depth != 2 && info.depth != 4 && info.depth != 8 && info.depth != 16)
+            return RAWD_ERR_HEADER;
+        break;
+    case 3:
+        if (info.depth != 1 && info.depth != 2 && info.depth != 4 && info.depth != 8)
+            return RAWD_ERR_HEADER;
+        break;
+    case 2:
+    case 4:
+    case 6:
+        if (info.depth != 8 && info.depth != 16)
+            return RAWD_ERR_HEADER;
+        break;
+    default:
+        return RAWD_ERR_HEADER;
+    }
+    return 0;
+}
+
+/* 行の unfilter. in (filter byte の次から) を out に戻す. prev は前の行の戻した結果 (先頭行は 0 の行) */
+static inline uint8_t paeth(int a, int b, int c)
+{
+    const int p = a + b - c;
+    const int pa = abs(p - a), pb = abs(p - b), pc = abs(p - c);
+    if (pa <= pb && pa <= pc)
+        return static_cast< uint8_t >(a);
+    return static_cast< uint8_t >(pb <= pc ? b : c);
+}
+
+static void unfilter_scalar(uint8_t filter, const uint8_t* in, uint8_t* out, const uint8_t* prev, size_t n, size_t bpp)
+{
+    const size_t head = std::min(bpp, n);
+    switch (filter) {
+    case 1:
+        memcpy(out, in, head);
+        for (size_t i = bpp; i < n; i ++)
+            out[i] = static_cast< uint8_t >(in[i] + out[i - bpp]);
+        break;
+    case 2:
+        for (size_t i = 0; i < n; i ++)
+            out[i] = static_cast< uint8_t >(in[i] + prev[i]);
+        break;
+    case 3:
+        for (size_t i = 0; i < head; i ++)
+            out[i] = static_cast< uint8_t >(in[i] + (prev[i] >> 1));
+        for (size_t i = bpp; i < n; i ++)
+            out[i] = static_cast< uint8_t >(in[i] + ((out[i - bpp] + prev[i]) >> 1));
+        break;
+    case 4:
+        for (size_t i = 0; i < head; i ++)
+            out[i] = static_cast< uint8_t >(in[i] + prev[i]);
+        for (size_t i = bpp; i < n; i ++)
+            out[i] = static_cast< uint8_t >(in[i] + paeth(out[i - bpp], prev[i], prev[i - bpp]));
+        break;
+    default:
+        memcpy(out, in, n);
+        break;
+    }
+}
+
+#if defined(SIMD_X86)
+/* 3/4 byte の pixel は 1 pixel ずつしか進めない (前の pixel に依存する) が、 channel はまとめて計算できる */
+template < size_t Bpp >
+static inline __m128i load_px(const uint8_t* p)
+{
+    uint32_t v = 0;
+    memcpy(&v, p, Bpp);
+    return _mm_cvtsi32_si128(static_cast< int >(v));
+}
+
+template < size_t Bpp >
+static inline void store_px(uint8_t* p, __m128i v)
+{
+    const uint32_t t = static_cast< uint32_t >(_mm_cvtsi128_si32(v));
+    memcpy(p, &t, Bpp);
+}
+
+static inline __m128i abs_epi16(__m128i x)
+{
+    return _mm_max_epi16(x, _mm_sub_epi16(_mm_setzero_si128(), x));
+}
+
+static inline __m128i select_si128(__m128i mask, __m128i a, __m128i b)
+{
+    return _mm_or_si128(_mm_and_si128(mask, a), _mm_andnot_si128(mask, b));
+}
+
+/* Up はどの bpp でも 16 byte ずつ. それ以外は Bpp (3 か 4) byte の pixel 単位 */
+template < size_t Bpp >
+static void unfilter_sse2(uint8_t filter, const uint8_t* in, uint8_t* out, const uint8_t* prev, size_t n)
+{
+    const __m128i zero = _mm_setzero_si128();
+    size_t i = 0;
+    switch (filter) {
+    case 1: {
+        __m128i a = zero;
+        for (; i < n; i += Bpp) {
+            a = _mm_add_epi8(load_px< Bpp >(in + i), a);
+            store_px< Bpp >(out + i, a);
+        }
+        break;
+    }
+    case 2:
+        for (; i + 16 <= n; i += 16) {
+            const __m128i v = _mm_add_epi8(_mm_loadu_si128(reinterpret_cast< const __m128i* >(in + i)), _mm_loadu_si128(reinterpret_cast< const __m128i* >(prev + i)));
+            _mm_storeu_si128(reinterpret_cast< __m128i* >(out + i), v);
+        }
+        for (; i < n; i ++)
+            out[i] = static_cast< uint8_t >(in[i] + prev[i]);
+        break;
+    case 3: {
+        /* pavgb は切り上げるので、 a と b の和が奇数なら 1 引く */
+        const __m128i one = _mm_set1_epi8(1);
+        __m128i a = zero;
+        for (; i < n; i += Bpp) {
+            const __m128i b = load_px< Bpp >(prev + i);
+            const __m128i avg = _mm_sub_epi8(_mm_avg_epu8(a, b), _mm_and_si128(_mm_xor_si128(a, b), one));
+            a = _mm_add_epi8(load_px< Bpp >(in + i), avg);
+            store_px< Bpp >(out + i, a);
+        }
+        break;
+    }
+    case 4: {
+        /* 16bit に広げて |p - a| = |b - c|, |p - b| = |a - c|, |p - c| = |a + b - 2c| を比べる */
+        __m128i a = zero, c = zero;
+        for (; i < n; i += Bpp) {
+            const __m128i b = _mm_unpacklo_epi8(load_px< Bpp >(prev + i), zero);
+            __m128i pa = _mm_sub_epi16(b, c);
+            __m128i pb = _mm_sub_epi16(a, c);
+            __m128i pc = abs_epi16(_mm_add_epi16(pa, pb));
+            pa = abs_epi16(pa);
+            pb = abs_epi16(pb);
+            const __m128i smallest = _mm_min_epi16(pc, _mm_min_epi16(pa, pb));
+            const __m128i nearest = select_si128(_mm_cmpeq_epi16(smallest, pa), a, select_si128(_mm_cmpeq_epi16(smallest, pb), b, c));
+            const __m128i d = _mm_add_epi8(load_px< Bpp >(in + i), _mm_packus_epi16(nearest, nearest));
+            store_px< Bpp >(out + i, d);
+            a = _mm_unpacklo_epi8(d, zero);
+            c = b;
+        }
+        break;
+    }
+    default:
+        memcpy(out, in, n);
+        break;
+    }
+}
+#endif
+
+static void unfilter(uint8_t filter, const uint8_t* in, uint8_t* out, const uint8_t* prev, size_t n, size_t bpp)
+{
+#if defined(SIMD_X86)
+    if (bpp == 4 || filter == 2) {
+        unfilter_sse2< 4 >(filter, in, out, prev, n);
+        return;
+    }
+    if (bpp == 3) {
+        unfilter_sse2< 3 >(filter, in, out, prev, n);
+        return;
+    }
+#endif
+    unfilter_scalar(filter, in, out, prev, n, bpp);
+}
+
+struct png_layout_t {
+    png_info_t info;
+    size_t stride;          /* filter byte を除いた 1 行の byte 数 */
+    size_t bpp;             /* filter が参照する左隣の距離 (1 pixel の byte 数. 8bit 未満は 1) */
+    uint32_t palette[256];  /* palette と 8bit 以下の gray は index から RGBA8 を引く */
+};
+
+/* 戻した行を RGBA8 にして dst に書く */
+static void convert_row(const png_layout_t& l, const uint8_t* row, uint8_t* narrow, uint8_t* dst)
+{
+    const png_info_t& info = l.info;
+    const uint32_t w = info.width;
+    if (info.depth == 16) {
+        /* 上位 byte だけ使う */
+        const size_t n = static_cast< size_t >(w) * png_channels(info.color);
+        for (size_t i = 0; i < n; i ++)
+            narrow[i] = row[i * 2];
+        row = narrow;
+    }
+    if (info.color == 6) {
+        memcpy(dst, row, static_cast< size_t >(w) * 4);
+    }
+    else if (info.color == 2) {
+        pixel_view_t v = {row, w, 1, RAWD_FORMAT_RGB8, 3, static_cast< size_t >(w) * 3};
+        pixconv(v, RAWD_FORMAT_RGBA8, dst, static_cast< size_t >(w) * 4);
+    }
+    else if (info.color == 4) {
+        for (uint32_t x = 0; x < w; x ++, row += 2, dst += 4) {
+            dst[0] = dst[1] = dst[2] = row[0];
+            dst[3] = row[1];
+        }
+    }
+    else if (info.color == 0 && info.depth == 16) {
+        for (uint32_t x = 0; x < w; x ++)
+            memcpy(dst + x * 4, &l.palette[row[x]], 4);
+    }
+    else {
+        const int d = info.depth;
+        const int per = 8 / d;
+        const uint32_t mask = (1u << d) - 1;
+        for (uint32_t x = 0; x < w; x ++) {
+            const uint32_t idx = (row[x / per] >> (8 - d * (x % per + 1))) & mask;
+            memcpy(dst + x * 4, &l.palette[idx], 4);
+        }
+    }
+}
+
+int png_decode(const uint8_t* p, size_t size, uint8_t* dst, size_t dstpitch)
+{
+    png_layout_t l;
+    int err = png_info(p, size, l.info);
+    if (err < 0)
+        return err;
+    const png_info_t& info = l.info;
+    const size_t bits = static_cast< size_t >(png_channels(info.color)) * info.depth;
+    l.stride = (static_cast< size_t >(info.width) * bits + 7) / 8;
+    l.bpp = std::max< size_t >(bits / 8, 1);
+
+    /* gray は明るさの palette として扱う */
+    for (uint32_t i = 0; i < 256; i ++) {
+        const uint32_t g = info.color == 0 && info.depth < 16 ? i * 255 / ((1u << std::min< int >(info.depth, 8)) - 1) : info.color == 0 ? i : 0;
+        l.palette[i] = (g & 0xff) * 0x010101u | 0xff000000u;
+    }
+
+    /* IDAT は何個かに分かれていることがあるので、 その時だけつなげる. CRC は見ない (adler32 で検査する) */
+    thread_local std::vector< uint8_t > joined;
+    const uint8_t* z = nullptr;
+    size_t zlen = 0;
+    int idats = 0;
+    for (size_t off = 8; ; ) {
+        if (off + 12 > size)
+            return RAWD_ERR_TRUNCATED;
+        const uint32_t len = be32(p + off);
+        const uint8_t* type = p + off + 4;
+        const uint8_t* data = p + off + 8;
+        if (len > size - off - 12)
+            return RAWD_ERR_TRUNCATED;
+        if (!memcmp(type, "IDAT", 4)) {
+            if (idats == 1) {
+                joined.assign(z, z + zlen);
+                z = nullptr;
+            }
+            if (idats ++ == 0) {
+                z = data;
+                zlen = len;
+            }
+            else {
+                joined.insert(joined.end(), data, data + len);
+            }
+        }
+        else if (!memcmp(type, "PLTE", 4) && info.color == 3) {
+            for (uint32_t i = 0; i < len / 3 && i < 256; i ++)
+                l.palette[i] = data[i * 3] | (data[i * 3 + 1] << 8) | (data[i * 3 + 2] << 16) | 0xff000000u;
+        }
+        else if (!memcmp(type, "tRNS", 4) && info.color == 3) {
+            for (uint32_t i = 0; i < len && i < 256; i ++)
+                l.palette[i] = (l.palette[i] & 0xffffffu) | (static_cast< uint32_t >(data[i]) << 24);
+        }
+        else if (!memcmp(type, "IEND", 4)) {
+            break;
+        }
+        off += 12 + len;
+    }
+    if (!idats)
+        return RAWD_ERR_TRUNCATED;
+    if (idats > 1) {
+        z = joined.data();
+        zlen = joined.size();
+    }
+
+    thread_local std::vector< uint8_t > filtered, scratch;
+    const size_t line = l.stride + 1;
+    filtered.resize(line * info.height);
+    scratch.assign(l.stride * 3 + static_cast< size_t >(info.width) * 4, 0);
+    const int64_t r = zlib_inflate(z, zlen, filtered.data(), filtered.size());
+    if (r < 0)
+        return RAWD_ERR_CORRUPT;
+    if (r != static_cast< int64_t >(filtered.size()))
+        return RAWD_ERR_TRUNCATED;
+
+    /* 行は scratch の 2 本を交互に使う (前の行を参照するので) */
+    uint8_t* bufs[2] = {scratch.data(), scratch.data() + l.stride};
+    uint8_t* narrow = scratch.data() + l.stride * 2;
+    const uint8_t* prev = narrow; /* 先頭行の前は 0 の行 */
+    memset(narrow, 0, l.stride);
+    for (uint32_t y = 0; y < info.height; y ++) {
+        const uint8_t* in = filtered.data() + line * y;
+        if (in[0] > 4)
+            return RAWD_ERR_CORRUPT;
+        uint8_t* out = bufs[y & 1];
+        unfilter(in[0], in + 1, out, prev, l.stride, l.bpp);
+        convert_row(l, out, narrow, dst + dstpitch * y);
+        prev = out;
+    }
+    return 0;
+}
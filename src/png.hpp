@@ -0,0 +1,33 @@
+/**
+ * (C) roentgen 
+ * this code is licensed under the MIT License.
+ */
+#if !defined(PNG_HPP__)
+#define PNG_HPP__
+
+#include "rawd.hpp"
+#include <stdint.h>
+#include <stddef.h>
+
+/* PNG の展開. D3D12 には依存しない. 出力は常に RGBA8 で、 行は dstpitch 間隔で書く (trampoline の footprint でよい).
+   8/16bit の gray, gray+alpha, RGB, RGBA と 1/2/4/8bit の palette (tRNS の alpha 付き) を読む. interlace は読まない.
+   IDAT は一度にまとめて inflate し、 その後で行ごとに unfilter (SSE2 で 3/4 byte の pixel をまとめて) と変換をする.
+   1 枚の中は chunk に分けて並列にはしない (unfilter は前の行に依存する). 並列にするのはファイル単位で、 loader の stage の worker がそれぞれ別の PNG を展開する */
+
+struct png_info_t {
+    uint32_t width;
+    uint32_t height;
+    uint8_t depth;
+    uint8_t color;     /* 0: gray, 2: RGB, 3: palette, 4: gray + alpha, 6: RGBA */
+    uint8_t interlace;
+};
+
+bool png_signature(const uint8_t* p, size_t size);
+
+/* IHDR を読む. 読めない形式なら RAWD_ERR_HEADER */
+int png_info(const uint8_t* p, size_t size, png_info_t& info);
+
+/* p (ファイル全体) を RGBA8 で dst に展開する */
+int png_decode(const uint8_t* p, size_t size, uint8_t* dst, size_t dstpitch);
+
+#endif
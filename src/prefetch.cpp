@@ -0,0 +1,119 @@
+/**
+ * (C) roentgen 
+ * this code is licensed under the MIT License.
+ */
+#include "prefetch.hpp"
+#include "asyncio.hpp"
+#include "rawd.hpp"
+#include <stdio.h>
+#include <string.h>
+#include <memory>
+
+static const char* MANIFEST_MAGIC = "# access manifest v1";
+
+static FILE* open_file(const std::wstring& fname, const char* mode)
+{
+#if defined(_WIN32)
+    FILE* fp = nullptr;
+    _wfopen_s(&fp, fname.c_str(), mode[0] == 'w' ? L"wb" : L"rb");
+    return fp;
+#else
+    return fopen(narrow_path(fname).c_str(), mode[0] == 'w' ? "wb" : "rb");
+#endif
+}
+
+void access_manifest_t::record(const std::wstring& path, uint64_t offset, uint64_t size, uint32_t ms)
+{
+    std::lock_guard< std::mutex > lock(mtx_);
+    if (!seen_.insert(std::make_pair(path, offset)).second)
+        return;
+    access_entry_t e = {path, offset, size, ms};
+    entries_.push_back(std::move(e));
+}
+
+void access_manifest_t::clear()
+{
+    std::lock_guard< std::mutex > lock(mtx_);
+    entries_.clear();
+    seen_.clear();
+}
+
+int access_manifest_t::load(const std::wstring& fname)
+{
+    std::unique_ptr< FILE, decltype(&fclose) > fp(open_file(fname, "r"), fclose);
+    if (!fp)
+        return RAWD_ERR_OPEN;
+    std::vector< access_entry_t > entries;
+    char line[4096];
+    if (!fgets(line, sizeof(line), fp.get()) || strncmp(line, MANIFEST_MAGIC, strlen(MANIFEST_MAGIC)) != 0)
+        return RAWD_ERR_HEADER;
+    while (fgets(line, sizeof(line), fp.get())) {
+        unsigned ms = 0;
+        unsigned long long offset = 0, size = 0;
+        int used = 0;
+        if (sscanf(line, "%u %llu %llu %n", &ms, &offset, &size, &used) != 3 || !used)
+            continue;
+        std::string path(line + used);
+        while (!path.empty() && (path.back() == '\n' || path.back() == '\r'))
+            path.pop_back();
+        if (path.empty())
+            continue;
+        access_entry_t e = {widen_path(path), offset, size, ms};
+        entries.push_back(std::move(e));
+    }
+    std::lock_guard< std::mutex > lock(mtx_);
+    entries_ = std::move(entries);
+    seen_.clear();
+    for (auto& e : entries_)
+        seen_.insert(std::make_pair(e.path, e.offset));
+    return 0;
+}
+
+int access_manifest_t::save(const std::wstring& fname) const
+{
+    std::unique_ptr< FILE, decltype(&fclose) > fp(open_file(fname, "w"), fclose);
+    if (!fp)
+        return RAWD_ERR_OPEN;
+    std::lock_guard< std::mutex > lock(mtx_);
+    fprintf(fp.get(), "%s\n", MANIFEST_MAGIC);
+    for (auto& e : entries_)
+        fprintf(fp.get(), "%u %llu %llu %s\n", e.ms, static_cast< unsigned long long >(e.offset), static_cast< unsigned long long >(e.size), narrow_path(e.path).c_str());
+    return ferror(fp.get()) ? RAWD_ERR_OPEN : 0;
+}
+
+std::vector< access_entry_t > access_manifest_t::entries() const
+{
+    std::lock_guard< std::mutex > lock(mtx_);
+    return entries_;
+}
+
+size_t access_manifest_t::size() const
+{
+    std::lock_guard< std::mutex > lock(mtx_);
+    return entries_.size();
+}
+
+void prefetcher_t::start(std::vector< access_entry_t > entries)
+{
+    stop();
+    stop_ = false;
+    issued_ = 0;
+    if (entries.empty())
+        return;
+    thr_ = std::thread([this, entries = std::move(entries)] {
+            /* 前回読んだ順. 先頭ほど早く要る */
+            for (auto& e : entries) {
+                if (stop_)
+                    break;
+                io_prefetch(e.path, e.offset, e.size);
+                issued_ ++;
+            }
+        });
+}
+
+void prefetcher_t::stop()
+{
+    stop_ = true;
+    if (thr_.joinable())
+        thr_.join();
+}
@@ -0,0 +1,62 @@
+/**
+ * (C) roentgen 
+ * this code is licensed under the MIT License.
+ */
+#if !defined(PREFETCH_HPP__)
+#define PREFETCH_HPP__
+
+#include <stdint.h>
+#include <stddef.h>
+#include <atomic>
+#include <mutex>
+#include <set>
+#include <string>
+#include <thread>
+#include <utility>
+#include <vector>
+
+/* 起動時にどのファイル (archive なら範囲) をどの順に読んだかを manifest に残し、
+   次の起動ではその順に io_prefetch() を投げて loader が要求を取り出す前にページキャッシュへ載せておく.
+   cold cache の起動は I/O の待ちだけで決まるので、 loading 画面の準備と並べて先読みする. D3D12 には依存しない.
+
+   manifest はテキストで、 1 行に "ms offset size path(UTF-8)" */
+
+struct access_entry_t {
+    std::wstring path;
+    uint64_t offset;
+    uint64_t size;   /* 0 ならファイル全体 */
+    uint32_t ms;     /* 記録を始めてから最初に読むまでの時間 */
+};
+
+/* 読んだ順の記録. 同じ範囲は最初の 1 回だけ残す. どのスレッドから record() してもよい */
+class access_manifest_t {
+    mutable std::mutex mtx_;
+    std::vector< access_entry_t > entries_;
+    std::set< std::pair< std::wstring, uint64_t > > seen_;
+public:
+    void record(const std::wstring& path, uint64_t offset, uint64_t size, uint32_t ms);
+    void clear();
+
+    /* 読めなければ RAWD_ERR_OPEN. 書式のおかしい行は読み飛ばす */
+    int load(const std::wstring& fname);
+    int save(const std::wstring& fname) const;
+
+    std::vector< access_entry_t > entries() const;
+    size_t size() const;
+};
+
+/* entries の順に io_prefetch() を投げるスレッド. 止めればそこで打ち切る */
+class prefetcher_t {
+    std::thread thr_;
+    std::atomic< bool > stop_;
+    std::atomic< size_t > issued_;
+public:
+    prefetcher_t() : stop_(false), issued_(0) {}
+    ~prefetcher_t() { stop(); }
+
+    void start(std::vector< access_entry_t > entries);
+    void stop();
+    size_t issued() const { return issued_; }
+};
+
+#endif
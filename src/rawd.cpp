@@ -0,0 +1,439 @@
+/**
+ * (C) roentgen 
+ * this code is licensed under the MIT License.
+ */
+#include "rawd.hpp"
+#include "lzblock.hpp"
+#include "png.hpp"
+#include "pipeline.hpp"
+#include "hash.hpp"
+#include "wccopy.hpp"
+#include <string.h>
+#include <algorithm>
+
+#if defined(_WIN32)
+#ifndef WIN32_LEAN_AND_MEAN
+#define WIN32_LEAN_AND_MEAN
+#endif
+#include <windows.h>
+#else
+#include <sys/types.h>
+#include <sys/stat.h>
+#include <sys/mman.h>
+#include <fcntl.h>
+#include <unistd.h>
+#endif
+
+std::string narrow_path(const std::wstring& path)
+{
+    std::string s;
+    s.reserve(path.size());
+    for (size_t i = 0; i < path.size(); i ++) {
+        uint32_t c = static_cast< uint32_t >(path[i]);
+        if (sizeof(wchar_t) == 2 && c >= 0xd800 && c < 0xdc00 && i + 1 < path.size()) {
+            /* surrogate pair (Win32 の wchar_t は UTF-16) */
+            c = 0x10000 + ((c - 0xd800) << 10) + (static_cast< uint32_t >(path[++ i]) - 0xdc00);
+        }
+        if (c < 0x80) {
+            s.push_back(static_cast< char >(c));
+        }
+        else if (c < 0x800) {
+            s.push_back(static_cast< char >(0xc0 | (c >> 6)));
+            s.push_back(static_cast< char >(0x80 | (c & 0x3f)));
+        }
+        else if (c < 0x10000) {
+            s.push_back(static_cast< char >(0xe0 | (c >> 12)));
+            s.push_back(static_cast< char >(0x80 | ((c >> 6) & 0x3f)));
+            s.push_back(static_cast< char >(0x80 | (c & 0x3f)));
+        }
+        else {
+            s.push_back(static_cast< char >(0xf0 | (c >> 18)));
+            s.push_back(static_cast< char >(0x80 | ((c >> 12) & 0x3f)));
+            s.push_back(static_cast< char >(0x80 | ((c >> 6) & 0x3f)));
+            s.push_back(static_cast< char >(0x80 | (c & 0x3f)));
+        }
+    }
+    return s;
+}
+
+std::wstring widen_path(const std::string& path)
+{
+    std::wstring s;
+    s.reserve(path.size());
+    for (size_t i = 0; i < path.size(); ) {
+        const uint8_t c = static_cast< uint8_t >(path[i]);
+        const int n = c < 0x80 ? 0 : c < 0xc0 ? -1 : c < 0xe0 ? 1 : c < 0xf0 ? 2 : c < 0xf8 ? 3 : -1;
+        if (n < 0 || i + n >= path.size()) {
+            s.push_back(static_cast< wchar_t >(0xfffd));
+            i ++;
+            continue;
+        }
+        uint32_t cp = n ? (c & (0x3f >> n)) : c;
+        bool ok = true;
+        for (int k = 1; k <= n; k ++) {
+            const uint8_t cc = static_cast< uint8_t >(path[i + k]);
+            ok = ok && (cc & 0xc0) == 0x80;
+            cp = (cp << 6) | (cc & 0x3f);
+        }
+        if (!ok) {
+            s.push_back(static_cast< wchar_t >(0xfffd));
+            i ++;
+            continue;
+        }
+        i += n + 1;
+        if (sizeof(wchar_t) == 2 && cp >= 0x10000) {
+            cp -= 0x10000;
+            s.push_back(static_cast< wchar_t >(0xd800 + (cp >> 10)));
+            s.push_back(static_cast< wchar_t >(0xdc00 + (cp & 0x3ff)));
+        }
+        else {
+            s.push_back(static_cast< wchar_t >(cp));
+        }
+    }
+    return s;
+}
+
+int mapped_file_t::open(const std::wstring& fname)
+{
+    close();
+#if defined(_WIN32)
+    /* 先頭から舐めるだけなので SEQUENTIAL_SCAN をヒントとして渡しておく */
+    HANDLE file = CreateFileW(fname.c_str(), GENERIC_READ, FILE_SHARE_READ, nullptr, OPEN_EXISTING, FILE_ATTRIBUTE_NORMAL | FILE_FLAG_SEQUENTIAL_SCAN, nullptr);
+    if (file == INVALID_HANDLE_VALUE)
+        return RAWD_ERR_OPEN;
+    LARGE_INTEGER sz = {};
+    if (!GetFileSizeEx(file, &sz) || sz.QuadPart == 0) {
+        CloseHandle(file);
+        return RAWD_ERR_OPEN;
+    }
+    HANDLE mapping = CreateFileMappingW(file, nullptr, PAGE_READONLY, 0, 0, nullptr);
+    CloseHandle(file);
+    if (!mapping)
+        return RAWD_ERR_OPEN;
+    void* p = MapViewOfFile(mapping, FILE_MAP_READ, 0, 0, 0);
+    CloseHandle(mapping); /* view が mapping の参照を持っている */
+    if (!p)
+        return RAWD_ERR_OPEN;
+    base_ = static_cast< const uint8_t* >(p);
+    size_ = static_cast< size_t >(sz.QuadPart);
+#else
+    int fd = ::open(narrow_path(fname).c_str(), O_RDONLY | O_CLOEXEC);
+    if (fd < 0)
+        return RAWD_ERR_OPEN;
+    struct stat st;
+    if (fstat(fd, &st) < 0 || st.st_size == 0) {
+        ::close(fd);
+        return RAWD_ERR_OPEN;
+    }
+    void* p = mmap(nullptr, static_cast< size_t >(st.st_size), PROT_READ, MAP_PRIVATE, fd, 0);
+    ::close(fd); /* mapping が inode の参照を持っている */
+    if (p == MAP_FAILED)
+        return RAWD_ERR_OPEN;
+    madvise(p, static_cast< size_t >(st.st_size), MADV_SEQUENTIAL);
+    madvise(p, static_cast< size_t >(st.st_size), MADV_WILLNEED);
+    base_ = static_cast< const uint8_t* >(p);
+    size_ = static_cast< size_t >(st.st_size);
+#endif
+    return 0;
+}
+
+void mapped_file_t::close()
+{
+    if (!base_)
+        return;
+#if defined(_WIN32)
+    UnmapViewOfFile(base_);
+#else
+    munmap(const_cast< uint8_t* >(base_), size_);
+#endif
+    base_ = nullptr;
+    size_ = 0;
+}
+
+/* v1.1 の拡張 header と block 表を読む. p は note の直後 */
+static int parse_ext(const uint8_t* p, size_t size, pixel_view_t& view, rawd_blocks_t* blocks)
+{
+    rawd_ext_t ext;
+    if (size < sizeof(ext))
+        return RAWD_ERR_TRUNCATED;
+    memcpy(&ext, p, sizeof(ext));
+    if (ext.size < sizeof(ext))
+        return RAWD_ERR_HEADER;
+    if (ext.size > size)
+        return RAWD_ERR_TRUNCATED;
+    if (ext.pitch < rawd_row_bytes(view))
+        return RAWD_ERR_HEADER;
+    view.pitch = ext.pitch;
+    p += ext.size;
+    size -= ext.size;
+    if (!(ext.flags & RAWD_FLAG_LZ)) {
+        /* 非圧縮だが pitch が dense ではない */
+        if (rawd_payload_bytes(view) > size)
+            return RAWD_ERR_TRUNCATED;
+        view.data = p;
+        return 0;
+    }
+    if (!blocks)
+        return RAWD_ERR_HEADER;
+    if (!ext.block_rows || ext.blocks != (rawd_rows(view) + ext.block_rows - 1) / ext.block_rows)
+        return RAWD_ERR_HEADER;
+    const uint64_t table = static_cast< uint64_t >(ext.blocks) * sizeof(uint32_t);
+    if (table + ext.payload_bytes > size)
+        return RAWD_ERR_TRUNCATED;
+    blocks->offset.resize(ext.blocks + 1);
+    blocks->offset[0] = 0;
+    for (uint32_t i = 0; i < ext.blocks; i ++) {
+        uint32_t c;
+        memcpy(&c, p + i * sizeof(uint32_t), sizeof(c));
+        blocks->offset[i + 1] = blocks->offset[i] + c;
+    }
+    if (blocks->offset[ext.blocks] != ext.payload_bytes)
+        return RAWD_ERR_HEADER;
+    blocks->data = p + table;
+    blocks->count = ext.blocks;
+    blocks->rows = ext.block_rows;
+    view.data = nullptr;
+    return 0;
+}
+
+/* 先頭の 32 byte を読んで view の形を埋める */
+static int parse_header(const uint8_t* p, size_t size, rawd_header_t& head, pixel_view_t& view)
+{
+    if (size < sizeof(rawd_header_t))
+        return RAWD_ERR_TRUNCATED;
+    memcpy(&head, p, sizeof(rawd_header_t));
+    if (memcmp(head.fourcc, "RAWD", 4) != 0 || head.ver_hi != 1)
+        return RAWD_ERR_HEADER;
+    if (!head.width || !head.height || !head.pixperbyte || head.pixperbyte > 16)
+        return RAWD_ERR_HEADER;
+    if (rawd_format_bytes(head.format) && rawd_format_bytes(head.format) != head.pixperbyte)
+        return RAWD_ERR_HEADER;
+    view.width = head.width;
+    view.height = head.height;
+    view.format = head.format;
+    view.bpp = head.pixperbyte;
+    view.pitch = rawd_row_bytes(view); /* たぶん dense */
+    return 0;
+}
+
+int parse_rawd(const uint8_t* p, size_t size, rawd_header_t& head, pixel_view_t& view, rawd_blocks_t* blocks)
+{
+    if (blocks)
+        *blocks = rawd_blocks_t();
+    int err = parse_header(p, size, head, view);
+    if (err < 0)
+        return err;
+
+    const uint64_t offset = sizeof(rawd_header_t) + static_cast< uint64_t >(head.notelen);
+    if (offset > size)
+        return RAWD_ERR_TRUNCATED;
+    if (head.ver_lo >= 1)
+        return parse_ext(p + offset, static_cast< size_t >(size - offset), view, blocks);
+
+    const uint64_t bytes = static_cast< uint64_t >(view.pitch) * rawd_rows(view);
+    if (offset + bytes > size)
+        return RAWD_ERR_TRUNCATED;
+    view.data = p + offset;
+    return 0;
+}
+
+int rawd_pixel_offset(const uint8_t* p, size_t size, uint64_t filesize, rawd_header_t& head, pixel_view_t& view, uint64_t& offset)
+{
+    view = pixel_view_t();
+    if (png_signature(p, size))
+        return RAWD_ERR_HEADER;
+    int err = parse_header(p, size, head, view);
+    if (err < 0)
+        return err;
+    offset = sizeof(rawd_header_t) + static_cast< uint64_t >(head.notelen);
+    if (head.ver_lo >= 1) {
+        rawd_ext_t ext;
+        if (offset + sizeof(ext) > size)
+            return RAWD_ERR_TRUNCATED;
+        memcpy(&ext, p + offset, sizeof(ext));
+        if (ext.size < sizeof(ext) || ext.pitch < rawd_row_bytes(view) || (ext.flags & RAWD_FLAG_LZ))
+            return RAWD_ERR_HEADER;
+        view.pitch = ext.pitch;
+        offset += ext.size;
+    }
+    if (offset + rawd_payload_bytes(view) > filesize)
+        return RAWD_ERR_TRUNCATED;
+    return 0;
+}
+
+/* RAWD か PNG として検証する. p は file_ か buf_ の中 */
+int rawd_image_t::parse(const uint8_t* p, size_t size)
+{
+    png_ = nullptr;
+    png_size_ = 0;
+    if (!png_signature(p, size))
+        return parse_rawd(p, size, head_, view_, &blocks_);
+    png_info_t info;
+    int err = png_info(p, size, info);
+    if (err < 0)
+        return err;
+    head_ = rawd_header_t();
+    memcpy(head_.fourcc, "RAWD", 4);
+    head_.ver_hi = 1;
+    head_.width = info.width;
+    head_.height = info.height;
+    head_.format = RAWD_FORMAT_RGBA8;
+    head_.pixperbyte = 4;
+    view_ = pixel_view_t();
+    view_.width = info.width;
+    view_.height = info.height;
+    view_.format = RAWD_FORMAT_RGBA8;
+    view_.bpp = 4;
+    view_.pitch = static_cast< size_t >(info.width) * 4;
+    blocks_ = rawd_blocks_t();
+    png_ = p;
+    png_size_ = size;
+    return 0;
+}
+
+int rawd_image_t::open(const std::wstring& fname)
+{
+    view_ = pixel_view_t();
+    buf_.clear();
+    int err = file_.open(fname);
+    if (err < 0)
+        return err;
+    err = parse(file_.data(), file_.size());
+    if (err < 0) {
+        file_.close();
+        view_ = pixel_view_t();
+        blocks_ = rawd_blocks_t();
+    }
+    return err;
+}
+
+int rawd_image_t::open(std::vector< uint8_t >&& contents)
+{
+    view_ = pixel_view_t();
+    file_.close();
+    buf_ = std::move(contents);
+    int err = parse(buf_.data(), buf_.size());
+    if (err < 0) {
+        buf_.clear();
+        view_ = pixel_view_t();
+        blocks_ = rawd_blocks_t();
+    }
+    return err;
+}
+
+int rawd_image_t::open(const uint8_t* p, size_t size)
+{
+    view_ = pixel_view_t();
+    file_.close();
+    buf_.clear();
+    int err = parse(p, size);
+    if (err < 0) {
+        view_ = pixel_view_t();
+        blocks_ = rawd_blocks_t();
+    }
+    return err;
+}
+
+uint32_t rawd_checksum(const uint8_t* p, size_t size)
+{
+    return rawd_checksum_of(xxh64(p, size));
+}
+
+const uint8_t* rawd_image_t::payload() const
+{
+    if (png_)
+        return png_;
+    if (blocks_.data)
+        return blocks_.data - static_cast< size_t >(blocks_.count) * sizeof(uint32_t);
+    return view_.data;
+}
+
+size_t rawd_image_t::payload_size() const
+{
+    if (png_)
+        return png_size_;
+    if (blocks_.data)
+        return static_cast< size_t >(blocks_.count) * sizeof(uint32_t) + packed_size();
+    return view_.data ? rawd_payload_bytes(view_) : 0;
+}
+
+int rawd_image_t::verify() const
+{
+    const uint32_t c = checksum();
+    if (!c)
+        return 0;
+    return rawd_checksum(payload(), payload_size()) == c ? 0 : RAWD_ERR_CHECKSUM;
+}
+
+int rawd_image_t::decode_block(uint32_t i, uint8_t* dst, size_t dstpitch, bool wc) const
+{
+    if (i >= blocks_.count)
+        return RAWD_ERR_CORRUPT;
+    /* block の展開後の大きさ. 最後の block は最後の行のパディングを含まない */
+    const size_t total = rawd_payload_bytes(view_);
+    const size_t begin = view_.pitch * blocks_.rows * i;
+    const size_t bytes = std::min< size_t >(total, begin + view_.pitch * blocks_.rows) - begin;
+    const uint8_t* src = blocks_.data + blocks_.offset[i];
+    const size_t csize = blocks_.csize(i);
+    const uint32_t rows = std::min< uint32_t >(blocks_.rows, rawd_rows(view_) - blocks_.rows * i);
+
+    if (dstpitch == view_.pitch) {
+        if (csize == bytes) {
+            if (wc)
+                wc_copy(dst, src, bytes);
+            else
+                memcpy(dst, src, bytes);
+            return 0;
+        }
+        /* pitch が一致していて cache の効く先なら直接展開する. write-combined な先は一致の copy が
+           書いたばかりの出力を読み直すので、 下の tmp に展開してから流す */
+        if (!wc)
+            return lz_decompress(src, csize, dst, bytes) < 0 ? RAWD_ERR_CORRUPT : 0;
+    }
+    const uint8_t* rows_src = src;
+    thread_local std::vector< uint8_t > tmp;
+    if (csize != bytes) {
+        tmp.resize(bytes);
+        if (lz_decompress(src, csize, tmp.data(), bytes) < 0)
+            return RAWD_ERR_CORRUPT;
+        rows_src = tmp.data();
+    }
+    if (dstpitch == view_.pitch)
+        wc_copy(dst, rows_src, bytes);
+    else
+        (wc ? wc_copy_rows : copy_rows)(dst, dstpitch, rows_src, view_.pitch, std::min< size_t >(dstpitch, rawd_row_bytes(view_)), rows);
+    return 0;
+}
+
+int rawd_image_t::decode_to(uint8_t* dst, size_t dstpitch, worker_pool_t* pool, bool wc) const
+{
+    if (png_)
+        return png_decode(png_, png_size_, dst, dstpitch);
+    if (!blocks_.data)
+        return RAWD_ERR_OPEN;
+    std::atomic< int > failed(0);
+    auto block = [&](size_t i) {
+        int err = decode_block(static_cast< uint32_t >(i), dst + dstpitch * blocks_.rows * i, dstpitch, wc);
+        if (err < 0)
+            failed = err;
+    };
+    if (pool)
+        pool->parallel_for(blocks_.count, block);
+    else
+        for (uint32_t i = 0; i < blocks_.count; i ++)
+            block(i);
+    return failed;
+}
+
+int rawd_image_t::decode(std::vector< uint8_t >& buf, pixel_view_t& v, worker_pool_t* pool) const
+{
+    v = view_;
+    if (!compressed())
+        return empty() ? RAWD_ERR_OPEN : 0;
+    buf.resize(rawd_payload_bytes(view_));
+    int err = decode_to(buf.data(), view_.pitch, pool);
+    if (err < 0)
+        return err;
+    v.data = buf.data();
+    return 0;
+}
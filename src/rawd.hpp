@@ -0,0 +1,261 @@
+/**
+ * (C) roentgen 
+ * this code is licensed under the MIT License.
+ */
+#if !defined(RAWD_HPP__)
+#define RAWD_HPP__
+
+#include <stdint.h>
+#include <stddef.h>
+#include <string>
+#include <vector>
+
+/* RAWD: tools/header.pl が生成する生テクスチャのコンテナ.
+   header(32 bytes) + note(notelen bytes) + dense な pixel 列.
+   v1.1 (ver_lo >= 1) では note の後に rawd_ext_t が続き、 pixel 列を行単位の block に分けて圧縮できる.
+   v1.2 (ver_lo >= 2) では header の checksum に payload の rawd_checksum() が入る.
+   D3D12 に依存しないので cooker や Linux 上のツールからも使える */
+
+#pragma pack(push, 1)
+struct rawd_header_t {
+    uint8_t fourcc[4];
+    uint16_t ver_hi;
+    uint16_t ver_lo;
+    uint32_t checksum;   /* v1.2 から. それより前は header.pl が 1 行の byte 数を書いていたので見ない */
+    uint32_t width;
+    uint32_t height;
+    uint32_t format;
+    uint32_t pixperbyte; /* 名前に反して 1 pixel あたりの byte 数 */
+    uint32_t notelen;
+};
+#pragma pack(pop)
+
+static_assert(sizeof(rawd_header_t) == 32, "RAWD header must be 32 bytes");
+
+#define RAWD_FLAG_LZ (1) /* payload が lzblock で圧縮されている */
+
+/* v1.1 の拡張 header. この後に uint32_t csize[blocks] (圧縮後の block の大きさ) と payload が続く.
+   展開後の pixel 列は pitch byte/行 で、 block_rows 行ずつ独立した block になっている (最後の block だけ短い).
+   BCn の場合の行は 4x4 block の行.
+   csize が展開後の大きさと同じ block は圧縮せずにそのまま入っている */
+#pragma pack(push, 1)
+struct rawd_ext_t {
+    uint32_t size;        /* sizeof(rawd_ext_t). 将来の拡張用 */
+    uint32_t flags;
+    uint32_t pitch;
+    uint32_t block_rows;
+    uint32_t blocks;
+    uint32_t reserve;
+    uint64_t payload_bytes; /* csize の合計 */
+};
+#pragma pack(pop)
+
+static_assert(sizeof(rawd_ext_t) == 32, "RAWD extension must be 32 bytes");
+
+#define RAWD_ERR_OPEN      (-1) /* ファイルが開けない/map できない */
+#define RAWD_ERR_HEADER    (-2) /* fourcc やバージョンがおかしい */
+#define RAWD_ERR_TRUNCATED (-3) /* header の示す大きさよりファイルが短い */
+#define RAWD_ERR_CORRUPT   (-4) /* 圧縮 block が展開できない, archive の toc が矛盾している */
+#define RAWD_ERR_CHECKSUM  (-5) /* payload が checksum と合わない */
+
+/* 読み取り専用の pixel 列. data は map されたファイルの中を直接指しているので
+   持ち主 (rawd_image_t など) より長生きさせてはいけない. 圧縮されている時は data は nullptr で、
+   pitch は展開後の 1 行の byte 数 */
+struct pixel_view_t {
+    const uint8_t* data;
+    uint32_t width;
+    uint32_t height;
+    uint32_t format;
+    uint32_t bpp;  /* bytes per pixel. BCn では 4x4 block ひとつの byte 数 */
+    size_t pitch;  /* data 上の 1 行 (BCn では block 1 行) の byte 数 */
+};
+
+/* rawd_header_t::format. header.pl は 0 (RGBA8) しか書かない.
+   BCn は 4x4 texel の block 単位で並んでいて、 pixperbyte は block の byte 数になる */
+enum rawd_format_t {
+    RAWD_FORMAT_RGBA8 = 0,
+    RAWD_FORMAT_BC1 = 1,   /* RGB (1bit alpha は使わない), 8 byte/block */
+    RAWD_FORMAT_BC3 = 2,   /* RGBA, 16 byte/block */
+    RAWD_FORMAT_BC7 = 3,   /* RGBA, 16 byte/block */
+    RAWD_FORMAT_UNIVERSAL = 4, /* load 時に BC7/BC1/RGBA8 へ変換する中間形式 (transcode.hpp), 12 byte/block */
+    /* 以下は texel 単位. GPU が直接読めないものは upload 時に変換する (pixconv.hpp) */
+    RAWD_FORMAT_RGB8 = 5,       /* 3 byte/texel */
+    RAWD_FORMAT_BGRA8 = 6,
+    RAWD_FORMAT_RGBA8_SRGB = 7, /* sRGB で符号化された RGBA8 */
+    RAWD_FORMAT_RGBA16F = 8,    /* half x 4 */
+    RAWD_FORMAT_RGBA32F = 9,    /* float x 4 */
+    RAWD_FORMAT_RGB10A2 = 10,   /* 10:10:10:2 の unorm を 32bit に (R が下位) */
+};
+
+/* GPU がそのまま読める block 圧縮形式か */
+inline bool rawd_is_bc(uint32_t format) { return format == RAWD_FORMAT_BC1 || format == RAWD_FORMAT_BC3 || format == RAWD_FORMAT_BC7; }
+/* 4x4 block 単位で並んでいるか (中間形式を含む) */
+inline bool rawd_is_block(uint32_t format) { return rawd_is_bc(format) || format == RAWD_FORMAT_UNIVERSAL; }
+/* 1 要素の byte 数. 0 なら header の pixperbyte を信じる (RGBA8 と未知の形式) */
+inline uint32_t rawd_format_bytes(uint32_t format)
+{
+    switch (format) {
+    case RAWD_FORMAT_BC1: return 8;
+    case RAWD_FORMAT_BC3: return 16;
+    case RAWD_FORMAT_BC7: return 16;
+    case RAWD_FORMAT_UNIVERSAL: return 12;
+    case RAWD_FORMAT_RGB8: return 3;
+    case RAWD_FORMAT_BGRA8: return 4;
+    case RAWD_FORMAT_RGBA8_SRGB: return 4;
+    case RAWD_FORMAT_RGBA16F: return 8;
+    case RAWD_FORMAT_RGBA32F: return 16;
+    case RAWD_FORMAT_RGB10A2: return 4;
+    default: return 0;
+    }
+}
+/* 1 要素が何 texel 四方か */
+inline uint32_t rawd_block_dim(uint32_t format) { return rawd_is_block(format) ? 4 : 1; }
+/* 要素 (texel か block) 単位の行数と 1 行の byte 数 (パディング無し) */
+inline uint32_t rawd_rows(const pixel_view_t& v) { return (v.height + rawd_block_dim(v.format) - 1) / rawd_block_dim(v.format); }
+inline size_t rawd_row_bytes(const pixel_view_t& v) { return static_cast< size_t >((v.width + rawd_block_dim(v.format) - 1) / rawd_block_dim(v.format)) * v.bpp; }
+
+/* 読み取り専用のファイルマッピング.
+   Win32 では CreateFileMapping/MapViewOfFile, それ以外では mmap を使う.
+   view さえ残っていればハンドルや fd は不要なので open() の中で閉じてしまう */
+class mapped_file_t {
+    const uint8_t* base_;
+    size_t size_;
+public:
+    mapped_file_t() : base_(nullptr), size_(0) {}
+    ~mapped_file_t() { close(); }
+    mapped_file_t(const mapped_file_t&) = delete;
+    mapped_file_t& operator=(const mapped_file_t&) = delete;
+    mapped_file_t(mapped_file_t&& o) : base_(o.base_), size_(o.size_) { o.base_ = nullptr; o.size_ = 0; }
+    mapped_file_t& operator=(mapped_file_t&& o)
+    {
+        if (this != &o) {
+            close();
+            base_ = o.base_;
+            size_ = o.size_;
+            o.base_ = nullptr;
+            o.size_ = 0;
+        }
+        return *this;
+    }
+
+    int open(const std::wstring& fname);
+    void close();
+
+    inline const uint8_t* data() const { return base_; }
+    inline size_t size() const { return size_; }
+    inline bool is_open() const { return base_ != nullptr; }
+};
+
+/* 圧縮された payload の block 表. offset[i] は data からの i 番目の block の位置 (要素数は count + 1) */
+struct rawd_blocks_t {
+    const uint8_t* data;
+    uint32_t count;
+    uint32_t rows;          /* 1 block の行数 */
+    std::vector< uint64_t > offset;
+
+    rawd_blocks_t() : data(nullptr), count(0), rows(0) {}
+    inline size_t csize(uint32_t i) const { return static_cast< size_t >(offset[i + 1] - offset[i]); }
+};
+
+class worker_pool_t;
+
+/* RAWD を map して header を検証し、 pixel 列への view を返す.
+   pixel はコピーされず、 upload heap に書き込む時に初めて触られる.
+   圧縮されていれば decode_block() で block ごとに直接書き込み先へ展開する.
+   PNG も開ける. その時は RGBA8 の圧縮された RAWD と同じ扱いで、 decode_to() で書き込み先へ直接展開する */
+class rawd_image_t {
+    mapped_file_t file_;
+    std::vector< uint8_t > buf_; /* map せずに読み込んだ時の中身 */
+    rawd_header_t head_;
+    pixel_view_t view_;
+    rawd_blocks_t blocks_;
+    const uint8_t* png_;         /* PNG ならファイルの先頭 */
+    size_t png_size_;
+
+    int parse(const uint8_t* p, size_t size);
+public:
+    rawd_image_t() : head_(), view_(), png_(nullptr), png_size_(0) {}
+    rawd_image_t(rawd_image_t&& o) : file_(std::move(o.file_)), buf_(std::move(o.buf_)), head_(o.head_), view_(o.view_), blocks_(std::move(o.blocks_)), png_(o.png_), png_size_(o.png_size_)
+    {
+        o.view_ = pixel_view_t();
+        o.blocks_ = rawd_blocks_t();
+        o.png_ = nullptr;
+        o.png_size_ = 0;
+    }
+    rawd_image_t& operator=(rawd_image_t&& o)
+    {
+        if (this != &o) {
+            file_ = std::move(o.file_);
+            buf_ = std::move(o.buf_);
+            head_ = o.head_;
+            view_ = o.view_;
+            blocks_ = std::move(o.blocks_);
+            png_ = o.png_;
+            png_size_ = o.png_size_;
+            o.view_ = pixel_view_t();
+            o.blocks_ = rawd_blocks_t();
+            o.png_ = nullptr;
+            o.png_size_ = 0;
+        }
+        return *this;
+    }
+
+    int open(const std::wstring& fname);
+    /* 読み込み済みのファイルの中身を引き取って検証する (async_io_t で読んだものなど). view は contents を指す */
+    int open(std::vector< uint8_t >&& contents);
+    /* 呼び出し側が持っているメモリを検証する (pool から借りたバッファなど). p は img より長生きさせること */
+    int open(const uint8_t* p, size_t size);
+
+    inline const rawd_header_t& header() const { return head_; }
+    inline const pixel_view_t& view() const { return view_; }
+    inline bool empty() const { return view_.data == nullptr && !compressed(); }
+
+    inline bool compressed() const { return blocks_.data != nullptr || png_ != nullptr; }
+    inline bool is_png() const { return png_ != nullptr; }
+    inline const rawd_blocks_t& blocks() const { return blocks_; }
+    /* checksum が守っている範囲. 非圧縮なら pixel 列, LZ なら block 表と圧縮 payload, PNG ならファイル全体 */
+    const uint8_t* payload() const;
+    size_t payload_size() const;
+    /* v1.2 以降の RAWD なら header の checksum. 無ければ 0 (PNG は zlib の adler32 を展開時に見る) */
+    inline uint32_t checksum() const { return (!png_ && head_.ver_lo >= 2) ? head_.checksum : 0; }
+    /* payload をなめて checksum と照合する. checksum が無ければ何もしない */
+    int verify() const;
+    /* 展開前のデータ (LZ の payload か PNG のファイル全体). 圧縮されていなければ空 */
+    const uint8_t* packed() const { return png_ ? png_ : blocks_.data; }
+    size_t packed_size() const { return png_ ? png_size_ : blocks_.data ? static_cast< size_t >(blocks_.offset[blocks_.count]) : 0; }
+    /* i 番目の block を dst (1 行 dstpitch byte) に展開する. 他の block と並列に呼んでよい.
+       wc は dst が map した upload heap の時だけ true にする. dst は non-temporal store で書くだけで読み直さない (LZ の block は一旦スレッドごとの tmp に展開する) */
+    int decode_block(uint32_t i, uint8_t* dst, size_t dstpitch, bool wc = false) const;
+    /* 全体を dst (1 行 dstpitch byte) に展開する. LZ の block は pool に配って並列に */
+    int decode_to(uint8_t* dst, size_t dstpitch, worker_pool_t* pool = nullptr, bool wc = false) const;
+    /* 全体を buf に展開して dense でない view (pitch は view().pitch) を作る. 圧縮されていなければ view() をそのまま返す */
+    int decode(std::vector< uint8_t >& buf, pixel_view_t& v, worker_pool_t* pool = nullptr) const;
+};
+
+/* 先頭 size バイトを RAWD として検証し、 pixel の view を作る. ファイル以外 (archive など) からも使う.
+   圧縮されたものは blocks に block 表を返す (blocks を渡さなければ RAWD_ERR_HEADER) */
+int parse_rawd(const uint8_t* p, size_t size, rawd_header_t& head, pixel_view_t& view, rawd_blocks_t* blocks = nullptr);
+
+/* 非圧縮の RAWD の pixel 列がファイルの先頭から何 byte 目に始まるか. p にはファイルの先頭 size byte
+   (header, note, 拡張 header を含む) があればよく、 pixel 列が filesize に収まるかだけを見る.
+   pixel を読まずに書き込み先を決めたい時に使う. view.data は nullptr. 圧縮されたものと PNG は RAWD_ERR_HEADER */
+int rawd_pixel_offset(const uint8_t* p, size_t size, uint64_t filesize, rawd_header_t& head, pixel_view_t& view, uint64_t& offset);
+/* 展開後の pixel 列の byte 数 (最後の行はパディングを含まない) */
+inline size_t rawd_payload_bytes(const pixel_view_t& v) { return v.pitch * (rawd_rows(v) - 1) + rawd_row_bytes(v); }
+
+/* 64bit の hash を 32bit の checksum に畳む. 0 は「無し」なので使わない */
+inline uint32_t rawd_checksum_of(uint64_t h)
+{
+    const uint32_t c = static_cast< uint32_t >(h ^ (h >> 32));
+    return c ? c : 1;
+}
+
+/* payload の checksum. xxh64 を畳んだもの (loader は content key を取る時の hash から同じ値を作る) */
+uint32_t rawd_checksum(const uint8_t* p, size_t size);
+
+/* wchar_t のパスを UTF-8 にする (POSIX の open() 用) */
+std::string narrow_path(const std::wstring& path);
+/* narrow_path() の逆. 壊れた UTF-8 は U+FFFD にする */
+std::wstring widen_path(const std::string& path);
+
+#endif
@@ -12,14 +12,8 @@
 #include <cmath>
 #include <algorithm>
 
-static const int TRAMPOLINE_MAX_WIDTH = 512;
-static const int TRAMPOLINE_MAX_HEIGHT = 512;
-    
 using Microsoft::WRL::ComPtr;
 
-D3D12_PLACED_SUBRESOURCE_FOOTPRINT write_to_trampoline(uniq_device_t& u, std::vector< uint32_t > data, const D3D12_RESOURCE_DESC& texdesc, ID3D12Resource* trampoline);
-int issue_texture_upload(ID3D12GraphicsCommandList* cmdlist, const D3D12_PLACED_SUBRESOURCE_FOOTPRINT& foorprint, ID3D12Resource* tex, ID3D12Resource* trampoline);
-
 void loading_t::init(uniq_device_t& u,  ID3D12GraphicsCommandList* cmdlist, const std::wstring& dir)
 {
     D3D12_FEATURE_DATA_ROOT_SIGNATURE featureData = {};
@@ -111,7 +105,7 @@ void loading_t::init(uniq_device_t& u,  ID3D12GraphicsCommandList* cmdlist, cons
         uint8_t* va = nullptr;
         D3D12_RANGE readrange = {0, 0};
         vertbuf_->Map(0, &readrange, reinterpret_cast< void** >(&va));
-        memcpy(va, v, size);
+        wc_copy(va, v, size);
         vertbuf_->Unmap(0, nullptr);
 
         vbv_.BufferLocation = vertbuf_->GetGPUVirtualAddress(); // GPU
@@ -171,8 +165,8 @@ void loading_t::init(uniq_device_t& u,  ID3D12GraphicsCommandList* cmdlist, cons
         float* ptr = nullptr;
         D3D12_RANGE readrange = {0, 0};
         cbv_->Map(0, &readrange, reinterpret_cast< void** >(&ptr));
-        memcpy(ptr, matrix, sizeof(float) * 16);
-        memcpy(reinterpret_cast< uint8_t* >(ptr) + ((sizeof(float)*16+255) & ~255), &matrix[1], sizeof(float) * 16);
+        wc_copy(ptr, matrix, sizeof(float) * 16);
+        wc_copy(reinterpret_cast< uint8_t* >(ptr) + ((sizeof(float)*16+255) & ~255), &matrix[1], sizeof(float) * 16);
         cbv_->Unmap(0, nullptr);
     }
 
@@ -180,6 +174,11 @@ void loading_t::init(uniq_device_t& u,  ID3D12GraphicsCommandList* cmdlist, cons
 
     uploader_.create_uploader(u);
 
+    /* 前回の起動で読んだ順に先読みを始めておく (ロード画面の準備と並ぶ) */
+    if (loadercfg_.manifest.empty())
+        loadercfg_.manifest = dir + L"textures.manifest";
+    loader_.init(u, uploader_.queue(), loadercfg_);
+
     ComPtr< ID3D12GraphicsCommandList > copycmdlist;
     /* upload のための cmdlist には PSO は必要ではない */
     u.dev()->CreateCommandList(0, D3D12_COMMAND_LIST_TYPE_COPY, uploader_.allocator().Get(), nullptr/*pso_.Get()*/, IID_PPV_ARGS(&copycmdlist));
@@ -189,22 +188,26 @@ void loading_t::init(uniq_device_t& u,  ID3D12GraphicsCommandList* cmdlist, cons
     {
         int width = 64;
         int height = 64;
-        std::vector< uint32_t > data = load_graphics_asset(dir +L"loading.rawdata", width, height);
+        rawd_image_t img;
+        if (load_graphics_asset(dir +L"loading.png", img) == 0) {
+            width = img.view().width;
+            height = img.view().height;
+        }
         INF("loading: first texture: width%d height:%d\n", width, height);
-        D3D12_RESOURCE_DESC desc = setup_tex2d(width, height);
+        D3D12_RESOURCE_DESC desc = setup_tex2d(width, height, texture_format(upload_format(img.view(), supported_formats(u))));
         D3D12_HEAP_PROPERTIES resident = setup_heapprop(D3D12_HEAP_TYPE_DEFAULT);
 
         auto hr = u.dev()->CreateCommittedResource(&resident, D3D12_HEAP_FLAG_NONE, &desc, D3D12_RESOURCE_STATE_COPY_DEST, nullptr, IID_PPV_ARGS(&tex_));
         if (FAILED(hr)) {
             ABT("failed to create resident texture: err:0x%x\n", hr);
         }
-        D3D12_PLACED_SUBRESOURCE_FOOTPRINT copied = write_to_trampoline(u, std::move(data), desc, trampoline_.Get()); /* copy to trampoline */
+        D3D12_PLACED_SUBRESOURCE_FOOTPRINT copied = write_to_trampoline(u, img, desc, trampoline_.Get()); /* copy to trampoline */
         
         issue_texture_upload(copycmdlist.Get(), copied, tex_.Get(), trampoline_.Get());
         
         D3D12_SHADER_RESOURCE_VIEW_DESC srv = {};
         srv.Shader4ComponentMapping = D3D12_DEFAULT_SHADER_4_COMPONENT_MAPPING;
-        srv.Format = DXGI_FORMAT_R8G8B8A8_UNORM;
+        srv.Format = desc.Format;
         srv.ViewDimension = D3D12_SRV_DIMENSION_TEXTURE2D;
         srv.Texture2D.MipLevels = 1;
         /* 指定した SRV Heap に ID3D12Resource/D3D12_SHADER_RESOURCE_VIEW_DESC で指定した SRV を生成する */
@@ -216,13 +219,19 @@ void loading_t::init(uniq_device_t& u,  ID3D12GraphicsCommandList* cmdlist, cons
     u.dev()->CreateFence(0, D3D12_FENCE_FLAG_NONE, IID_PPV_ARGS(&fence));
     qsync_.init(std::move(fence), 0);
 
-    auto workq = std::make_shared< std::deque< std::wstring > >();
+    /* cook 済みのアーカイブがあればそちらを優先する. 無ければ個別の .rawdata を読む */
+    if (archive_.open(dir + L"textures.rawa") == 0) {
+        INF("texture archive: %d entries\n", archive_.count());
+    }
 
-    workq->push_back(dir + L"mc256x256.rawdata");
-    workq->push_back(dir + L"mc256x256_0.rawdata");
-    workq->push_back(dir + L"mc256x256_1.rawdata");
-    workq->push_back(dir + L"mc256x256_2.rawdata");
-    workq->push_back(dir + L"mc256x256_3.rawdata");
+    /* payload は submit した順に並ぶ */
+    auto batch = std::make_shared< std::vector< texture_handle_t > >();
+
+    batch->push_back(requests_->submit(dir + L"mc256x256.rawdata"));
+    batch->push_back(requests_->submit(dir + L"mc256x256_0.rawdata"));
+    batch->push_back(requests_->submit(dir + L"mc256x256_1.rawdata"));
+    batch->push_back(requests_->submit(dir + L"mc256x256_2.rawdata"));
+    batch->push_back(requests_->submit(dir + L"mc256x256_3.rawdata"));
 
     /* 楽に move capture が使いたいなぁ */
     auto payload = std::make_shared< std::vector< Microsoft::WRL::ComPtr< ID3D12Resource > > >();
@@ -240,37 +249,13 @@ void loading_t::init(uniq_device_t& u,  ID3D12GraphicsCommandList* cmdlist, cons
 
     finished_ = true;
 
-    loadthr_ = std::thread([&, workq, payload, copycmdlist]{
-            Sleep(1000);
-            while (!shutdown_ && !workq->empty()) {
-                auto wi = workq->front();
-                workq->pop_front();
-                int w, h;
-                auto data = load_graphics_asset(wi, w, h);
-                if (!data.size())
-                    continue;
-                INF("Load texture: %s w:%d h:%d\n", wi.c_str(), w, h);
-
-                Sleep(1000); /* Loading Screen っぽくもったいつける */
-                uploader_.allocator()->Reset();
-                auto hr = copycmdlist->Reset(uploader_.allocator().Get(), nullptr);
-                if (FAILED(hr)) {
-                    ABT("failed to reset copycmdlist:0x%x\n", hr);
-                }
-                
-                auto tex = create_texture(u, w, h);
-                auto copied = write_to_trampoline(u, std::move(data), tex->GetDesc(), trampoline_.Get()); /* copy to trampoline */
-                issue_texture_upload(copycmdlist.Get(), copied, tex.Get(), trampoline_.Get());
-                copycmdlist->Close();
-                
-                ID3D12CommandList* l[] = {copycmdlist.Get()};
-                uploader_.queue()->ExecuteCommandLists(1, l);
-                
-                qsync_.incr(); /* wait for next value */
-                qsync_.wait(uploader_.queue().Get());
+    loader_.set_archive(&archive_);
+    /* ロード画面の後も requests_ に submit() すれば読み込める */
+    loader_.start(requests_);
 
-                payload->push_back(std::move(tex));
-            }
+    loadthr_ = std::thread([&, batch, payload]{
+            texture_loader_t::collect(*batch, *payload);
+            loader_.report();
 
             auto p = consumer_.get().lock();
             if (p) {
@@ -347,49 +332,6 @@ void loading_t::init(uniq_device_t& u,  ID3D12GraphicsCommandList* cmdlist, cons
     }
 }
 
-std::vector< uint32_t > loading_t::load_graphics_asset(const std::wstring& fname, int& width, int& height)
-{
-    std::vector< uint32_t > data;
-    FILE* rawfp = nullptr;
-    _wfopen_s(&rawfp, fname.c_str(), L"rb");
-    std::unique_ptr< FILE, decltype(&fclose) > fp(rawfp, fclose);
-    if (!fp) {
-        WRN("could not locate file:%s\n", fname.c_str());
-        return data;
-    }
-    __pragma(pack(push, 1)) struct header_t {
-        uint8_t fourcc[4];
-        uint16_t ver_hi;
-        uint16_t ver_lo;
-        uint32_t reserve;
-        uint32_t width;
-        uint32_t height;
-        uint32_t format;
-        uint32_t pixperbyte;
-        uint32_t notelen;
-    };// __attribute__((__packed__));
-    __pragma(pack(pop));
-    header_t head;
-    if (fread(&head, 1, sizeof(header_t), fp.get()) < sizeof(header_t)) {
-        WRN("file maybe broken:%s\n", fname.c_str());
-        return data;
-    }
-    fseek(fp.get(), head.notelen, SEEK_CUR);
-    
-    width = head.width;
-    height = head.height;
-    
-    if (head.width > TRAMPOLINE_MAX_WIDTH || head.height > TRAMPOLINE_MAX_HEIGHT) {
-        WRN("file must small than trampoline buffer:%s (%d, %d) \n ", fname.c_str(), head.width, head.height);
-        return data;
-    }
-    size_t len = head.width * head.height; /* たぶん dense */
-    data.reserve(len);
-    data.resize(len);
-    fread(&data[0], 1, len * head.pixperbyte, fp.get());
-    return data;
-}
-
 ComPtr< ID3D12Resource > loading_t::create_texture(uniq_device_t& u, int width, int height)
 {
     D3D12_RESOURCE_DESC desc = setup_tex2d(width, height);
@@ -543,7 +485,7 @@ void playground_t::init(uniq_device_t& u, ID3D12GraphicsCommandList* cmdlist, co
         uint8_t* va = nullptr;
         D3D12_RANGE readrange = {0, 0};
         vertbuf_->Map(0, &readrange, reinterpret_cast< void** >(&va));
-        memcpy(va, v, size);
+        wc_copy(va, v, size);
         vertbuf_->Unmap(0, nullptr);
 
         vbv_.BufferLocation = vertbuf_->GetGPUVirtualAddress(); // GPU
@@ -584,8 +526,8 @@ void playground_t::init(uniq_device_t& u, ID3D12GraphicsCommandList* cmdlist, co
         float* ptr = nullptr;
         D3D12_RANGE readrange = {0, 0};
         cbv_->Map(0, &readrange, reinterpret_cast< void** >(&ptr));
-        memcpy(ptr, matrix, sizeof(float) * 16);
-        memcpy(reinterpret_cast< uint8_t* >(ptr) + ((sizeof(float)*16+255) & ~255), &matrix[1], sizeof(float) * 16);
+        wc_copy(ptr, matrix, sizeof(float) * 16);
+        wc_copy(reinterpret_cast< uint8_t* >(ptr) + ((sizeof(float)*16+255) & ~255), &matrix[1], sizeof(float) * 16);
         cbv_->Unmap(0, nullptr);
     }
 
@@ -759,66 +701,3 @@ ComPtr< ID3D12Resource > resources_t::create_texture(int width, int height)
     }
     return tex;
 }
-
-D3D12_PLACED_SUBRESOURCE_FOOTPRINT write_to_trampoline(uniq_device_t& u, std::vector< uint32_t > data, const D3D12_RESOURCE_DESC& texdesc, ID3D12Resource* trampoline)
-{
-    D3D12_PLACED_SUBRESOURCE_FOOTPRINT footprint = {};
-    size_t rowpitch;
-    size_t totalbytes;
-    uint32_t rows;
-    u.dev()->GetCopyableFootprints(&texdesc,
-                                   0 /* first idx of the resource */,
-                                   1 /* num of subresorces */,
-                                   0 /* base offset to the resource in bytes */,
-                                       &footprint, &rows, &rowpitch, &totalbytes);
-    INF("texture footprint: rows:%d rowpitch:%lld totalbyte:%lld\n", rows, rowpitch, totalbytes);
-    uint8_t* ptr = nullptr;
-    trampoline->Map(0, nullptr, reinterpret_cast< void** >(&ptr));
-    for (int y = 0; y < texdesc.Height; ++ y) {
-        memcpy(ptr + footprint.Offset + footprint.Footprint.RowPitch * y, data.data() + texdesc.Width * y, rowpitch);
-    }
-    trampoline->Unmap(0, nullptr);
-    return footprint;
-}
-
-int issue_texture_upload(ID3D12GraphicsCommandList* cmdlist, const D3D12_PLACED_SUBRESOURCE_FOOTPRINT& footprint, ID3D12Resource* tex, ID3D12Resource* trampoline)
-{
-    /* COPY コマンドを設定: trampoline(UPLOAD) -> tex(RESIDENT VRAM) */
-    D3D12_TEXTURE_COPY_LOCATION dst = {tex, D3D12_TEXTURE_COPY_TYPE_SUBRESOURCE_INDEX, {0}};
-    D3D12_TEXTURE_COPY_LOCATION src = {trampoline, D3D12_TEXTURE_COPY_TYPE_PLACED_FOOTPRINT, {footprint}};
-    /* dst の Dimension が Buffer なら CopyBufferRegion() を使う */
-    cmdlist->CopyTextureRegion(&dst, 0 /* dst-x */, 0 /* dst-y */, 0/* dst-z */, &src, nullptr);
-
-    /* Barrier(GPU 同期): 
-       D3D12_RESOURCE_TRANSITION_BARRIER でリソースの状態を明示する.
-       COPY 前に参照していない場合は D3D12_RESOURCE_STATE_COPY_DEST.
-    */
-    D3D12_RESOURCE_BARRIER barrier = {
-        D3D12_RESOURCE_BARRIER_TYPE_TRANSITION,
-        D3D12_RESOURCE_BARRIER_FLAG_NONE,
-        /* D3D12_RESOURCE_TRANSITION_BARRIER */
-        { 
-            tex,
-            D3D12_RESOURCE_BARRIER_ALL_SUBRESOURCES,
-            D3D12_RESOURCE_STATE_COPY_DEST,/* before state */
-            D3D12_RESOURCE_STATE_PIXEL_SHADER_RESOURCE /* after state */
-        }
-    };
-    /* COPY cmdlist の場合は CommandQueue の非同期実行完了時に暗黙の状態遷移(COMMON への降格(decay))が起きる */
-    if (cmdlist->GetType() == D3D12_COMMAND_LIST_TYPE_COPY) {
-        barrier.Transition.StateAfter = D3D12_RESOURCE_STATE_COMMON;
-    }
-    cmdlist->ResourceBarrier(1, &barrier);
-    
-    return 0;
-}
-
-extern "C" {
-    int WINAPI WinMain(HINSTANCE instance, HINSTANCE, LPSTR, int cmd);
-}
-
-int WINAPI WinMain(HINSTANCE instance, HINSTANCE, LPSTR, int cmd)
-{
-    return runapp< resources_t >(1280, 720, instance, cmd);
-}
-
@@ -9,6 +9,7 @@
 #include "serializer.hpp"
 #include "dbgutils.hpp"
 #include "uniq_device.hpp"
+#include "texloader.hpp"
 #include <comdef.h>
 #include <vector>
 #include <thread>
@@ -55,9 +56,9 @@ public:
         for (auto& item : *payload_) {
             D3D12_SHADER_RESOURCE_VIEW_DESC srv = {};
             srv.Shader4ComponentMapping = D3D12_DEFAULT_SHADER_4_COMPONENT_MAPPING;
-            srv.Format = DXGI_FORMAT_R8G8B8A8_UNORM;
+            srv.Format = item->GetDesc().Format;
             srv.ViewDimension = D3D12_SRV_DIMENSION_TEXTURE2D;
-            srv.Texture2D.MipLevels = 1;
+            srv.Texture2D.MipLevels = item->GetDesc().MipLevels;
             /* 指定した SRV Heap に ID3D12Resource/D3D12_SHADER_RESOURCE_VIEW_DESC で指定した SRV を生成する */
             u.dev()->CreateShaderResourceView(item.Get(), &srv, hdl);
             hdl.ptr += u.sizeset().view;
@@ -86,15 +87,19 @@ class loading_t : public scene_t {
     asset_uploader_t uploader_;
     queue_sync_object_t< 1 > qsync_;
     Microsoft::WRL::ComPtr< ID3D12Resource > tex_;
+    rawd_archive_t archive_;
+    texture_loader_config_t loadercfg_;
+    texture_loader_t loader_;
+    std::shared_ptr< texture_request_queue_t > requests_;
 
     std::thread loadthr_;
     std::future< std::weak_ptr< playground_t > > consumer_;
     std::atomic< bool > finished_;
-    std::atomic< bool > shutdown_;
     uint64_t time_;
     int32_t cover_alpha_;
 public:
-    loading_t() : finished_(false), shutdown_(false), time_(0ULL), cover_alpha_(0) {}
+    loading_t(const texture_loader_config_t& cfg = texture_loader_config_t())
+        : loadercfg_(cfg), requests_(std::make_shared< texture_request_queue_t >()), finished_(false), time_(0ULL), cover_alpha_(0) {}
     void set_consumer(std::future< std::weak_ptr< playground_t > > weakref) { consumer_ = std::move(weakref); }
     
     void init(uniq_device_t& u,  ID3D12GraphicsCommandList* cmdlist, const std::wstring&);
@@ -102,13 +107,15 @@ public:
     void draw(uniq_device_t& u, ID3D12GraphicsCommandList* cmdlist);
     bool is_ready();
 
-    std::vector< uint32_t > load_graphics_asset(const std::wstring& fname, int& width, int& height);
+    std::vector< stage_report_t > loader_stats() const { return loader_.stats(); }
+    std::shared_ptr< texture_request_queue_t > requests() { return requests_; }
     Microsoft::WRL::ComPtr< ID3D12Resource > create_texture(uniq_device_t& u, int width, int height);
 
     void shutdown()
     {
+        /* 待っている要求は cancel されるので batch の待ちも抜ける */
+        loader_.stop();
         if (loadthr_.joinable()) {
-            shutdown_ = true;
             loadthr_.join();
         }
     }
@@ -292,6 +299,7 @@ protected:
     {
         loading_->shutdown();
         flipper_.wait(uniq_.queue().Get());
+        texture_cache().clear(); /* device より先に手放す */
     }
 
 };
@@ -0,0 +1,81 @@
+/**
+ * (C) roentgen 
+ * this code is licensed under the MIT License.
+ */
+#include "ringalloc.hpp"
+
+static inline uint64_t align_up(uint64_t v, uint64_t align)
+{
+    return (v + align - 1) & ~(align - 1);
+}
+
+void ring_allocator_t::reset(uint64_t capacity)
+{
+    std::lock_guard< std::mutex > lock(mtx_);
+    spans_.clear();
+    first_ = 0;
+    capacity_ = capacity;
+    head_ = 0;
+    tail_ = 0;
+    peak_ = 0;
+}
+
+bool ring_allocator_t::alloc(uint64_t size, uint64_t align, uint64_t& offset, uint64_t& ticket)
+{
+    std::lock_guard< std::mutex > lock(mtx_);
+    if (!size || size > capacity_)
+        return false;
+    /* 揃えるのは capacity_ の中での offset. 末尾に収まらなければ残りは捨てて次の周の先頭から */
+    const uint64_t pos = head_ % capacity_;
+    uint64_t start = head_ - pos + align_up(pos, align ? align : 1);
+    if (start - (head_ - pos) + size > capacity_)
+        start = head_ - pos + capacity_;
+    if (start + size - tail_ > capacity_)
+        return false;
+    span_t s = {start + size, 0, false};
+    spans_.push_back(s);
+    ticket = first_ + spans_.size() - 1;
+    offset = start % capacity_;
+    head_ = start + size;
+    if (head_ - tail_ > peak_)
+        peak_ = head_ - tail_;
+    return true;
+}
+
+void ring_allocator_t::set_fence(uint64_t ticket, uint64_t fence)
+{
+    std::lock_guard< std::mutex > lock(mtx_);
+    if (ticket >= first_ && ticket - first_ < spans_.size())
+        spans_[static_cast< size_t >(ticket - first_)].fence = fence;
+}
+
+void ring_allocator_t::release(uint64_t ticket)
+{
+    std::lock_guard< std::mutex > lock(mtx_);
+    if (ticket >= first_ && ticket - first_ < spans_.size())
+        spans_[static_cast< size_t >(ticket - first_)].released = true;
+}
+
+void ring_allocator_t::retire(uint64_t completed)
+{
+    std::lock_guard< std::mutex > lock(mtx_);
+    while (!spans_.empty()) {
+        const span_t& s = spans_.front();
+        if (!s.released && (!s.fence || s.fence > completed))
+            break;
+        tail_ = s.end;
+        spans_.pop_front();
+        first_ ++;
+    }
+    if (spans_.empty())
+        tail_ = head_;
+}
+
+bool ring_allocator_t::oldest(uint64_t& fence) const
+{
+    std::lock_guard< std::mutex > lock(mtx_);
+    if (spans_.empty())
+        return false;
+    fence = spans_.front().released ? 0 : spans_.front().fence;
+    return true;
+}
@@ -0,0 +1,52 @@
+/**
+ * (C) roentgen 
+ * this code is licensed under the MIT License.
+ */
+#if !defined(RINGALLOC_HPP__)
+#define RINGALLOC_HPP__
+
+#include <stdint.h>
+#include <stddef.h>
+#include <deque>
+#include <mutex>
+
+/* upload ring の割り当て. D3D12 には依存しない (offset を返すだけで、どのバッファかは知らない).
+   確保した順に並んだ区間を先頭から解放する ring で、各区間はそれを読む copy の fence の値を後から付けてもらう.
+   retire() に完了した fence の値を渡すと、先頭から値の付いた終わったものを外す.
+   fence がまだ付いていない (submit されていない) 区間があるとそこで止まる. GPU に渡さずに捨てるなら release() */
+class ring_allocator_t {
+    struct span_t {
+        uint64_t end;   /* 次の区間の始まり (仮想的な通しの位置) */
+        uint64_t fence; /* 0 ならまだ submit されていない */
+        bool released;
+    };
+    mutable std::mutex mtx_;
+    std::deque< span_t > spans_;
+    uint64_t first_;    /* spans_.front() の ticket */
+    uint64_t capacity_;
+    uint64_t head_;     /* 次に確保する位置. 位置は capacity_ で割った余りが offset になる通しの値 */
+    uint64_t tail_;     /* 一番古い生きている区間の始まり */
+    uint64_t peak_;
+
+public:
+    ring_allocator_t() : first_(0), capacity_(0), head_(0), tail_(0), peak_(0) {}
+
+    /* 中身を空にして大きさを決める */
+    void reset(uint64_t capacity);
+
+    /* size byte を align (2 のべき) に揃えて確保する. 末尾に収まらなければ先頭まで飛ばす.
+       空きが足りなければ false. ticket は set_fence() / release() に渡す */
+    bool alloc(uint64_t size, uint64_t align, uint64_t& offset, uint64_t& ticket);
+    void set_fence(uint64_t ticket, uint64_t fence);
+    void release(uint64_t ticket);
+    /* completed までの fence が終わった区間を先頭から外す */
+    void retire(uint64_t completed);
+    /* 先頭の区間が待っている fence. 空なら false. まだ submit されていなければ fence は 0 */
+    bool oldest(uint64_t& fence) const;
+
+    uint64_t capacity() const { return capacity_; }
+    uint64_t used() const { std::lock_guard< std::mutex > lock(mtx_); return head_ - tail_; }
+    uint64_t peak() const { std::lock_guard< std::mutex > lock(mtx_); return peak_; }
+};
+
+#endif
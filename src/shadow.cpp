@@ -40,10 +40,11 @@ void shadow_t::load_asset()
     NAME_OBJ(thr_cmd_lst);
     NAME_OBJ(thr_cmd_alloc);
 
-    auto workq = std::make_shared< std::deque< std::wstring > >();
-    workq->push_back(dir + L"mc512x512_blue.rawdata");
+    auto requests = std::make_shared< texture_request_queue_t >();
+    std::vector< texture_handle_t > batch;
+    batch.push_back(requests->submit(dir + L"mc512x512_blue.rawdata"));
     
-    loading_ = std::make_shared< loading_t< playground_t > >(std::move(workq));
+    loading_ = std::make_shared< loading_t< playground_t > >(requests, std::move(batch));
     playing_ = std::make_shared< playground_t >();
     
     /* もし loader スレッドが一瞬で終わって set_consumer() よりも set_shadowtexture() が先に呼ばれたりしないよう
@@ -58,6 +59,7 @@ void shadow_t::load_asset()
                 
                 ID3D12CommandList* l[] = {thr_cmd_lst.Get()};
                 uniq_.queue()->ExecuteCommandLists(std::extent< decltype(l) >::value, l);
+                playing_->geometry_submitted(uniq_.queue().Get());
                 flipper_.wait(uniq_.queue().Get());
                 return std::weak_ptr< playground_t >(playing_);
             }));
@@ -18,6 +18,7 @@
 #include <string>
 #include "scene.hpp"
 #include "loading.hpp"
+#include "geometry.hpp"
 
 struct vertex_t {
     DirectX::XMFLOAT3 pos;
@@ -50,22 +51,18 @@ class playground_t : public scene_t {
     Microsoft::WRL::ComPtr< ID3D12DescriptorHeap > nullsrv_descheap_;
     Microsoft::WRL::ComPtr< ID3D12PipelineState > shadow_pso_;
     Microsoft::WRL::ComPtr< ID3D12RootSignature > shadow_rootsig_;
-    Microsoft::WRL::ComPtr< ID3D12Resource > cube_vert_;
-    Microsoft::WRL::ComPtr< ID3D12Resource > cube_vertupload_;
-    Microsoft::WRL::ComPtr< ID3D12Resource > cube_idx_;
-    Microsoft::WRL::ComPtr< ID3D12Resource > cube_idxupload_;
+    geometry_pool_t geometry_; /* cube と ground の頂点/index */
 
     D3D12_VERTEX_BUFFER_VIEW ground_vbv_;
-    Microsoft::WRL::ComPtr< ID3D12Resource > ground_vert_;
-    Microsoft::WRL::ComPtr< ID3D12Resource > ground_vertupload_;
-    Microsoft::WRL::ComPtr< ID3D12Resource > ground_idx_;
-    Microsoft::WRL::ComPtr< ID3D12Resource > ground_idxupload_;
 
     std::shared_ptr< std::vector< Microsoft::WRL::ComPtr< ID3D12Resource > > > payload_;
     std::atomic< bool > finished_;
 public:
     playground_t() : finished_(false) {}
 
+    /* init() の cmdlist を queue に Execute した後に呼ぶ. copy が終われば geometry の staging を捨てる */
+    void geometry_submitted(ID3D12CommandQueue* queue) { geometry_.submitted(queue); }
+
     void set_payload(uniq_device_t& u, std::shared_ptr< std::vector< Microsoft::WRL::ComPtr< ID3D12Resource > > > payload)
     {
         payload_ = std::move(payload);
@@ -74,9 +71,9 @@ public:
         for (auto& item : *payload_) {
             D3D12_SHADER_RESOURCE_VIEW_DESC srv = {};
             srv.Shader4ComponentMapping = D3D12_DEFAULT_SHADER_4_COMPONENT_MAPPING;
-            srv.Format = DXGI_FORMAT_R8G8B8A8_UNORM;
+            srv.Format = item->GetDesc().Format;
             srv.ViewDimension = D3D12_SRV_DIMENSION_TEXTURE2D;
-            srv.Texture2D.MipLevels = 1;
+            srv.Texture2D.MipLevels = item->GetDesc().MipLevels;
             /* 指定した SRV Heap に ID3D12Resource/D3D12_SHADER_RESOURCE_VIEW_DESC で指定した SRV を生成する */
             u.dev()->CreateShaderResourceView(item.Get(), &srv, hdl);
             hdl.ptr += u.sizeset().view;
@@ -394,6 +391,7 @@ protected:
     {
         loading_->shutdown();
         flipper_.wait(uniq_.queue().Get());
+        texture_cache().clear(); /* device より先に手放す */
     }
 
 };
@@ -35,6 +35,8 @@ using namespace Microsoft::WRL;
 void playground_t::init(uniq_device_t& u, ID3D12GraphicsCommandList* cmdlist, const std::wstring& dir)
 {
     finished_ = false;
+    /* 小さい mesh が数個なので、 block も staging も 64KB ひとつに収まる */
+    geometry_.init(u, D3D12_DEFAULT_RESOURCE_PLACEMENT_ALIGNMENT, D3D12_DEFAULT_RESOURCE_PLACEMENT_ALIGNMENT);
 
     D3D12_FEATURE_DATA_ROOT_SIGNATURE featureData = {};
     featureData.HighestVersion = D3D_ROOT_SIGNATURE_VERSION_1_1;
@@ -154,38 +156,7 @@ void playground_t::init(uniq_device_t& u, ID3D12GraphicsCommandList* cmdlist, co
             {{ 1.f,  1.f, 0.f}, {0.f, 1.f}, {0.f, 1.f, 0.f}}, // 3: 
         };
 #endif
-        size_t size = sizeof(v);
-        auto prop = setup_heapprop(D3D12_HEAP_TYPE_UPLOAD);
-        auto bufdesc = setup_buffer(size);
-
-        auto hr = u.dev()->CreateCommittedResource(&prop, D3D12_HEAP_FLAG_NONE, &bufdesc, D3D12_RESOURCE_STATE_GENERIC_READ, nullptr, IID_PPV_ARGS(&ground_vertupload_));
-
-        if (FAILED(hr)) {
-            ABT("failed to create vert buffer: err:0x%x\n", hr);
-        }
-
-        uint8_t* va = nullptr;
-        D3D12_RANGE readrange = {0, 0};
-        ground_vertupload_->Map(0, &readrange, reinterpret_cast< void** >(&va));
-        memcpy(va, v, size);
-        ground_vertupload_->Unmap(0, nullptr);
-
-        u.dev()->CreateCommittedResource(&setup_heapprop(D3D12_HEAP_TYPE_DEFAULT), D3D12_HEAP_FLAG_NONE, &setup_buffer(size), D3D12_RESOURCE_STATE_COPY_DEST, nullptr, IID_PPV_ARGS(&ground_vert_));
-
-        cmdlist->CopyBufferRegion(ground_vert_.Get(), 0, ground_vertupload_.Get(), 0, size);
-
-        D3D12_RESOURCE_BARRIER barrier1 = {
-            D3D12_RESOURCE_BARRIER_TYPE_TRANSITION, D3D12_RESOURCE_BARRIER_FLAG_NONE,
-            {ground_vert_.Get(),
-             D3D12_RESOURCE_BARRIER_ALL_SUBRESOURCES,
-             D3D12_RESOURCE_STATE_COPY_DEST,/* before state */
-             D3D12_RESOURCE_STATE_NON_PIXEL_SHADER_RESOURCE /* after state */ }};
-        
-        cmdlist->ResourceBarrier(1, &barrier1);
-
-        ground_vbv_.BufferLocation = ground_vertupload_->GetGPUVirtualAddress(); // GPU
-        ground_vbv_.StrideInBytes = sizeof(vertex_t);
-        ground_vbv_.SizeInBytes = static_cast< UINT >(size);
+        ground_vbv_ = geometry_.upload_vertices(cmdlist, v, sizeof(vertex_t), static_cast< uint32_t >(sizeof(v) / sizeof(v[0])));
     }
 #endif
 
@@ -236,38 +207,7 @@ void playground_t::init(uniq_device_t& u, ID3D12GraphicsCommandList* cmdlist, co
             {{ .5f,-.5f, .5f}, {1.f, 1.f}, {0.f,-1.f, 0.f}}, // 22: C'
             {{ .5f,-.5f,-.5f}, {1.f, 0.f}, {0.f,-1.f, 0.f}}  // 23: B'
         };
-        size_t size = sizeof(v);
-        auto prop = setup_heapprop(D3D12_HEAP_TYPE_UPLOAD);
-        auto bufdesc = setup_buffer(size);
-        
-        auto hr = u.dev()->CreateCommittedResource(&prop, D3D12_HEAP_FLAG_NONE, &bufdesc, D3D12_RESOURCE_STATE_GENERIC_READ, nullptr, IID_PPV_ARGS(&cube_vertupload_));
-                
-        if (FAILED(hr)) {
-            ABT("failed to create vert buffer: err:0x%x\n", hr);
-        }
-
-        uint8_t* va = nullptr;
-        D3D12_RANGE readrange = {0, 0};
-        cube_vertupload_->Map(0, &readrange, reinterpret_cast< void** >(&va));
-        memcpy(va, v, size);
-        cube_vertupload_->Unmap(0, nullptr);
-
-        u.dev()->CreateCommittedResource(&setup_heapprop(D3D12_HEAP_TYPE_DEFAULT), D3D12_HEAP_FLAG_NONE, &setup_buffer(size), D3D12_RESOURCE_STATE_COPY_DEST, nullptr, IID_PPV_ARGS(&cube_vert_));
-
-        cmdlist->CopyBufferRegion(cube_vert_.Get(), 0, cube_vertupload_.Get(), 0, size);
-
-        D3D12_RESOURCE_BARRIER barrier1 = {
-            D3D12_RESOURCE_BARRIER_TYPE_TRANSITION, D3D12_RESOURCE_BARRIER_FLAG_NONE,
-            {cube_vert_.Get(),
-             D3D12_RESOURCE_BARRIER_ALL_SUBRESOURCES,
-             D3D12_RESOURCE_STATE_COPY_DEST,/* before state */
-             D3D12_RESOURCE_STATE_NON_PIXEL_SHADER_RESOURCE /* after state */ }};
-        
-        cmdlist->ResourceBarrier(1, &barrier1);
-
-        vbv_.BufferLocation = cube_vertupload_->GetGPUVirtualAddress(); // GPU
-        vbv_.StrideInBytes = sizeof(vertex_t);
-        vbv_.SizeInBytes = static_cast< UINT >(size);
+        vbv_ = geometry_.upload_vertices(cmdlist, v, sizeof(vertex_t), static_cast< uint32_t >(sizeof(v) / sizeof(v[0])));
     }
 #endif
     
@@ -288,30 +228,7 @@ void playground_t::init(uniq_device_t& u, ID3D12GraphicsCommandList* cmdlist, co
                          12, 13, 14, 14, 13, 15,
                          16, 17, 18, 18, 17, 19,
                          20, 21, 22, 22, 21, 23};
-        size_t size = sizeof(idx);
-        u.dev()->CreateCommittedResource(&setup_heapprop(D3D12_HEAP_TYPE_UPLOAD), D3D12_HEAP_FLAG_NONE, &setup_buffer(size), D3D12_RESOURCE_STATE_GENERIC_READ, nullptr, IID_PPV_ARGS(&cube_idxupload_));
-        int32_t* va = nullptr;
-        D3D12_RANGE readrange = {0, 0};
-        cube_idxupload_->Map(0, &readrange, reinterpret_cast< void** >(&va));
-        memcpy(va, idx, size);
-        cube_idxupload_->Unmap(0, nullptr);
-
-        u.dev()->CreateCommittedResource(&setup_heapprop(D3D12_HEAP_TYPE_DEFAULT), D3D12_HEAP_FLAG_NONE, &setup_buffer(size), D3D12_RESOURCE_STATE_COPY_DEST, nullptr, IID_PPV_ARGS(&cube_idx_));
-
-        cmdlist->CopyBufferRegion(cube_idx_.Get(), 0, cube_idxupload_.Get(), 0, size);
-
-        D3D12_RESOURCE_BARRIER barrier2 = {
-            D3D12_RESOURCE_BARRIER_TYPE_TRANSITION, D3D12_RESOURCE_BARRIER_FLAG_NONE,
-            {cube_idx_.Get(),
-             D3D12_RESOURCE_BARRIER_ALL_SUBRESOURCES,
-             D3D12_RESOURCE_STATE_COPY_DEST,/* before state */
-             D3D12_RESOURCE_STATE_NON_PIXEL_SHADER_RESOURCE /* after state */ }};
-        
-        cmdlist->ResourceBarrier(1, &barrier2);
-
-        ibv_.BufferLocation = cube_idx_->GetGPUVirtualAddress(); // GPU
-        ibv_.Format = DXGI_FORMAT_R16_UINT;
-        ibv_.SizeInBytes = static_cast< UINT >(size);
+        ibv_ = geometry_.upload_indices(cmdlist, idx, DXGI_FORMAT_R16_UINT, static_cast< uint32_t >(sizeof(idx) / sizeof(idx[0])));
     }
 
     D3D12_DESCRIPTOR_HEAP_DESC nullheap = {
@@ -411,7 +328,7 @@ void playground_t::init(uniq_device_t& u, ID3D12GraphicsCommandList* cmdlist, co
             u.dev()->CreateConstantBufferView(&cbvdesc, hdl);
             hdl.ptr += u.sizeset().view;
         
-            memcpy(reinterpret_cast< uint8_t* >(ptr) + i * align256(sizeof(float) * 16), &matrix[i], sizeof(float) * 16);
+            wc_copy(reinterpret_cast< uint8_t* >(ptr) + i * align256(sizeof(float) * 16), &matrix[i], sizeof(float) * 16);
             n ++;
         }
         cbv_->Unmap(0, nullptr);
@@ -601,7 +518,7 @@ void playground_t::update(uniq_device_t& u, uint64_t freq)
     float* ptr = nullptr;
     D3D12_RANGE readrange = {0, 0};
     auto hr = cbv_->Map(0, &readrange, reinterpret_cast< void** >(&ptr));
-    memcpy(reinterpret_cast< uint8_t* >(ptr) + 0 * align256(sizeof(float) * 16), &mat, sizeof(float) * 16);
+    wc_copy(reinterpret_cast< uint8_t* >(ptr) + 0 * align256(sizeof(float) * 16), &mat, sizeof(float) * 16);
     cbv_->Unmap(0, nullptr);
 #endif
 }
@@ -0,0 +1,76 @@
+/**
+ * (C) roentgen 
+ * this code is licensed under the MIT License.
+ */
+#include "simd.hpp"
+
+#if defined(SIMD_X86)
+#if defined(_MSC_VER)
+#include <intrin.h>
+#else
+#include <cpuid.h>
+#endif
+#endif
+
+#if defined(SIMD_X86)
+static void cpuid(uint32_t leaf, uint32_t sub, uint32_t r[4])
+{
+#if defined(_MSC_VER)
+    int v[4];
+    __cpuidex(v, static_cast< int >(leaf), static_cast< int >(sub));
+    for (int i = 0; i < 4; i ++)
+        r[i] = static_cast< uint32_t >(v[i]);
+#else
+    __cpuid_count(leaf, sub, r[0], r[1], r[2], r[3]);
+#endif
+}
+
+static uint64_t xgetbv0()
+{
+#if defined(_MSC_VER)
+    return _xgetbv(0);
+#else
+    uint32_t lo, hi;
+    __asm__ volatile ("xgetbv" : "=a"(lo), "=d"(hi) : "c"(0));
+    return (static_cast< uint64_t >(hi) << 32) | lo;
+#endif
+}
+#endif
+
+static cpu_features_t detect()
+{
+    cpu_features_t f = {};
+#if defined(SIMD_X86)
+    uint32_t r[4];
+    cpuid(0, 0, r);
+    const uint32_t maxleaf = r[0];
+    cpuid(1, 0, r);
+    f.sse2 = (r[3] >> 26) & 1;
+    f.ssse3 = (r[2] >> 9) & 1;
+    f.sse41 = (r[2] >> 19) & 1;
+    f.sse42 = (r[2] >> 20) & 1;
+    f.f16c = (r[2] >> 29) & 1;
+    const bool osxsave = (r[2] >> 27) & 1;
+    const bool avx = (r[2] >> 28) & 1;
+    /* OS が XSAVE で YMM (bit 1,2) / ZMM (bit 5,6,7) を退避してくれるか */
+    const uint64_t xcr0 = osxsave ? xgetbv0() : 0;
+    const bool ymm = (xcr0 & 0x6) == 0x6;
+    const bool zmm = (xcr0 & 0xe6) == 0xe6;
+    f.avx = avx && ymm;
+    f.f16c = f.f16c && f.avx;
+    if (maxleaf >= 7) {
+        cpuid(7, 0, r);
+        f.avx2 = f.avx && ((r[1] >> 5) & 1);
+        f.bmi2 = (r[1] >> 8) & 1;
+        f.avx512f = zmm && ((r[1] >> 16) & 1);
+        f.avx512bw = f.avx512f && ((r[1] >> 30) & 1);
+    }
+#endif
+    return f;
+}
+
+const cpu_features_t& cpu_features()
+{
+    static const cpu_features_t f = detect();
+    return f;
+}
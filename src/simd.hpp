@@ -0,0 +1,40 @@
+/**
+ * (C) roentgen 
+ * this code is licensed under the MIT License.
+ */
+#if !defined(SIMD_HPP__)
+#define SIMD_HPP__
+
+#include <stdint.h>
+
+/* x86/x64 なら SSE2 は必ずある前提 (x64 の baseline). それ以上は実行時に cpu_features() で見て分岐する */
+#if defined(_M_X64) || defined(_M_IX86) || defined(__x86_64__) || defined(__i386__)
+#define SIMD_X86 1
+#include <emmintrin.h>
+#endif
+
+/* GCC/clang では関数単位で命令セットを有効にしないと AVX2 などの intrinsic が使えない.
+   MSVC は /arch 無しでも intrinsic を吐けるので空でよい */
+#if defined(SIMD_X86) && (defined(__GNUC__) || defined(__clang__))
+#define SIMD_TARGET(isa) __attribute__((target(isa)))
+#else
+#define SIMD_TARGET(isa)
+#endif
+
+struct cpu_features_t {
+    bool sse2;
+    bool ssse3;
+    bool sse41;
+    bool sse42;
+    bool avx;
+    bool avx2;
+    bool f16c;
+    bool bmi2;
+    bool avx512f;
+    bool avx512bw;
+};
+
+/* 初回呼び出し時に cpuid を引いてキャッシュする. OS が YMM/ZMM の保存に対応していなければ AVX 系は false */
+const cpu_features_t& cpu_features();
+
+#endif
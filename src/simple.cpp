@@ -5,6 +5,7 @@
 #include "stdafx.h"
 #include <string>
 #include "simple.hpp"
+#include "wccopy.hpp"
 #include <D3DCompiler.h>
 #include <vector>
 
@@ -133,7 +134,7 @@ void simple_t::load_asset()
         uint8_t* va = nullptr;
         D3D12_RANGE readrange = {0, 0};
         vertbuf_->Map(0, &readrange, reinterpret_cast< void** >(&va));
-        memcpy(va, v, size);
+        wc_copy(va, v, size);
         vertbuf_->Unmap(0, nullptr);
 
         vbv_.BufferLocation = vertbuf_->GetGPUVirtualAddress(); // GPU
@@ -177,8 +178,8 @@ void simple_t::load_asset()
         float* ptr = nullptr;
         D3D12_RANGE readrange = {0, 0};
         cbv_->Map(0, &readrange, reinterpret_cast< void** >(&ptr));
-        memcpy(ptr, matrix, sizeof(float) * 16);
-        memcpy(reinterpret_cast< uint8_t* >(ptr) + ((sizeof(float)*16+255) & ~255), &matrix[1], sizeof(float) * 16);
+        wc_copy(ptr, matrix, sizeof(float) * 16);
+        wc_copy(reinterpret_cast< uint8_t* >(ptr) + ((sizeof(float)*16+255) & ~255), &matrix[1], sizeof(float) * 16);
         cbv_->Unmap(0, nullptr);
     }
     
@@ -396,9 +397,8 @@ D3D12_PLACED_SUBRESOURCE_FOOTPRINT simple_t::write_to_trampoline(std::vector< ui
     INF("texture footprint: rows:%d rowpitch:%lld totalbyte:%lld\n", rows, rowpitch, totalbytes);
     uint8_t* ptr = nullptr;
     trampoline->Map(0, nullptr, reinterpret_cast< void** >(&ptr));
-    for (int y = 0; y < texdesc.Height; ++ y) {
-        memcpy(ptr + footprint.Offset + footprint.Footprint.RowPitch * y, data.data() + texdesc.Width * y, rowpitch);
-    }
+    wc_copy_rows(ptr + footprint.Offset, footprint.Footprint.RowPitch, reinterpret_cast< const uint8_t* >(data.data()),
+                 static_cast< size_t >(texdesc.Width) * sizeof(uint32_t), rowpitch, texdesc.Height);
     trampoline->Unmap(0, nullptr);
     return footprint;
 }
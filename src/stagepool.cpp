@@ -0,0 +1,173 @@
+/**
+ * (C) roentgen 
+ * this code is licensed under the MIT License.
+ */
+#include "stagepool.hpp"
+#include <atomic>
+
+#if defined(_WIN32)
+#ifndef WIN32_LEAN_AND_MEAN
+#define WIN32_LEAN_AND_MEAN
+#endif
+#include <windows.h>
+#else
+#include <sys/mman.h>
+#endif
+
+static const size_t HUGE_PAGE = size_t(2) << 20;
+static const uint32_t CLASS_MIN_SHIFT = 16; /* 64KB */
+
+/* huge page を頼めたら huge を立てる. 2MB より小さいものは普通の page */
+static uint8_t* os_alloc(size_t bytes, bool& huge)
+{
+    huge = false;
+#if defined(_WIN32)
+    static std::atomic< bool > large(true);
+    const size_t lp = GetLargePageMinimum();
+    if (large && lp && bytes >= lp && bytes % lp == 0) {
+        void* p = VirtualAlloc(nullptr, bytes, MEM_RESERVE | MEM_COMMIT | MEM_LARGE_PAGES, PAGE_READWRITE);
+        if (p) {
+            huge = true;
+            return static_cast< uint8_t* >(p);
+        }
+        large = false; /* SeLockMemoryPrivilege が無ければ何度やっても駄目 */
+    }
+    return static_cast< uint8_t* >(VirtualAlloc(nullptr, bytes, MEM_RESERVE | MEM_COMMIT, PAGE_READWRITE));
+#else
+    if (bytes >= HUGE_PAGE) {
+#if defined(MAP_HUGETLB)
+        static std::atomic< bool > hugetlb(true);
+        if (hugetlb) {
+            void* p = mmap(nullptr, bytes, PROT_READ | PROT_WRITE, MAP_PRIVATE | MAP_ANONYMOUS | MAP_HUGETLB, -1, 0);
+            if (p != MAP_FAILED) {
+                huge = true;
+                return static_cast< uint8_t* >(p);
+            }
+            hugetlb = false; /* 予約された huge page が無い. 以後は THP に任せる */
+        }
+#endif
+        /* THP は 2MB 境界から始まる範囲にしか効かないので、余分に取って前後を捨てる */
+        void* p = mmap(nullptr, bytes + HUGE_PAGE, PROT_READ | PROT_WRITE, MAP_PRIVATE | MAP_ANONYMOUS, -1, 0);
+        if (p == MAP_FAILED)
+            return nullptr;
+        const uintptr_t base = reinterpret_cast< uintptr_t >(p);
+        const uintptr_t aligned = (base + HUGE_PAGE - 1) & ~static_cast< uintptr_t >(HUGE_PAGE - 1);
+        if (aligned > base)
+            munmap(p, aligned - base);
+        if (base + HUGE_PAGE > aligned)
+            munmap(reinterpret_cast< void* >(aligned + bytes), base + HUGE_PAGE - aligned);
+#if defined(MADV_HUGEPAGE)
+        huge = madvise(reinterpret_cast< void* >(aligned), bytes, MADV_HUGEPAGE) == 0;
+#endif
+        return reinterpret_cast< uint8_t* >(aligned);
+    }
+    void* p = mmap(nullptr, bytes, PROT_READ | PROT_WRITE, MAP_PRIVATE | MAP_ANONYMOUS, -1, 0);
+    return p == MAP_FAILED ? nullptr : static_cast< uint8_t* >(p);
+#endif
+}
+
+static void os_free(uint8_t* p, size_t bytes)
+{
+#if defined(_WIN32)
+    (void)bytes;
+    VirtualFree(p, 0, MEM_RELEASE);
+#else
+    munmap(p, bytes);
+#endif
+}
+
+static inline size_t class_bytes(uint32_t cls)
+{
+    return size_t(1) << (CLASS_MIN_SHIFT + cls);
+}
+
+void staging_buffer_t::reset()
+{
+    if (data_)
+        pool_->release(data_, cls_);
+    pool_ = nullptr;
+    data_ = nullptr;
+    size_ = 0;
+}
+
+staging_buffer_t staging_pool_t::acquire(size_t size)
+{
+    staging_buffer_t b;
+    if (!size)
+        return b;
+    uint32_t cls = 0;
+    while (cls < CLASSES && CLASS_MIN_SHIFT + cls < sizeof(size_t) * 8 && class_bytes(cls) < size)
+        cls ++;
+    if (cls >= CLASSES || CLASS_MIN_SHIFT + cls >= sizeof(size_t) * 8)
+        return b;
+    uint8_t* p = nullptr;
+    {
+        std::lock_guard< std::mutex > lock(mtx_);
+        if (!free_[cls].empty()) {
+            p = free_[cls].back();
+            free_[cls].pop_back();
+            pooled_ -= class_bytes(cls);
+            reuses_ ++;
+        }
+    }
+    if (!p) {
+        bool huge = false;
+        p = os_alloc(class_bytes(cls), huge);
+        if (!p)
+            return b;
+        std::lock_guard< std::mutex > lock(mtx_);
+        allocations_ ++;
+        if (huge)
+            huge_ ++;
+    }
+    b.pool_ = this;
+    b.data_ = p;
+    b.size_ = size;
+    b.cls_ = cls;
+    return b;
+}
+
+void staging_pool_t::release(uint8_t* p, uint32_t cls)
+{
+    {
+        std::lock_guard< std::mutex > lock(mtx_);
+        if (pooled_ + class_bytes(cls) <= budget_) {
+            free_[cls].push_back(p);
+            pooled_ += class_bytes(cls);
+            return;
+        }
+    }
+    os_free(p, class_bytes(cls));
+}
+
+void staging_pool_t::set_budget(size_t budget)
+{
+    std::lock_guard< std::mutex > lock(mtx_);
+    budget_ = budget;
+    /* 大きい class から捨てる */
+    for (int cls = CLASSES - 1; cls >= 0 && pooled_ > budget_; cls --) {
+        while (!free_[cls].empty() && pooled_ > budget_) {
+            os_free(free_[cls].back(), class_bytes(cls));
+            free_[cls].pop_back();
+            pooled_ -= class_bytes(cls);
+        }
+    }
+}
+
+void staging_pool_t::trim()
+{
+    std::lock_guard< std::mutex > lock(mtx_);
+    for (uint32_t cls = 0; cls < CLASSES; cls ++) {
+        for (auto p : free_[cls])
+            os_free(p, class_bytes(cls));
+        free_[cls].clear();
+    }
+    pooled_ = 0;
+}
+
+staging_pool_stats_t staging_pool_t::stats()
+{
+    std::lock_guard< std::mutex > lock(mtx_);
+    staging_pool_stats_t s = {allocations_, huge_, reuses_, pooled_, budget_};
+    return s;
+}
@@ -0,0 +1,90 @@
+/**
+ * (C) roentgen 
+ * this code is licensed under the MIT License.
+ */
+#if !defined(STAGEPOOL_HPP__)
+#define STAGEPOOL_HPP__
+
+#include <stdint.h>
+#include <stddef.h>
+#include <mutex>
+#include <vector>
+
+/* 読み込んだファイルの中身、圧縮 RAWD の展開先、 mip chain など 1 枚ぶんの pixel を置く CPU 側のバッファの pool. D3D12 には依存しない.
+   大きさは 64KB からの 2 のべきの size class に丸め、返されたものは class ごとの free list に残して次の acquire() で渡す.
+   新しく確保する時は OS から直接取り、 2MB 以上の class は huge page を頼む
+   (Linux は MAP_HUGETLB, 駄目なら THP の madvise. Win32 は large page が使えれば).
+   page fault とゼロ埋めは最初の 1 回だけで、以後は同じ page を使い回す */
+
+class staging_pool_t;
+
+/* acquire() で借りたバッファ. 捨てると pool に返る */
+class staging_buffer_t {
+    friend class staging_pool_t;
+    staging_pool_t* pool_;
+    uint8_t* data_;
+    size_t size_;  /* 頼んだ大きさ. 実際にはその class の大きさまで使える */
+    uint32_t cls_;
+public:
+    staging_buffer_t() : pool_(nullptr), data_(nullptr), size_(0), cls_(0) {}
+    ~staging_buffer_t() { reset(); }
+    staging_buffer_t(const staging_buffer_t&) = delete;
+    staging_buffer_t& operator=(const staging_buffer_t&) = delete;
+    staging_buffer_t(staging_buffer_t&& o) : pool_(o.pool_), data_(o.data_), size_(o.size_), cls_(o.cls_) { o.pool_ = nullptr; o.data_ = nullptr; o.size_ = 0; }
+    staging_buffer_t& operator=(staging_buffer_t&& o)
+    {
+        if (this != &o) {
+            reset();
+            pool_ = o.pool_;
+            data_ = o.data_;
+            size_ = o.size_;
+            cls_ = o.cls_;
+            o.pool_ = nullptr;
+            o.data_ = nullptr;
+            o.size_ = 0;
+        }
+        return *this;
+    }
+    void reset();
+    inline uint8_t* data() const { return data_; }
+    inline size_t size() const { return size_; }
+    inline bool empty() const { return data_ == nullptr; }
+};
+
+struct staging_pool_stats_t {
+    uint64_t allocations; /* OS から確保した回数 */
+    uint64_t huge;        /* そのうち huge page を頼めたもの */
+    uint64_t reuses;      /* free list から渡した回数 */
+    size_t pooled;        /* free list に残っている byte 数 */
+    size_t budget;
+};
+
+/* どのスレッドから acquire() / 返却してもよい. 借りたバッファは pool より先に返すこと */
+class staging_pool_t {
+    enum { CLASSES = 20 }; /* 64KB .. 32GB */
+    std::mutex mtx_;
+    std::vector< uint8_t* > free_[CLASSES];
+    size_t pooled_;
+    size_t budget_;
+    uint64_t allocations_;
+    uint64_t huge_;
+    uint64_t reuses_;
+
+    void release(uint8_t* p, uint32_t cls);
+    friend class staging_buffer_t;
+public:
+    /* budget を超えて返されたものは free list に残さずに OS に返す */
+    explicit staging_pool_t(size_t budget = size_t(256) << 20) : pooled_(0), budget_(budget), allocations_(0), huge_(0), reuses_(0) {}
+    ~staging_pool_t() { trim(); }
+    staging_pool_t(const staging_pool_t&) = delete;
+    staging_pool_t& operator=(const staging_pool_t&) = delete;
+
+    /* size byte 以上のバッファ. 中身は前に使った時のまま (ゼロではない). 確保できなければ empty() */
+    staging_buffer_t acquire(size_t size);
+    void set_budget(size_t budget);
+    /* free list を全部 OS に返す */
+    void trim();
+    staging_pool_stats_t stats();
+};
+
+#endif
@@ -203,7 +203,7 @@ void stereo_t::load_asset()
         uint8_t* va = nullptr;
         D3D12_RANGE readrange = {0, 0};
         vertbuf_->Map(0, &readrange, reinterpret_cast< void** >(&va));
-        memcpy(va, v, size);
+        wc_copy(va, v, size);
         vertbuf_->Unmap(0, nullptr);
         
         vbv_.BufferLocation = vertbuf_->GetGPUVirtualAddress(); // GPU
@@ -236,8 +236,8 @@ void stereo_t::load_asset()
             volatile uint8_t* ptr = nullptr;
             D3D12_RANGE readrange = {0, 0};
             cbv_->Map(0, &readrange, reinterpret_cast< void** >(const_cast< uint8_t** >(&ptr)));
-            memcpy(const_cast< uint8_t* >(ptr), matrix, sizeof(float) * 16);
-            memcpy(const_cast< uint8_t* >(ptr) + sizeof(float) * 16, &matrix[1], sizeof(float) * 16);
+            wc_copy(const_cast< uint8_t* >(ptr), matrix, sizeof(float) * 16);
+            wc_copy(const_cast< uint8_t* >(ptr) + sizeof(float) * 16, &matrix[1], sizeof(float) * 16);
             //memcpy(const_cast< uint8_t* >(ptr) + aligned * 2, &matrix[2], sizeof(float) * 16);
             //memcpy(const_cast< uint8_t* >(ptr) + aligned * 3, &matrix[3], sizeof(float) * 16);
             cbv_->Unmap(0, nullptr);
@@ -262,10 +262,11 @@ void stereo_t::load_asset()
     NAME_OBJ(thr_cmd_lst);
     NAME_OBJ(thr_cmd_alloc);
 
-    auto workq = std::make_shared< std::deque< std::wstring > >();
-    workq->push_back(dir + L"mc512x512_blue.rawdata");
+    auto requests = std::make_shared< texture_request_queue_t >();
+    std::vector< texture_handle_t > batch;
+    batch.push_back(requests->submit(dir + L"mc512x512_blue.rawdata"));
     
-    loading_ = std::make_shared< loading_t< playground_t > >(workq);
+    loading_ = std::make_shared< loading_t< playground_t > >(requests, std::move(batch));
     playing_ = std::make_shared< playground_t >();
 
     /* [&, thr_cmd_lst, thr_cmd_alloc] の capture を指定するとなぜか future::get() で例外が発生する */
@@ -279,6 +280,7 @@ void stereo_t::load_asset()
                 
                 ID3D12CommandList* l[] = {thr_cmd_lst.Get()};
                 uniq_.queue()->ExecuteCommandLists(std::extent< decltype(l) >::value, l);
+                playing_->geometry_submitted(uniq_.queue().Get());
                 flipper_.wait(uniq_.queue().Get());
                 
                 return std::weak_ptr< playground_t >(playing_);
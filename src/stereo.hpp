@@ -19,6 +19,7 @@
 #include <pix.h>
 #include "scene.hpp"
 #include "loading.hpp"
+#include "geometry.hpp"
 
 #define DUMMY_OVR
 
@@ -69,16 +70,9 @@ class playground_t : public scene_t {
     Microsoft::WRL::ComPtr< ID3D12DescriptorHeap > patch_descheap_;
     Microsoft::WRL::ComPtr< ID3D12PipelineState > shadow_pso_;
     Microsoft::WRL::ComPtr< ID3D12RootSignature > shadow_rootsig_;
-    Microsoft::WRL::ComPtr< ID3D12Resource > cube_vert_;
-    Microsoft::WRL::ComPtr< ID3D12Resource > cube_vertupload_;
-    Microsoft::WRL::ComPtr< ID3D12Resource > cube_idx_;
-    Microsoft::WRL::ComPtr< ID3D12Resource > cube_idxupload_;
+    geometry_pool_t geometry_; /* cube と ground の頂点/index */
 
     D3D12_VERTEX_BUFFER_VIEW ground_vbv_;
-    Microsoft::WRL::ComPtr< ID3D12Resource > ground_vert_;
-    Microsoft::WRL::ComPtr< ID3D12Resource > ground_vertupload_;
-    Microsoft::WRL::ComPtr< ID3D12Resource > ground_idx_;
-    Microsoft::WRL::ComPtr< ID3D12Resource > ground_idxupload_;
 
     Microsoft::WRL::ComPtr< ID3D12CommandAllocator > bundle_alloc_;
     Microsoft::WRL::ComPtr< ID3D12GraphicsCommandList > bundle_;
@@ -93,6 +87,9 @@ class playground_t : public scene_t {
 public:
     playground_t() : shadowpass_(false), finished_(false) {}
 
+    /* init() の cmdlist を queue に Execute した後に呼ぶ. copy が終われば geometry の staging を捨てる */
+    void geometry_submitted(ID3D12CommandQueue* queue) { geometry_.submitted(queue); }
+
     void set_deferred_cmdset(cmdset_t cmdset)
     {
         deferred_cmdset_ = cmdset;
@@ -109,9 +106,9 @@ public:
         for (auto& item : *payload_) {
             D3D12_SHADER_RESOURCE_VIEW_DESC srv = {};
             srv.Shader4ComponentMapping = D3D12_DEFAULT_SHADER_4_COMPONENT_MAPPING;
-            srv.Format = DXGI_FORMAT_R8G8B8A8_UNORM;
+            srv.Format = item->GetDesc().Format;
             srv.ViewDimension = D3D12_SRV_DIMENSION_TEXTURE2D;
-            srv.Texture2D.MipLevels = 1;
+            srv.Texture2D.MipLevels = item->GetDesc().MipLevels;
             {
                 /* 指定した SRV Heap に ID3D12Resource/D3D12_SHADER_RESOURCE_VIEW_DESC で指定した SRV を生成する */
                 u.dev()->CreateShaderResourceView(item.Get(), &srv, hdl);
@@ -854,6 +851,7 @@ protected:
         uniq_.swapchain()->SetFullscreenState(false, nullptr);
         loading_->shutdown();
         flipper_.wait(uniq_.queue().Get());
+        texture_cache().clear(); /* device より先に手放す */
     }
 
     void create_root_signature(uniq_device_t& u);
@@ -0,0 +1,154 @@
+/**
+ * (C) roentgen 
+ * this code is licensed under the MIT License.
+ */
+#include "swizzle.hpp"
+#include "simd.hpp"
+#include "wccopy.hpp"
+#include <string.h>
+#include <algorithm>
+
+/* 要素の byte 数 1, 2, 4, 8, 16 ごとの表. x と y の bit は重ならないので番地は xtab[x] + ytab[y] */
+struct swizzle_table_t {
+    uint32_t width;
+    uint32_t height;
+    uint32_t xtab[256];
+    uint32_t ytab[256];
+};
+
+/* 要素の番号の bit を下位から. 要素の byte 数の bit はこの下に付く */
+static const char* const PATTERNS[5] = {
+    "xxxxyyyyxyxyxyxy", /* 1 byte: 256x256 */
+    "xxxxyyyyxyxyxyx",  /* 2 byte: 256x128 */
+    "xxxxyyyyxyxyxy",   /* 4 byte: 128x128 */
+    "xxxxyyyyxyxyx",    /* 8 byte: 128x64 */
+    "xxxxyyyyxyxy",     /* 16 byte: 64x64 */
+};
+
+/* 1 行で tile の中に続けて並ぶ要素の数 (x の下位 4 bit) */
+static const uint32_t RUN = 16;
+
+static void build(swizzle_table_t& t, uint32_t shift)
+{
+    uint32_t xbit[8] = {};
+    uint32_t ybit[8] = {};
+    uint32_t xs = 0;
+    uint32_t ys = 0;
+    uint32_t pos = shift;
+    for (const char* p = PATTERNS[shift]; *p; p ++, pos ++) {
+        if (*p == 'x')
+            xbit[xs ++] = pos;
+        else
+            ybit[ys ++] = pos;
+    }
+    t.width = 1u << xs;
+    t.height = 1u << ys;
+    for (uint32_t v = 0; v < 256; v ++) {
+        t.xtab[v] = 0;
+        t.ytab[v] = 0;
+        for (uint32_t b = 0; b < 8; b ++) {
+            if (!((v >> b) & 1))
+                continue;
+            if (b < xs)
+                t.xtab[v] |= 1u << xbit[b];
+            if (b < ys)
+                t.ytab[v] |= 1u << ybit[b];
+        }
+    }
+}
+
+struct swizzle_tables_t {
+    swizzle_table_t t[5];
+    swizzle_tables_t()
+    {
+        for (uint32_t i = 0; i < 5; i ++)
+            build(t[i], i);
+    }
+};
+
+/* 対応していなければ nullptr */
+static const swizzle_table_t* table_of(uint32_t bytes)
+{
+    static const swizzle_tables_t tables;
+    switch (bytes) {
+    case 1: return &tables.t[0];
+    case 2: return &tables.t[1];
+    case 4: return &tables.t[2];
+    case 8: return &tables.t[3];
+    case 16: return &tables.t[4];
+    default: return nullptr;
+    }
+}
+
+bool swizzle_tile_dims(uint32_t bytes, uint32_t& width, uint32_t& height)
+{
+    const swizzle_table_t* t = table_of(bytes);
+    if (!t)
+        return false;
+    width = t->width;
+    height = t->height;
+    return true;
+}
+
+uint64_t swizzle_64kb_size(const pixel_view_t& v)
+{
+    const swizzle_table_t* t = table_of(v.bpp);
+    if (!t || !v.width || !v.height)
+        return 0;
+    const uint32_t cols = static_cast< uint32_t >(rawd_row_bytes(v) / v.bpp);
+    const uint64_t tx = (cols + t->width - 1) / t->width;
+    const uint64_t ty = (rawd_rows(v) + t->height - 1) / t->height;
+    return tx * ty * SWIZZLE_TILE_BYTES;
+}
+
+/* 16 要素ぶん (16 の倍数の byte 数). dst は 16 byte 境界 */
+static inline void copy_run(uint8_t* dst, const uint8_t* src, size_t bytes)
+{
+#if defined(SIMD_X86)
+    for (size_t i = 0; i < bytes; i += 16)
+        _mm_store_si128(reinterpret_cast< __m128i* >(dst + i), _mm_loadu_si128(reinterpret_cast< const __m128i* >(src + i)));
+#else
+    memcpy(dst, src, bytes);
+#endif
+}
+
+int swizzle_64kb(const pixel_view_t& v, uint8_t* dst, worker_pool_t* pool)
+{
+    const swizzle_table_t* t = table_of(v.bpp);
+    if (!t || !v.data || !v.width || !v.height)
+        return -1;
+    const uint32_t bytes = v.bpp;
+    const uint32_t cols = static_cast< uint32_t >(rawd_row_bytes(v) / bytes);
+    const uint32_t rows = rawd_rows(v);
+    const uint32_t tiles_x = (cols + t->width - 1) / t->width;
+    const uint32_t tiles_y = (rows + t->height - 1) / t->height;
+    const size_t run = static_cast< size_t >(RUN) * bytes;
+
+    auto tile = [&](size_t i) {
+        alignas(64) uint8_t scratch[SWIZZLE_TILE_BYTES];
+        const uint32_t x0 = static_cast< uint32_t >(i % tiles_x) * t->width;
+        const uint32_t y0 = static_cast< uint32_t >(i / tiles_x) * t->height;
+        const uint32_t w = std::min(t->width, cols - x0);
+        const uint32_t h = std::min(t->height, rows - y0);
+        if (w < t->width || h < t->height)
+            memset(scratch, 0, sizeof(scratch));
+        const uint32_t full = w & ~(RUN - 1);
+        for (uint32_t y = 0; y < h; y ++) {
+            const uint8_t* src = v.data + v.pitch * (y0 + y) + static_cast< size_t >(x0) * bytes;
+            uint8_t* line = scratch + t->ytab[y];
+            uint32_t x = 0;
+            for (; x < full; x += RUN)
+                copy_run(line + t->xtab[x], src + static_cast< size_t >(x) * bytes, run);
+            if (x < w)
+                memcpy(line + t->xtab[x], src + static_cast< size_t >(x) * bytes, static_cast< size_t >(w - x) * bytes);
+        }
+        wc_copy(dst + i * SWIZZLE_TILE_BYTES, scratch, SWIZZLE_TILE_BYTES);
+    };
+    const size_t n = static_cast< size_t >(tiles_x) * tiles_y;
+    if (pool)
+        pool->parallel_for(n, tile);
+    else
+        for (size_t i = 0; i < n; i ++)
+            tile(i);
+    return 0;
+}
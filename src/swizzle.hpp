@@ -0,0 +1,33 @@
+/**
+ * (C) roentgen 
+ * this code is licensed under the MIT License.
+ */
+#if !defined(SWIZZLE_HPP__)
+#define SWIZZLE_HPP__
+
+#include "rawd.hpp"
+#include "pipeline.hpp"
+#include <stdint.h>
+
+/* D3D12_TEXTURE_LAYOUT_64KB_STANDARD_SWIZZLE の 2D (sample 1) の並びを CPU で作る. D3D12 には依存しない.
+
+   subresource は 64KB の tile を行優先で並べたもの. tile は要素 (texel か block) の byte 数で形が決まり
+   (1:256x256 2:256x128 4:128x128 8:128x64 16:64x64. 幅 x 高さ, 要素単位), tile の中の要素の番地は
+   下位から x0 x1 x2 x3 y0 y1 y2 y3 の後に x と y を交互に並べたものに要素の byte 数を掛けたもの.
+   x の下位 4 bit が連続しているので、 16 要素の行 (16-256 byte) は tile の中でもそのまま並ぶ.
+   はみ出した tile の余白は 0 で埋める. packed mip (tile より小さい level) の並びは規定されていないので扱わない */
+
+#define SWIZZLE_TILE_BYTES (65536)
+
+/* 1 要素 bytes byte の tile の幅と高さ (要素単位). 対応していない大きさ (3, 12 など) なら false */
+bool swizzle_tile_dims(uint32_t bytes, uint32_t& width, uint32_t& height);
+
+/* v (1 level) を swizzle した時の byte 数 (tile の数 x 64KB). 対応していなければ 0 */
+uint64_t swizzle_64kb_size(const pixel_view_t& v);
+
+/* v を dst (swizzle_64kb_size() byte) に swizzle して書く. tile ごとに cache の上で組み立ててから
+   non-temporal store で書き出すので、 map した WC のメモリに直接書いてよい. tile は pool に配って並列に.
+   data が無いか、対応していない要素の大きさなら -1 */
+int swizzle_64kb(const pixel_view_t& v, uint8_t* dst, worker_pool_t* pool = nullptr);
+
+#endif
@@ -0,0 +1,113 @@
+/**
+ * (C) roentgen 
+ * this code is licensed under the MIT License.
+ */
+#if !defined(TEXCACHE_HPP__)
+#define TEXCACHE_HPP__
+
+#include <stdint.h>
+#include <stddef.h>
+#include <list>
+#include <mutex>
+#include <unordered_map>
+
+struct content_cache_stats_t {
+    size_t entries;
+    size_t bytes;
+    size_t budget;
+    uint64_t hits;
+    uint64_t misses;
+    uint64_t evictions;
+};
+
+/* 内容の hash (xxh64) を key にした LRU. D3D12 には依存しない (Value は ComPtr などコピーで共有できるもの).
+   bytes の合計が budget を超えたら一番長く使われていないものから捨てる.
+   捨てるのは cache の持っている参照だけなので、使っている側が持っていれば中身は生きている */
+template < typename Value >
+class content_cache_t {
+    struct entry_t {
+        uint64_t key;
+        Value value;
+        size_t bytes;
+    };
+    typedef std::list< entry_t > lru_t;
+
+    mutable std::mutex mtx_;
+    lru_t lru_; /* 先頭が一番最近使ったもの */
+    std::unordered_map< uint64_t, typename lru_t::iterator > index_;
+    size_t budget_;
+    size_t used_;
+    uint64_t hits_;
+    uint64_t misses_;
+    uint64_t evictions_;
+
+    void evict_locked()
+    {
+        while (used_ > budget_ && !lru_.empty()) {
+            used_ -= lru_.back().bytes;
+            index_.erase(lru_.back().key);
+            lru_.pop_back();
+            evictions_ ++;
+        }
+    }
+
+public:
+    explicit content_cache_t(size_t budget = 0) : budget_(budget), used_(0), hits_(0), misses_(0), evictions_(0) {}
+
+    bool find(uint64_t key, Value& v)
+    {
+        std::lock_guard< std::mutex > lock(mtx_);
+        auto it = index_.find(key);
+        if (it == index_.end()) {
+            misses_ ++;
+            return false;
+        }
+        lru_.splice(lru_.begin(), lru_, it->second);
+        v = it->second->value;
+        hits_ ++;
+        return true;
+    }
+
+    /* 同じ key が先に入っていればそちらを返す (同じ内容はひとつの Value を共有する).
+       budget より大きいものは入れた直後に捨てられる */
+    Value insert(uint64_t key, const Value& v, size_t bytes)
+    {
+        std::lock_guard< std::mutex > lock(mtx_);
+        auto it = index_.find(key);
+        if (it != index_.end()) {
+            lru_.splice(lru_.begin(), lru_, it->second);
+            return it->second->value;
+        }
+        entry_t e = {key, v, bytes};
+        lru_.push_front(e);
+        index_[key] = lru_.begin();
+        used_ += bytes;
+        evict_locked();
+        return v;
+    }
+
+    void set_budget(size_t budget)
+    {
+        std::lock_guard< std::mutex > lock(mtx_);
+        budget_ = budget;
+        evict_locked();
+    }
+
+    /* device を捨てる前などに全部手放す */
+    void clear()
+    {
+        std::lock_guard< std::mutex > lock(mtx_);
+        lru_.clear();
+        index_.clear();
+        used_ = 0;
+    }
+
+    content_cache_stats_t stats() const
+    {
+        std::lock_guard< std::mutex > lock(mtx_);
+        content_cache_stats_t s = {lru_.size(), used_, budget_, hits_, misses_, evictions_};
+        return s;
+    }
+};
+
+#endif
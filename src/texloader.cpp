@@ -0,0 +1,1319 @@
+/**
+ * (C) roentgen 
+ * this code is licensed under the MIT License.
+ */
+#include "stdafx.h"
+#include "texloader.hpp"
+#include <string>
+#include <vector>
+#include <memory>
+#include <thread>
+#include <chrono>
+#include <algorithm>
+#include <string.h>
+
+using Microsoft::WRL::ComPtr;
+
+int check_graphics_asset(const std::wstring& fname, const pixel_view_t& v, uint32_t max_width, uint32_t max_height)
+{
+    if (v.width > max_width || v.height > max_height) {
+        WRN("file must small than trampoline buffer:%s (%d, %d) \n ", fname.c_str(), v.width, v.height);
+        return -1;
+    }
+    if (v.format == RAWD_FORMAT_UNIVERSAL) {
+        /* 変換先が決まるまで大きさは分からないが、 RGBA8 になっても trampoline には載る */
+        if (v.bpp != rawd_format_bytes(v.format)) {
+            WRN("unsupported transcodable image:%s (%d bytes)\n", fname.c_str(), v.bpp);
+            return -1;
+        }
+        return 0;
+    }
+    if (rawd_is_bc(v.format)) {
+        /* BCn は 4x4 単位. level 0 が 4 の倍数でないと texture を作れない */
+        if (v.bpp != rawd_format_bytes(v.format) || (v.width & 3) || (v.height & 3)) {
+            WRN("unsupported block compressed image:%s (%d, %d) format:%d\n", fname.c_str(), v.width, v.height, v.format);
+            return -1;
+        }
+        return 0;
+    }
+    if (v.format == RAWD_FORMAT_RGBA8 ? v.bpp != 4 : v.bpp != rawd_format_bytes(v.format)) {
+        WRN("unsupported pixel size:%s (%d bytes) format:%d\n", fname.c_str(), v.bpp, v.format);
+        return -1;
+    }
+    return 0;
+}
+
+DXGI_FORMAT texture_format(uint32_t format)
+{
+    switch (format) {
+    case RAWD_FORMAT_BC1: return DXGI_FORMAT_BC1_UNORM;
+    case RAWD_FORMAT_BC3: return DXGI_FORMAT_BC3_UNORM;
+    case RAWD_FORMAT_BC7: return DXGI_FORMAT_BC7_UNORM;
+    case RAWD_FORMAT_RGBA8_SRGB: return DXGI_FORMAT_R8G8B8A8_UNORM_SRGB;
+    case RAWD_FORMAT_RGBA16F: return DXGI_FORMAT_R16G16B16A16_FLOAT;
+    case RAWD_FORMAT_RGBA32F: return DXGI_FORMAT_R32G32B32A32_FLOAT;
+    case RAWD_FORMAT_RGB10A2: return DXGI_FORMAT_R10G10B10A2_UNORM;
+    default: return DXGI_FORMAT_R8G8B8A8_UNORM;
+    }
+}
+
+static uint32_t rawd_format_of(DXGI_FORMAT format)
+{
+    switch (format) {
+    case DXGI_FORMAT_BC1_UNORM: return RAWD_FORMAT_BC1;
+    case DXGI_FORMAT_BC3_UNORM: return RAWD_FORMAT_BC3;
+    case DXGI_FORMAT_BC7_UNORM: return RAWD_FORMAT_BC7;
+    case DXGI_FORMAT_R8G8B8A8_UNORM_SRGB: return RAWD_FORMAT_RGBA8_SRGB;
+    case DXGI_FORMAT_R16G16B16A16_FLOAT: return RAWD_FORMAT_RGBA16F;
+    case DXGI_FORMAT_R32G32B32A32_FLOAT: return RAWD_FORMAT_RGBA32F;
+    case DXGI_FORMAT_R10G10B10A2_UNORM: return RAWD_FORMAT_RGB10A2;
+    default: return RAWD_FORMAT_RGBA8;
+    }
+}
+
+/* 配置の計算に要る形式の大きさ. 知らない形式 (plane のあるもの, depth など) は false */
+static bool footprint_desc_of(const D3D12_RESOURCE_DESC& desc, footprint_desc_t& f)
+{
+    f.width = desc.Width;
+    f.height = desc.Height;
+    f.depth_or_array = desc.DepthOrArraySize;
+    f.mips = desc.MipLevels;
+    f.block_dim = 1;
+    f.block_bytes = 1;
+    switch (desc.Dimension) {
+    case D3D12_RESOURCE_DIMENSION_BUFFER: f.dimension = FOOTPRINT_BUFFER; return true;
+    case D3D12_RESOURCE_DIMENSION_TEXTURE1D: f.dimension = FOOTPRINT_TEXTURE1D; break;
+    case D3D12_RESOURCE_DIMENSION_TEXTURE2D: f.dimension = FOOTPRINT_TEXTURE2D; break;
+    case D3D12_RESOURCE_DIMENSION_TEXTURE3D: f.dimension = FOOTPRINT_TEXTURE3D; break;
+    default: return false;
+    }
+    switch (desc.Format) {
+    case DXGI_FORMAT_R8G8B8A8_UNORM:
+    case DXGI_FORMAT_R8G8B8A8_UNORM_SRGB:
+    case DXGI_FORMAT_B8G8R8A8_UNORM:
+    case DXGI_FORMAT_R10G10B10A2_UNORM: f.block_bytes = 4; return true;
+    case DXGI_FORMAT_R16G16B16A16_FLOAT: f.block_bytes = 8; return true;
+    case DXGI_FORMAT_R32G32B32A32_FLOAT: f.block_bytes = 16; return true;
+    case DXGI_FORMAT_BC1_UNORM: f.block_dim = 4; f.block_bytes = 8; return true;
+    case DXGI_FORMAT_BC3_UNORM:
+    case DXGI_FORMAT_BC7_UNORM: f.block_dim = 4; f.block_bytes = 16; return true;
+    default: return false;
+    }
+}
+
+UINT64 copyable_footprints(uniq_device_t& u, const D3D12_RESOURCE_DESC& desc, uint32_t first, uint32_t n, uint64_t base,
+                           D3D12_PLACED_SUBRESOURCE_FOOTPRINT* footprints, uint32_t* rows, UINT64* rowsize)
+{
+    footprint_desc_t f;
+    subresource_footprint_t fp[D3D12_REQ_MIP_LEVELS];
+    if (n > D3D12_REQ_MIP_LEVELS || !footprint_desc_of(desc, f)) {
+        UINT64 total = 0;
+        u.dev()->GetCopyableFootprints(&desc, first, n, base, footprints, rows, rowsize, &total);
+        return total;
+    }
+    const uint64_t total = footprint_layout(f, first, n, base, fp);
+    for (uint32_t i = 0; i < n && total != ~0ULL; i ++) {
+        if (footprints) {
+            footprints[i].Offset = fp[i].offset;
+            footprints[i].Footprint.Format = f.dimension == FOOTPRINT_BUFFER ? DXGI_FORMAT_UNKNOWN : desc.Format;
+            footprints[i].Footprint.Width = fp[i].width;
+            footprints[i].Footprint.Height = fp[i].height;
+            footprints[i].Footprint.Depth = fp[i].depth;
+            footprints[i].Footprint.RowPitch = fp[i].row_pitch;
+        }
+        if (rows)
+            rows[i] = fp[i].rows;
+        if (rowsize)
+            rowsize[i] = fp[i].row_bytes;
+    }
+#if defined(_DEBUG)
+    /* device の答えと突き合わせる */
+    D3D12_PLACED_SUBRESOURCE_FOOTPRINT dfp[D3D12_REQ_MIP_LEVELS];
+    uint32_t drows[D3D12_REQ_MIP_LEVELS];
+    UINT64 drowsize[D3D12_REQ_MIP_LEVELS];
+    UINT64 dtotal = 0;
+    u.dev()->GetCopyableFootprints(&desc, first, n, base, dfp, drows, drowsize, &dtotal);
+    bool same = dtotal == total;
+    for (uint32_t i = 0; i < n && same && total != ~0ULL; i ++) {
+        same = dfp[i].Offset == fp[i].offset && dfp[i].Footprint.Width == fp[i].width && dfp[i].Footprint.Height == fp[i].height &&
+            dfp[i].Footprint.Depth == fp[i].depth && dfp[i].Footprint.RowPitch == fp[i].row_pitch && drows[i] == fp[i].rows && drowsize[i] == fp[i].row_bytes;
+    }
+    if (!same)
+        WRN("footprint differs from device: format:%d %lldx%d first:%d n:%d total:%lld (device:%lld)\n", desc.Format, desc.Width, desc.Height, first, n, total, dtotal);
+#endif
+    return total;
+}
+
+uint32_t upload_format(const pixel_view_t& v, uint32_t supported, uint32_t convert)
+{
+    if (v.format == RAWD_FORMAT_UNIVERSAL)
+        return transcode_target(v, supported);
+    return pixconv_target(v.format, convert);
+}
+
+uint32_t supported_formats(uniq_device_t& u)
+{
+    uint32_t bits = TRANSCODE_FORMAT_BIT(RAWD_FORMAT_RGBA8);
+    const uint32_t candidates[] = {RAWD_FORMAT_BC1, RAWD_FORMAT_BC7};
+    for (auto f : candidates) {
+        D3D12_FEATURE_DATA_FORMAT_SUPPORT support = {texture_format(f)};
+        if (SUCCEEDED(u.dev()->CheckFeatureSupport(D3D12_FEATURE_FORMAT_SUPPORT, &support, sizeof(support)))
+            && (support.Support1 & D3D12_FORMAT_SUPPORT1_TEXTURE2D) && (support.Support1 & D3D12_FORMAT_SUPPORT1_SHADER_SAMPLE))
+            bits |= TRANSCODE_FORMAT_BIT(f);
+    }
+    return bits;
+}
+
+int load_graphics_asset(const std::wstring& fname, rawd_image_t& img)
+{
+    int err = img.open(fname);
+    if (err == 0)
+        err = img.verify();
+    if (err == RAWD_ERR_OPEN) {
+        WRN("could not locate file:%s\n", fname.c_str());
+        return err;
+    }
+    if (err < 0) {
+        WRN("file maybe broken:%s err:%d\n", fname.c_str(), err);
+        return err;
+    }
+    if (check_graphics_asset(fname, img.view()) < 0) {
+        img = rawd_image_t();
+        return -1;
+    }
+    return 0;
+}
+
+/* fname の stem でアーカイブを引く. 見つからなければ黙って -1 を返すので呼び出し側でファイルにフォールバックする */
+int load_graphics_asset(const rawd_archive_t& archive, const std::wstring& fname, pixel_view_t& view)
+{
+    const rawa_entry_t* e = archive.find(rawa_key_from_path(fname));
+    if (!e)
+        return -1;
+    const uint32_t sum = archive.checksum(e);
+    if (sum && rawd_checksum(archive.payload(e), static_cast< size_t >(e->size)) != sum) {
+        WRN("file maybe broken:%s err:%d\n", fname.c_str(), RAWD_ERR_CHECKSUM);
+        return -1;
+    }
+    if (archive.view(e, 0, view) < 0 || check_graphics_asset(fname, view) < 0) {
+        view = pixel_view_t();
+        return -1;
+    }
+    return 0;
+}
+
+/* 1 subresource 分を footprint の位置へ */
+static void copy_to_footprint(uint8_t* ptr, const D3D12_PLACED_SUBRESOURCE_FOOTPRINT& footprint, uint32_t rows, size_t rowsize, const pixel_view_t& src, uint32_t target, worker_pool_t* pool)
+{
+    if (!src.data)
+        return;
+    if (src.format == RAWD_FORMAT_UNIVERSAL) {
+        /* 中間形式は footprint の位置へ直接変換する */
+        if (transcode(src, target, ptr + footprint.Offset, footprint.Footprint.RowPitch, pool) < 0)
+            WRN("could not transcode to format:%d\n", target);
+        return;
+    }
+    if (src.format != target) {
+        /* 行のコピーと一緒に texel の形式も変換する */
+        if (pixconv(src, target, ptr + footprint.Offset, footprint.Footprint.RowPitch, pool) < 0)
+            WRN("could not convert format:%d to %d\n", src.format, target);
+        return;
+    }
+    /* 書き込み先は write-combined なので non-temporal store で. pitch が一致していれば一度に */
+    wc_copy_rows(ptr + footprint.Offset, footprint.Footprint.RowPitch, src.data, src.pitch, std::min< size_t >(rowsize, src.pitch), rows);
+}
+
+void write_levels_to_upload(uniq_device_t& u, const pixel_view_t* levels, uint32_t n, const D3D12_RESOURCE_DESC& texdesc, uint8_t* ptr, uint64_t base, D3D12_PLACED_SUBRESOURCE_FOOTPRINT* footprints, worker_pool_t* pool)
+{
+    uint32_t rows[D3D12_REQ_MIP_LEVELS];
+    UINT64 rowsize[D3D12_REQ_MIP_LEVELS];
+    UINT64 totalbytes;
+    n = std::min< uint32_t >(n, D3D12_REQ_MIP_LEVELS);
+    totalbytes = copyable_footprints(u, texdesc, 0, n, base, footprints, rows, rowsize);
+    INF("texture footprint: levels:%d rows:%d rowpitch:%d totalbyte:%lld\n", n, rows[0], footprints[0].Footprint.RowPitch, totalbytes);
+    const uint32_t target = rawd_format_of(texdesc.Format);
+    /* archive の payload は footprint と同じ並びなので、 全 level が形式もそのまま並んでいれば 1 回でコピーする */
+    bool packed = true;
+    for (uint32_t i = 0; i < n && packed; i ++) {
+        packed = levels[i].data && levels[i].format == target && levels[i].pitch == footprints[i].Footprint.RowPitch &&
+            static_cast< uint64_t >(levels[i].data - levels[0].data) == footprints[i].Offset - footprints[0].Offset;
+    }
+    if (packed) {
+        wc_copy(ptr + footprints[0].Offset, levels[0].data, static_cast< size_t >(totalbytes));
+        return;
+    }
+    for (uint32_t i = 0; i < n; i ++)
+        copy_to_footprint(ptr, footprints[i], rows[i], static_cast< size_t >(rowsize[i]), levels[i], target, pool);
+}
+
+void write_levels_to_trampoline(uniq_device_t& u, const pixel_view_t* levels, uint32_t n, const D3D12_RESOURCE_DESC& texdesc, ID3D12Resource* trampoline, D3D12_PLACED_SUBRESOURCE_FOOTPRINT* footprints, worker_pool_t* pool)
+{
+    uint8_t* ptr = nullptr;
+    D3D12_RANGE readrange = {0, 0}; /* CPU からは読まない */
+    trampoline->Map(0, &readrange, reinterpret_cast< void** >(&ptr));
+    write_levels_to_upload(u, levels, n, texdesc, ptr, 0, footprints, pool);
+    trampoline->Unmap(0, nullptr);
+}
+
+D3D12_PLACED_SUBRESOURCE_FOOTPRINT write_to_trampoline(uniq_device_t& u, const pixel_view_t& src, const D3D12_RESOURCE_DESC& texdesc, ID3D12Resource* trampoline)
+{
+    D3D12_PLACED_SUBRESOURCE_FOOTPRINT footprint = {};
+    write_levels_to_trampoline(u, &src, 1, texdesc, trampoline, &footprint);
+    return footprint;
+}
+
+D3D12_PLACED_SUBRESOURCE_FOOTPRINT write_to_upload(uniq_device_t& u, const rawd_image_t& img, const D3D12_RESOURCE_DESC& texdesc, uint8_t* ptr, uint64_t base, worker_pool_t* pool)
+{
+    D3D12_PLACED_SUBRESOURCE_FOOTPRINT footprint = {};
+    if (!img.compressed()) {
+        write_levels_to_upload(u, &img.view(), 1, texdesc, ptr, base, &footprint, pool);
+        return footprint;
+    }
+    if (img.view().format != rawd_format_of(texdesc.Format)) {
+        /* 変換する行は LZ の block とは揃っていないので一度展開する */
+        std::vector< uint8_t > decoded;
+        pixel_view_t view;
+        if (img.decode(decoded, view, pool) < 0)
+            WRN("broken compressed file\n");
+        else
+            write_levels_to_upload(u, &view, 1, texdesc, ptr, base, &footprint, pool);
+        return footprint;
+    }
+
+    copyable_footprints(u, texdesc, 0, 1, base, &footprint);
+    /* LZ の block は互いに独立しているので、 それぞれの先頭行の位置へ直接展開する.
+       RowPitch と pitch が一致していれば (cooker は 256 byte に揃えている) 中間バッファも要らない.
+       PNG は RowPitch 間隔の行をそのまま書く */
+    const int err = img.decode_to(ptr + footprint.Offset, footprint.Footprint.RowPitch, pool, true);
+    if (err < 0)
+        WRN("broken compressed file: err:%d\n", err);
+    return footprint;
+}
+
+D3D12_PLACED_SUBRESOURCE_FOOTPRINT write_to_trampoline(uniq_device_t& u, const rawd_image_t& img, const D3D12_RESOURCE_DESC& texdesc, ID3D12Resource* trampoline, worker_pool_t* pool)
+{
+    uint8_t* ptr = nullptr;
+    D3D12_RANGE readrange = {0, 0}; /* CPU からは読まない */
+    trampoline->Map(0, &readrange, reinterpret_cast< void** >(&ptr));
+    D3D12_PLACED_SUBRESOURCE_FOOTPRINT footprint = write_to_upload(u, img, texdesc, ptr, 0, pool);
+    trampoline->Unmap(0, nullptr);
+    return footprint;
+}
+
+/* copy が全部終わった tex を after へ遷移させる */
+static void transition_after_copy(ID3D12GraphicsCommandList* cmdlist, ID3D12Resource* tex, D3D12_RESOURCE_STATES after)
+{
+    /* Barrier(GPU 同期): 
+       D3D12_RESOURCE_TRANSITION_BARRIER でリソースの状態を明示する.
+       COPY 前に参照していない場合は D3D12_RESOURCE_STATE_COPY_DEST.
+       全 subresource を一度に遷移させる.
+    */
+    D3D12_RESOURCE_BARRIER barrier = {
+        D3D12_RESOURCE_BARRIER_TYPE_TRANSITION,
+        D3D12_RESOURCE_BARRIER_FLAG_NONE,
+        /* D3D12_RESOURCE_TRANSITION_BARRIER */
+        { 
+            tex,
+            D3D12_RESOURCE_BARRIER_ALL_SUBRESOURCES,
+            D3D12_RESOURCE_STATE_COPY_DEST,/* before state */
+            after /* after state */
+        }
+    };
+    /* COPY cmdlist の場合は CommandQueue の非同期実行完了時に暗黙の状態遷移(COMMON への降格(decay))が起きる */
+    if (cmdlist->GetType() == D3D12_COMMAND_LIST_TYPE_COPY) {
+        barrier.Transition.StateAfter = D3D12_RESOURCE_STATE_COMMON;
+    }
+    cmdlist->ResourceBarrier(1, &barrier);
+}
+
+int issue_texture_upload(ID3D12GraphicsCommandList* cmdlist, const D3D12_PLACED_SUBRESOURCE_FOOTPRINT& footprint, ID3D12Resource* tex, ID3D12Resource* trampoline, D3D12_RESOURCE_STATES after)
+{
+    return issue_texture_upload(cmdlist, &footprint, 1, tex, trampoline, after);
+}
+
+int issue_texture_upload(ID3D12GraphicsCommandList* cmdlist, const D3D12_PLACED_SUBRESOURCE_FOOTPRINT* footprints, uint32_t n, ID3D12Resource* tex, ID3D12Resource* trampoline, D3D12_RESOURCE_STATES after)
+{
+    /* COPY コマンドを設定: trampoline(UPLOAD) -> tex(RESIDENT VRAM). mip level ごとに 1 回 */
+    for (uint32_t i = 0; i < n; i ++) {
+        D3D12_TEXTURE_COPY_LOCATION dst = {tex, D3D12_TEXTURE_COPY_TYPE_SUBRESOURCE_INDEX, {0}};
+        dst.SubresourceIndex = i;
+        D3D12_TEXTURE_COPY_LOCATION src = {trampoline, D3D12_TEXTURE_COPY_TYPE_PLACED_FOOTPRINT, {footprints[i]}};
+        /* dst の Dimension が Buffer なら CopyBufferRegion() を使う */
+        cmdlist->CopyTextureRegion(&dst, 0 /* dst-x */, 0 /* dst-y */, 0/* dst-z */, &src, nullptr);
+    }
+    transition_after_copy(cmdlist, tex, after);
+    return 0;
+}
+
+static size_t view_bytes(const pixel_view_t& v)
+{
+    return rawd_row_bytes(v) * rawd_rows(v);
+}
+
+/* runtime で mip を作れる形式 (channel ごとに独立した 8bit x 4) */
+static bool mip_source(uint32_t format)
+{
+    return format == RAWD_FORMAT_RGBA8 || format == RAWD_FORMAT_BGRA8 || format == RAWD_FORMAT_RGBA8_SRGB;
+}
+
+static const size_t TEXTURE_CACHE_BUDGET = size_t(256) << 20;
+static const uint64_t RING_MIN_SIZE = uint64_t(4) << 20;
+
+texture_cache_t& texture_cache()
+{
+    static texture_cache_t cache(TEXTURE_CACHE_BUDGET);
+    return cache;
+}
+
+texture_loader_t::~texture_loader_t()
+{
+    stop();
+    timeline_.stop();
+}
+
+int texture_loader_t::init(uniq_device_t& u, ComPtr< ID3D12CommandQueue > copyq, const texture_loader_config_t& cfg)
+{
+    u_ = &u;
+    queue_ = std::move(copyq);
+    cfg_ = cfg;
+    cfg_.readers = std::max(cfg_.readers, 1);
+    cfg_.decoders = std::max(cfg_.decoders, 1);
+    cfg_.stagers = std::max(cfg_.stagers, 1);
+    cfg_.slots = std::max(cfg_.slots, 1);
+    cfg_.depth = std::max(cfg_.depth, 1);
+    cfg_.batch_count = std::max(std::min(cfg_.batch_count, cfg_.slots), 1);
+    cfg_.block_workers = std::max(cfg_.block_workers, 0);
+    if (pool_.size() != static_cast< size_t >(cfg_.block_workers))
+        pool_.start(cfg_.block_workers);
+    formats_ = supported_formats(u);
+    cache_ = cfg_.cache ? cfg_.cache : &texture_cache();
+    if (!cfg_.manifest.empty()) {
+        /* init() は loading 画面の準備より前に呼んでおけば、その間に先読みが進む */
+        access_manifest_t last;
+        if (last.load(cfg_.manifest) == 0) {
+            INF("texture loader: prefetch %lld files from manifest\n", static_cast< uint64_t >(last.size()));
+            prefetcher_.start(last.entries());
+        }
+    }
+    {
+        /* 同じファイルでも mip や変換の設定が違えば別の texture になる. resource は device ごと */
+        const uint64_t conf[] = {cfg_.mips, static_cast< uint64_t >(cfg_.mip_filter), cfg_.convert, formats_, reinterpret_cast< uintptr_t >(u.dev().Get())};
+        seed_ = xxh64(conf, sizeof(conf));
+    }
+    if (cfg_.io_batch > 0) {
+        /* reader ごとに 1 batch ぶんの深さ */
+        io_.start(IO_BACKEND_AUTO, static_cast< uint32_t >(cfg_.io_batch * cfg_.readers), cfg_.readers);
+        INF("texture loader: batched reads (%d per batch) via %s\n", cfg_.io_batch, io_.backend() == IO_BACKEND_URING ? L"io_uring" : L"threads");
+    }
+
+    auto hr = u.dev()->CreateFence(0, D3D12_FENCE_FLAG_NONE, IID_PPV_ARGS(&fence_));
+    if (FAILED(hr)) {
+        ABT("failed to create fence for texture loader: err:0x%x\n", hr);
+        return -1;
+    }
+    fence_value_ = 0;
+    if (timeline_.start(fence_) < 0)
+        return -1;
+    heap_.init(u, cfg_.heap_block);
+
+    /* upload ring: 全 slot で共有するひとつの UPLOAD buffer. map したまま使い、区間は fence で返ってくる */
+    const uint64_t ringsize = (std::max< uint64_t >(cfg_.ring_size, RING_MIN_SIZE) + D3D12_DEFAULT_RESOURCE_PLACEMENT_ALIGNMENT - 1) & ~static_cast< uint64_t >(D3D12_DEFAULT_RESOURCE_PLACEMENT_ALIGNMENT - 1);
+    INF("texture loader: %d slots (batch %d), ring %lld bytes, readers:%d decoders:%d stagers:%d (+%d block workers) depth:%d\n",
+        cfg_.slots, cfg_.batch_count, ringsize, cfg_.readers, cfg_.decoders, cfg_.stagers, cfg_.block_workers, cfg_.depth);
+
+    auto upload = setup_heapprop(D3D12_HEAP_TYPE_UPLOAD);
+    D3D12_RESOURCE_DESC buf = setup_buffer(ringsize);
+    hr = u.dev()->CreateCommittedResource(&upload, D3D12_HEAP_FLAG_NONE, &buf, D3D12_RESOURCE_STATE_GENERIC_READ, nullptr, IID_PPV_ARGS(&ring_buf_));
+    if (FAILED(hr)) {
+        ABT("failed to create upload ring: err:0x%x\n", hr);
+        return -1;
+    }
+    NAME_OBJ(ring_buf_);
+    D3D12_RANGE readrange = {0, 0}; /* CPU からは読まない */
+    ring_buf_->Map(0, &readrange, reinterpret_cast< void** >(&ring_ptr_));
+    ring_.reset(ringsize);
+    swizzle_bytes_ = cfg_.swizzle ? probe_swizzle() : 0;
+
+    slots_.resize(cfg_.slots);
+    for (auto& s : slots_) {
+        u.dev()->CreateCommandAllocator(D3D12_COMMAND_LIST_TYPE_COPY, IID_PPV_ARGS(&s.allocator));
+        u.dev()->CreateCommandList(0, D3D12_COMMAND_LIST_TYPE_COPY, s.allocator.Get(), nullptr, IID_PPV_ARGS(&s.cmdlist));
+        s.cmdlist->Close(); /* stage stage で Reset() してから使う */
+        NAME_OBJ(s.cmdlist);
+    }
+
+    for (int i = STAGE_DECODE; i < STAGE_SUBMIT; i ++)
+        q_[i].reset(new item_queue_t(cfg_.depth));
+    q_[STAGE_SUBMIT].reset(new item_queue_t(std::max(cfg_.depth, cfg_.batch_count))); /* 1 batch ぶんは溜められるように */
+    q_[STAGE_RETIRE].reset(new item_queue_t(slots_.size())); /* GPU に投げたものは slot の数までしか無い */
+    free_slots_.reset(new bounded_queue_t< int >(slots_.size()));
+    for (int i = 0; i < cfg_.slots; i ++)
+        free_slots_->push(i);
+    return 0;
+}
+
+ComPtr< ID3D12Resource > texture_loader_t::create_texture(int width, int height, DXGI_FORMAT format, uint32_t mips)
+{
+    D3D12_RESOURCE_DESC desc = setup_tex2d(width, height, format, static_cast< uint16_t >(mips));
+    ComPtr< ID3D12Resource > tex;
+    auto hr = heap_.create(desc, D3D12_HEAP_TYPE_DEFAULT, D3D12_RESOURCE_STATE_COPY_DEST, nullptr, tex);
+    if (FAILED(hr)) {
+        ABT("failed to create resident texture: err:0x%x\n", hr);
+    }
+    return tex;
+}
+
+/* CPU から見える (UMA の L0 の WC) heap に standard swizzle で. 最初に GPU が読む時に COMMON から昇格する */
+ComPtr< ID3D12Resource > texture_loader_t::create_swizzled_texture(int width, int height, DXGI_FORMAT format, uint32_t mips)
+{
+    D3D12_RESOURCE_DESC desc = setup_tex2d(width, height, format, static_cast< uint16_t >(mips));
+    desc.Layout = D3D12_TEXTURE_LAYOUT_64KB_STANDARD_SWIZZLE;
+    D3D12_HEAP_PROPERTIES heap = setup_heapprop(D3D12_HEAP_TYPE_CUSTOM);
+    heap.CPUPageProperty = D3D12_CPU_PAGE_PROPERTY_WRITE_COMBINE;
+    heap.MemoryPoolPreference = D3D12_MEMORY_POOL_L0;
+    ComPtr< ID3D12Resource > tex;
+    auto hr = u_->dev()->CreateCommittedResource(&heap, D3D12_HEAP_FLAG_NONE, &desc, D3D12_RESOURCE_STATE_COMMON, nullptr, IID_PPV_ARGS(&tex));
+    if (FAILED(hr)) {
+        WRN("failed to create swizzled texture: err:0x%x\n", hr);
+    }
+    return tex;
+}
+
+/* 要素の byte 数ごとに tile ひとつぶんの texture を作り、 driver に WriteToSubresource() で並べさせたものと
+   swizzle_64kb() の結果を突き合わせる. 一致した大きさだけを返す */
+uint32_t texture_loader_t::probe_swizzle()
+{
+    D3D12_FEATURE_DATA_ARCHITECTURE arch = {};
+    D3D12_FEATURE_DATA_D3D12_OPTIONS opt = {};
+    u_->dev()->CheckFeatureSupport(D3D12_FEATURE_ARCHITECTURE, &arch, sizeof(arch));
+    u_->dev()->CheckFeatureSupport(D3D12_FEATURE_D3D12_OPTIONS, &opt, sizeof(opt));
+    if (!arch.UMA || !opt.StandardSwizzle64KBSupported) {
+        INF("texture loader: no CPU swizzle (UMA:%d StandardSwizzle64KBSupported:%d)\n", arch.UMA, opt.StandardSwizzle64KBSupported);
+        return 0;
+    }
+    static const struct {
+        uint32_t bytes;
+        DXGI_FORMAT format;
+    } probes[] = {
+        {4, DXGI_FORMAT_R32_UINT},
+        {8, DXGI_FORMAT_R32G32_UINT},
+        {16, DXGI_FORMAT_R32G32B32A32_UINT},
+    };
+    uint32_t ok = 0;
+    for (auto& p : probes) {
+        uint32_t w = 0, h = 0;
+        swizzle_tile_dims(p.bytes, w, h);
+        auto tex = create_swizzled_texture(w, h, p.format, 1);
+        if (!tex)
+            continue;
+        const size_t pitch = static_cast< size_t >(w) * p.bytes;
+        std::vector< uint8_t > linear(pitch * h);
+        std::vector< uint8_t > expect(SWIZZLE_TILE_BYTES);
+        for (size_t i = 0; i < linear.size(); i ++)
+            linear[i] = static_cast< uint8_t >(i * 131 + (i >> 8));
+        const pixel_view_t v = {linear.data(), w, h, RAWD_FORMAT_RGBA8, p.bytes, pitch};
+        swizzle_64kb(v, expect.data());
+        uint8_t* mapped = nullptr;
+        if (FAILED(tex->Map(0, nullptr, reinterpret_cast< void** >(&mapped))) || !mapped)
+            continue;
+        bool same = SUCCEEDED(tex->WriteToSubresource(0, nullptr, linear.data(), static_cast< UINT >(pitch), static_cast< UINT >(linear.size())));
+        same = same && memcmp(mapped, expect.data(), expect.size()) == 0;
+        tex->Unmap(0, nullptr);
+        if (same)
+            ok |= 1u << p.bytes;
+        else
+            WRN("texture loader: driver standard swizzle differs for %d byte elements, copy them instead\n", p.bytes);
+    }
+    INF("texture loader: CPU swizzle for element sizes mask:0x%x\n", ok);
+    return ok;
+}
+
+/* 相乗りしている要求も同じ status で完了させる (同じ内容なら同じ理由で失敗する) */
+void texture_loader_t::drop(item_ptr_t& item, int stage, int status)
+{
+    counters_[stage].dropped ++;
+    if (item->slot >= 0)
+        free_slots_->push(item->slot);
+    for (auto t : item->tickets)
+        ring_.release(t); /* submit していないので GPU は読んでいない */
+    if (item->owner) {
+        std::lock_guard< std::mutex > lock(inflight_mtx_);
+        detach_locked(*item);
+    }
+    item->req.complete(texture_load_result_t(status));
+    for (auto& w : item->waiters)
+        w.complete(texture_load_result_t(status));
+    item.reset();
+}
+
+/* inflight_ から外して相乗りを引き取る. 以後の同じ内容の要求は新しく読み始める */
+void texture_loader_t::detach_locked(item_t& item)
+{
+    auto it = inflight_.find(item.key);
+    if (it != inflight_.end()) {
+        for (auto& w : it->second)
+            item.waiters.push_back(std::move(w));
+        inflight_.erase(it);
+    }
+    item.owner = false;
+}
+
+/* 自分が cancel されても、相乗りしている要求が生きていれば読み続ける */
+bool texture_loader_t::cancelled(item_t& item)
+{
+    if (!item.req.cancelled())
+        return false;
+    if (!item.owner)
+        return true;
+    std::lock_guard< std::mutex > lock(inflight_mtx_);
+    auto it = inflight_.find(item.key);
+    if (it != inflight_.end()) {
+        for (auto& w : it->second)
+            if (!w.cancelled())
+                return false;
+    }
+    detach_locked(item);
+    return true;
+}
+
+/* payload を 1 回だけなめて hash を取り、 checksum があればその hash で照合する (検証のために読み直さない).
+   key はそれに形と設定を混ぜたもの. 形式や大きさが違えば同じ byte 列でも別物 */
+int texture_loader_t::content_key(item_t& item) const
+{
+    const uint8_t* p = item.payload;
+    size_t size = item.payload_size;
+    uint32_t sum = item.checksum;
+    if (!p) {
+        p = item.img.payload();
+        size = item.img.payload_size();
+        sum = item.img.checksum();
+    }
+    const uint64_t h = xxh64(p, size);
+    if (sum && rawd_checksum_of(h) != sum)
+        return RAWD_ERR_CHECKSUM;
+    const pixel_view_t& v = item.view;
+    const uint64_t shape[] = {h, v.width, v.height, v.format, v.bpp, v.pitch, item.chain.levels.size()};
+    item.key = xxh64(shape, sizeof(shape), seed_);
+    return 0;
+}
+
+texture_loader_t::item_ptr_t texture_loader_t::new_item(texture_request_queue_t::request_t& req)
+{
+    item_ptr_t item(new item_t());
+    item->req = std::move(req);
+    item->view = pixel_view_t();
+    item->format = RAWD_FORMAT_RGBA8;
+    item->slot = -1;
+    item->fence_value = 0;
+    item->key = 0;
+    item->owner = false;
+    item->payload = nullptr;
+    item->payload_size = 0;
+    item->checksum = 0;
+    item->direct = false;
+    item->footprint = D3D12_PLACED_SUBRESOURCE_FOOTPRINT();
+    item->source = direct_source_t();
+    return item;
+}
+
+void texture_loader_t::record_access(const std::wstring& path, uint64_t offset, uint64_t size)
+{
+    if (cfg_.manifest.empty())
+        return;
+    const auto ms = std::chrono::duration_cast< std::chrono::milliseconds >(std::chrono::steady_clock::now() - started_).count();
+    accesses_.record(path, offset, size, static_cast< uint32_t >(ms));
+}
+
+/* archive にあれば view (と cooker が作った mip) を埋める */
+bool texture_loader_t::read_archive(item_t& item)
+{
+    const rawa_entry_t* e = archive_ ? archive_->find(rawa_key_from_path(item.req.path)) : nullptr;
+    if (!e || archive_->view(e, 0, item.view) < 0)
+        return false;
+    item.payload = archive_->payload(e);
+    item.payload_size = static_cast< size_t >(e->size);
+    item.checksum = archive_->checksum(e);
+    record_access(archive_->path(), e->offset, e->size);
+    if (e->mips > 1) {
+        item.chain.levels.resize(e->mips);
+        for (uint32_t l = 0; l < e->mips; l ++)
+            archive_->view(e, l, item.chain.levels[l]);
+    }
+    return true;
+}
+
+/* 中身を全部読んで hash を取り、 checksum を照合する. map しただけのファイルはここで page fault (= 実際の読み込み) を済ませるので
+   stage stage の memcpy で初めて読まれることはない.
+   cache にあればここで完了させ、同じ内容を読んでいる最中ならそれに相乗りする */
+void texture_loader_t::finish_read(item_ptr_t& item, std::chrono::steady_clock::time_point begin)
+{
+    if (item->req.cancelled()) {
+        drop(item, STAGE_READ, LOAD_ERR_CANCELLED);
+        return;
+    }
+    int err = content_key(*item);
+    if (err < 0) {
+        WRN("checksum mismatch:%s\n", item->req.path.c_str());
+        drop(item, STAGE_READ, err);
+        return;
+    }
+    if (!item->payload)
+        record_access(item->req.path, 0, 0);
+    counters_[STAGE_READ].add(view_bytes(item->view), begin);
+
+    texture_load_result_t hit(0);
+    if (cache_->find(item->key, hit.tex)) {
+        item->req.complete(std::move(hit));
+        item.reset();
+        return;
+    }
+    {
+        std::lock_guard< std::mutex > lock(inflight_mtx_);
+        auto it = inflight_.find(item->key);
+        if (it != inflight_.end()) {
+            it->second.push_back(std::move(item->req));
+            coalesced_ ++;
+            item.reset();
+            return;
+        }
+        inflight_[item->key];
+        item->owner = true;
+    }
+    q_[STAGE_DECODE]->push(std::move(item));
+}
+
+/* read: 優先度順に要求を取り出し、 archive かファイルを map して page を触る */
+void texture_loader_t::read_stage()
+{
+    if (cfg_.io_batch > 0) {
+        read_batched();
+        return;
+    }
+    texture_request_queue_t::request_t req;
+    while (requests_->pop(req)) {
+        const auto begin = std::chrono::steady_clock::now();
+        item_ptr_t item = new_item(req);
+        if (!read_archive(*item)) {
+            /* archive に無いものは個別ファイルから */
+            const std::wstring& path = item->req.path;
+            int err = item->img.open(path);
+            if (err < 0) {
+                WRN("could not load file:%s err:%d\n", path.c_str(), err);
+                drop(item, STAGE_READ, err);
+                continue;
+            }
+            item->view = item->img.view();
+        }
+        finish_read(item, begin);
+    }
+}
+
+/* direct の時に先に読む先頭の byte 数. header, note, 拡張 header が収まればよい */
+static const size_t DIRECT_HEAD_PROBE = 4096;
+
+/* direct: header から texture と footprint を決め、 ring から取った区間の RowPitch の位置へ pixel 列を読む要求を reads に積む.
+   mip や変換が要るもの, 圧縮されたもの, slot や ring が空いていないものは false (全体を読んでいつもの経路に流す) */
+bool texture_loader_t::plan_direct(item_t& item, const uint8_t* head, size_t headsize, uint64_t filesize, io_file_t f, std::vector< io_request_t >& reads)
+{
+    direct_source_t src;
+    if (direct_probe(head, headsize, filesize, src) < 0)
+        return false;
+    const pixel_view_t& v = src.view;
+    if (v.width > D3D12_REQ_TEXTURE2D_U_OR_V_DIMENSION || v.height > D3D12_REQ_TEXTURE2D_U_OR_V_DIMENSION)
+        return false;
+    if (upload_format(v, formats_, cfg_.convert) != v.format)
+        return false;
+    if (cfg_.mips && mip_source(v.format) && mip_levels(v.width, v.height) > 1)
+        return false;
+    /* batch の中で slot や ring を待つと自分の持っているものが返ってこないので待たない */
+    int s = -1;
+    if (!free_slots_->try_pop(s))
+        return false;
+    item.tex = create_texture(v.width, v.height, texture_format(v.format), 1);
+    if (!item.tex) {
+        free_slots_->push(s);
+        return false;
+    }
+    const D3D12_RESOURCE_DESC desc = item.tex->GetDesc();
+    uint64_t base = 0;
+    const UINT64 total = copyable_footprints(*u_, desc, 0, 1, 0, &item.footprint);
+    if (total > ring_.capacity() / 2 || !ring_alloc(total, base, item, false)) {
+        item.tex.Reset();
+        free_slots_->push(s);
+        return false;
+    }
+    item.footprint.Offset += base;
+    direct_requests(src, f, ring_ptr_ + item.footprint.Offset, item.footprint.Footprint.RowPitch, reads);
+    item.slot = s;
+    item.view = v;
+    item.format = v.format;
+    item.source = src;
+    item.direct = true;
+    return true;
+}
+
+/* io_batch > 0 の read: 届いている要求を io_batch 個までまとめ、 個別ファイルは全体を 1 回の submit で読んで
+   batch の完了を待ってから検証する. archive にあるものは map のまま流す.
+   direct なら先に header だけを読み、 ring へ直接読めたものは copy を記録して submit stage へ */
+void texture_loader_t::read_batched()
+{
+    texture_request_queue_t::request_t req;
+    std::vector< item_ptr_t > batch;
+    std::vector< io_file_t > files;
+    std::vector< uint64_t > sizes;
+    std::vector< uint8_t > heads;
+    std::vector< io_request_t > reads;
+    std::vector< size_t > first;   /* batch[i] の要求は reads[first[i]] から reads[first[i + 1]] の手前まで */
+    std::vector< int64_t > results;
+    while (requests_->pop(req)) {
+        const auto begin = std::chrono::steady_clock::now();
+        batch.clear();
+        files.clear();
+        sizes.clear();
+        reads.clear();
+        first.clear();
+        do {
+            item_ptr_t item = new_item(req);
+            if (read_archive(*item)) {
+                finish_read(item, std::chrono::steady_clock::now());
+                continue;
+            }
+            uint64_t size = 0;
+            const io_file_t f = io_open(item->req.path, &size);
+            if (f == IO_INVALID_FILE || size == 0) {
+                WRN("could not load file:%s err:%d\n", item->req.path.c_str(), RAWD_ERR_OPEN);
+                io_close(f);
+                drop(item, STAGE_READ, RAWD_ERR_OPEN);
+                continue;
+            }
+            batch.push_back(std::move(item));
+            files.push_back(f);
+            sizes.push_back(size);
+        } while (batch.size() < static_cast< size_t >(cfg_.io_batch) && requests_->try_pop(req));
+        if (batch.empty())
+            continue;
+        if (cfg_.direct) {
+            /* 先頭だけ読んで header を見る. heads は batch をまたいで使い回す */
+            heads.resize(batch.size() * DIRECT_HEAD_PROBE);
+            results.assign(batch.size(), 0);
+            for (size_t i = 0; i < batch.size(); i ++) {
+                io_request_t r = {files[i], 0, static_cast< size_t >(std::min< uint64_t >(sizes[i], DIRECT_HEAD_PROBE)), &heads[i * DIRECT_HEAD_PROBE], &results[i]};
+                reads.push_back(r);
+            }
+            io_.wait(io_.submit(reads.data(), reads.size()));
+            reads.clear();
+        }
+        for (size_t i = 0; i < batch.size(); i ++) {
+            first.push_back(reads.size());
+            if (cfg_.direct && results[i] > 0
+                && plan_direct(*batch[i], &heads[i * DIRECT_HEAD_PROBE], static_cast< size_t >(results[i]), sizes[i], files[i], reads))
+                continue;
+            /* 前の texture が使い終わったバッファを借りる */
+            staging_buffer_t& contents = batch[i]->contents;
+            contents = staging_.acquire(static_cast< size_t >(sizes[i]));
+            if (!contents.empty()) {
+                io_request_t r = {files[i], 0, contents.size(), contents.data(), nullptr};
+                reads.push_back(r);
+            }
+        }
+        first.push_back(reads.size());
+        results.assign(reads.size(), 0);
+        for (size_t k = 0; k < reads.size(); k ++)
+            reads[k].result = &results[k];
+        io_.wait(io_.submit(reads.data(), reads.size()));
+
+        for (size_t i = 0; i < batch.size(); i ++) {
+            io_close(files[i]);
+            item_ptr_t& item = batch[i];
+            bool complete = true;
+            for (size_t k = first[i]; k < first[i + 1]; k ++)
+                complete = complete && results[k] == static_cast< int64_t >(reads[k].size);
+            /* 待ち時間は batch の先頭にだけ付ける */
+            const auto t = i == 0 ? begin : std::chrono::steady_clock::now();
+            if (item->direct) {
+                if (!complete || item->req.cancelled()) {
+                    drop(item, STAGE_READ, complete ? LOAD_ERR_CANCELLED : RAWD_ERR_TRUNCATED);
+                    continue;
+                }
+                /* ring は読み直さず、 今読んだばかりのファイルを map して page cache の方で照合する */
+                if (item->source.checksum) {
+                    const int err = direct_verify(item->source, item->req.path);
+                    if (err < 0) {
+                        WRN("checksum mismatch:%s\n", item->req.path.c_str());
+                        drop(item, STAGE_READ, err);
+                        continue;
+                    }
+                    direct_verified_ ++;
+                }
+                record_access(item->req.path, 0, 0);
+                counters_[STAGE_READ].add(view_bytes(item->view), t);
+                direct_reads_ ++;
+                /* copy の記録もここで済ませて submit へ. stage stage に回すと、 ring が空くのを待っている stager と
+                   この item の ring の区間とで待ち合ってしまう */
+                slot_t& slot = slots_[item->slot];
+                slot.allocator->Reset();
+                slot.cmdlist->Reset(slot.allocator.Get(), nullptr);
+                issue_texture_upload(slot.cmdlist.Get(), &item->footprint, 1, item->tex.Get(), ring_buf_.Get());
+                slot.cmdlist->Close();
+                q_[STAGE_SUBMIT]->push(std::move(item));
+                continue;
+            }
+            int err = RAWD_ERR_OPEN;
+            if (complete && !item->contents.empty())
+                err = item->img.open(item->contents.data(), item->contents.size());
+            if (err < 0) {
+                WRN("could not load file:%s err:%d\n", item->req.path.c_str(), err);
+                drop(item, STAGE_READ, err);
+                continue;
+            }
+            item->view = item->img.view();
+            finish_read(item, t);
+        }
+    }
+}
+
+/* decode: 形式の検証と mip chain の生成.
+   圧縮 RAWD のまま mip も変換も要らなければ展開は stage stage で upload ring に直接行う.
+   形式の変換 (中間形式を含む) も stage stage で ring に書きながら行う */
+void texture_loader_t::decode_stage()
+{
+    item_ptr_t item;
+    while (q_[STAGE_DECODE]->pop(item)) {
+        const auto begin = std::chrono::steady_clock::now();
+        if (cancelled(*item)) {
+            drop(item, STAGE_DECODE, LOAD_ERR_CANCELLED);
+            continue;
+        }
+        if (check_graphics_asset(item->req.path, item->view, D3D12_REQ_TEXTURE2D_U_OR_V_DIMENSION, D3D12_REQ_TEXTURE2D_U_OR_V_DIMENSION) < 0) {
+            drop(item, STAGE_DECODE, RAWD_ERR_HEADER);
+            continue;
+        }
+        item->format = upload_format(item->view, formats_, cfg_.convert);
+        if (item->chain.levels.empty()) {
+            /* BCn は cooker が作った mip をそのまま使う. runtime では 8bit x 4 の形式だけ縮小する */
+            const bool mips = cfg_.mips && mip_source(item->view.format) && mip_levels(item->view.width, item->view.height) > 1;
+            if (mips || (item->img.compressed() && item->format != item->view.format)) {
+                /* mip を作るものと変換するものは展開しておく */
+                if (item->img.compressed()) {
+                    const pixel_view_t v = item->img.view();
+                    item->decoded = staging_.acquire(rawd_payload_bytes(v));
+                    int err = item->decoded.empty() ? RAWD_ERR_OPEN : item->img.decode_to(item->decoded.data(), v.pitch, &pool_);
+                    if (err < 0) {
+                        WRN("broken compressed file:%s err:%d\n", item->req.path.c_str(), err);
+                        drop(item, STAGE_DECODE, err);
+                        continue;
+                    }
+                    item->view = v;
+                    item->view.data = item->decoded.data();
+                    item->img = rawd_image_t();
+                }
+                if (mips) {
+                    item->mips = staging_.acquire(mip_chain_bytes(item->view));
+                    generate_mips_to(item->view, cfg_.mip_filter, item->view.format == RAWD_FORMAT_RGBA8_SRGB, item->mips.data(), item->mips.size(), item->chain);
+                }
+                if (item->chain.levels.empty())
+                    item->chain.levels.assign(1, item->view);
+            }
+            else {
+                item->chain.levels.assign(1, item->view);
+            }
+        }
+        counters_[STAGE_DECODE].add(view_bytes(item->view), begin);
+        q_[STAGE_STAGE]->push(std::move(item));
+    }
+}
+
+/* ring から size byte を取って item の ticket に積む. wait なら空くまで待つ
+   (先頭の区間の fence を待つ. まだ submit されていなければ submit されるまで少しずつ寝る).
+   ring より大きいものや、 wait せずに取れなければ false */
+bool texture_loader_t::ring_alloc(uint64_t size, uint64_t& offset, item_t& item, bool wait)
+{
+    uint64_t ticket = 0;
+    for (;;) {
+        ring_.retire(fence_->GetCompletedValue());
+        if (ring_.alloc(size, D3D12_TEXTURE_DATA_PLACEMENT_ALIGNMENT, offset, ticket)) {
+            item.tickets.push_back(ticket);
+            return true;
+        }
+        uint64_t oldest = 0;
+        if (!wait || size > ring_.capacity() || !ring_.oldest(oldest))
+            return false;
+        if (oldest)
+            fence_->SetEventOnCompletion(oldest, nullptr); /* event を渡さなければ到達するまで戻らない */
+        else
+            std::this_thread::sleep_for(std::chrono::milliseconds(1));
+    }
+}
+
+/* n 本の cmdlist を 1 回の Execute で copy queue に投げて fence を 1 回打ち、 tickets の ring の区間にその値を付ける */
+uint64_t texture_loader_t::execute(ID3D12CommandList* const* lists, uint32_t n, std::vector< uint64_t >& tickets)
+{
+    std::lock_guard< std::mutex > lock(submit_mtx_);
+    queue_->ExecuteCommandLists(n, lists);
+    queue_->Signal(fence_.Get(), ++ fence_value_);
+    for (auto t : tickets)
+        ring_.set_fence(t, fence_value_);
+    tickets.clear();
+    return fence_value_;
+}
+
+/* ring の半分を超える texture: level ごとに ring の 1/4 以下の行の帯に分けて書き、 帯ごとに box を付けて copy する.
+   ring が自分の帯で一杯になったら、そこまでの copy を投げて GPU が読み終わるのを待ってから cmdlist を使い直す.
+   帯の高さは 4 texel の倍数 (BCn の block と中間形式の block がどちらも割り切れる) */
+int texture_loader_t::upload_banded(item_t& item, slot_t& slot)
+{
+    const D3D12_RESOURCE_DESC desc = item.tex->GetDesc();
+    const uint32_t levels = std::min< uint32_t >(desc.MipLevels, static_cast< uint32_t >(item.chain.levels.size()));
+    D3D12_PLACED_SUBRESOURCE_FOOTPRINT fp[D3D12_REQ_MIP_LEVELS];
+    uint32_t rows[D3D12_REQ_MIP_LEVELS];
+    UINT64 rowsize[D3D12_REQ_MIP_LEVELS];
+    copyable_footprints(*u_, desc, 0, levels, 0, fp, rows, rowsize);
+    const uint32_t target = rawd_format_of(desc.Format);
+    const uint32_t dim = rawd_block_dim(target);
+    for (uint32_t i = 0; i < levels; i ++) {
+        const pixel_view_t& src = item.chain.levels[i];
+        const uint32_t width = std::max< uint32_t >(static_cast< uint32_t >(desc.Width) >> i, 1);
+        const uint32_t height = std::max< uint32_t >(desc.Height >> i, 1);
+        const uint64_t pitch = fp[i].Footprint.RowPitch;
+        const uint32_t band = std::max< uint32_t >(static_cast< uint32_t >(ring_.capacity() / 4 / pitch) * dim / 4 * 4, 4);
+        for (uint32_t y = 0; y < height; y += band) {
+            const uint32_t h = std::min(band, height - y);
+            const uint32_t n = std::min((h + dim - 1) / dim, rows[i] - y / dim); /* この帯の要素行 */
+            uint64_t offset = 0;
+            if (!ring_alloc(pitch * n, offset, item, false)) {
+                slot.cmdlist->Close();
+                ID3D12CommandList* l[] = {slot.cmdlist.Get()};
+                fence_->SetEventOnCompletion(execute(l, 1, item.tickets), nullptr);
+                slot.allocator->Reset();
+                slot.cmdlist->Reset(slot.allocator.Get(), nullptr);
+                if (!ring_alloc(pitch * n, offset, item, true))
+                    return -1;
+            }
+            D3D12_PLACED_SUBRESOURCE_FOOTPRINT part = fp[i];
+            part.Offset = offset;
+            part.Footprint.Height = n * dim;
+            pixel_view_t band_src = src;
+            band_src.data += src.pitch * (y / rawd_block_dim(src.format));
+            band_src.height = h;
+            copy_to_footprint(ring_ptr_, part, n, static_cast< size_t >(rowsize[i]), band_src, target, &pool_);
+
+            D3D12_TEXTURE_COPY_LOCATION dst = {item.tex.Get(), D3D12_TEXTURE_COPY_TYPE_SUBRESOURCE_INDEX, {0}};
+            dst.SubresourceIndex = i;
+            D3D12_TEXTURE_COPY_LOCATION from = {ring_buf_.Get(), D3D12_TEXTURE_COPY_TYPE_PLACED_FOOTPRINT, {part}};
+            /* BCn の帯の footprint は 4 texel に揃っているので、 level の端からはみ出さないように box で切る */
+            D3D12_BOX box = {0, 0, 0, width, h, 1};
+            slot.cmdlist->CopyTextureRegion(&dst, 0, y, 0, &from, &box);
+        }
+    }
+    transition_after_copy(slot.cmdlist.Get(), item.tex.Get(), D3D12_RESOURCE_STATE_PIXEL_SHADER_RESOURCE);
+    return 0;
+}
+
+/* tile より大きい level は map して swizzle_64kb() で直接書き、 packed mip に入りうる小さい level は
+   WriteToSubresource() で driver に並べさせる. 変換が要るか swizzle できない要素の大きさなら false (普通に copy する) */
+bool texture_loader_t::write_swizzled(item_t& item)
+{
+    const uint32_t levels = static_cast< uint32_t >(item.chain.levels.size());
+    const uint32_t bytes = item.chain.levels[0].bpp;
+    if (bytes > 16 || !(swizzle_bytes_ & (1u << bytes)))
+        return false;
+    for (auto& l : item.chain.levels) {
+        if (!l.data || l.format != item.format)
+            return false;
+    }
+    item.tex = create_swizzled_texture(item.view.width, item.view.height, texture_format(item.format), levels);
+    if (!item.tex)
+        return false;
+    uint32_t tw = 0, th = 0;
+    swizzle_tile_dims(bytes, tw, th);
+    for (uint32_t i = 0; i < levels; i ++) {
+        const pixel_view_t& l = item.chain.levels[i];
+        const bool whole = rawd_row_bytes(l) / bytes >= tw && rawd_rows(l) >= th;
+        uint8_t* mapped = nullptr;
+        HRESULT hr = item.tex->Map(i, nullptr, whole ? reinterpret_cast< void** >(&mapped) : nullptr);
+        if (SUCCEEDED(hr)) {
+            if (whole)
+                hr = mapped && swizzle_64kb(l, mapped, &pool_) == 0 ? S_OK : E_FAIL;
+            else
+                hr = item.tex->WriteToSubresource(i, nullptr, l.data, static_cast< UINT >(l.pitch), static_cast< UINT >(l.pitch * rawd_rows(l)));
+            item.tex->Unmap(i, nullptr);
+        }
+        if (FAILED(hr)) {
+            WRN("could not write swizzled texture:%s level:%d err:0x%x\n", item.req.path.c_str(), i, hr);
+            item.tex.Reset();
+            return false;
+        }
+    }
+    swizzled_ ++;
+    return true;
+}
+
+/* もう pixel は要らないので unmap して、バッファは次の texture のために pool へ返す */
+void texture_loader_t::release_pixels(item_t& item)
+{
+    item.img = rawd_image_t();
+    item.chain = mip_chain_t();
+    item.contents.reset();
+    item.decoded.reset();
+    item.mips.reset();
+}
+
+/* stage: 空いた slot の cmdlist を取り、 ring から取った区間に書き込んで copy を記録する.
+   free_slots_ には GPU が読み終わった (retire した) slot しか入っていない */
+void texture_loader_t::stage_stage()
+{
+    item_ptr_t item;
+    while (q_[STAGE_STAGE]->pop(item)) {
+        if (cancelled(*item)) {
+            drop(item, STAGE_STAGE, LOAD_ERR_CANCELLED);
+            continue;
+        }
+        const auto begin = std::chrono::steady_clock::now();
+        if (swizzle_bytes_ && write_swizzled(*item)) {
+            /* GPU の copy が無いので slot も fence も要らない */
+            release_pixels(*item);
+            counters_[STAGE_STAGE].add(view_bytes(item->view), begin);
+            q_[STAGE_RETIRE]->push(std::move(item));
+            continue;
+        }
+        int s = -1;
+        free_slots_->pop(s);
+        item->slot = s;
+        slot_t& slot = slots_[s];
+        slot.allocator->Reset();
+        slot.cmdlist->Reset(slot.allocator.Get(), nullptr);
+
+        const uint32_t levels = static_cast< uint32_t >(item->chain.levels.size());
+        item->tex = create_texture(item->view.width, item->view.height, texture_format(item->format), levels);
+        if (!item->tex) {
+            slot.cmdlist->Close();
+            drop(item, STAGE_STAGE, -1);
+            continue;
+        }
+        const D3D12_RESOURCE_DESC desc = item->tex->GetDesc();
+        const UINT64 total = copyable_footprints(*u_, desc, 0, levels, 0);
+        int err = 0;
+        if (total <= ring_.capacity() / 2) {
+            /* ring から 1 区間取って全 level を並べ、ひとつの cmdlist で copy する.
+               map したファイル (と生成した mip) から直接. 圧縮されたままなら (mip なし) block を並列に展開しながら */
+            uint64_t offset = 0;
+            D3D12_PLACED_SUBRESOURCE_FOOTPRINT copied[D3D12_REQ_MIP_LEVELS];
+            if (!ring_alloc(total, offset, *item, true))
+                err = -1;
+            else if (item->img.compressed())
+                copied[0] = write_to_upload(*u_, item->img, desc, ring_ptr_, offset, &pool_);
+            else
+                write_levels_to_upload(*u_, item->chain.levels.data(), levels, desc, ring_ptr_, offset, copied, &pool_);
+            if (err == 0)
+                issue_texture_upload(slot.cmdlist.Get(), copied, levels, item->tex.Get(), ring_buf_.Get());
+        }
+        else {
+            if (item->img.compressed()) {
+                /* 帯は LZ の block と揃っていないので一度展開する */
+                const pixel_view_t v = item->img.view();
+                item->decoded = staging_.acquire(rawd_payload_bytes(v));
+                err = item->decoded.empty() ? RAWD_ERR_OPEN : item->img.decode_to(item->decoded.data(), v.pitch, &pool_);
+                item->chain.levels.assign(1, v);
+                item->chain.levels[0].data = item->decoded.data();
+            }
+            if (err == 0)
+                err = upload_banded(*item, slot);
+        }
+        slot.cmdlist->Close();
+        if (err < 0) {
+            WRN("could not stage texture:%s err:%d\n", item->req.path.c_str(), err);
+            drop(item, STAGE_STAGE, err);
+            continue;
+        }
+        /* GPU が読むのは ring なので fence を待たずに pixel を返してよい */
+        release_pixels(*item);
+        counters_[STAGE_STAGE].add(view_bytes(item->view), begin);
+        q_[STAGE_SUBMIT]->push(std::move(item));
+    }
+}
+
+/* submit: 記録済みの cmdlist をまとめて copy queue に投げ、 batch ごとに fence を 1 回だけ打つ. 完了は待たない.
+   1 枚目は待って取り、 あとはキューに溜まっている分を batch_count 枚か batch_bytes になるまで待たずに足す.
+   GPU を待つのは timeline で、 batch の fence に達したら slot を返して item を retire stage へ流す.
+   ここは待たないので、 copy が GPU にある間も上流は次の texture を用意できる.
+   上流が尽きたら、 retire stage のキューを閉じる前に残りの batch が終わるのを待つ */
+void texture_loader_t::submit_stage()
+{
+    item_ptr_t item;
+    std::vector< item_ptr_t > batch;
+    std::vector< ID3D12CommandList* > lists;
+    std::vector< uint64_t > tickets;
+    while (q_[STAGE_SUBMIT]->pop(item)) {
+        const auto begin = std::chrono::steady_clock::now();
+        uint64_t bytes = 0;
+        do {
+            bytes += view_bytes(item->view);
+            lists.push_back(slots_[item->slot].cmdlist.Get());
+            tickets.insert(tickets.end(), item->tickets.begin(), item->tickets.end());
+            item->tickets.clear();
+            batch.push_back(std::move(item));
+        } while (batch.size() < static_cast< size_t >(cfg_.batch_count) && bytes < cfg_.batch_bytes && q_[STAGE_SUBMIT]->try_pop(item));
+        const uint64_t fence = execute(lists.data(), static_cast< uint32_t >(lists.size()), tickets);
+        batches_ ++;
+        for (auto& b : batch) {
+            b->fence_value = fence;
+            counters_[STAGE_SUBMIT].add(view_bytes(b->view), begin);
+        }
+        /* std::function は copy できるものしか持てないので shared_ptr に包む */
+        auto done = std::make_shared< std::vector< item_ptr_t > >(std::move(batch));
+        timeline_.when(fence, [this, done] {
+                for (auto& b : *done) {
+                    free_slots_->push(b->slot);
+                    b->slot = -1;
+                    q_[STAGE_RETIRE]->push(std::move(b));
+                }
+            });
+        batch.clear();
+        lists.clear();
+    }
+    timeline_.drain();
+}
+
+/* retire: ここに来る item は copy が終わっている (timeline が fence を見て流す. CPU で swizzle したものは stage から直接). handle を完了させる.
+   cache に入れてから inflight_ から外すので、その間に来た同じ内容の要求は cache で拾える */
+void texture_loader_t::retire_stage()
+{
+    item_ptr_t item;
+    while (q_[STAGE_RETIRE]->pop(item)) {
+        const auto begin = std::chrono::steady_clock::now();
+        texture_load_result_t r(0);
+        r.tex = std::move(item->tex);
+        if (item->owner) {
+            const D3D12_RESOURCE_DESC desc = r.tex->GetDesc();
+            const size_t bytes = static_cast< size_t >(u_->dev()->GetResourceAllocationInfo(0, 1, &desc).SizeInBytes);
+            r.tex = cache_->insert(item->key, r.tex, bytes);
+            std::lock_guard< std::mutex > lock(inflight_mtx_);
+            detach_locked(*item);
+        }
+        for (auto& w : item->waiters)
+            w.complete(r);
+        item->req.complete(std::move(r));
+        counters_[STAGE_RETIRE].add(view_bytes(item->view), begin);
+    }
+}
+
+int texture_loader_t::start(std::shared_ptr< texture_request_queue_t > requests)
+{
+    if (!workers_.empty() || !requests)
+        return -1;
+    requests_ = std::move(requests);
+    started_ = std::chrono::steady_clock::now();
+    for (auto& c : counters_) {
+        c.items = 0;
+        c.bytes = 0;
+        c.busy_ns = 0;
+        c.dropped = 0;
+    }
+    coalesced_ = 0;
+    direct_reads_ = 0;
+    direct_verified_ = 0;
+    batches_ = 0;
+    accesses_.clear();
+    for (int i = STAGE_DECODE; i < STAGE_NUM; i ++)
+        q_[i]->reopen(); /* 前回の stop() で閉じている */
+
+    /* 各 stage の最後の worker が抜けたら下流のキューを閉じる */
+    const int workers[STAGE_NUM] = {cfg_.readers, cfg_.decoders, cfg_.stagers, 1, 1};
+    void (texture_loader_t::*body[STAGE_NUM])() = {
+        &texture_loader_t::read_stage, &texture_loader_t::decode_stage, &texture_loader_t::stage_stage,
+        &texture_loader_t::submit_stage, &texture_loader_t::retire_stage
+    };
+    for (int st = 0; st < STAGE_NUM; st ++) {
+        live_[st] = workers[st];
+        void (texture_loader_t::*fn)() = body[st];
+        for (int i = 0; i < workers[st]; i ++) {
+            workers_.emplace_back([this, st, fn] {
+                    (this->*fn)();
+                    if (-- live_[st] == 0 && st + 1 < STAGE_NUM)
+                        q_[st + 1]->close();
+                });
+        }
+    }
+    return 0;
+}
+
+void texture_loader_t::stop()
+{
+    if (workers_.empty())
+        return;
+    requests_->cancel_pending();
+    requests_->close();
+    for (auto& t : workers_)
+        t.join();
+    workers_.clear();
+    prefetcher_.stop();
+    if (!cfg_.manifest.empty() && accesses_.size()) {
+        if (accesses_.save(cfg_.manifest) < 0)
+            WRN("could not write access manifest:%s\n", cfg_.manifest.c_str());
+    }
+}
+
+int texture_loader_t::collect(const std::vector< texture_handle_t >& batch, payload_t& payload)
+{
+    int loaded = 0;
+    for (auto& h : batch) {
+        const texture_load_result_t& r = h.get();
+        if (r.status == 0 && r.tex) {
+            payload.push_back(r.tex);
+            loaded ++;
+        }
+    }
+    return loaded;
+}
+
+std::vector< stage_report_t > texture_loader_t::stats() const
+{
+    static const char* names[STAGE_NUM] = {"read", "decode", "stage", "submit", "retire"};
+    const int workers[STAGE_NUM] = {cfg_.readers, cfg_.decoders, cfg_.stagers, 1, 1};
+    std::vector< stage_report_t > r(STAGE_NUM);
+    for (int i = 0; i < STAGE_NUM; i ++) {
+        r[i].name = names[i];
+        r[i].workers = workers[i];
+        r[i].items = counters_[i].items;
+        r[i].bytes = counters_[i].bytes;
+        r[i].dropped = counters_[i].dropped;
+        r[i].busy_ms = counters_[i].busy_ns / 1000000.0;
+        if (i == STAGE_READ && requests_) {
+            r[i].depth = requests_->size();
+            r[i].max_depth = 0;
+            r[i].capacity = 0; /* 要求キューには上限が無い */
+        }
+        else {
+            r[i].depth = q_[i] ? q_[i]->depth() : 0;
+            r[i].max_depth = q_[i] ? q_[i]->max_depth() : 0;
+            r[i].capacity = q_[i] ? q_[i]->capacity() : 0;
+        }
+    }
+    return r;
+}
+
+void texture_loader_t::report() const
+{
+    const double ms = std::chrono::duration< double, std::milli >(std::chrono::steady_clock::now() - started_).count();
+    const double sec = std::max(ms, 0.001) / 1000.0;
+    for (auto& s : stats()) {
+        INF("loader %S: workers:%d items:%lld (dropped:%lld) %.2f MB/s %.1f items/s busy:%.2f(ms) queue:%lld/%lld (max:%lld)\n",
+            s.name, s.workers, s.items, s.dropped, s.bytes / sec / (1024.0 * 1024.0), s.items / sec, s.busy_ms,
+            static_cast< uint64_t >(s.depth), static_cast< uint64_t >(s.capacity), static_cast< uint64_t >(s.max_depth));
+    }
+    const content_cache_stats_t c = cache_->stats();
+    INF("loader cache: %lld entries %.2f/%.2f MB hits:%lld misses:%lld evictions:%lld coalesced:%lld\n",
+        static_cast< uint64_t >(c.entries), c.bytes / (1024.0 * 1024.0), c.budget / (1024.0 * 1024.0), c.hits, c.misses, c.evictions, coalesced_.load());
+    INF("loader ring: peak %.2f/%.2f MB\n", ring_.peak() / (1024.0 * 1024.0), ring_.capacity() / (1024.0 * 1024.0));
+    const uint64_t submitted = counters_[STAGE_SUBMIT].items;
+    INF("loader submit: %lld batches (%.1f textures per fence)\n", batches_.load(), batches_ ? static_cast< double >(submitted) / batches_ : 0.0);
+    if (swizzle_bytes_)
+        INF("loader swizzle: %lld textures written by CPU (element sizes mask:0x%x)\n", swizzled_.load(), swizzle_bytes_);
+    heap_.report();
+    const staging_pool_stats_t p = staging_.stats();
+    INF("loader pixel buffers: %lld allocated (%lld huge page), %lld reused, %.2f/%.2f MB pooled, %lld direct reads (%lld checksum verified)\n",
+        p.allocations, p.huge, p.reuses, p.pooled / (1024.0 * 1024.0), p.budget / (1024.0 * 1024.0), direct_reads_.load(), direct_verified_.load());
+    if (!cfg_.manifest.empty())
+        INF("loader prefetch: %lld issued, %lld accesses recorded\n", static_cast< uint64_t >(prefetcher_.issued()), static_cast< uint64_t >(accesses_.size()));
+    INF("loader: %.2f(ms) since start\n", ms);
+}
@@ -0,0 +1,243 @@
+/**
+ * (C) roentgen 
+ * this code is licensed under the MIT License.
+ */
+#if !defined(TEXLOADER_HPP__)
+#define TEXLOADER_HPP__
+
+#include "uniq_device.hpp"
+#include "rawd.hpp"
+#include "archive.hpp"
+#include "pipeline.hpp"
+#include "loadqueue.hpp"
+#include "mipgen.hpp"
+#include "transcode.hpp"
+#include "pixconv.hpp"
+#include "asyncio.hpp"
+#include "directread.hpp"
+#include "prefetch.hpp"
+#include "hash.hpp"
+#include "texcache.hpp"
+#include "stagepool.hpp"
+#include "ringalloc.hpp"
+#include "timeline.hpp"
+#include "wccopy.hpp"
+#include "footprint.hpp"
+#include "swizzle.hpp"
+#include "placedheap.hpp"
+#include <thread>
+#include <vector>
+#include <string>
+#include <memory>
+#include <atomic>
+#include <mutex>
+#include <unordered_map>
+
+/* 1 枚ずつ同期で upload する (loading 画面などの) trampoline の大きさ. loader は upload ring を使うのでこの制限は無い */
+static const int TRAMPOLINE_MAX_WIDTH = 512;
+static const int TRAMPOLINE_MAX_HEIGHT = 512;
+
+/* max_width x max_height を超える大きさや未対応の pixel 形式なら警告して -1 */
+int check_graphics_asset(const std::wstring& fname, const pixel_view_t& v, uint32_t max_width = TRAMPOLINE_MAX_WIDTH, uint32_t max_height = TRAMPOLINE_MAX_HEIGHT);
+/* RAWD の format に対応する texture の形式 */
+DXGI_FORMAT texture_format(uint32_t format);
+/* device が 2D texture として使える変換先 (TRANSCODE_FORMAT_BIT の組み合わせ) */
+uint32_t supported_formats(uniq_device_t& u);
+/* v を upload する時の形式. 中間形式は supported から選び、 それ以外は convert (PIXCONV_*) に従う */
+uint32_t upload_format(const pixel_view_t& v, uint32_t supported, uint32_t convert = 0);
+
+int load_graphics_asset(const std::wstring& fname, rawd_image_t& img);
+int load_graphics_asset(const rawd_archive_t& archive, const std::wstring& fname, pixel_view_t& view);
+
+/* GetCopyableFootprints() と同じ結果を footprint_layout() で計算して total を返す (debug build では device の結果と突き合わせる).
+   footprint.hpp が知らない形式は device に聞く */
+UINT64 copyable_footprints(uniq_device_t& u, const D3D12_RESOURCE_DESC& desc, uint32_t first, uint32_t n, uint64_t base,
+                           D3D12_PLACED_SUBRESOURCE_FOOTPRINT* footprints = nullptr, uint32_t* rows = nullptr, UINT64* rowsize = nullptr);
+
+D3D12_PLACED_SUBRESOURCE_FOOTPRINT write_to_trampoline(uniq_device_t& u, const pixel_view_t& src, const D3D12_RESOURCE_DESC& texdesc, ID3D12Resource* trampoline);
+/* 以下の *_to_upload は map 済みの upload buffer の先頭 ptr と、そこからの配置の開始位置 base (512 byte 境界) を取る.
+   *_to_trampoline は trampoline を map して base 0 に書く */
+void write_levels_to_upload(uniq_device_t& u, const pixel_view_t* levels, uint32_t n, const D3D12_RESOURCE_DESC& texdesc, uint8_t* ptr, uint64_t base, D3D12_PLACED_SUBRESOURCE_FOOTPRINT* footprints, worker_pool_t* pool = nullptr);
+D3D12_PLACED_SUBRESOURCE_FOOTPRINT write_to_upload(uniq_device_t& u, const rawd_image_t& img, const D3D12_RESOURCE_DESC& texdesc, uint8_t* ptr, uint64_t base, worker_pool_t* pool = nullptr);
+/* levels[i] を subresource i として trampoline に並べる. footprints には n 個の配置が返る.
+   level の形式が texdesc.Format と違えば変換しながら書く (pool があれば並列に) */
+void write_levels_to_trampoline(uniq_device_t& u, const pixel_view_t* levels, uint32_t n, const D3D12_RESOURCE_DESC& texdesc, ID3D12Resource* trampoline, D3D12_PLACED_SUBRESOURCE_FOOTPRINT* footprints, worker_pool_t* pool = nullptr);
+/* 圧縮された RAWD は block ごとに、 PNG は行ごとに trampoline へ直接展開する (pool があれば並列に). 圧縮されていなければ上と同じ.
+   変換が要るものは展開してから変換する */
+D3D12_PLACED_SUBRESOURCE_FOOTPRINT write_to_trampoline(uniq_device_t& u, const rawd_image_t& img, const D3D12_RESOURCE_DESC& texdesc, ID3D12Resource* trampoline, worker_pool_t* pool = nullptr);
+
+int issue_texture_upload(ID3D12GraphicsCommandList* cmdlist, const D3D12_PLACED_SUBRESOURCE_FOOTPRINT& foorprint, ID3D12Resource* tex, ID3D12Resource* trampoline, D3D12_RESOURCE_STATES after=D3D12_RESOURCE_STATE_PIXEL_SHADER_RESOURCE);
+/* subresource 0..n-1 をまとめて copy し、 barrier はひとつだけ打つ */
+int issue_texture_upload(ID3D12GraphicsCommandList* cmdlist, const D3D12_PLACED_SUBRESOURCE_FOOTPRINT* footprints, uint32_t n, ID3D12Resource* tex, ID3D12Resource* trampoline, D3D12_RESOURCE_STATES after=D3D12_RESOURCE_STATE_PIXEL_SHADER_RESOURCE);
+
+/* upload 済みの texture の cache. key はファイルの中身と loader の設定の hash */
+typedef content_cache_t< Microsoft::WRL::ComPtr< ID3D12Resource > > texture_cache_t;
+
+/* process 全体で共有する cache. scene を作り直しても同じ内容なら upload し直さない.
+   budget は GPU 上の大きさで既定 256MB. device を捨てる前に clear() すること */
+texture_cache_t& texture_cache();
+
+struct texture_loader_config_t {
+    int readers;   /* ファイルを map して page を触る (I/O 待ちになるので多め) */
+    int decoders;  /* 検証/変換 */
+    int stagers;   /* upload ring への書き込みと copy コマンドの記録 */
+    int slots;     /* copy を記録する cmdlist の数 (= 同時に GPU に投げておける texture の数). GPU が読み終わるまでは再利用できない */
+    size_t ring_size;  /* upload ring の大きさ. この半分を超える texture は行の帯に分けて ring が空くのを待ちながら copy する */
+    int batch_count;   /* submit stage が 1 回の Execute と fence にまとめる texture の数の上限 (slots 以下) */
+    size_t batch_bytes; /* 同じく byte 数の上限. どちらかに達するか、キューが空になったら投げる */
+    int depth;     /* stage 間のキューの長さ */
+    int block_workers; /* 圧縮 block の展開を手伝うスレッド (stager と共有) */
+    bool mips;         /* mip を持たない入力は decode stage で 1x1 までの mip chain を作る */
+    mip_filter_t mip_filter;
+    uint32_t convert;  /* PIXCONV_*. 線形 RGBA8 を sRGB にする, float を RGB10A2 に詰める */
+    int io_batch;      /* 0 なら個別ファイルは map する. 1 以上なら reader が最大この数の要求をまとめて async_io_t で読む */
+    bool direct;       /* io_batch > 0 の時、 mip も変換も要らない非圧縮の RAWD は header だけ先に読んで footprint を決め、
+                          pixel 列は upload ring から取った区間の RowPitch の位置へ直接読む (中間バッファも memcpy も無い).
+                          checksum を持つもの (v1.2 以降) は読み終わってからファイルを map し、 page cache の方で照合する.
+                          cache と相乗りには使わない. slot か ring が空いていなければ普通に読む */
+    bool swizzle;      /* UMA で 64KB standard swizzle が使える device なら、 変換の要らない texture は CPU から見える heap に
+                          standard swizzle で作り、 swizzle_64kb() で直接書く (ring も copy queue も使わない).
+                          init() で driver の並びと突き合わせ、 合わない要素の大きさは普通の copy に回す */
+    texture_cache_t* cache; /* nullptr なら texture_cache() */
+    size_t heap_block;      /* texture を placed resource として切り出す heap の大きさ. 0 なら committed で作る */
+    size_t staging_budget;  /* 使い終わった pixel バッファ (読んだ中身, 展開先, mip) を次の texture のために残しておく上限 */
+    std::wstring manifest;  /* 空でなければ読んだ順をここに残し (stop() で書く)、 次の init() ではその順に先読みする */
+    texture_loader_config_t() : readers(2), decoders(1), stagers(2), slots(16), ring_size(size_t(64) << 20), batch_count(8), batch_bytes(size_t(32) << 20), depth(4), block_workers(2), mips(true), mip_filter(MIP_FILTER_BOX), convert(0), io_batch(0), direct(false), swizzle(false), cache(nullptr), heap_block(size_t(64) << 20), staging_budget(size_t(128) << 20) {}
+};
+
+/* 1 枚ぶんの読み込み結果. status < 0 なら tex は空 (RAWD_ERR_*, LOAD_ERR_*) */
+struct texture_load_result_t {
+    int status;
+    Microsoft::WRL::ComPtr< ID3D12Resource > tex;
+    texture_load_result_t(int s = 0) : status(s) {}
+};
+
+typedef load_request_queue_t< texture_load_result_t > texture_request_queue_t;
+typedef texture_request_queue_t::handle_t texture_handle_t;
+
+/* read -> decode -> stage -> submit -> retire のパイプラインでテクスチャを読み込む.
+   start() すると request queue から要求を取り出し続けるので、ロード画面の後でもどのスレッドからでも
+   submit() すればストリーミングできる. stage 間は bounded_queue_t でつないであり、それぞれの stage は独立した worker 数を持つ.
+   submit は copy queue に順に投げるだけで、 retire が fence を待ってから handle を完了させる.
+   read stage で中身の hash を取り、 cache にあればそこで完了させる. 同じ内容を読んでいる最中の要求は
+   先に読み始めたものに相乗りして、同じ resource で完了する */
+class texture_loader_t {
+public:
+    typedef std::vector< Microsoft::WRL::ComPtr< ID3D12Resource > > payload_t;
+    enum { STAGE_READ, STAGE_DECODE, STAGE_STAGE, STAGE_SUBMIT, STAGE_RETIRE, STAGE_NUM };
+
+private:
+    struct slot_t {
+        Microsoft::WRL::ComPtr< ID3D12CommandAllocator > allocator;
+        Microsoft::WRL::ComPtr< ID3D12GraphicsCommandList > cmdlist;
+    };
+
+    struct item_t {
+        texture_request_queue_t::request_t req;
+        rawd_image_t img;
+        pixel_view_t view;
+        uint32_t format;                /* upload する形式 (decode stage で決める) */
+        mip_chain_t chain;              /* decode stage 以降は levels[0] が view. archive に mip があれば read stage で埋める */
+        staging_buffer_t contents;      /* io_batch で読んだファイルの中身. img が指している */
+        staging_buffer_t decoded;       /* mip を作る (か変換する) ために展開した圧縮 RAWD */
+        staging_buffer_t mips;          /* chain.levels[1..] */
+        Microsoft::WRL::ComPtr< ID3D12Resource > tex;
+        int slot;
+        uint64_t fence_value; /* この値に fence が到達するまで slot の cmdlist は GPU が使っている */
+        std::vector< uint64_t > tickets; /* cmdlist の copy が読む ring の区間. submit で fence を付ける */
+        uint64_t key;         /* content_key() */
+        const uint8_t* payload; /* archive の entry の payload と checksum. ファイルから読んだものは img が持っている */
+        size_t payload_size;
+        uint32_t checksum;
+        bool owner;           /* inflight_[key] に登録したのが自分 */
+        std::vector< texture_request_queue_t::request_t > waiters; /* inflight_ から外した時に引き取った相乗り */
+        bool direct;          /* read stage で slot, tex, ring の区間を確保し、 ring へ直接読んだ */
+        D3D12_PLACED_SUBRESOURCE_FOOTPRINT footprint; /* direct の時の level 0 の配置 */
+        direct_source_t source; /* direct の時のファイルの中の pixel 列と checksum */
+    };
+    typedef std::unique_ptr< item_t > item_ptr_t;
+    typedef bounded_queue_t< item_ptr_t > item_queue_t;
+
+    uniq_device_t* u_;
+    Microsoft::WRL::ComPtr< ID3D12CommandQueue > queue_;
+    Microsoft::WRL::ComPtr< ID3D12Fence > fence_;
+    uint64_t fence_value_;
+    fence_timeline_t timeline_; /* submit した batch の完了を待って retire stage へ渡す */
+    const rawd_archive_t* archive_;
+    texture_loader_config_t cfg_;
+    std::vector< slot_t > slots_;
+    Microsoft::WRL::ComPtr< ID3D12Resource > ring_buf_; /* 永続的に map した UPLOAD buffer */
+    uint8_t* ring_ptr_;
+    ring_allocator_t ring_;
+    placed_heap_t heap_; /* create_texture() の置き場所. texture が残っている間は heap も残る */
+    std::mutex submit_mtx_; /* queue_ への Execute と fence_value_ の Signal を並べる */
+    worker_pool_t pool_;
+    staging_pool_t staging_; /* item の pixel バッファ. item より先に壊れないように q_ より前に置く */
+    uint32_t formats_; /* supported_formats() */
+    async_io_t io_;    /* cfg_.io_batch > 0 の時だけ使う */
+    texture_cache_t* cache_;
+    uint64_t seed_;    /* 結果の texture を変える設定の hash */
+    std::mutex inflight_mtx_;
+    std::unordered_map< uint64_t, std::vector< texture_request_queue_t::request_t > > inflight_; /* key -> 相乗りしている要求 */
+    std::atomic< uint64_t > coalesced_;
+    access_manifest_t accesses_; /* 今回読んだ順 */
+    prefetcher_t prefetcher_;    /* 前回の manifest の先読み */
+    std::atomic< uint64_t > direct_reads_;
+    std::atomic< uint64_t > direct_verified_; /* direct_reads_ のうち checksum を照合したもの */
+    std::atomic< uint64_t > batches_;
+    uint32_t swizzle_bytes_; /* CPU で swizzle して書いてよい要素の byte 数 (bit n が n byte). 0 なら使わない */
+    std::atomic< uint64_t > swizzled_;
+
+    std::shared_ptr< texture_request_queue_t > requests_;
+    std::vector< std::thread > workers_;
+    std::atomic< int > live_[STAGE_NUM];
+    stage_counter_t counters_[STAGE_NUM];
+    std::unique_ptr< item_queue_t > q_[STAGE_NUM]; /* q_[n] は stage n の入力. read は requests_ から直接取る */
+    std::unique_ptr< bounded_queue_t< int > > free_slots_;
+    std::chrono::steady_clock::time_point started_;
+
+    void read_stage();
+    void read_batched();
+    item_ptr_t new_item(texture_request_queue_t::request_t& req);
+    bool read_archive(item_t& item);
+    bool ring_alloc(uint64_t size, uint64_t& offset, item_t& item, bool wait);
+    uint64_t execute(ID3D12CommandList* const* lists, uint32_t n, std::vector< uint64_t >& tickets);
+    int upload_banded(item_t& item, slot_t& slot);
+    uint32_t probe_swizzle();
+    bool write_swizzled(item_t& item);
+    void release_pixels(item_t& item);
+    bool plan_direct(item_t& item, const uint8_t* head, size_t headsize, uint64_t filesize, io_file_t f, std::vector< io_request_t >& reads);
+    void record_access(const std::wstring& path, uint64_t offset, uint64_t size);
+    void finish_read(item_ptr_t& item, std::chrono::steady_clock::time_point begin);
+    int content_key(item_t& item) const;
+    bool cancelled(item_t& item);
+    void detach_locked(item_t& item);
+    void decode_stage();
+    void stage_stage();
+    void submit_stage();
+    void retire_stage();
+    void drop(item_ptr_t& item, int stage, int status);
+    Microsoft::WRL::ComPtr< ID3D12Resource > create_texture(int width, int height, DXGI_FORMAT format, uint32_t mips);
+    Microsoft::WRL::ComPtr< ID3D12Resource > create_swizzled_texture(int width, int height, DXGI_FORMAT format, uint32_t mips);
+
+public:
+    texture_loader_t() : u_(nullptr), fence_value_(0), archive_(nullptr), ring_ptr_(nullptr), formats_(0), cache_(nullptr), seed_(0), coalesced_(0), direct_reads_(0), direct_verified_(0), batches_(0), swizzle_bytes_(0), swizzled_(0) {}
+    ~texture_loader_t();
+
+    int init(uniq_device_t& u, Microsoft::WRL::ComPtr< ID3D12CommandQueue > copyq, const texture_loader_config_t& cfg = texture_loader_config_t());
+    /* archive に見つからないものは個別のファイルから読む. 空の archive なら無視する */
+    void set_archive(const rawd_archive_t* archive) { archive_ = (archive && archive->count()) ? archive : nullptr; }
+
+    /* worker を起こして requests を処理し始める */
+    int start(std::shared_ptr< texture_request_queue_t > requests);
+    /* 待っている要求を cancel してキューを閉じ、流れているものを片付けて worker を止める */
+    void stop();
+
+    /* batch の完了を順に待ち、成功したものだけを batch の順に payload に追加する (SRV の slot がずれないように) */
+    static int collect(const std::vector< texture_handle_t >& batch, payload_t& payload);
+
+    std::vector< stage_report_t > stats() const;
+    void report() const;
+};
+
+#endif
@@ -0,0 +1,99 @@
+/**
+ * (C) roentgen 
+ * this code is licensed under the MIT License.
+ */
+#include "stdafx.h"
+#include "timeline.hpp"
+#include "dbgutils.hpp"
+#include <vector>
+
+int fence_timeline_t::start(Microsoft::WRL::ComPtr< ID3D12Fence > fence)
+{
+    stop();
+    fence_ = std::move(fence);
+    if (!event_)
+        event_ = CreateEvent(nullptr, FALSE, FALSE, nullptr);
+    if (!event_) {
+        ABT("failed to create event for fence timeline: err:0x%x\n", GetLastError());
+        return -1;
+    }
+    quit_ = false;
+    thr_ = std::thread([this]{ run(); });
+    return 0;
+}
+
+void fence_timeline_t::stop()
+{
+    if (thr_.joinable()) {
+        {
+            std::lock_guard< std::mutex > lock(mtx_);
+            quit_ = true;
+        }
+        wake_.notify_all();
+        thr_.join();
+    }
+    if (event_) {
+        CloseHandle(event_);
+        event_ = nullptr;
+    }
+}
+
+void fence_timeline_t::when(uint64_t value, std::function< void() > fn)
+{
+    std::lock_guard< std::mutex > lock(mtx_);
+    pending_.emplace(value, std::move(fn));
+    if (!waiting_)
+        wake_.notify_one();
+    else if (value < waiting_)
+        SetEvent(event_); /* もっと先の値を待っているので起こして待ち直させる */
+}
+
+void fence_timeline_t::drain()
+{
+    std::unique_lock< std::mutex > lock(mtx_);
+    idle_.wait(lock, [this]{ return pending_.empty() && !busy_; });
+}
+
+size_t fence_timeline_t::pending()
+{
+    std::lock_guard< std::mutex > lock(mtx_);
+    return pending_.size();
+}
+
+/* 一番小さい値だけを待ち、 達したら GetCompletedValue() 以下のものをまとめて lock の外で呼ぶ.
+   auto reset の event が when() で余分に立っていても、待ち直すだけ */
+void fence_timeline_t::run()
+{
+    std::vector< std::function< void() > > ready;
+    std::unique_lock< std::mutex > lock(mtx_);
+    for (;;) {
+        wake_.wait(lock, [this]{ return quit_ || !pending_.empty(); });
+        if (pending_.empty())
+            return; /* quit_ で、残りも無い */
+        const uint64_t next = pending_.begin()->first;
+        uint64_t done = fence_->GetCompletedValue();
+        if (done < next) {
+            waiting_ = next;
+            fence_->SetEventOnCompletion(next, event_);
+            lock.unlock();
+            WaitForSingleObjectEx(event_, INFINITE, FALSE);
+            lock.lock();
+            waiting_ = 0;
+            continue;
+        }
+        const auto end = pending_.upper_bound(done);
+        for (auto it = pending_.begin(); it != end; ++ it)
+            ready.push_back(std::move(it->second));
+        pending_.erase(pending_.begin(), end);
+        busy_ = true;
+        lock.unlock();
+        for (auto& fn : ready)
+            fn();
+        ran_ += ready.size();
+        ready.clear();
+        lock.lock();
+        busy_ = false;
+        if (pending_.empty())
+            idle_.notify_all();
+    }
+}
@@ -0,0 +1,54 @@
+/**
+ * (C) roentgen 
+ * this code is licensed under the MIT License.
+ */
+#if !defined(TIMELINE_HPP__)
+#define TIMELINE_HPP__
+
+#include <d3d12.h>
+#include <wrl/client.h>
+#include <stdint.h>
+#include <atomic>
+#include <condition_variable>
+#include <functional>
+#include <map>
+#include <mutex>
+#include <thread>
+
+/* fence の値ごとに登録した継続 (texture の公開, slot や staging の解放など) を、 GPU がその値に達したら呼ぶ.
+   fence を待つのは中の 1 本のスレッドだけで、 when() した側は待たずに次の仕事に戻れる.
+   継続はそのスレッドで値の小さい順に呼ばれる. 継続の中から when() してもよいが、長く止めると後ろの継続も遅れる */
+class fence_timeline_t {
+    Microsoft::WRL::ComPtr< ID3D12Fence > fence_;
+    HANDLE event_;
+    std::mutex mtx_;
+    std::condition_variable wake_;
+    std::condition_variable idle_;
+    std::multimap< uint64_t, std::function< void() > > pending_;
+    uint64_t waiting_;  /* waiter が SetEventOnCompletion している値. 0 なら fence を待っていない */
+    bool busy_;         /* waiter が継続を呼んでいる */
+    bool quit_;
+    std::atomic< uint64_t > ran_;
+    std::thread thr_;
+
+    void run();
+public:
+    fence_timeline_t() : event_(nullptr), waiting_(0), busy_(false), quit_(false), ran_(0) {}
+    ~fence_timeline_t() { stop(); }
+    fence_timeline_t(const fence_timeline_t&) = delete;
+    fence_timeline_t& operator=(const fence_timeline_t&) = delete;
+
+    int start(Microsoft::WRL::ComPtr< ID3D12Fence > fence);
+    /* 登録済みの継続を全部呼び終えてから止める */
+    void stop();
+
+    /* fence が value に達したら fn を呼ぶ. 既に達していても呼ぶのは waiter スレッド */
+    void when(uint64_t value, std::function< void() > fn);
+    /* 今登録されている継続が全部呼ばれるまで待つ */
+    void drain();
+
+    size_t pending();
+    uint64_t ran() const { return ran_; }
+};
+
+#endif
@@ -0,0 +1,207 @@
+/**
+ * (C) roentgen 
+ * this code is licensed under the MIT License.
+ */
+#include "transcode.hpp"
+#include <string.h>
+#include <algorithm>
+
+/* 4 個の 2bit index をまとめて付け替える表. BC1 は palette の並びが e0, e1, 1/3, 2/3 なので */
+struct selector_tables_t {
+    uint8_t bc1[2][256];  /* [端点を入れ替えたか][4 texel 分の index] */
+    selector_tables_t()
+    {
+        static const uint8_t straight[4] = {0, 2, 3, 1};
+        static const uint8_t swapped[4] = {1, 3, 2, 0};
+        for (int v = 0; v < 256; v ++) {
+            uint8_t a = 0, b = 0;
+            for (int i = 0; i < 4; i ++) {
+                const int s = (v >> (i * 2)) & 3;
+                a |= static_cast< uint8_t >(straight[s] << (i * 2));
+                b |= static_cast< uint8_t >(swapped[s] << (i * 2));
+            }
+            bc1[0][v] = a;
+            bc1[1][v] = b;
+        }
+    }
+};
+
+static const selector_tables_t& selector_tables()
+{
+    static const selector_tables_t t;
+    return t;
+}
+
+static inline uint32_t read_selectors(const uint8_t* blk)
+{
+    uint32_t v;
+    memcpy(&v, blk + 8, 4);
+    return v;
+}
+
+static void transcode_rgba8(const uint8_t* blk, uint8_t* dst, size_t dstpitch, uint32_t w, uint32_t h)
+{
+    uint8_t pal[4][4];
+    for (int s = 0; s < 4; s ++)
+        for (int c = 0; c < 4; c ++)
+            pal[s][c] = static_cast< uint8_t >(((3 - s) * blk[c] + s * blk[4 + c] + 1) / 3);
+    const uint32_t sel = read_selectors(blk);
+    for (uint32_t y = 0; y < h; y ++) {
+        uint8_t* row = dst + dstpitch * y;
+        for (uint32_t x = 0; x < w; x ++)
+            memcpy(row + x * 4, pal[(sel >> ((y * 4 + x) * 2)) & 3], 4);
+    }
+}
+
+static inline uint16_t pack565(const uint8_t* e)
+{
+    const uint32_t r = (e[0] * 31 + 127) / 255;
+    const uint32_t g = (e[1] * 63 + 127) / 255;
+    const uint32_t b = (e[2] * 31 + 127) / 255;
+    return static_cast< uint16_t >((r << 11) | (g << 5) | b);
+}
+
+static void transcode_bc1(const uint8_t* blk, uint8_t* out)
+{
+    uint16_t c0 = pack565(blk);
+    uint16_t c1 = pack565(blk + 4);
+    const uint32_t sel = read_selectors(blk);
+    uint32_t bits = 0;
+    if (c0 != c1) {
+        /* c0 > c1 (4 色 mode) になるよう並べ、 index もそれに合わせて付け替える */
+        const int swap = c0 < c1;
+        if (swap)
+            std::swap(c0, c1);
+        const uint8_t* map = selector_tables().bc1[swap];
+        for (int i = 0; i < 4; i ++)
+            bits |= static_cast< uint32_t >(map[(sel >> (i * 8)) & 0xff]) << (i * 8);
+    }
+    out[0] = static_cast< uint8_t >(c0);
+    out[1] = static_cast< uint8_t >(c0 >> 8);
+    out[2] = static_cast< uint8_t >(c1);
+    out[3] = static_cast< uint8_t >(c1 >> 8);
+    memcpy(out + 4, &bits, 4);
+}
+
+/* 8bit の値に一番近い 7bit + p-bit. p は 4 channel で共通なので誤差の合計で選ぶ */
+static int bc7_pbit(const uint8_t* e, int q[4])
+{
+    int best = -1;
+    int bestp = 0;
+    for (int p = 0; p < 2; p ++) {
+        int err = 0;
+        int t[4];
+        for (int c = 0; c < 4; c ++) {
+            t[c] = std::min((e[c] - p + 1) >> 1, 127);
+            const int d = ((t[c] << 1) | p) - e[c];
+            err += d * d;
+        }
+        if (best < 0 || err < best) {
+            best = err;
+            bestp = p;
+            memcpy(q, t, sizeof(t));
+        }
+    }
+    return bestp;
+}
+
+/* BC7 mode 6. index s は 4bit の 0/5/10/15 (weight 0, 21, 43, 64) に対応する */
+static void transcode_bc7(const uint8_t* blk, uint8_t* out)
+{
+    int q[2][4];
+    int p[2];
+    p[0] = bc7_pbit(blk, q[0]);
+    p[1] = bc7_pbit(blk + 4, q[1]);
+    uint32_t sel = read_selectors(blk);
+    /* texel 0 の index は最上位 bit を省略するので、 8 以上になるなら端点を入れ替えて反転する */
+    if (sel & 2) {
+        std::swap(p[0], p[1]);
+        for (int c = 0; c < 4; c ++)
+            std::swap(q[0][c], q[1][c]);
+        sel = ~sel;
+    }
+    uint64_t lo = 1 << 6; /* mode 6 */
+    for (int c = 0; c < 4; c ++) {
+        lo |= static_cast< uint64_t >(q[0][c]) << (7 + c * 14);
+        lo |= static_cast< uint64_t >(q[1][c]) << (14 + c * 14);
+    }
+    lo |= static_cast< uint64_t >(p[0]) << 63;
+    uint64_t hi = static_cast< uint64_t >(p[1]);
+    hi |= static_cast< uint64_t >((sel & 3) * 5) << 1;
+    for (int t = 1; t < 16; t ++)
+        hi |= static_cast< uint64_t >(((sel >> (t * 2)) & 3) * 5) << (4 + (t - 1) * 4);
+    memcpy(out, &lo, 8);
+    memcpy(out + 8, &hi, 8);
+}
+
+uint32_t transcode_target(const pixel_view_t& src, uint32_t supported)
+{
+    if (src.format != RAWD_FORMAT_UNIVERSAL)
+        return src.format;
+    /* BCn の texture は level 0 が 4 の倍数でないと作れない */
+    const bool aligned = !(src.width & 3) && !(src.height & 3);
+    if (aligned && (supported & TRANSCODE_FORMAT_BIT(RAWD_FORMAT_BC7)))
+        return RAWD_FORMAT_BC7;
+    if (aligned && (supported & TRANSCODE_FORMAT_BIT(RAWD_FORMAT_BC1)) && transcode_opaque(src))
+        return RAWD_FORMAT_BC1;
+    return RAWD_FORMAT_RGBA8;
+}
+
+bool transcode_opaque(const pixel_view_t& src)
+{
+    const uint32_t bw = static_cast< uint32_t >(rawd_row_bytes(src) / src.bpp);
+    for (uint32_t by = 0, rows = rawd_rows(src); by < rows; by ++) {
+        const uint8_t* blk = src.data + src.pitch * by;
+        for (uint32_t bx = 0; bx < bw; bx ++, blk += src.bpp) {
+            if ((blk[3] & blk[7]) != 255)
+                return false;
+        }
+    }
+    return true;
+}
+
+pixel_view_t transcoded_view(const pixel_view_t& src, uint32_t target)
+{
+    pixel_view_t v = {};
+    v.width = src.width;
+    v.height = src.height;
+    v.format = target;
+    v.bpp = target == RAWD_FORMAT_RGBA8 ? 4 : rawd_format_bytes(target);
+    v.pitch = rawd_row_bytes(v);
+    return v;
+}
+
+int transcode(const pixel_view_t& src, uint32_t target, uint8_t* dst, size_t dstpitch, worker_pool_t* pool)
+{
+    if (src.format != RAWD_FORMAT_UNIVERSAL || src.bpp != rawd_format_bytes(src.format) || !src.data)
+        return -1;
+    if (target != RAWD_FORMAT_RGBA8 && target != RAWD_FORMAT_BC1 && target != RAWD_FORMAT_BC7)
+        return -1;
+    const uint32_t bw = (src.width + 3) / 4;
+    const uint32_t bh = rawd_rows(src);
+    auto row = [&](size_t by) {
+        const uint8_t* blk = src.data + src.pitch * by;
+        if (target == RAWD_FORMAT_RGBA8) {
+            /* RGBA8 は texel 4 行分. 端の block は画像の内側だけ書く */
+            uint8_t* out = dst + dstpitch * by * 4;
+            const uint32_t h = std::min< uint32_t >(4, src.height - static_cast< uint32_t >(by) * 4);
+            for (uint32_t bx = 0; bx < bw; bx ++, blk += src.bpp)
+                transcode_rgba8(blk, out + bx * 16, dstpitch, std::min< uint32_t >(4, src.width - bx * 4), h);
+            return;
+        }
+        uint8_t* out = dst + dstpitch * by;
+        const uint32_t size = rawd_format_bytes(target);
+        for (uint32_t bx = 0; bx < bw; bx ++, blk += src.bpp, out += size) {
+            if (target == RAWD_FORMAT_BC7)
+                transcode_bc7(blk, out);
+            else
+                transcode_bc1(blk, out);
+        }
+    };
+    if (pool)
+        pool->parallel_for(bh, row);
+    else
+        for (uint32_t by = 0; by < bh; by ++)
+            row(by);
+    return 0;
+}
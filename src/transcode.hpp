@@ -0,0 +1,35 @@
+/**
+ * (C) roentgen 
+ * this code is licensed under the MIT License.
+ */
+#if !defined(TRANSCODE_HPP__)
+#define TRANSCODE_HPP__
+
+#include "rawd.hpp"
+#include "pipeline.hpp"
+#include <stdint.h>
+
+/* 中間形式 (RAWD_FORMAT_UNIVERSAL) を load 時に GPU が読める形式へ変換する. D3D12 には依存しない.
+
+   block (12 byte) は RGBA8 の端点 e0, e1 と 16 texel 分の 2bit index (texel t が bit 2t から).
+   index s の texel は (e0 * (3 - s) + e1 * s + 1) / 3. 配布物はひとつにして (LZ をかければ BC7 より小さい)
+   BC7 mode 6 / BC1 には端点の量子化と index の付け替えだけで、 RGBA8 には palette の展開だけでなれる */
+
+/* supported の bit */
+#define TRANSCODE_FORMAT_BIT(f) (1u << (f))
+
+/* supported (TRANSCODE_FORMAT_BIT の組み合わせ) の中から src の変換先を選ぶ.
+   BC7 > (不透明なら) BC1 > RGBA8 の順. 中間形式でなければ src.format のまま */
+uint32_t transcode_target(const pixel_view_t& src, uint32_t supported);
+
+/* すべての端点の alpha が 255 か */
+bool transcode_opaque(const pixel_view_t& src);
+
+/* 変換後の view (data は nullptr, pitch は dense) */
+pixel_view_t transcoded_view(const pixel_view_t& src, uint32_t target);
+
+/* src を target (RAWD_FORMAT_RGBA8/BC1/BC7) に変換して dst に dstpitch 間隔で書く (staging に直接書いてよい).
+   block 行は pool に配って並列に処理する */
+int transcode(const pixel_view_t& src, uint32_t target, uint8_t* dst, size_t dstpitch, worker_pool_t* pool = nullptr);
+
+#endif
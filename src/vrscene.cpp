@@ -44,6 +44,8 @@ void set_perspective_lefthand(DirectX::XMMATRIX& mat, float fov, float aspectrat
 void playground_t::init(uniq_device_t& u, ID3D12GraphicsCommandList* cmdlist, const std::wstring& dir)
 {
     finished_ = false;
+    /* 小さい mesh が数個なので、 block も staging も 64KB ひとつに収まる */
+    geometry_.init(u, D3D12_DEFAULT_RESOURCE_PLACEMENT_ALIGNMENT, D3D12_DEFAULT_RESOURCE_PLACEMENT_ALIGNMENT);
 
     D3D12_FEATURE_DATA_ROOT_SIGNATURE featureData = {};
     featureData.HighestVersion = D3D_ROOT_SIGNATURE_VERSION_1_1;
@@ -182,38 +184,7 @@ void playground_t::init(uniq_device_t& u, ID3D12GraphicsCommandList* cmdlist, co
             {{ 1.f,  1.f, 0.f}, {0.f, 1.f}, {0.f, 1.f, 0.f}}, // 3: 
         };
 #endif
-        size_t size = sizeof(v);
-        auto prop = setup_heapprop(D3D12_HEAP_TYPE_UPLOAD);
-        auto bufdesc = setup_buffer(size);
-
-        auto hr = u.dev()->CreateCommittedResource(&prop, D3D12_HEAP_FLAG_NONE, &bufdesc, D3D12_RESOURCE_STATE_GENERIC_READ, nullptr, IID_PPV_ARGS(&ground_vertupload_));
-
-        if (FAILED(hr)) {
-            ABT("failed to create vert buffer: err:0x%x\n", hr);
-        }
-
-        uint8_t* va = nullptr;
-        D3D12_RANGE readrange = {0, 0};
-        ground_vertupload_->Map(0, &readrange, reinterpret_cast< void** >(&va));
-        memcpy(va, v, size);
-        ground_vertupload_->Unmap(0, nullptr);
-
-        u.dev()->CreateCommittedResource(&setup_heapprop(D3D12_HEAP_TYPE_DEFAULT), D3D12_HEAP_FLAG_NONE, &setup_buffer(size), D3D12_RESOURCE_STATE_COPY_DEST, nullptr, IID_PPV_ARGS(&ground_vert_));
-
-        cmdlist->CopyBufferRegion(ground_vert_.Get(), 0, ground_vertupload_.Get(), 0, size);
-
-        D3D12_RESOURCE_BARRIER barrier1 = {
-            D3D12_RESOURCE_BARRIER_TYPE_TRANSITION, D3D12_RESOURCE_BARRIER_FLAG_NONE,
-            {ground_vert_.Get(),
-             D3D12_RESOURCE_BARRIER_ALL_SUBRESOURCES,
-             D3D12_RESOURCE_STATE_COPY_DEST,/* before state */
-             D3D12_RESOURCE_STATE_NON_PIXEL_SHADER_RESOURCE /* after state */ }};
-        
-        cmdlist->ResourceBarrier(1, &barrier1);
-
-        ground_vbv_.BufferLocation = ground_vertupload_->GetGPUVirtualAddress(); // GPU
-        ground_vbv_.StrideInBytes = sizeof(vertex_t);
-        ground_vbv_.SizeInBytes = static_cast< UINT >(size);
+        ground_vbv_ = geometry_.upload_vertices(cmdlist, v, sizeof(vertex_t), static_cast< uint32_t >(sizeof(v) / sizeof(v[0])));
     }
 #endif
 
@@ -265,38 +236,7 @@ void playground_t::init(uniq_device_t& u, ID3D12GraphicsCommandList* cmdlist, co
             {{ .5f,-.5f,-.5f}, {1.f, 0.f}, {0.f,-1.f, 0.f}}  // 23: B'
         };
 
-        size_t size = sizeof(v);
-        auto prop = setup_heapprop(D3D12_HEAP_TYPE_UPLOAD);
-        auto bufdesc = setup_buffer(size);
-        
-        auto hr = u.dev()->CreateCommittedResource(&prop, D3D12_HEAP_FLAG_NONE, &bufdesc, D3D12_RESOURCE_STATE_GENERIC_READ, nullptr, IID_PPV_ARGS(&cube_vertupload_));
-                
-        if (FAILED(hr)) {
-            ABT("failed to create vert buffer: err:0x%x\n", hr);
-        }
-
-        uint8_t* va = nullptr;
-        D3D12_RANGE readrange = {0, 0};
-        cube_vertupload_->Map(0, &readrange, reinterpret_cast< void** >(&va));
-        memcpy(va, v, size);
-        cube_vertupload_->Unmap(0, nullptr);
-
-        u.dev()->CreateCommittedResource(&setup_heapprop(D3D12_HEAP_TYPE_DEFAULT), D3D12_HEAP_FLAG_NONE, &setup_buffer(size), D3D12_RESOURCE_STATE_COPY_DEST, nullptr, IID_PPV_ARGS(&cube_vert_));
-
-        cmdlist->CopyBufferRegion(cube_vert_.Get(), 0, cube_vertupload_.Get(), 0, size);
-
-        D3D12_RESOURCE_BARRIER barrier1 = {
-            D3D12_RESOURCE_BARRIER_TYPE_TRANSITION, D3D12_RESOURCE_BARRIER_FLAG_NONE,
-            {cube_vert_.Get(),
-             D3D12_RESOURCE_BARRIER_ALL_SUBRESOURCES,
-             D3D12_RESOURCE_STATE_COPY_DEST,/* before state */
-             D3D12_RESOURCE_STATE_NON_PIXEL_SHADER_RESOURCE /* after state */ }};
-        
-        cmdlist->ResourceBarrier(1, &barrier1);
-
-        vbv_.BufferLocation = cube_vertupload_->GetGPUVirtualAddress(); // GPU
-        vbv_.StrideInBytes = sizeof(vertex_t);
-        vbv_.SizeInBytes = static_cast< UINT >(size);
+        vbv_ = geometry_.upload_vertices(cmdlist, v, sizeof(vertex_t), static_cast< uint32_t >(sizeof(v) / sizeof(v[0])));
     }
 #endif
     
@@ -317,30 +257,7 @@ void playground_t::init(uniq_device_t& u, ID3D12GraphicsCommandList* cmdlist, co
                          12, 13, 14, 14, 13, 15,
                          16, 17, 18, 18, 17, 19,
                          20, 21, 22, 22, 21, 23};
-        size_t size = sizeof(idx);
-        u.dev()->CreateCommittedResource(&setup_heapprop(D3D12_HEAP_TYPE_UPLOAD), D3D12_HEAP_FLAG_NONE, &setup_buffer(size), D3D12_RESOURCE_STATE_GENERIC_READ, nullptr, IID_PPV_ARGS(&cube_idxupload_));
-        int32_t* va = nullptr;
-        D3D12_RANGE readrange = {0, 0};
-        cube_idxupload_->Map(0, &readrange, reinterpret_cast< void** >(&va));
-        memcpy(va, idx, size);
-        cube_idxupload_->Unmap(0, nullptr);
-
-        u.dev()->CreateCommittedResource(&setup_heapprop(D3D12_HEAP_TYPE_DEFAULT), D3D12_HEAP_FLAG_NONE, &setup_buffer(size), D3D12_RESOURCE_STATE_COPY_DEST, nullptr, IID_PPV_ARGS(&cube_idx_));
-
-        cmdlist->CopyBufferRegion(cube_idx_.Get(), 0, cube_idxupload_.Get(), 0, size);
-
-        D3D12_RESOURCE_BARRIER barrier2 = {
-            D3D12_RESOURCE_BARRIER_TYPE_TRANSITION, D3D12_RESOURCE_BARRIER_FLAG_NONE,
-            {cube_idx_.Get(),
-             D3D12_RESOURCE_BARRIER_ALL_SUBRESOURCES,
-             D3D12_RESOURCE_STATE_COPY_DEST,/* before state */
-             D3D12_RESOURCE_STATE_NON_PIXEL_SHADER_RESOURCE /* after state */ }};
-        
-        cmdlist->ResourceBarrier(1, &barrier2);
-
-        ibv_.BufferLocation = cube_idx_->GetGPUVirtualAddress(); // GPU
-        ibv_.Format = DXGI_FORMAT_R16_UINT;
-        ibv_.SizeInBytes = static_cast< UINT >(size);
+        ibv_ = geometry_.upload_indices(cmdlist, idx, DXGI_FORMAT_R16_UINT, static_cast< uint32_t >(sizeof(idx) / sizeof(idx[0])));
     }
 
     /* ConstantBufferView * 3 と ShaderResouceView の Descriptor Heap:
@@ -388,7 +305,7 @@ void playground_t::init(uniq_device_t& u, ID3D12GraphicsCommandList* cmdlist, co
         volatile uint8_t* ptr = nullptr;
         D3D12_RANGE readrange = {0, 0};
         patch_cbv_->Map(0, &readrange, reinterpret_cast< void** >(const_cast< uint8_t** >(&ptr)));
-        memcpy(const_cast< uint8_t* >(ptr), mat, sizeof(float) * 16 * 2);
+        wc_copy(const_cast< uint8_t* >(ptr), mat, sizeof(float) * 16 * 2);
         patch_cbv_->Unmap(0, nullptr);
 
         D3D12_CPU_DESCRIPTOR_HANDLE hdl = patch_descheap_->GetCPUDescriptorHandleForHeapStart();
@@ -444,7 +361,7 @@ void playground_t::init(uniq_device_t& u, ID3D12GraphicsCommandList* cmdlist, co
         /* CBV[0,1]: 2 つの View 行列をそれぞれ別の CBV Descriptor に設定 */
         for (int i = 0; i < 2; i ++) {
             INF("matrix[%d]: gpu addr:0x%llx\n", i, cbv_->GetGPUVirtualAddress() + i * sizeof(float) * 16);
-            memcpy(const_cast< uint8_t* >(ptr), &matrix[i], sizeof(float) * 16);
+            wc_copy(const_cast< uint8_t* >(ptr), &matrix[i], sizeof(float) * 16);
             D3D12_CONSTANT_BUFFER_VIEW_DESC cbvdesc = { cbv_->GetGPUVirtualAddress() + i * align256(sizeof(float) * 16), align256(sizeof(float) * 16)};
             u.dev()->CreateConstantBufferView(&cbvdesc, hdl);
             hdl.ptr += u.sizeset().view;
@@ -453,7 +370,7 @@ void playground_t::init(uniq_device_t& u, ID3D12GraphicsCommandList* cmdlist, co
 
         for (int i = 0; i < 3; i ++) {
             INF("matrix[%d]: gpu addr:0x%llx\n", i, cbv_->GetGPUVirtualAddress() + (2 + i) * sizeof(float) * 16);
-            memcpy(const_cast< uint8_t* >(ptr) + i * sizeof(float) * 16, &matrix[2 + i], sizeof(float) * 16);
+            wc_copy(const_cast< uint8_t* >(ptr) + i * sizeof(float) * 16, &matrix[2 + i], sizeof(float) * 16);
         }
         
         cbv_->Unmap(0, nullptr);
@@ -480,9 +397,10 @@ void playground_t::init(uniq_device_t& u, ID3D12GraphicsCommandList* cmdlist, co
         volatile uint8_t* ptr = nullptr;
         D3D12_RANGE readrange = {0, 0};
         cbv2_->Map(0, &readrange, reinterpret_cast< void** >(const_cast< uint8_t** >(&ptr)));
-        for (int i = 0; i < USE_MODEL_MATRICIES; i ++) {
-            memcpy(const_cast< uint8_t* >(ptr) + i * sizeof(float) * 16, &ident, sizeof(float) * 16);
-        }
+        std::vector< float > idents(16 * USE_MODEL_MATRICIES);
+        for (int i = 0; i < USE_MODEL_MATRICIES; i ++)
+            memcpy(&idents[i * 16], &ident, sizeof(float) * 16);
+        wc_copy(const_cast< uint8_t* >(ptr), idents.data(), idents.size() * sizeof(float));
         cbv2_->Unmap(0, nullptr);
     }
 
@@ -713,16 +631,16 @@ void playground_t::update(uniq_device_t& u, uint64_t freq)
     /* FIXME: CBV の更新と GPU の実行は(ダブルバッファ化しているコマンドバッファとは異なり)オーバーラップするので悪い. */
     float* ptr = nullptr;
     D3D12_RANGE readrange = {0, 0};
-    auto hr = cbv2_->Map(0, &readrange, reinterpret_cast< void** >(&ptr));
+    /* 行列は手元で全部作ってから 1 回の wc_copy で流す (sfence も 1 回) */
+    static DirectX::XMMATRIX models[ROW * COL];
     for (int i = 0; i < ROW; i ++) {
         for (int j = 0; j < COL; j ++) {
-            if (i || j ) {
-                auto t = DirectX::XMMatrixTranspose(DirectX::XMMatrixTranslationFromVector({1.5f * i, 0.5f, 1.5f * j}));
-                memcpy(reinterpret_cast< uint8_t* >(ptr) + (i * COL + j) * sizeof(float) * 16, &t, sizeof(float) * 16);
-            }
+            models[i * COL + j] = DirectX::XMMatrixTranspose(DirectX::XMMatrixTranslationFromVector({1.5f * i, 0.5f, 1.5f * j}));
         }
     }
-    memcpy(reinterpret_cast< uint8_t* >(ptr), &mat, sizeof(float) * 16);
+    models[0] = mat;
+    auto hr = cbv2_->Map(0, &readrange, reinterpret_cast< void** >(&ptr));
+    wc_copy(ptr, models, sizeof(models));
     cbv2_->Unmap(0, nullptr);
 #endif
 }
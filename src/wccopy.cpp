@@ -0,0 +1,179 @@
+/**
+ * (C) roentgen 
+ * this code is licensed under the MIT License.
+ */
+#include "wccopy.hpp"
+#include "simd.hpp"
+#include <string.h>
+#include <algorithm>
+
+#if defined(SIMD_X86)
+#include <immintrin.h>
+#endif
+
+typedef void (*stream_fn_t)(uint8_t* dst, const uint8_t* src, size_t bytes);
+
+static void stream_memcpy(uint8_t* dst, const uint8_t* src, size_t bytes)
+{
+    memcpy(dst, src, bytes);
+}
+
+#if defined(SIMD_X86)
+/* dst を align に揃えるまでの byte 数. bytes より長くはしない */
+static inline size_t head_bytes(const uint8_t* dst, size_t align, size_t bytes)
+{
+    const size_t mis = reinterpret_cast< uintptr_t >(dst) & (align - 1);
+    return std::min(mis ? align - mis : 0, bytes);
+}
+
+/* 端は普通の store で書く. WC でも部分的な書き込みはそのまま通る */
+static void stream_sse2(uint8_t* dst, const uint8_t* src, size_t bytes)
+{
+    const size_t head = head_bytes(dst, 16, bytes);
+    memcpy(dst, src, head);
+    dst += head;
+    src += head;
+    bytes -= head;
+    /* WC の buffer 1 本 (64 byte) ずつ埋める */
+    for (; bytes >= 64; bytes -= 64, dst += 64, src += 64) {
+        const __m128i a = _mm_loadu_si128(reinterpret_cast< const __m128i* >(src));
+        const __m128i b = _mm_loadu_si128(reinterpret_cast< const __m128i* >(src + 16));
+        const __m128i c = _mm_loadu_si128(reinterpret_cast< const __m128i* >(src + 32));
+        const __m128i d = _mm_loadu_si128(reinterpret_cast< const __m128i* >(src + 48));
+        _mm_stream_si128(reinterpret_cast< __m128i* >(dst), a);
+        _mm_stream_si128(reinterpret_cast< __m128i* >(dst + 16), b);
+        _mm_stream_si128(reinterpret_cast< __m128i* >(dst + 32), c);
+        _mm_stream_si128(reinterpret_cast< __m128i* >(dst + 48), d);
+    }
+    for (; bytes >= 16; bytes -= 16, dst += 16, src += 16)
+        _mm_stream_si128(reinterpret_cast< __m128i* >(dst), _mm_loadu_si128(reinterpret_cast< const __m128i* >(src)));
+    memcpy(dst, src, bytes);
+}
+
+SIMD_TARGET("avx")
+static void stream_avx(uint8_t* dst, const uint8_t* src, size_t bytes)
+{
+    const size_t head = head_bytes(dst, 32, bytes);
+    memcpy(dst, src, head);
+    dst += head;
+    src += head;
+    bytes -= head;
+    for (; bytes >= 64; bytes -= 64, dst += 64, src += 64) {
+        const __m256i a = _mm256_loadu_si256(reinterpret_cast< const __m256i* >(src));
+        const __m256i b = _mm256_loadu_si256(reinterpret_cast< const __m256i* >(src + 32));
+        _mm256_stream_si256(reinterpret_cast< __m256i* >(dst), a);
+        _mm256_stream_si256(reinterpret_cast< __m256i* >(dst + 32), b);
+    }
+    if (bytes >= 32) {
+        _mm256_stream_si256(reinterpret_cast< __m256i* >(dst), _mm256_loadu_si256(reinterpret_cast< const __m256i* >(src)));
+        bytes -= 32;
+        dst += 32;
+        src += 32;
+    }
+    memcpy(dst, src, bytes);
+}
+
+SIMD_TARGET("avx512f")
+static void stream_avx512(uint8_t* dst, const uint8_t* src, size_t bytes)
+{
+    const size_t head = head_bytes(dst, 64, bytes);
+    memcpy(dst, src, head);
+    dst += head;
+    src += head;
+    bytes -= head;
+    for (; bytes >= 128; bytes -= 128, dst += 128, src += 128) {
+        const __m512i a = _mm512_loadu_si512(src);
+        const __m512i b = _mm512_loadu_si512(src + 64);
+        _mm512_stream_si512(reinterpret_cast< __m512i* >(dst), a);
+        _mm512_stream_si512(reinterpret_cast< __m512i* >(dst + 64), b);
+    }
+    if (bytes >= 64) {
+        _mm512_stream_si512(reinterpret_cast< __m512i* >(dst), _mm512_loadu_si512(src));
+        bytes -= 64;
+        dst += 64;
+        src += 64;
+    }
+    memcpy(dst, src, bytes);
+}
+#endif
+
+struct wc_kernel_t {
+    stream_fn_t fn;
+    const char* name;
+};
+
+static wc_kernel_t select_kernel()
+{
+    wc_kernel_t k = {stream_memcpy, "memcpy"};
+#if defined(SIMD_X86)
+    const cpu_features_t& cpu = cpu_features();
+    if (cpu.avx512f) {
+        k.fn = stream_avx512;
+        k.name = "avx512";
+    }
+    else if (cpu.avx) {
+        k.fn = stream_avx;
+        k.name = "avx";
+    }
+    else {
+        k.fn = stream_sse2;
+        k.name = "sse2";
+    }
+#endif
+    return k;
+}
+
+static const wc_kernel_t& kernel()
+{
+    static const wc_kernel_t k = select_kernel();
+    return k;
+}
+
+/* non-temporal store は普通の store と順序が保証されないので、 GPU に渡す前に吐き出す */
+static inline void flush_stores()
+{
+#if defined(SIMD_X86)
+    _mm_sfence();
+#endif
+}
+
+void wc_copy(void* dst, const void* src, size_t bytes)
+{
+    if (!bytes)
+        return;
+    kernel().fn(static_cast< uint8_t* >(dst), static_cast< const uint8_t* >(src), bytes);
+    flush_stores();
+}
+
+void wc_copy_rows(uint8_t* dst, size_t dstpitch, const uint8_t* src, size_t srcpitch, size_t rowbytes, uint32_t rows)
+{
+    if (!rows || !rowbytes)
+        return;
+    const stream_fn_t fn = kernel().fn;
+    if (dstpitch == srcpitch && rowbytes <= dstpitch) {
+        /* pitch が一致していれば行間のパディングごと一度に */
+        fn(dst, src, dstpitch * (rows - 1) + rowbytes);
+    }
+    else {
+        for (uint32_t y = 0; y < rows; y ++)
+            fn(dst + dstpitch * y, src + srcpitch * y, rowbytes);
+    }
+    flush_stores();
+}
+
+void copy_rows(uint8_t* dst, size_t dstpitch, const uint8_t* src, size_t srcpitch, size_t rowbytes, uint32_t rows)
+{
+    if (!rows || !rowbytes)
+        return;
+    if (dstpitch == srcpitch && rowbytes <= dstpitch) {
+        memcpy(dst, src, dstpitch * (rows - 1) + rowbytes);
+        return;
+    }
+    for (uint32_t y = 0; y < rows; y ++)
+        memcpy(dst + dstpitch * y, src + srcpitch * y, rowbytes);
+}
+
+const char* wc_copy_kernel()
+{
+    return kernel().name;
+}
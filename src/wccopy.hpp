@@ -0,0 +1,29 @@
+/**
+ * (C) roentgen 
+ * this code is licensed under the MIT License.
+ */
+#if !defined(WCCOPY_HPP__)
+#define WCCOPY_HPP__
+
+#include <stdint.h>
+#include <stddef.h>
+
+/* map した UPLOAD heap (write-combined) への書き込み用のコピー. D3D12 には依存しない.
+   書き込み先を 16/32/64 byte に揃えるまでを普通に書き、 残りを non-temporal store (SSE2/AVX/AVX-512 を実行時に選ぶ) で書く.
+   cache を汚さず、 WC の buffer を行の途中で吐き出させない. 最後に sfence するので、戻ったら GPU に渡してよい.
+   読み出し元は cache に載っているものとして普通に読む. x86 以外では memcpy.
+   書き込み先が普通のメモリ (すぐ CPU が読み直す vector や pool のバッファ) なら、 cache から追い出すだけ損なので copy_rows() を使う */
+
+/* bytes を dst へ */
+void wc_copy(void* dst, const void* src, size_t bytes);
+
+/* rows 行の rowbytes ずつを、 それぞれの pitch の間隔で. sfence は最後に 1 回 */
+void wc_copy_rows(uint8_t* dst, size_t dstpitch, const uint8_t* src, size_t srcpitch, size_t rowbytes, uint32_t rows);
+
+/* wc_copy_rows() と同じ並びを普通の store (memcpy) で */
+void copy_rows(uint8_t* dst, size_t dstpitch, const uint8_t* src, size_t srcpitch, size_t rowbytes, uint32_t rows);
+
+/* 今の CPU で選ばれた kernel の名前 ("avx512", "avx", "sse2", "memcpy") */
+const char* wc_copy_kernel();
+
+#endif
@@ -0,0 +1,45 @@
+/**
+ * (C) roentgen 
+ * this code is licensed under the MIT License.
+ */
+#if !defined(BENCH_HPP__)
+#define BENCH_HPP__
+
+#include <stdio.h>
+#include <stdint.h>
+#include <chrono>
+#include <algorithm>
+
+/* tests/ の bench_* 用. ctest には入れず、 `cmake --build . --target bench` でまとめて走らせる.
+   数字に意味があるのは最適化を有効にしたビルド (-DCMAKE_BUILD_TYPE=Release) だけ */
+
+inline void bench_banner(const char* name)
+{
+#if defined(NDEBUG)
+    printf("== %s\n", name);
+#else
+    printf("== %s (not optimized: configure with -DCMAKE_BUILD_TYPE=Release for real numbers)\n", name);
+#endif
+}
+
+/* fn を repeat 回走らせて一番速かった ms */
+template < typename F >
+double bench_best_ms(int repeat, F fn)
+{
+    double best = 1e30;
+    for (int i = 0; i < repeat; i ++) {
+        const auto t0 = std::chrono::steady_clock::now();
+        fn();
+        best = std::min(best, std::chrono::duration< double, std::milli >(std::chrono::steady_clock::now() - t0).count());
+    }
+    return best;
+}
+
+/* 結果を捨てられないように */
+inline void bench_sink(uint64_t v)
+{
+    static volatile uint64_t sink;
+    sink = sink + v;
+}
+
+#endif
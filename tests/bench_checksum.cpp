@@ -0,0 +1,59 @@
+/**
+ * (C) roentgen 
+ * this code is licensed under the MIT License.
+ */
+#include "hash.hpp"
+#include "bench.hpp"
+#include <string.h>
+#include <vector>
+
+/* payload の checksum (xxh64) がメモリ帯域で回るか. 比べるのは同じ大きさを
+   - 1 回なめるだけ (8 byte ずつ足す, 読み出し帯域の目安)
+   - memcpy (trampoline へのコピーと同じ量の読み書き)
+   cache に載る大きさと載らない大きさの両方で見る. loader は読み込みの hash pass で 1 回だけなめる */
+
+static uint64_t read_pass(const uint8_t* p, size_t bytes)
+{
+    uint64_t a = 0, b = 0, c = 0, d = 0;
+    size_t i = 0;
+    for (; i + 32 <= bytes; i += 32) {
+        uint64_t v[4];
+        memcpy(v, p + i, sizeof(v));
+        a += v[0];
+        b += v[1];
+        c += v[2];
+        d += v[3];
+    }
+    return a ^ b ^ c ^ d;
+}
+
+int main()
+{
+    bench_banner("checksum: xxh64 throughput vs a plain read pass and memcpy");
+    printf("  %10s  %10s %10s %10s  %s\n", "bytes", "xxh64 GB/s", "read GB/s", "memcpy GB/s", "xxh64 vs read");
+    static const size_t sizes[] = {4 << 10, 64 << 10, 1 << 20, 4 << 20, 16 << 20, 64 << 20, 256 << 20};
+    for (size_t bytes : sizes) {
+        std::vector< uint8_t > src(bytes), dst(bytes);
+        for (size_t i = 0; i < bytes; i ++)
+            src[i] = static_cast< uint8_t >(i * 131 + 7);
+        const int loops = static_cast< int >(std::max< size_t >(1, (1024ull << 20) / bytes));
+        const int repeat = 3;
+        auto rate = [&](double ms) { return static_cast< double >(bytes) * loops / (ms * 1e-3) / 1e9; };
+
+        const double hash = bench_best_ms(repeat, [&] {
+                for (int i = 0; i < loops; i ++)
+                    bench_sink(xxh64(src.data(), bytes));
+            });
+        const double read = bench_best_ms(repeat, [&] {
+                for (int i = 0; i < loops; i ++)
+                    bench_sink(read_pass(src.data(), bytes));
+            });
+        const double copy = bench_best_ms(repeat, [&] {
+                for (int i = 0; i < loops; i ++)
+                    memcpy(dst.data(), src.data(), bytes);
+                bench_sink(dst[bytes - 1]);
+            });
+        printf("  %10zu  %10.2f %10.2f %10.2f  %9.0f%%\n", bytes, rate(hash), rate(read), rate(copy), 100.0 * read / hash);
+    }
+    return 0;
+}
@@ -0,0 +1,117 @@
+/**
+ * (C) roentgen 
+ * this code is licensed under the MIT License.
+ */
+#include "heapalloc.hpp"
+#include "bench.hpp"
+#include <random>
+#include <vector>
+
+/* streaming で来る texture と buffer に近い大きさ. 小さいものは 4KB, 大きいものは 64KB に揃える */
+struct request_t {
+    uint64_t size;
+    uint64_t align;
+};
+
+static request_t next_request(std::mt19937_64& rng)
+{
+    request_t r;
+    const uint32_t kind = rng() % 8;
+    if (kind < 3)
+        r.size = (rng() % 16 + 1) * 4096;           /* 小さい texture, 定数 buffer */
+    else if (kind < 7)
+        r.size = (rng() % 64 + 1) * 65536;          /* 256x256 から 2048x2048 の BCn */
+    else
+        r.size = (rng() % 4 + 1) * 4 * 1024 * 1024; /* 大きな RGBA8 */
+    r.align = r.size <= 64 * 1024 ? 4096 : 65536;
+    return r;
+}
+
+/* 使用率を target 付近に保ちながら alloc/free を混ぜ、 1 回あたりの時間と断片化を見る.
+   断片化は 1 - (一番大きい空き / 空きの合計) の平均. 0 なら空きがひとつにまとまっている */
+static void steady_state(double target)
+{
+    const uint64_t capacity = 256ull << 20;
+    tlsf_allocator_t t;
+    t.reset(capacity);
+    std::mt19937_64 rng(7);
+    std::vector< uint32_t > live;
+    const int ops = 1000000;
+    uint64_t fails = 0, allocs = 0;
+    double frag = 0.0;
+    int samples = 0;
+    const double ms = bench_best_ms(1, [&] {
+            for (int i = 0; i < ops; i ++) {
+                const bool grow = live.empty() || static_cast< double >(t.used()) < capacity * target;
+                if (grow) {
+                    const request_t r = next_request(rng);
+                    uint64_t offset;
+                    uint32_t handle;
+                    allocs ++;
+                    if (t.alloc(r.size, r.align, offset, handle))
+                        live.push_back(handle);
+                    else
+                        fails ++;
+                }
+                else {
+                    const size_t k = rng() % live.size();
+                    t.free(live[k]);
+                    live[k] = live.back();
+                    live.pop_back();
+                }
+                if ((i & 4095) == 0) {
+                    const uint64_t free = t.capacity() - t.used();
+                    frag += free ? 1.0 - static_cast< double >(t.largest_free()) / free : 0.0;
+                    samples ++;
+                }
+            }
+        });
+    printf("  tlsf   load %3.0f%%: %7.1f ns/op  fragmentation %.3f  failed %5.2f%%  live %zu\n",
+           target * 100.0, ms * 1e6 / ops, frag / samples, allocs ? 100.0 * fails / allocs : 0.0, live.size());
+}
+
+/* block を足しながら置く時、 持っている block の合計に対して中身がどれだけ詰まっているか */
+static void suballocator()
+{
+    const uint64_t block = 64ull << 20;
+    heap_suballocator_t s(1);
+    std::mt19937_64 rng(11);
+    std::vector< heap_allocation_t > live;
+    uint64_t live_bytes = 0, peak_blocks = 0;
+    const int ops = 500000;
+    const double ms = bench_best_ms(1, [&] {
+            for (int i = 0; i < ops; i ++) {
+                if (live.size() < 400 || (live.size() < 800 && rng() % 2)) {
+                    const request_t r = next_request(rng);
+                    heap_allocation_t a;
+                    if (!s.alloc(0, r.size, r.align, a)) {
+                        s.add_block(0, block);
+                        s.alloc(0, r.size, r.align, a);
+                    }
+                    live.push_back(a);
+                    live_bytes += a.size;
+                }
+                else {
+                    const size_t k = rng() % live.size();
+                    live_bytes -= live[k].size;
+                    s.free(live[k]);
+                    live[k] = live.back();
+                    live.pop_back();
+                }
+            }
+        });
+    peak_blocks = s.blocks(0);
+    printf("  blocks 64MB     : %7.1f ns/op  %llu blocks  %.1f MB live (%.0f%% of blocks)\n",
+           ms * 1e6 / ops, static_cast< unsigned long long >(peak_blocks), live_bytes / 1048576.0,
+           100.0 * live_bytes / (peak_blocks * block));
+}
+
+int main()
+{
+    bench_banner("heapalloc: TLSF alloc/free throughput and fragmentation (256MB heap)");
+    steady_state(0.50);
+    steady_state(0.75);
+    steady_state(0.90);
+    suballocator();
+    return 0;
+}
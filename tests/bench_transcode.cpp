@@ -0,0 +1,127 @@
+/**
+ * (C) roentgen 
+ * this code is licensed under the MIT License.
+ */
+#include "transcode.hpp"
+#include "bcenc.hpp"
+#include "wccopy.hpp"
+#include "footprint.hpp"
+#include "bench.hpp"
+#include <algorithm>
+#include <thread>
+#include <vector>
+
+/* 中間形式からの load 時の変換 (transcode) と、 最初から BC7 で配った時の upload (行を RowPitch へコピーするだけ) の比較.
+   どちらも 2048x2048 を staging と同じ RowPitch の並びで普通のメモリへ書き、 Mtexel/s と core あたりの値を出す.
+   core 数は呼び出し元 + worker_pool_t の worker */
+
+static const uint32_t SIZE = 2048;
+
+/* なだらかな gradient に少し noise を足した不透明な画像 (BC1 も選べるように alpha は 255) */
+static std::vector< uint8_t > make_image()
+{
+    std::vector< uint8_t > img(static_cast< size_t >(SIZE) * SIZE * 4);
+    uint32_t seed = 12345;
+    for (uint32_t y = 0; y < SIZE; y ++) {
+        for (uint32_t x = 0; x < SIZE; x ++) {
+            seed = seed * 1664525u + 1013904223u;
+            const uint32_t noise = (seed >> 24) & 15;
+            uint8_t* p = &img[(static_cast< size_t >(y) * SIZE + x) * 4];
+            p[0] = static_cast< uint8_t >((x >> 3) + noise);
+            p[1] = static_cast< uint8_t >((y >> 3) + noise);
+            p[2] = static_cast< uint8_t >(((x + y) >> 4) + noise);
+            p[3] = 255;
+        }
+    }
+    return img;
+}
+
+static void report(const char* name, int cores, double ms)
+{
+    const double texels = static_cast< double >(SIZE) * SIZE;
+    const double rate = texels / (ms * 1e-3) / 1e6;
+    printf("  %-22s %2d core(s): %9.1f Mtexel/s  %8.1f Mtexel/s/core\n", name, cores, rate, rate / cores);
+}
+
+/* BC7 の payload を block 行ごとに RowPitch の並びへ. 行を pool に配るのは transcode() と同じ */
+static void upload_rows(const pixel_view_t& bc7, uint8_t* dst, size_t dstpitch, bool wc, worker_pool_t* pool)
+{
+    const uint32_t rows = rawd_rows(bc7);
+    const size_t rowbytes = rawd_row_bytes(bc7);
+    const uint32_t chunk = 16;
+    const size_t n = (rows + chunk - 1) / chunk;
+    auto fn = [&](size_t i) {
+        const uint32_t y = static_cast< uint32_t >(i) * chunk;
+        const uint32_t count = std::min(chunk, rows - y);
+        if (wc)
+            wc_copy_rows(dst + dstpitch * y, dstpitch, bc7.data + bc7.pitch * y, bc7.pitch, rowbytes, count);
+        else
+            copy_rows(dst + dstpitch * y, dstpitch, bc7.data + bc7.pitch * y, bc7.pitch, rowbytes, count);
+    };
+    if (pool)
+        pool->parallel_for(n, fn);
+    else
+        for (size_t i = 0; i < n; i ++)
+            fn(i);
+}
+
+int main()
+{
+    bench_banner("transcode: universal -> BC7/BC1/RGBA8 vs uploading BC7 as is (2048x2048)");
+    const std::vector< uint8_t > img = make_image();
+    pixel_view_t rgba = pixel_view_t();
+    rgba.data = img.data();
+    rgba.width = SIZE;
+    rgba.height = SIZE;
+    rgba.format = RAWD_FORMAT_RGBA8;
+    rgba.bpp = 4;
+    rgba.pitch = SIZE * 4;
+
+    worker_pool_t encoder;
+    encoder.start(static_cast< int >(std::max(1u, std::thread::hardware_concurrency()) - 1));
+    std::vector< uint8_t > ubuf, bcbuf;
+    pixel_view_t universal, bc7;
+    if (bc_encode(rgba, RAWD_FORMAT_UNIVERSAL, BC_QUALITY_FAST, ubuf, universal, &encoder) < 0
+        || bc_encode(rgba, RAWD_FORMAT_BC7, BC_QUALITY_FAST, bcbuf, bc7, &encoder) < 0) {
+        printf("  could not encode the source image\n");
+        return 1;
+    }
+    encoder.stop();
+
+    /* 一番大きい RGBA8 に合わせて確保しておく */
+    std::vector< uint8_t > dst(static_cast< size_t >(footprint_row_pitch(SIZE * 4)) * SIZE + 64);
+    uint8_t* d = dst.data() + 16; /* head を通す */
+    const unsigned hw = std::max(1u, std::thread::hardware_concurrency());
+    const int threads[] = {1, static_cast< int >(std::min(4u, hw)), static_cast< int >(hw)};
+    int last = 0;
+    for (int cores : threads) {
+        if (cores == last)
+            continue;
+        last = cores;
+        worker_pool_t pool;
+        pool.start(cores - 1);
+        worker_pool_t* p = cores > 1 ? &pool : nullptr;
+        const int repeat = 5;
+        static const uint32_t targets[] = {RAWD_FORMAT_BC7, RAWD_FORMAT_BC1, RAWD_FORMAT_RGBA8};
+        static const char* names[] = {"transcode -> BC7", "transcode -> BC1", "transcode -> RGBA8"};
+        for (int t = 0; t < 3; t ++) {
+            const pixel_view_t out = transcoded_view(universal, targets[t]);
+            const size_t pitch = footprint_row_pitch(rawd_row_bytes(out));
+            report(names[t], cores, bench_best_ms(repeat, [&] {
+                    transcode(universal, targets[t], d, pitch, p);
+                    bench_sink(d[0]);
+                }));
+        }
+        const size_t pitch = footprint_row_pitch(rawd_row_bytes(bc7));
+        report("BC7 upload (memcpy)", cores, bench_best_ms(repeat, [&] {
+                upload_rows(bc7, d, pitch, false, p);
+                bench_sink(d[0]);
+            }));
+        report("BC7 upload (wc_copy)", cores, bench_best_ms(repeat, [&] {
+                upload_rows(bc7, d, pitch, true, p);
+                bench_sink(d[0]);
+            }));
+    }
+    printf("  payload: universal %zu bytes, BC7 %zu bytes\n", ubuf.size(), bcbuf.size());
+    return 0;
+}
@@ -0,0 +1,43 @@
+/**
+ * (C) roentgen 
+ * this code is licensed under the MIT License.
+ */
+#if !defined(CHECK_HPP__)
+#define CHECK_HPP__
+
+#include <stdio.h>
+
+/* tests/ の test_* 用. 失敗しても止めずに数えて表示し、 main は check_result() を返す (ctest は 0 以外を失敗とみなす) */
+
+inline int& check_failures()
+{
+    static int n = 0;
+    return n;
+}
+
+inline int check_result()
+{
+    if (check_failures())
+        fprintf(stderr, "%d check(s) failed\n", check_failures());
+    return check_failures() ? 1 : 0;
+}
+
+#define CHECK(cond)                                                     \
+    do {                                                                \
+        if (!(cond)) {                                                  \
+            fprintf(stderr, "%s:%d: CHECK(%s)\n", __FILE__, __LINE__, #cond); \
+            check_failures() ++;                                        \
+        }                                                               \
+    } while (0)
+
+#define CHECK_EQ(a, b)                                                  \
+    do {                                                                \
+        const unsigned long long a_ = static_cast< unsigned long long >(a); \
+        const unsigned long long b_ = static_cast< unsigned long long >(b); \
+        if (a_ != b_) {                                                 \
+            fprintf(stderr, "%s:%d: CHECK_EQ(%s, %s): %llu != %llu\n", __FILE__, __LINE__, #a, #b, a_, b_); \
+            check_failures() ++;                                        \
+        }                                                               \
+    } while (0)
+
+#endif
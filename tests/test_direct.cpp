@@ -0,0 +1,195 @@
+/**
+ * (C) roentgen 
+ * this code is licensed under the MIT License.
+ */
+#include "directread.hpp"
+#include "ringalloc.hpp"
+#include "footprint.hpp"
+#include "check.hpp"
+#include <stdio.h>
+#include <string.h>
+#include <stdlib.h>
+#include <atomic>
+#include <new>
+#include <string>
+#include <vector>
+
+/* texture_loader_t の direct と同じ手順 (先頭を読む, probe, ring から取る, RowPitch の位置へ読む, checksum を照合する) を
+   D3D12 無しでなぞり、 pixel が正しい位置に届くことと、 定常状態で pixel の大きさの allocation が 1 回も無いことを見る */
+
+/* LARGE_ALLOC byte 以上の operator new を数える. 一番小さい texture の pixel 列より小さくしておく */
+static const size_t LARGE_ALLOC = 8192;
+static std::atomic< bool > counting(false);
+static std::atomic< int > large_allocs(0);
+
+void* operator new(size_t size)
+{
+    if (counting.load(std::memory_order_relaxed) && size >= LARGE_ALLOC)
+        large_allocs ++;
+    if (void* p = malloc(size ? size : 1))
+        return p;
+    throw std::bad_alloc();
+}
+
+void operator delete(void* p) noexcept
+{
+    free(p);
+}
+
+void operator delete(void* p, size_t) noexcept
+{
+    free(p);
+}
+
+struct source_t {
+    const char* name;
+    uint16_t ver_lo;
+    uint32_t format;
+    uint32_t width;
+    uint32_t height;
+    uint32_t bpp;    /* header の pixperbyte */
+    uint32_t pitch;  /* v1.1 以降のファイルの pitch. 0 なら dense */
+    int probe;       /* direct_probe() の結果 */
+    int verify;      /* direct_verify() の結果 */
+};
+
+static uint8_t pattern(size_t row, size_t i, uint32_t seed)
+{
+    return static_cast< uint8_t >(row * 7 + i * 13 + seed);
+}
+
+static std::wstring widen_ascii(const std::string& s)
+{
+    return std::wstring(s.begin(), s.end());
+}
+
+/* 行ごとに違う模様の RAWD を書く. note は header の後に置き、 pitch の余りは 0xee で埋める */
+static bool write_source(const source_t& s, uint32_t seed)
+{
+    pixel_view_t v = pixel_view_t();
+    v.width = s.width;
+    v.height = s.height;
+    v.format = s.format;
+    v.bpp = s.bpp;
+    const size_t row = rawd_row_bytes(v);
+    v.pitch = s.pitch ? s.pitch : row;
+    std::vector< uint8_t > payload(rawd_payload_bytes(v), 0xee);
+    for (uint32_t y = 0; y < rawd_rows(v); y ++)
+        for (size_t i = 0; i < row; i ++)
+            payload[v.pitch * y + i] = pattern(y, i, seed);
+
+    static const char note[] = "test_direct";
+    rawd_header_t h = rawd_header_t();
+    memcpy(h.fourcc, "RAWD", 4);
+    h.ver_hi = 1;
+    h.ver_lo = s.ver_lo;
+    h.checksum = s.ver_lo >= 2 ? rawd_checksum(payload.data(), payload.size()) : 0;
+    if (s.verify == RAWD_ERR_CHECKSUM)
+        h.checksum ^= 1;
+    h.width = s.width;
+    h.height = s.height;
+    h.format = s.format;
+    h.pixperbyte = s.bpp;
+    h.notelen = sizeof(note);
+    FILE* fp = fopen(s.name, "wb");
+    if (!fp)
+        return false;
+    bool ok = fwrite(&h, sizeof(h), 1, fp) == 1 && fwrite(note, sizeof(note), 1, fp) == 1;
+    if (s.ver_lo >= 1) {
+        rawd_ext_t ext = rawd_ext_t();
+        ext.size = sizeof(ext);
+        ext.pitch = static_cast< uint32_t >(v.pitch);
+        ok = ok && fwrite(&ext, sizeof(ext), 1, fp) == 1;
+    }
+    ok = ok && fwrite(payload.data(), payload.size(), 1, fp) == 1;
+    return fclose(fp) == 0 && ok;
+}
+
+static bool check_pixels(uint32_t seed, const uint8_t* dst, const subresource_footprint_t& fp)
+{
+    for (uint32_t y = 0; y < fp.rows; y ++)
+        for (size_t i = 0; i < fp.row_bytes; i ++)
+            if (dst[static_cast< size_t >(fp.row_pitch) * y + i] != pattern(y, i, seed))
+                return false;
+    return true;
+}
+
+int main()
+{
+    static const source_t sources[] = {
+        {"test_direct_dense.rawd",    0, RAWD_FORMAT_RGBA8, 64, 64, 4, 0, 0, 0},     /* pitch 256 は RowPitch と同じなので 1 回で読む */
+        {"test_direct_rows.rawd",     0, RAWD_FORMAT_RGBA8, 100, 60, 4, 0, 0, 0},    /* 400 byte/行 を 512 byte の RowPitch へ行ごとに */
+        {"test_direct_bc7.rawd",      1, RAWD_FORMAT_BC7, 128, 128, 16, 1024, 0, 0}, /* v1.1 の非圧縮. pitch 1024 から RowPitch 512 へ */
+        {"test_direct_rgb10a2.rawd",  1, RAWD_FORMAT_RGB10A2, 64, 40, 4, 0, 0, 0},
+        {"test_direct_checksum.rawd", 2, RAWD_FORMAT_RGBA8, 100, 60, 4, 400, 0, 0}, /* assetcook の出力と同じ v1.2 */
+        {"test_direct_badsum.rawd",   2, RAWD_FORMAT_RGBA8, 64, 64, 4, 256, 0, RAWD_ERR_CHECKSUM},
+        {"test_direct_bpp.rawd",      0, RAWD_FORMAT_RGBA8, 64, 64, 3, 0, RAWD_ERR_HEADER, 0},
+    };
+    const size_t n = sizeof(sources) / sizeof(sources[0]);
+    for (size_t k = 0; k < n; k ++)
+        CHECK(write_source(sources[k], static_cast< uint32_t >(k)));
+
+    async_io_t io;
+    CHECK_EQ(io.start(), 0);
+    ring_allocator_t ring;
+    std::vector< uint8_t > ring_mem(4 << 20);
+    ring.reset(ring_mem.size());
+    std::vector< uint8_t > head(4096);
+    std::vector< io_request_t > reads;
+    std::vector< int64_t > results;
+    reads.reserve(1024);
+    results.reserve(1024);
+
+    /* 1 周目は async_io_t や ring の中の小さな管理用の確保が落ち着くまで. 2 周目からは数える */
+    int direct = 0;
+    for (int round = 0; round < 8; round ++) {
+        counting = round > 0;
+        for (size_t k = 0; k < n; k ++) {
+            const source_t& s = sources[k];
+            uint64_t size = 0;
+            const io_file_t f = io_open(widen_ascii(s.name), &size);
+            CHECK(f != IO_INVALID_FILE);
+            if (f == IO_INVALID_FILE)
+                continue;
+            int64_t got = 0;
+            io_request_t r = {f, 0, static_cast< size_t >(size < head.size() ? size : head.size()), head.data(), &got};
+            io.wait(io.submit(&r, 1));
+            direct_source_t src;
+            const int err = direct_probe(head.data(), static_cast< size_t >(got), size, src);
+            CHECK_EQ(err, s.probe);
+            if (err < 0) {
+                io_close(f);
+                continue;
+            }
+            subresource_footprint_t fp;
+            const uint64_t total = footprint_layout(footprint_tex2d(s.format, s.width, s.height), 0, 1, 0, &fp);
+            uint64_t offset = 0, ticket = 0;
+            CHECK(ring.alloc(total, FOOTPRINT_PLACEMENT_ALIGNMENT, offset, ticket));
+            uint8_t* dst = ring_mem.data() + offset;
+            memset(dst, 0, static_cast< size_t >(total));
+
+            reads.clear();
+            const size_t issued = direct_requests(src, f, dst, fp.row_pitch, reads);
+            CHECK_EQ(issued, src.view.pitch == fp.row_pitch ? 1 : fp.rows);
+            results.assign(reads.size(), 0);
+            for (size_t i = 0; i < reads.size(); i ++)
+                reads[i].result = &results[i];
+            io.wait(io.submit(reads.data(), reads.size()));
+            io_close(f);
+            for (size_t i = 0; i < reads.size(); i ++)
+                CHECK_EQ(results[i], reads[i].size);
+            CHECK(check_pixels(static_cast< uint32_t >(k), dst, fp));
+            CHECK_EQ(src.checksum != 0, s.ver_lo >= 2);
+            CHECK_EQ(direct_verify(src, widen_ascii(s.name)), s.verify);
+            ring.release(ticket);
+            direct ++;
+        }
+    }
+    counting = false;
+    io.stop();
+    CHECK_EQ(direct, 8 * 6);
+    CHECK_EQ(large_allocs.load(), 0);
+    for (size_t k = 0; k < n; k ++)
+        remove(sources[k].name);
+    return check_result();
+}
@@ -0,0 +1,342 @@
+/**
+ * (C) roentgen 
+ * this code is licensed under the MIT License.
+ */
+#include "footprint.hpp"
+#include "rawd.hpp"
+#include "check.hpp"
+
+/* footprint_layout() を表と照合する.
+   表の値は footprint.cpp とは別に D3D12 の規則 (RowPitch は 256, subresource の先頭は 512 byte 境界,
+   BCn は 4x4 block, total は最後の行のパディングを含まない) から計算して書き写したもの.
+   GetCopyableFootprints() の結果と同じになるはずのもの (Windows の _DEBUG ビルドでは texloader が device と照合している) */
+
+struct layout_case_t {
+    const char* name;
+    uint32_t dimension;
+    uint32_t format;
+    uint64_t width;
+    uint32_t height;
+    uint32_t depth_or_array;
+    uint32_t mips;
+    uint32_t first;
+    uint32_t n;
+    uint64_t base;
+    uint64_t total;
+    uint32_t expected; /* expected[] の先頭 */
+};
+
+static const layout_case_t cases[] = {
+    {"rgba8 256x256", FOOTPRINT_TEXTURE2D, RAWD_FORMAT_RGBA8, 256, 256, 1, 1, 0, 1, 0, 262144, 0},
+    {"bc1 256x256", FOOTPRINT_TEXTURE2D, RAWD_FORMAT_BC1, 256, 256, 1, 1, 0, 1, 0, 32768, 1},
+    {"bc3 256x256", FOOTPRINT_TEXTURE2D, RAWD_FORMAT_BC3, 256, 256, 1, 1, 0, 1, 0, 65536, 2},
+    {"bc7 256x256", FOOTPRINT_TEXTURE2D, RAWD_FORMAT_BC7, 256, 256, 1, 1, 0, 1, 0, 65536, 3},
+    {"universal 256x256", FOOTPRINT_TEXTURE2D, RAWD_FORMAT_UNIVERSAL, 256, 256, 1, 1, 0, 1, 0, 49152, 4},
+    {"rgb8 256x256", FOOTPRINT_TEXTURE2D, RAWD_FORMAT_RGB8, 256, 256, 1, 1, 0, 1, 0, 196608, 5},
+    {"bgra8 256x256", FOOTPRINT_TEXTURE2D, RAWD_FORMAT_BGRA8, 256, 256, 1, 1, 0, 1, 0, 262144, 6},
+    {"rgba8_srgb 256x256", FOOTPRINT_TEXTURE2D, RAWD_FORMAT_RGBA8_SRGB, 256, 256, 1, 1, 0, 1, 0, 262144, 7},
+    {"rgba16f 256x256", FOOTPRINT_TEXTURE2D, RAWD_FORMAT_RGBA16F, 256, 256, 1, 1, 0, 1, 0, 524288, 8},
+    {"rgba32f 256x256", FOOTPRINT_TEXTURE2D, RAWD_FORMAT_RGBA32F, 256, 256, 1, 1, 0, 1, 0, 1048576, 9},
+    {"rgb10a2 256x256", FOOTPRINT_TEXTURE2D, RAWD_FORMAT_RGB10A2, 256, 256, 1, 1, 0, 1, 0, 262144, 10},
+    {"rgba8 37x19 full mips", FOOTPRINT_TEXTURE2D, RAWD_FORMAT_RGBA8, 37, 19, 1, 0, 0, 6, 0, 9732, 11},
+    {"bc1 37x19 full mips", FOOTPRINT_TEXTURE2D, RAWD_FORMAT_BC1, 37, 19, 1, 0, 0, 6, 0, 4104, 17},
+    {"bc3 37x19 full mips", FOOTPRINT_TEXTURE2D, RAWD_FORMAT_BC3, 37, 19, 1, 0, 0, 6, 0, 4112, 23},
+    {"bc7 37x19 full mips", FOOTPRINT_TEXTURE2D, RAWD_FORMAT_BC7, 37, 19, 1, 0, 0, 6, 0, 4112, 29},
+    {"universal 37x19 full mips", FOOTPRINT_TEXTURE2D, RAWD_FORMAT_UNIVERSAL, 37, 19, 1, 0, 0, 6, 0, 4108, 35},
+    {"rgb8 37x19 full mips", FOOTPRINT_TEXTURE2D, RAWD_FORMAT_RGB8, 37, 19, 1, 0, 0, 6, 0, 9731, 41},
+    {"bgra8 37x19 full mips", FOOTPRINT_TEXTURE2D, RAWD_FORMAT_BGRA8, 37, 19, 1, 0, 0, 6, 0, 9732, 47},
+    {"rgba8_srgb 37x19 full mips", FOOTPRINT_TEXTURE2D, RAWD_FORMAT_RGBA8_SRGB, 37, 19, 1, 0, 0, 6, 0, 9732, 53},
+    {"rgba16f 37x19 full mips", FOOTPRINT_TEXTURE2D, RAWD_FORMAT_RGBA16F, 37, 19, 1, 0, 0, 6, 0, 14344, 59},
+    {"rgba32f 37x19 full mips", FOOTPRINT_TEXTURE2D, RAWD_FORMAT_RGBA32F, 37, 19, 1, 0, 0, 6, 0, 21520, 65},
+    {"rgb10a2 37x19 full mips", FOOTPRINT_TEXTURE2D, RAWD_FORMAT_RGB10A2, 37, 19, 1, 0, 0, 6, 0, 9732, 71},
+    {"rgba8 256x256 full mips", FOOTPRINT_TEXTURE2D, RAWD_FORMAT_RGBA8, 256, 256, 1, 0, 0, 9, 0, 359940, 77},
+    {"rgba8 64x2 row is exactly the pitch", FOOTPRINT_TEXTURE2D, RAWD_FORMAT_RGBA8, 64, 2, 1, 1, 0, 1, 0, 512, 86},
+    {"rgba8 65x2 last row has no padding", FOOTPRINT_TEXTURE2D, RAWD_FORMAT_RGBA8, 65, 2, 1, 1, 0, 1, 0, 772, 87},
+    {"bc1 4x4 full mips", FOOTPRINT_TEXTURE2D, RAWD_FORMAT_BC1, 4, 4, 1, 0, 0, 3, 0, 1032, 88},
+    {"bc7 10x6 partial blocks", FOOTPRINT_TEXTURE2D, RAWD_FORMAT_BC7, 10, 6, 1, 1, 0, 1, 0, 304, 91},
+    {"bc1 1024x1024 level 0 only", FOOTPRINT_TEXTURE2D, RAWD_FORMAT_BC1, 1024, 1024, 1, 0, 0, 1, 0, 524288, 92},
+    {"rgba8 256x256 mips 3..8 with base", FOOTPRINT_TEXTURE2D, RAWD_FORMAT_RGBA8, 256, 256, 1, 0, 3, 6, 8192, 15876, 93},
+    {"rgba8 64x32 array 4 mips 3", FOOTPRINT_TEXTURE2D, RAWD_FORMAT_RGBA8, 64, 32, 4, 3, 0, 12, 0, 57152, 99},
+    {"rgba8 64x32 array 4 mips 3 range crosses slices", FOOTPRINT_TEXTURE2D, RAWD_FORMAT_RGBA8, 64, 32, 4, 3, 5, 4, 0, 16192, 111},
+    {"bc3 128x128 array 2 second slice", FOOTPRINT_TEXTURE2D, RAWD_FORMAT_BC3, 128, 128, 2, 0, 8, 8, 0, 25104, 115},
+    {"rgba16f 1d 300 array 2", FOOTPRINT_TEXTURE1D, RAWD_FORMAT_RGBA16F, 300, 1, 2, 0, 0, 18, 0, 15880, 123},
+    {"rgba8 3d 32x16x8 full mips", FOOTPRINT_TEXTURE3D, RAWD_FORMAT_RGBA8, 32, 16, 8, 0, 0, 6, 0, 44036, 141},
+    {"bc1 3d 16x16x4", FOOTPRINT_TEXTURE3D, RAWD_FORMAT_BC1, 16, 16, 4, 1, 0, 1, 0, 3872, 147},
+    {"buffer 1000 bytes", FOOTPRINT_BUFFER, RAWD_FORMAT_RGBA8, 1000, 1, 1, 1, 0, 1, 0, 1000, 148},
+    {"buffer 65536 bytes with base", FOOTPRINT_BUFFER, RAWD_FORMAT_RGBA8, 65536, 1, 1, 1, 0, 1, 512, 65536, 149},
+};
+
+static const subresource_footprint_t expected[] = {
+    {0, 256, 256, 1, 1024, 256, 1024},
+    {0, 256, 256, 1, 512, 64, 512},
+    {0, 256, 256, 1, 1024, 64, 1024},
+    {0, 256, 256, 1, 1024, 64, 1024},
+    {0, 256, 256, 1, 768, 64, 768},
+    {0, 256, 256, 1, 768, 256, 768},
+    {0, 256, 256, 1, 1024, 256, 1024},
+    {0, 256, 256, 1, 1024, 256, 1024},
+    {0, 256, 256, 1, 2048, 256, 2048},
+    {0, 256, 256, 1, 4096, 256, 4096},
+    {0, 256, 256, 1, 1024, 256, 1024},
+    {0, 37, 19, 1, 256, 19, 148},
+    {5120, 18, 9, 1, 256, 9, 72},
+    {7680, 9, 4, 1, 256, 4, 36},
+    {8704, 4, 2, 1, 256, 2, 16},
+    {9216, 2, 1, 1, 256, 1, 8},
+    {9728, 1, 1, 1, 256, 1, 4},
+    {0, 40, 20, 1, 256, 5, 80},
+    {1536, 20, 12, 1, 256, 3, 40},
+    {2560, 12, 4, 1, 256, 1, 24},
+    {3072, 4, 4, 1, 256, 1, 8},
+    {3584, 4, 4, 1, 256, 1, 8},
+    {4096, 4, 4, 1, 256, 1, 8},
+    {0, 40, 20, 1, 256, 5, 160},
+    {1536, 20, 12, 1, 256, 3, 80},
+    {2560, 12, 4, 1, 256, 1, 48},
+    {3072, 4, 4, 1, 256, 1, 16},
+    {3584, 4, 4, 1, 256, 1, 16},
+    {4096, 4, 4, 1, 256, 1, 16},
+    {0, 40, 20, 1, 256, 5, 160},
+    {1536, 20, 12, 1, 256, 3, 80},
+    {2560, 12, 4, 1, 256, 1, 48},
+    {3072, 4, 4, 1, 256, 1, 16},
+    {3584, 4, 4, 1, 256, 1, 16},
+    {4096, 4, 4, 1, 256, 1, 16},
+    {0, 40, 20, 1, 256, 5, 120},
+    {1536, 20, 12, 1, 256, 3, 60},
+    {2560, 12, 4, 1, 256, 1, 36},
+    {3072, 4, 4, 1, 256, 1, 12},
+    {3584, 4, 4, 1, 256, 1, 12},
+    {4096, 4, 4, 1, 256, 1, 12},
+    {0, 37, 19, 1, 256, 19, 111},
+    {5120, 18, 9, 1, 256, 9, 54},
+    {7680, 9, 4, 1, 256, 4, 27},
+    {8704, 4, 2, 1, 256, 2, 12},
+    {9216, 2, 1, 1, 256, 1, 6},
+    {9728, 1, 1, 1, 256, 1, 3},
+    {0, 37, 19, 1, 256, 19, 148},
+    {5120, 18, 9, 1, 256, 9, 72},
+    {7680, 9, 4, 1, 256, 4, 36},
+    {8704, 4, 2, 1, 256, 2, 16},
+    {9216, 2, 1, 1, 256, 1, 8},
+    {9728, 1, 1, 1, 256, 1, 4},
+    {0, 37, 19, 1, 256, 19, 148},
+    {5120, 18, 9, 1, 256, 9, 72},
+    {7680, 9, 4, 1, 256, 4, 36},
+    {8704, 4, 2, 1, 256, 2, 16},
+    {9216, 2, 1, 1, 256, 1, 8},
+    {9728, 1, 1, 1, 256, 1, 4},
+    {0, 37, 19, 1, 512, 19, 296},
+    {9728, 18, 9, 1, 256, 9, 144},
+    {12288, 9, 4, 1, 256, 4, 72},
+    {13312, 4, 2, 1, 256, 2, 32},
+    {13824, 2, 1, 1, 256, 1, 16},
+    {14336, 1, 1, 1, 256, 1, 8},
+    {0, 37, 19, 1, 768, 19, 592},
+    {14848, 18, 9, 1, 512, 9, 288},
+    {19456, 9, 4, 1, 256, 4, 144},
+    {20480, 4, 2, 1, 256, 2, 64},
+    {20992, 2, 1, 1, 256, 1, 32},
+    {21504, 1, 1, 1, 256, 1, 16},
+    {0, 37, 19, 1, 256, 19, 148},
+    {5120, 18, 9, 1, 256, 9, 72},
+    {7680, 9, 4, 1, 256, 4, 36},
+    {8704, 4, 2, 1, 256, 2, 16},
+    {9216, 2, 1, 1, 256, 1, 8},
+    {9728, 1, 1, 1, 256, 1, 4},
+    {0, 256, 256, 1, 1024, 256, 1024},
+    {262144, 128, 128, 1, 512, 128, 512},
+    {327680, 64, 64, 1, 256, 64, 256},
+    {344064, 32, 32, 1, 256, 32, 128},
+    {352256, 16, 16, 1, 256, 16, 64},
+    {356352, 8, 8, 1, 256, 8, 32},
+    {358400, 4, 4, 1, 256, 4, 16},
+    {359424, 2, 2, 1, 256, 2, 8},
+    {359936, 1, 1, 1, 256, 1, 4},
+    {0, 64, 2, 1, 256, 2, 256},
+    {0, 65, 2, 1, 512, 2, 260},
+    {0, 4, 4, 1, 256, 1, 8},
+    {512, 4, 4, 1, 256, 1, 8},
+    {1024, 4, 4, 1, 256, 1, 8},
+    {0, 12, 8, 1, 256, 2, 48},
+    {0, 1024, 1024, 1, 2048, 256, 2048},
+    {8192, 32, 32, 1, 256, 32, 128},
+    {16384, 16, 16, 1, 256, 16, 64},
+    {20480, 8, 8, 1, 256, 8, 32},
+    {22528, 4, 4, 1, 256, 4, 16},
+    {23552, 2, 2, 1, 256, 2, 8},
+    {24064, 1, 1, 1, 256, 1, 4},
+    {0, 64, 32, 1, 256, 32, 256},
+    {8192, 32, 16, 1, 256, 16, 128},
+    {12288, 16, 8, 1, 256, 8, 64},
+    {14336, 64, 32, 1, 256, 32, 256},
+    {22528, 32, 16, 1, 256, 16, 128},
+    {26624, 16, 8, 1, 256, 8, 64},
+    {28672, 64, 32, 1, 256, 32, 256},
+    {36864, 32, 16, 1, 256, 16, 128},
+    {40960, 16, 8, 1, 256, 8, 64},
+    {43008, 64, 32, 1, 256, 32, 256},
+    {51200, 32, 16, 1, 256, 16, 128},
+    {55296, 16, 8, 1, 256, 8, 64},
+    {0, 16, 8, 1, 256, 8, 64},
+    {2048, 64, 32, 1, 256, 32, 256},
+    {10240, 32, 16, 1, 256, 16, 128},
+    {14336, 16, 8, 1, 256, 8, 64},
+    {0, 128, 128, 1, 512, 32, 512},
+    {16384, 64, 64, 1, 256, 16, 256},
+    {20480, 32, 32, 1, 256, 8, 128},
+    {22528, 16, 16, 1, 256, 4, 64},
+    {23552, 8, 8, 1, 256, 2, 32},
+    {24064, 4, 4, 1, 256, 1, 16},
+    {24576, 4, 4, 1, 256, 1, 16},
+    {25088, 4, 4, 1, 256, 1, 16},
+    {0, 300, 1, 1, 2560, 1, 2400},
+    {2560, 150, 1, 1, 1280, 1, 1200},
+    {4096, 75, 1, 1, 768, 1, 600},
+    {5120, 37, 1, 1, 512, 1, 296},
+    {5632, 18, 1, 1, 256, 1, 144},
+    {6144, 9, 1, 1, 256, 1, 72},
+    {6656, 4, 1, 1, 256, 1, 32},
+    {7168, 2, 1, 1, 256, 1, 16},
+    {7680, 1, 1, 1, 256, 1, 8},
+    {8192, 300, 1, 1, 2560, 1, 2400},
+    {10752, 150, 1, 1, 1280, 1, 1200},
+    {12288, 75, 1, 1, 768, 1, 600},
+    {13312, 37, 1, 1, 512, 1, 296},
+    {13824, 18, 1, 1, 256, 1, 144},
+    {14336, 9, 1, 1, 256, 1, 72},
+    {14848, 4, 1, 1, 256, 1, 32},
+    {15360, 2, 1, 1, 256, 1, 16},
+    {15872, 1, 1, 1, 256, 1, 8},
+    {0, 32, 16, 8, 256, 16, 128},
+    {32768, 16, 8, 4, 256, 8, 64},
+    {40960, 8, 4, 2, 256, 4, 32},
+    {43008, 4, 2, 1, 256, 2, 16},
+    {43520, 2, 1, 1, 256, 1, 8},
+    {44032, 1, 1, 1, 256, 1, 4},
+    {0, 16, 16, 4, 256, 4, 32},
+    {0, 1000, 1, 1, 1024, 1, 1000},
+    {512, 65536, 1, 1, 65536, 1, 65536},
+};
+
+static footprint_desc_t desc_of(const layout_case_t& c)
+{
+    if (c.dimension == FOOTPRINT_BUFFER)
+        return footprint_buffer(c.width);
+    footprint_desc_t d = footprint_tex2d(c.format, c.width, c.height, c.mips, c.depth_or_array);
+    d.dimension = c.dimension;
+    return d;
+}
+
+static void reference_table()
+{
+    const uint32_t count = sizeof(cases) / sizeof(cases[0]);
+    for (uint32_t i = 0; i < count; i ++) {
+        const layout_case_t& c = cases[i];
+        const footprint_desc_t d = desc_of(c);
+        subresource_footprint_t out[32] = {};
+        const uint64_t total = footprint_layout(d, c.first, c.n, c.base, out);
+        if (total != c.total)
+            fprintf(stderr, "case: %s\n", c.name);
+        CHECK_EQ(total, c.total);
+        CHECK_EQ(footprint_layout(d, c.first, c.n, c.base, nullptr), c.total);
+        for (uint32_t s = 0; s < c.n; s ++) {
+            const subresource_footprint_t& e = expected[c.expected + s];
+            const subresource_footprint_t& f = out[s];
+            if (f.offset != e.offset || f.width != e.width || f.height != e.height || f.depth != e.depth ||
+                f.row_pitch != e.row_pitch || f.rows != e.rows || f.row_bytes != e.row_bytes)
+                fprintf(stderr, "case: %s subresource:%u\n", c.name, c.first + s);
+            CHECK_EQ(f.offset, e.offset);
+            CHECK_EQ(f.width, e.width);
+            CHECK_EQ(f.height, e.height);
+            CHECK_EQ(f.depth, e.depth);
+            CHECK_EQ(f.row_pitch, e.row_pitch);
+            CHECK_EQ(f.rows, e.rows);
+            CHECK_EQ(f.row_bytes, e.row_bytes);
+            /* 規則そのもの */
+            CHECK_EQ(f.row_pitch % FOOTPRINT_PITCH_ALIGNMENT, 0);
+            CHECK_EQ((f.offset - c.base) % FOOTPRINT_PLACEMENT_ALIGNMENT, 0);
+            CHECK(f.row_bytes <= f.row_pitch);
+        }
+        /* 最後の subresource の最後の行で終わる (パディングは含まない) */
+        const subresource_footprint_t& last = out[c.n - 1];
+        CHECK_EQ(c.base + total, last.offset + static_cast< uint64_t >(last.row_pitch) * (static_cast< uint64_t >(last.rows) * last.depth - 1) + last.row_bytes);
+    }
+}
+
+/* subresource の数と、 範囲外やおかしな desc は D3D12 と同じく UINT64_MAX */
+static void subresources_and_errors()
+{
+    CHECK_EQ(footprint_mips(footprint_tex2d(RAWD_FORMAT_RGBA8, 256, 256, 0)), 9);
+    CHECK_EQ(footprint_mips(footprint_tex2d(RAWD_FORMAT_RGBA8, 1, 1, 0)), 1);
+    CHECK_EQ(footprint_mips(footprint_tex2d(RAWD_FORMAT_BC1, 37, 19, 0)), 6);
+    CHECK_EQ(footprint_subresources(footprint_tex2d(RAWD_FORMAT_RGBA8, 64, 32, 3, 4)), 12);
+    footprint_desc_t vol = footprint_tex2d(RAWD_FORMAT_RGBA8, 32, 16, 0, 8);
+    vol.dimension = FOOTPRINT_TEXTURE3D;
+    CHECK_EQ(footprint_subresources(vol), 6); /* 3D は depth で分けない */
+    CHECK_EQ(footprint_subresources(footprint_buffer(100)), 1);
+
+    const uint64_t INVALID = ~0ULL;
+    const footprint_desc_t d = footprint_tex2d(RAWD_FORMAT_RGBA8, 64, 32, 3, 4);
+    CHECK_EQ(footprint_layout(d, 12, 1, 0, nullptr), INVALID);
+    CHECK_EQ(footprint_layout(d, 11, 2, 0, nullptr), INVALID);
+    CHECK_EQ(footprint_layout(d, 0, 13, 0, nullptr), INVALID);
+    footprint_desc_t bad = d;
+    bad.width = 0;
+    CHECK_EQ(footprint_layout(bad, 0, 1, 0, nullptr), INVALID);
+    bad = d;
+    bad.height = 0;
+    CHECK_EQ(footprint_layout(bad, 0, 1, 0, nullptr), INVALID);
+    bad = d;
+    bad.block_bytes = 0;
+    CHECK_EQ(footprint_layout(bad, 0, 1, 0, nullptr), INVALID);
+    bad = d;
+    bad.dimension = 4;
+    CHECK_EQ(footprint_layout(bad, 0, 1, 0, nullptr), INVALID);
+    CHECK_EQ(footprint_layout(footprint_buffer(100), 1, 1, 0, nullptr), INVALID);
+}
+
+/* 全部の形式と、 幅と高さを 1 から 70 まで振って、 行と配置の規則と total を確かめる */
+static void exhaustive_rules()
+{
+    for (uint32_t format = RAWD_FORMAT_RGBA8; format <= RAWD_FORMAT_RGB10A2; format ++) {
+        const uint32_t dim = rawd_block_dim(format);
+        const uint32_t bytes = format == RAWD_FORMAT_RGBA8 ? 4 : rawd_format_bytes(format);
+        for (uint32_t w = 1; w <= 70; w ++) {
+            for (uint32_t h = 1; h <= 70; h += 3) {
+                const footprint_desc_t d = footprint_tex2d(format, w, h, 0);
+                const uint32_t mips = footprint_mips(d);
+                subresource_footprint_t out[8];
+                const uint64_t total = footprint_layout(d, 0, mips, 0, out);
+                uint64_t end = 0;
+                for (uint32_t m = 0; m < mips; m ++) {
+                    const uint32_t mw = w >> m ? w >> m : 1;
+                    const uint32_t mh = h >> m ? h >> m : 1;
+                    const uint32_t bw = (mw + dim - 1) / dim;
+                    const uint32_t bh = (mh + dim - 1) / dim;
+                    const uint64_t offset = m ? (end + FOOTPRINT_PLACEMENT_ALIGNMENT - 1) / FOOTPRINT_PLACEMENT_ALIGNMENT * FOOTPRINT_PLACEMENT_ALIGNMENT : 0;
+                    const uint64_t row = static_cast< uint64_t >(bw) * bytes;
+                    const uint64_t pitch = (row + FOOTPRINT_PITCH_ALIGNMENT - 1) / FOOTPRINT_PITCH_ALIGNMENT * FOOTPRINT_PITCH_ALIGNMENT;
+                    CHECK_EQ(out[m].offset, offset);
+                    CHECK_EQ(out[m].width, bw * dim);
+                    CHECK_EQ(out[m].height, bh * dim);
+                    CHECK_EQ(out[m].rows, bh);
+                    CHECK_EQ(out[m].row_bytes, row);
+                    CHECK_EQ(out[m].row_pitch, pitch);
+                    end = offset + pitch * (bh - 1) + row;
+                }
+                CHECK_EQ(total, end);
+                if (check_failures())
+                    return; /* 同じ失敗を何千回も出さない */
+            }
+        }
+    }
+}
+
+int main()
+{
+    reference_table();
+    subresources_and_errors();
+    exhaustive_rules();
+    return check_result();
+}
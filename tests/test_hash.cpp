@@ -0,0 +1,52 @@
+/**
+ * (C) roentgen 
+ * this code is licensed under the MIT License.
+ */
+#include "hash.hpp"
+#include "check.hpp"
+#include <algorithm>
+#include <vector>
+
+/* xxh64() が本家の XXH64 と同じ値を返すか. 値は python-xxhash (pip install xxhash) の
+   xxhash.xxh64_intdigest(data[:size], seed) で、 data は main() と同じ i * 131 + 7 の列.
+   長さは 32 byte の stripe, 8/4/1 byte の端の処理の境目を全部通るように選んである */
+struct vector_t {
+    size_t size;
+    uint64_t seed0;
+    uint64_t seed1; /* seed = 0x9e3779b97f4a7c15 */
+};
+
+static const vector_t vectors[] = {
+    {0, 0xef46db3751d8e999ull, 0xc4349fc93c010000ull},
+    {1, 0xa96c7f0ce858bbb7ull, 0x585882422a6165e7ull},
+    {3, 0xbed43740ee6332bbull, 0x45fa1406538fa168ull},
+    {4, 0xfa212ae44b3bb23dull, 0xa65107f22943365aull},
+    {7, 0x2744460dd675d2c0ull, 0xc9b637e2c4599de2ull},
+    {8, 0x994b676b71ce94ddull, 0xce592d5f53e192ecull},
+    {15, 0x09e6451ed2ff8b1dull, 0x47a857d1f90c35e1ull},
+    {16, 0x94ad0095e72b24d5ull, 0x3f8fea7c86a04013ull},
+    {31, 0x6711d55e306b5d8full, 0x24c4e99ab0404b5eull},
+    {32, 0x07f7b8e3bc5d6e25ull, 0x046e99bbda1a814bull},
+    {33, 0x09f85eeb4e1cbe9full, 0xd7fe2bfee6e4cdedull},
+    {63, 0xb7c9968c066cb6a5ull, 0xbd457f9ea47180c8ull},
+    {64, 0x50d4159a0411632eull, 0xa768f350a8e4fcf6ull},
+    {100, 0x9ddada11d3dc2d8full, 0x35546bd9a4779ae4ull},
+    {1000, 0x0bf0bdbcc82eb373ull, 0x3ecb5d7b5e7c64cfull},
+    {4096, 0xcf05adf75aca30cfull, 0x1ed4fa0c97932cbfull},
+};
+
+int main()
+{
+    std::vector< uint8_t > data(4096 + 1);
+    for (size_t i = 0; i < data.size(); i ++)
+        data[i] = static_cast< uint8_t >(i * 131 + 7);
+    for (const vector_t& v : vectors) {
+        CHECK_EQ(xxh64(data.data(), v.size), v.seed0);
+        CHECK_EQ(xxh64(data.data(), v.size, 0x9e3779b97f4a7c15ull), v.seed1);
+        /* 先頭が揃っていなくても同じ */
+        std::vector< uint8_t > shifted(v.size + 1);
+        std::copy(data.begin(), data.begin() + v.size, shifted.begin() + 1);
+        CHECK_EQ(xxh64(shifted.data() + 1, v.size), v.seed0);
+    }
+    return check_result();
+}
@@ -0,0 +1,156 @@
+/**
+ * (C) roentgen 
+ * this code is licensed under the MIT License.
+ */
+#include "heapalloc.hpp"
+#include "check.hpp"
+#include <iterator>
+#include <map>
+#include <random>
+#include <vector>
+
+/* 区間が重ならず、 揃っていて、 capacity に収まっているか. 全部 free したら区間ひとつに戻るか */
+static void random_alloc_free()
+{
+    std::mt19937_64 rng(1);
+    for (int round = 0; round < 20; round ++) {
+        tlsf_allocator_t t;
+        const uint64_t capacity = (64ull << 20) + round * 4096 * 7;
+        t.reset(capacity);
+        struct live_t {
+            uint64_t offset;
+            uint64_t size;
+            uint32_t handle;
+        };
+        std::vector< live_t > live;
+        std::map< uint64_t, uint64_t > used; /* offset -> size */
+        for (int i = 0; i < 20000; i ++) {
+            if (live.empty() || rng() % 100 < 55) {
+                const uint64_t size = (rng() % 4 == 0) ? rng() % (4 << 20) + 1 : rng() % 200000 + 1;
+                uint64_t align = (rng() % 3 == 0) ? 65536 : (rng() % 2) ? 4096 : 256;
+                if (rng() % 50 == 0)
+                    align = 4 << 20;
+                uint64_t offset;
+                uint32_t handle;
+                if (!t.alloc(size, align, offset, handle))
+                    continue;
+                CHECK_EQ(offset % align, 0);
+                CHECK(offset + size <= capacity);
+                auto next = used.upper_bound(offset);
+                if (next != used.end())
+                    CHECK(offset + size <= next->first);
+                if (next != used.begin()) {
+                    auto prev = std::prev(next);
+                    CHECK(prev->first + prev->second <= offset);
+                }
+                used[offset] = size;
+                live.push_back({offset, size, handle});
+            }
+            else {
+                const size_t k = rng() % live.size();
+                t.free(live[k].handle);
+                used.erase(live[k].offset);
+                live[k] = live.back();
+                live.pop_back();
+            }
+            CHECK_EQ(t.allocations(), live.size());
+        }
+        for (auto& a : live)
+            t.free(a.handle);
+        CHECK_EQ(t.used(), 0);
+        CHECK_EQ(t.allocations(), 0);
+        CHECK_EQ(t.largest_free(), t.capacity());
+    }
+}
+
+/* 隣り合う空きは順序によらずつながる */
+static void coalesce()
+{
+    tlsf_allocator_t t;
+    t.reset(1 << 20);
+    uint64_t offset[4];
+    uint32_t handle[4];
+    for (int i = 0; i < 4; i ++)
+        CHECK(t.alloc(256 << 10, 256, offset[i], handle[i]));
+    CHECK_EQ(t.largest_free(), 0);
+    t.free(handle[1]);
+    t.free(handle[3]);
+    CHECK_EQ(t.largest_free(), 256 << 10);
+    t.free(handle[2]); /* 1, 2, 3 がつながる */
+    CHECK_EQ(t.largest_free(), 768 << 10);
+    uint64_t o;
+    uint32_t h;
+    CHECK(t.alloc(768 << 10, 256, o, h));
+    CHECK_EQ(o, offset[1]);
+    t.free(h);
+    t.free(handle[0]);
+    CHECK_EQ(t.largest_free(), 1 << 20);
+}
+
+static void exhaust_and_align()
+{
+    tlsf_allocator_t t;
+    t.reset(1 << 20);
+    uint64_t offset;
+    uint32_t handle;
+    int n = 0;
+    while (t.alloc(65536, 65536, offset, handle))
+        n ++;
+    CHECK_EQ(n, 16); /* 64KB の block がちょうど 16 個入る */
+    CHECK_EQ(t.used(), 1 << 20);
+
+    /* 大きさと offset は GRANULE に揃う. 中途半端な capacity は切り捨て */
+    t.reset((1 << 20) + 100);
+    CHECK_EQ(t.capacity(), 1 << 20);
+    CHECK(t.alloc(1, 1, offset, handle));
+    CHECK_EQ(offset % tlsf_allocator_t::GRANULE, 0);
+    CHECK_EQ(t.used(), tlsf_allocator_t::GRANULE);
+    t.free(handle);
+    t.free(handle); /* 二重の free は無視する */
+    CHECK_EQ(t.used(), 0);
+    CHECK_EQ(t.allocations(), 0);
+
+    CHECK(!t.alloc((1 << 20) + 1, 256, offset, handle));
+}
+
+static void suballocator()
+{
+    heap_suballocator_t s(3);
+    CHECK_EQ(s.categories(), 3);
+    heap_allocation_t a;
+    CHECK(!s.alloc(1, 100, 256, a)); /* block が無い */
+    CHECK_EQ(s.add_block(1, 1 << 20), 0);
+    CHECK(s.alloc(1, 100, 4096, a));
+    CHECK_EQ(a.category, 1);
+    CHECK_EQ(a.block, 0);
+    CHECK_EQ(s.blocks(0), 0);
+
+    /* 埋まったら次の block へ. 前の block が空けば先にそちらを使う */
+    heap_allocation_t big;
+    CHECK(!s.alloc(1, 1 << 20, 65536, big));
+    CHECK_EQ(s.add_block(1, 1 << 20), 1);
+    CHECK(s.alloc(1, 1 << 20, 65536, big));
+    CHECK_EQ(big.block, 1);
+    s.free(a);
+    heap_allocation_t again;
+    CHECK(s.alloc(1, 4096, 4096, again));
+    CHECK_EQ(again.block, 0);
+    CHECK_EQ(s.block(1, 1).used(), 1 << 20);
+    s.free(big);
+    s.free(again);
+    CHECK_EQ(s.block(1, 0).used(), 0);
+    CHECK_EQ(s.block(1, 1).used(), 0);
+
+    s.reset(2);
+    CHECK_EQ(s.categories(), 2);
+    CHECK_EQ(s.blocks(1), 0);
+}
+
+int main()
+{
+    random_alloc_free();
+    coalesce();
+    exhaust_and_align();
+    suballocator();
+    return check_result();
+}
@@ -0,0 +1,607 @@
+/**
+ * (C) roentgen 
+ * this code is licensed under the MIT License.
+ */
+/* assetcook: アセットディレクトリを舐めて RAWD (と RAWA アーカイブ) を作る.
+
+   usage: assetcook [-j N] [--force] [--archive] [--mips] [--mip-filter box|kaiser] [--srgb]
+                    [--format rgba8|bc1|bc3|bc7|universal] [--quality 0-2] [--compress] <srcdir> <outdir>
+
+   入力は
+     *.rawdata          既存の RAWD (header.pl 製). header を正規化して書き直す
+     <name>_<w>x<h>.raw header の無い RGBA8 の生データ
+     *.png              RGBA8 に展開して cook する (同じ名前の .rawdata があればそちらを使う)
+   出力は <outdir>/<name>.rawdata. --archive を付けると <outdir>/textures.rawa もまとめて作る.
+   --mips は archive に 1x1 までの mip chain を入れる. --srgb なら線形空間で縮小する.
+   --format で BCn に圧縮する (mip は RGBA8 のまま作ってから level ごとに圧縮する). --quality は 0 が速く 2 が丁寧.
+   BCn は level 0 の幅と高さが 4 の倍数でなければならないので、そうでないものは RGBA8 のまま書く.
+   universal は load 時に device に合わせて BC7/BC1/RGBA8 に変換する中間形式 (--compress と組み合わせる想定).
+   --compress を付けると .rawdata の pixel 列を block 圧縮 (lzblock) で書く. archive は非圧縮のまま.
+   .rawdata は v1.2, archive は v1.1 で書き、どちらも payload の checksum を入れる (load 時に照合する).
+
+   入力の中身のハッシュを <outdir>/.assetcook に覚えておき、変わっていないものは再 cook しない.
+   入力が消えたものは出力の .rawdata も消す. archive に入れたもののハッシュは <outdir>/.assetcook-archive に覚えておき、
+   その集合が変わった時だけ archive を作り直す. 作り直す時も、今回 cook したものはその時の level を、
+   変わっていないものは前の archive の payload をそのまま使い、 encode し直さない.
+   ファイル単位で独立しているので全コアに配って並列に処理する */
+#include "rawd.hpp"
+#include "archive.hpp"
+#include "footprint.hpp"
+#include "lzblock.hpp"
+#include "mipgen.hpp"
+#include "bcenc.hpp"
+#include <stdio.h>
+#include <stdlib.h>
+#include <string.h>
+#include <algorithm>
+#include <atomic>
+#include <chrono>
+#include <filesystem>
+#include <fstream>
+#include <map>
+#include <mutex>
+#include <set>
+#include <string>
+#include <thread>
+#include <vector>
+
+namespace fs = std::filesystem;
+
+namespace {
+
+const char* CACHE_NAME = ".assetcook";
+const char* ARCHIVE_NAME = "textures.rawa";
+const char* ARCHIVE_CACHE_NAME = ".assetcook-archive";
+
+/* encoder (bcenc, mipgen, lzblock) や出力の書き方を変えたら上げる. 上がると cache は全部無効になる */
+const int TOOL_VERSION = 2;
+
+const char* format_name(uint32_t format)
+{
+    switch (format) {
+    case RAWD_FORMAT_BC1: return "bc1";
+    case RAWD_FORMAT_BC3: return "bc3";
+    case RAWD_FORMAT_BC7: return "bc7";
+    case RAWD_FORMAT_UNIVERSAL: return "universal";
+    default: return "rgba8";
+    }
+}
+
+struct cook_options_t {
+    unsigned jobs = 0;
+    bool force = false;
+    bool archive = false;
+    bool mips = false;
+    mip_filter_t filter = MIP_FILTER_BOX;
+    bool srgb = false;
+    uint32_t format = RAWD_FORMAT_RGBA8;
+    int quality = BC_QUALITY_NORMAL;
+    bool compress = false;
+
+    /* 出力に影響するオプション. これが変わったら全部作り直す */
+    std::string signature() const
+    {
+        std::string s = "v" + std::to_string(TOOL_VERSION);
+        if (mips) {
+            s += (filter == MIP_FILTER_KAISER) ? " mips:kaiser" : " mips:box";
+            if (srgb)
+                s += " srgb";
+        }
+        if (format != RAWD_FORMAT_RGBA8)
+            s += " " + std::string(format_name(format)) + ":q" + std::to_string(quality);
+        if (compress)
+            s += " lz";
+        return s;
+    }
+};
+
+struct asset_t {
+    fs::path src;
+    fs::path dst;
+    std::string key;     /* archive の名前 (stem) */
+    uint64_t hash = 0;   /* 入力の中身のハッシュ */
+    bool dirty = false;
+    int err = 0;
+    uint32_t width = 0;
+    uint32_t height = 0;
+    double ms = 0.0;
+    /* --archive の時に cook した level (mip chain を圧縮したもの). archive を書くまで持っておく */
+    std::vector< std::vector< uint8_t > > bufs;
+    std::vector< pixel_view_t > levels;
+};
+
+double elapsed_ms(std::chrono::steady_clock::time_point t0)
+{
+    return std::chrono::duration< double, std::milli >(std::chrono::steady_clock::now() - t0).count();
+}
+
+/* FNV-1a (64bit). 変更検出にしか使わないので暗号学的な強さは要らない */
+uint64_t hash_bytes(const uint8_t* p, size_t size)
+{
+    uint64_t h = 0xcbf29ce484222325ULL;
+    for (size_t i = 0; i < size; i ++) {
+        h ^= p[i];
+        h *= 0x100000001b3ULL;
+    }
+    return h;
+}
+
+/* "<name>_<w>x<h>" を分解する */
+bool parse_raw_name(const std::string& stem, std::string& name, uint32_t& w, uint32_t& h)
+{
+    size_t us = stem.rfind('_');
+    if (us == std::string::npos)
+        return false;
+    unsigned int x = 0, y = 0;
+    char tail = 0;
+    if (sscanf(stem.c_str() + us + 1, "%ux%u%c", &x, &y, &tail) != 2 || !x || !y)
+        return false;
+    name = stem.substr(0, us);
+    w = x;
+    h = y;
+    return true;
+}
+
+/* 入力のパスから archive の名前を決める. 扱わない拡張子と名前の付け方が違う .raw は false */
+bool asset_key(const fs::path& p, std::string& key)
+{
+    if (p.extension() == ".rawdata" || p.extension() == ".png") {
+        key = p.stem().string();
+        return true;
+    }
+    uint32_t w, h;
+    return p.extension() == ".raw" && parse_raw_name(p.stem().string(), key, w, h);
+}
+
+/* 圧縮する時の block の大きさの目安. 展開側で block ごとに並列に処理できるよう小さめに */
+const size_t LZ_BLOCK_BYTES = 64 * 1024;
+
+/* v1.1: 行を 256 byte (D3D12 の RowPitch の境界) に揃えてから block ごとに圧縮する.
+   pitch が upload heap の RowPitch と一致するので、 runtime は staging に直接展開できる */
+void compress_blocks(const pixel_view_t& v, rawd_ext_t& ext, std::vector< uint32_t >& csize, std::vector< uint8_t >& payload)
+{
+    const size_t row = rawd_row_bytes(v);
+    const uint32_t rows = rawd_rows(v);
+    ext = rawd_ext_t();
+    ext.size = sizeof(ext);
+    ext.flags = RAWD_FLAG_LZ;
+    ext.pitch = footprint_row_pitch(row);
+    ext.block_rows = std::max< uint32_t >(1, static_cast< uint32_t >(LZ_BLOCK_BYTES / ext.pitch));
+    ext.blocks = (rows + ext.block_rows - 1) / ext.block_rows;
+
+    pixel_view_t padded = v;
+    padded.pitch = ext.pitch;
+    std::vector< uint8_t > raw(rawd_payload_bytes(padded), 0);
+    for (uint32_t y = 0; y < rows; y ++)
+        memcpy(&raw[padded.pitch * y], v.data + v.pitch * y, row);
+
+    std::vector< uint8_t > tmp;
+    for (uint32_t i = 0; i < ext.blocks; i ++) {
+        const size_t begin = padded.pitch * ext.block_rows * i;
+        const size_t bytes = std::min< size_t >(raw.size(), begin + padded.pitch * ext.block_rows) - begin;
+        tmp.resize(lz_compress_bound(bytes));
+        size_t n = lz_compress(&raw[begin], bytes, tmp.data(), tmp.size());
+        if (!n || n >= bytes) {
+            /* 縮まなければそのまま入れる (csize == 展開後の大きさ) */
+            payload.insert(payload.end(), raw.begin() + begin, raw.begin() + begin + bytes);
+            csize.push_back(static_cast< uint32_t >(bytes));
+        }
+        else {
+            payload.insert(payload.end(), tmp.begin(), tmp.begin() + n);
+            csize.push_back(static_cast< uint32_t >(n));
+        }
+    }
+    ext.payload_bytes = payload.size();
+}
+
+/* 常に v1.2 (rawd_ext_t 付き) で書き、 payload (block 表 + 圧縮 payload か dense な pixel 列) の checksum を header に入れる */
+int write_rawd(const fs::path& fname, const pixel_view_t& v, const std::string& note, bool compress)
+{
+    /* note は header.pl と同じく 16 byte 境界まで 0 で埋める. 日付は入れない (再現性のため) */
+    const uint32_t notelen = align_up(static_cast< uint32_t >(note.size()), 16);
+    const size_t row = rawd_row_bytes(v);
+    const uint32_t rows = rawd_rows(v);
+
+    rawd_ext_t ext;
+    std::vector< uint8_t > payload;
+    if (compress) {
+        std::vector< uint32_t > csize;
+        std::vector< uint8_t > blocks;
+        compress_blocks(v, ext, csize, blocks);
+        payload.resize(csize.size() * sizeof(uint32_t));
+        memcpy(payload.data(), csize.data(), payload.size());
+        payload.insert(payload.end(), blocks.begin(), blocks.end());
+    }
+    else {
+        ext = rawd_ext_t();
+        ext.size = sizeof(ext);
+        ext.pitch = static_cast< uint32_t >(row);
+        payload.resize(row * rows);
+        for (uint32_t y = 0; y < rows; y ++)
+            memcpy(&payload[row * y], v.data + v.pitch * y, row);
+        ext.payload_bytes = payload.size();
+    }
+    rawd_header_t head = {{'R', 'A', 'W', 'D'}, 1, 2, rawd_checksum(payload.data(), payload.size()), v.width, v.height, v.format, v.bpp, notelen};
+
+    std::ofstream out(fname, std::ios::binary | std::ios::trunc);
+    if (!out)
+        return RAWD_ERR_OPEN;
+    out.write(reinterpret_cast< const char* >(&head), sizeof(head));
+    std::vector< char > padded(notelen, 0);
+    memcpy(padded.data(), note.data(), note.size());
+    out.write(padded.data(), padded.size());
+    out.write(reinterpret_cast< const char* >(&ext), sizeof(ext));
+    out.write(reinterpret_cast< const char* >(payload.data()), payload.size());
+    return out ? 0 : RAWD_ERR_OPEN;
+}
+
+/* 入力を map して pixel の view を作る. 圧縮された RAWD と PNG は展開する */
+struct source_t {
+    mapped_file_t file;
+    rawd_image_t img;
+    std::vector< uint8_t > decoded;
+    pixel_view_t view = {};
+};
+
+int load_source(const asset_t& a, source_t& s)
+{
+    if (a.src.extension() == ".rawdata" || a.src.extension() == ".png") {
+        int err = s.img.open(a.src.wstring());
+        if (err == 0)
+            err = s.img.verify();
+        if (err == 0)
+            err = s.img.decode(s.decoded, s.view);
+        return err;
+    }
+    int err = s.file.open(a.src.wstring());
+    if (err < 0)
+        return err;
+    std::string name;
+    pixel_view_t& view = s.view;
+    if (!parse_raw_name(a.src.stem().string(), name, view.width, view.height))
+        return RAWD_ERR_HEADER;
+    view.bpp = 4;
+    view.pitch = static_cast< size_t >(view.width) * view.bpp;
+    if (s.file.size() < view.pitch * view.height)
+        return RAWD_ERR_TRUNCATED;
+    view.data = s.file.data();
+    return 0;
+}
+
+/* RGBA8 の level を opt.format に圧縮する. BCn にできないもの (既に圧縮済み, 4 の倍数でない) はそのまま */
+int encode_level(const pixel_view_t& base, const pixel_view_t& src, const cook_options_t& opt, worker_pool_t* pool, std::vector< uint8_t >& buf, pixel_view_t& dst)
+{
+    dst = src;
+    if (opt.format == RAWD_FORMAT_RGBA8 || src.format != RAWD_FORMAT_RGBA8 || src.bpp != 4)
+        return 0;
+    if (rawd_is_bc(opt.format) && ((base.width & 3) || (base.height & 3)))
+        return 0;
+    return bc_encode(src, opt.format, opt.quality, buf, dst, pool);
+}
+
+/* archive に入れる level を作る. mip は RGBA8 の入力から作り、 level ごとに圧縮する.
+   s が無くなっても使えるよう、 圧縮しなかった level も bufs に詰めてコピーしておく */
+int archive_levels(const source_t& s, const cook_options_t& opt, worker_pool_t* pool, std::vector< std::vector< uint8_t > >& bufs, std::vector< pixel_view_t >& levels)
+{
+    mip_chain_t chain;
+    chain.levels.assign(1, s.view);
+    if (opt.mips && s.view.bpp == 4 && s.view.format == RAWD_FORMAT_RGBA8)
+        generate_mips(s.view, opt.filter, opt.srgb, chain);
+    bufs.assign(chain.levels.size(), std::vector< uint8_t >());
+    levels.resize(chain.levels.size());
+    for (size_t i = 0; i < levels.size(); i ++) {
+        int err = encode_level(s.view, chain.levels[i], opt, pool, bufs[i], levels[i]);
+        if (err < 0)
+            return err;
+        pixel_view_t& v = levels[i];
+        if (!bufs[i].empty() && v.data == bufs[i].data())
+            continue;
+        const size_t row = rawd_row_bytes(v);
+        const uint32_t rows = rawd_rows(v);
+        bufs[i].resize(row * rows);
+        for (uint32_t y = 0; y < rows; y ++)
+            memcpy(&bufs[i][row * y], v.data + v.pitch * y, row);
+        v.data = bufs[i].data();
+        v.pitch = row;
+    }
+    return 0;
+}
+
+/* 1 ファイルを cook する. 入力は map して読むのでコピーは出力時の一回だけ.
+   --archive の時は archive の level もここで作り、 level 0 は .rawdata と共有する */
+int cook_asset(asset_t& a, const cook_options_t& opt, worker_pool_t* pool)
+{
+    source_t s;
+    int err = load_source(a, s);
+    if (err < 0)
+        return err;
+    a.width = s.view.width;
+    a.height = s.view.height;
+    std::vector< uint8_t > buf;
+    pixel_view_t out;
+    if (opt.archive) {
+        err = archive_levels(s, opt, pool, a.bufs, a.levels);
+        if (err == 0)
+            out = a.levels[0];
+    }
+    else {
+        err = encode_level(s.view, s.view, opt, pool, buf, out);
+    }
+    if (err < 0)
+        return err;
+    if (out.format != opt.format)
+        fprintf(stderr, "  %s: kept as %s (%ux%u)\n", a.key.c_str(), format_name(out.format), out.width, out.height);
+    return write_rawd(a.dst, out, "assetcook " + a.src.filename().string(), opt.compress);
+}
+
+/* level は cook した時のもの, 無ければ前の archive の entry (入力のハッシュが archived と同じ時だけ) を使う.
+   どちらにも無いものだけ読み直して encode する */
+int build_archive(const std::vector< asset_t >& assets, const cook_options_t& opt, const fs::path& fname, bool reuse, const std::map< std::string, uint64_t >& archived, worker_pool_t* pool)
+{
+    rawd_archive_writer_t writer;
+    {
+        /* 前の archive. add() が payload をコピーするので、 上書きする前に閉じる */
+        rawd_archive_t old;
+        if (reuse && old.open(fname.wstring()) < 0)
+            reuse = false;
+        for (auto& a : assets) {
+            if (a.err < 0)
+                continue;
+            std::vector< pixel_view_t > levels = a.levels;
+            std::vector< std::vector< uint8_t > > bufs;
+            if (levels.empty()) {
+                auto it = archived.find(a.key);
+                const rawa_entry_t* e = (reuse && it != archived.end() && it->second == a.hash) ? old.find(rawa_name_hash(a.key.c_str())) : nullptr;
+                if (e) {
+                    levels.resize(e->mips);
+                    for (uint32_t i = 0; i < e->mips; i ++)
+                        old.view(e, i, levels[i]);
+                }
+                else {
+                    source_t s;
+                    if (load_source(a, s) < 0 || archive_levels(s, opt, pool, bufs, levels) < 0) {
+                        fprintf(stderr, "archive: could not read %s\n", a.src.string().c_str());
+                        return -1;
+                    }
+                }
+            }
+            if (writer.add(a.key, levels.data(), static_cast< uint32_t >(levels.size())) < 0) {
+                fprintf(stderr, "archive: could not add %s (duplicated name?)\n", a.key.c_str());
+                return -1;
+            }
+        }
+    }
+    return writer.write(fname.wstring());
+}
+
+/* cache: 1 行目がオプション, 以降 "<hash> <名前>".
+   名前は .assetcook では入力の相対パス, .assetcook-archive では archive の key */
+void load_cache(const fs::path& fname, std::string& sig, std::map< std::string, uint64_t >& hashes)
+{
+    std::ifstream in(fname);
+    std::string line;
+    if (!std::getline(in, sig))
+        return;
+    while (std::getline(in, line)) {
+        size_t sp = line.find(' ');
+        if (sp == std::string::npos)
+            continue;
+        hashes[line.substr(sp + 1)] = strtoull(line.substr(0, sp).c_str(), nullptr, 16);
+    }
+}
+
+void save_cache(const fs::path& fname, const std::string& sig, const std::map< std::string, uint64_t >& hashes)
+{
+    std::ofstream out(fname, std::ios::trunc);
+    out << sig << "\n";
+    for (auto& h : hashes) {
+        char hex[17];
+        snprintf(hex, sizeof(hex), "%016llx", static_cast< unsigned long long >(h.second));
+        out << hex << " " << h.first << "\n";
+    }
+}
+
+void usage()
+{
+    fprintf(stderr, "usage: assetcook [-j N] [--force] [--archive] [--mips] [--mip-filter box|kaiser] [--srgb]\n"
+                    "                 [--format rgba8|bc1|bc3|bc7|universal] [--quality 0-2] [--compress] <srcdir> <outdir>\n");
+}
+
+} /* namespace */
+
+int main(int argc, char** argv)
+{
+    cook_options_t opt;
+    std::vector< std::string > args;
+    for (int i = 1; i < argc; i ++) {
+        std::string a(argv[i]);
+        if (a == "-j" && i + 1 < argc)
+            opt.jobs = static_cast< unsigned >(atoi(argv[++ i]));
+        else if (a == "--force")
+            opt.force = true;
+        else if (a == "--archive")
+            opt.archive = true;
+        else if (a == "--mips")
+            opt.mips = true;
+        else if (a == "--mip-filter" && i + 1 < argc) {
+            const std::string f(argv[++ i]);
+            if (f == "box")
+                opt.filter = MIP_FILTER_BOX;
+            else if (f == "kaiser")
+                opt.filter = MIP_FILTER_KAISER;
+            else {
+                usage();
+                return 2;
+            }
+        }
+        else if (a == "--srgb")
+            opt.srgb = true;
+        else if (a == "--format" && i + 1 < argc) {
+            const std::string f(argv[++ i]);
+            if (f == "rgba8")
+                opt.format = RAWD_FORMAT_RGBA8;
+            else if (f == "bc1")
+                opt.format = RAWD_FORMAT_BC1;
+            else if (f == "bc3")
+                opt.format = RAWD_FORMAT_BC3;
+            else if (f == "bc7")
+                opt.format = RAWD_FORMAT_BC7;
+            else if (f == "universal")
+                opt.format = RAWD_FORMAT_UNIVERSAL;
+            else {
+                usage();
+                return 2;
+            }
+        }
+        else if (a == "--quality" && i + 1 < argc)
+            opt.quality = std::min(std::max(atoi(argv[++ i]), BC_QUALITY_FAST), BC_QUALITY_SLOW);
+        else if (a == "--compress")
+            opt.compress = true;
+        else if (!a.empty() && a[0] == '-') {
+            usage();
+            return 2;
+        }
+        else
+            args.push_back(a);
+    }
+    if (args.size() != 2) {
+        usage();
+        return 2;
+    }
+    if (!opt.jobs)
+        opt.jobs = std::max(1u, std::thread::hardware_concurrency());
+
+    const fs::path srcdir(args[0]);
+    const fs::path outdir(args[1]);
+    std::error_code ec;
+    fs::create_directories(outdir, ec);
+    if (ec) {
+        fprintf(stderr, "could not create %s: %s\n", outdir.string().c_str(), ec.message().c_str());
+        return 1;
+    }
+
+    const auto t0 = std::chrono::steady_clock::now();
+
+    /* 入力を集める. 順序は出力を決定的にするためパスでソートする */
+    std::vector< asset_t > assets;
+    for (auto& e : fs::recursive_directory_iterator(srcdir, ec)) {
+        if (!e.is_regular_file())
+            continue;
+        const fs::path& p = e.path();
+        asset_t a;
+        a.src = p;
+        if (!asset_key(p, a.key)) {
+            if (p.extension() == ".raw")
+                fprintf(stderr, "skip %s: name must be <name>_<w>x<h>.raw\n", p.string().c_str());
+            continue;
+        }
+        if (p.extension() == ".png" && fs::exists(fs::path(p).replace_extension(".rawdata")))
+            continue;
+        a.dst = outdir / (a.key + ".rawdata");
+        assets.push_back(std::move(a));
+    }
+    if (ec) {
+        fprintf(stderr, "could not read %s: %s\n", srcdir.string().c_str(), ec.message().c_str());
+        return 1;
+    }
+    std::sort(assets.begin(), assets.end(), [](const asset_t& a, const asset_t& b) { return a.src < b.src; });
+
+    std::string cached_sig;
+    std::map< std::string, uint64_t > cached;
+    load_cache(outdir / CACHE_NAME, cached_sig, cached);
+    const std::string sig = opt.signature();
+    const bool all_dirty = opt.force || cached_sig != sig;
+
+    /* 前回あって今回無い入力の出力を消す. 同じ key の別の入力 (png の代わりに置いた rawdata など) があれば残す */
+    std::set< std::string > srcs, keys;
+    for (auto& a : assets) {
+        srcs.insert(a.src.lexically_relative(srcdir).generic_string());
+        keys.insert(a.key);
+    }
+    for (auto& c : cached) {
+        std::string key;
+        if (srcs.count(c.first) || !asset_key(fs::path(c.first), key) || keys.count(key))
+            continue;
+        if (fs::remove(outdir / (key + ".rawdata"), ec))
+            printf("  removed %-31s\n", key.c_str());
+    }
+
+    /* BCn の block 行を配る pool. ファイル単位の worker が全員忙しい間は使われず、
+       大きなファイルだけが残った時に空いたコアを使う */
+    worker_pool_t blockpool;
+    blockpool.start(static_cast< int >(opt.jobs) - 1);
+
+    /* hash -> (必要なら) cook を全コアで. ワーカーは atomic な index で次のファイルを取りに行く */
+    std::atomic< size_t > next(0);
+    std::atomic< int > ncooked(0);
+    std::atomic< int > nfailed(0);
+    std::mutex logmtx;
+    auto worker = [&] {
+        for (size_t i = next ++; i < assets.size(); i = next ++) {
+            asset_t& a = assets[i];
+            const auto t = std::chrono::steady_clock::now();
+            {
+                mapped_file_t f;
+                if (f.open(a.src.wstring()) == 0)
+                    a.hash = hash_bytes(f.data(), f.size());
+            }
+            auto it = cached.find(a.src.lexically_relative(srcdir).generic_string());
+            a.dirty = all_dirty || it == cached.end() || it->second != a.hash || !fs::exists(a.dst);
+            if (a.dirty) {
+                a.err = cook_asset(a, opt, &blockpool);
+                if (a.err < 0)
+                    nfailed ++;
+                else
+                    ncooked ++;
+            }
+            a.ms = elapsed_ms(t);
+
+            std::lock_guard< std::mutex > lock(logmtx);
+            if (a.err < 0)
+                fprintf(stderr, "  FAILED %-32s err:%d\n", a.src.string().c_str(), a.err);
+            else if (a.dirty)
+                printf("  cooked %-32s %4ux%-4u %8.2f ms\n", a.key.c_str(), a.width, a.height, a.ms);
+            else
+                printf("  uptodate %-30s          %8.2f ms\n", a.key.c_str(), a.ms);
+        }
+    };
+    std::vector< std::thread > pool;
+    const unsigned nthr = std::min< unsigned >(opt.jobs, std::max< unsigned >(1, static_cast< unsigned >(assets.size())));
+    for (unsigned i = 0; i < nthr; i ++)
+        pool.emplace_back(worker);
+    for (auto& t : pool)
+        t.join();
+
+    /* 失敗したものは cache にも archive にも入れない (次回もう一度やる) */
+    std::map< std::string, uint64_t > cooked, current;
+    for (auto& a : assets) {
+        if (a.err < 0)
+            continue;
+        cooked[a.src.lexically_relative(srcdir).generic_string()] = a.hash;
+        current[a.key] = a.hash;
+    }
+
+    const fs::path archive = outdir / ARCHIVE_NAME;
+    if (opt.archive) {
+        std::string archived_sig;
+        std::map< std::string, uint64_t > archived;
+        load_cache(outdir / ARCHIVE_CACHE_NAME, archived_sig, archived);
+        if (all_dirty || archived_sig != sig || archived != current || !fs::exists(archive)) {
+            const auto t = std::chrono::steady_clock::now();
+            if (build_archive(assets, opt, archive, !all_dirty && archived_sig == sig, archived, &blockpool) < 0) {
+                fprintf(stderr, "  FAILED %s\n", archive.string().c_str());
+                fs::remove(outdir / ARCHIVE_CACHE_NAME, ec);
+                nfailed ++;
+            }
+            else {
+                save_cache(outdir / ARCHIVE_CACHE_NAME, sig, current);
+                printf("  archive %-31s %9s %8.2f ms\n", ARCHIVE_NAME, opt.mips ? "(mips)" : "", elapsed_ms(t));
+            }
+        }
+    }
+
+    save_cache(outdir / CACHE_NAME, sig, cooked);
+    printf("%d cooked, %d up to date, %d failed, %u threads, %.2f ms\n",
+           ncooked.load(), static_cast< int >(assets.size()) - ncooked.load() - nfailed.load(), nfailed.load(), nthr, elapsed_ms(t0));
+    return nfailed ? 1 : 0;
+}